@@ -83,9 +83,10 @@ contents_cksum() {
 	echo "$cksum"
 }
 
-# Verify the checksum for $curfile stored at $distfile and index $dfcount
+# Verify the checksum for $curfile stored at $distfile and index $dfcount;
+# $4 is the sha256 computed while downloading it, if known
 verify_cksum() {
-	local curfile="$1" distfile="$2" cksum="$3" filesum
+	local curfile="$1" distfile="$2" cksum="$3" filesum="$4"
 
 	# If the checksum starts with an commercial at (@) it is the contents checksum
 	if [ "${cksum:0:1}" = "@" ]; then
@@ -101,7 +102,7 @@ verify_cksum() {
 		fi
 	else
 		msg_normal "$pkgver: verifying checksum for distfile '$curfile'... "
-		filesum=$(${XBPS_DIGEST_CMD} "$distfile")
+		[ -n "$filesum" ] || filesum=$(${XBPS_DIGEST_CMD} "$distfile")
 		if [ "$cksum" != "$filesum" ]; then
 			echo
 			msg_red "SHA256 mismatch for '${curfile}:'\n${filesum}\n"
@@ -127,11 +128,33 @@ link_cksum() {
 	return 1
 }
 
+# Fetch $1 into the current directory and print its sha256. xbps-fetch -s
+# hashes the file as it is written; other fetch commands get it hashed
+# afterwards.
+fetch_sum() {
+	local url="$1" curfile="$2" out=
+
+	if [ "${fetch_cmd##*/}" = "xbps-fetch" ]; then
+		out=$($fetch_cmd -s "$url")
+		if [[ $out =~ ([0-9a-f]{64}) ]]; then
+			echo "${BASH_REMATCH[1]}"
+			return 0
+		fi
+	else
+		$fetch_cmd "$url"
+	fi
+	[ -f "$curfile" ] && ${XBPS_DIGEST_CMD} "$curfile"
+}
+
+# Race the mirrors of $mirror_list for $curfile: each one downloads into its
+# own directory and the first copy matching $cksum is kept.
 try_mirrors() {
 	local curfile="$1" distfile="$2" cksum="$3" f="$4" mirror_list="$5"
-	local filesum basefile mirror path scheme good
+	local mirror path scheme racedir n running=0 winner=
+	local -a urls pids
 	[ -z "$mirror_list" ] && return 1
-	basefile="${f##*/}"
+	# Contents checksums can only be verified after extraction
+	[ "${cksum:0:1}" = "@" ] && return 1
 	for mirror in $mirror_list; do
 		scheme="file"
 		if [[ $mirror == *://* ]]; then
@@ -152,31 +175,57 @@ try_mirrors() {
 			# For sources.voidlinux.* append the subdirectory
 			mirror="$mirror/$pkgname-$version"
 		fi
-		msg_normal "$pkgver: fetching distfile '$curfile' from mirror '$mirror'...\n"
-		$fetch_cmd "$mirror/$curfile"
-		# If basefile was not found, but a curfile file may exist, try to fetch it
-		# if [ ! -f "$distfile" -a "$basefile" != "$curfile" ]; then
-		# 	msg_normal "$pkgver: fetching distfile '$basefile' from mirror '$mirror'...\n"
-		# 	$fetch_cmd "$mirror/$basefile"
-		# fi
-		[ ! -f "$distfile" ] && continue
-		flock -n ${distfile}.part rm -f ${distfile}.part
-		filesum=$(${XBPS_DIGEST_CMD} "$distfile")
-		if [ "$cksum" == "$filesum" ]; then
-			return 0
-		fi
-		msg_normal "$pkgver: checksum failed - removing '$curfile'...\n"
-		rm -f ${distfile}
+		urls+=("$mirror/$curfile")
 	done
-	return 1
+	[ ${#urls[@]} -eq 0 ] && return 1
+
+	racedir=$(mktemp -d "${distfile}.race.XXXXXXXX") || return 1
+	for n in "${!urls[@]}"; do
+		msg_normal "$pkgver: fetching distfile '$curfile' from mirror '${urls[$n]%/*}'...\n"
+		mkdir "$racedir/$n"
+		(
+			cd "$racedir/$n" || exit 1
+			# Losers are killed once a mirror wins
+			trap 'kill $fpid 2>/dev/null; exit 1' TERM
+			fetch_sum "${urls[$n]}" "$curfile" > sum &
+			fpid=$!
+			wait $fpid
+			[ "$(cat sum)" = "$cksum" ] && : > ok
+		) &
+		pids+=($!)
+		running=$((running + 1))
+	done
+
+	while [ $running -gt 0 ] && [ -z "$winner" ]; do
+		wait -n
+		running=$((running - 1))
+		for n in "${!urls[@]}"; do
+			if [ -e "$racedir/$n/ok" ]; then
+				winner=$n
+				break
+			fi
+		done
+	done
+	kill "${pids[@]}" 2>/dev/null
+	wait
+
+	if [ -n "$winner" ]; then
+		mv -f "$racedir/$winner/$curfile" "$distfile"
+		msg_normal "$pkgver: got '$curfile' from mirror '${urls[$winner]%/*}'.\n"
+	else
+		msg_normal "$pkgver: checksum failed or not found on mirrors - '$curfile'...\n"
+	fi
+	rm -rf "$racedir"
+	[ -n "$winner" ] && [ -f "$distfile" ]
 }
 
 try_urls() {
 	local curfile="$1"
-	local good=
+	local good= filesum=
 	for i in ${_file_idxs["$curfile"]}; do
 		local cksum=${_checksums["$i"]}
 		local url=${_distfiles["$i"]}
+		filesum=
 
 		# If distfile does not exist, download it from the original location.
 		if [[ "$FTP_RETRIES" && "${url}" =~ ^ftp:// ]]; then
@@ -191,7 +240,7 @@ try_urls() {
 				else
 					msg_normal "$pkgver: fetch attempt $retry of $max_retries...\n"
 				fi
-				flock "${distfile}.part" $fetch_cmd "$url"
+				filesum=$(fetch_sum "$url" "$curfile")
 			fi
 		done
 
@@ -200,20 +249,64 @@ try_urls() {
 		fi
 
 		# distfile downloaded, verify sha256 hash.
-		flock -n "${distfile}.part" rm -f "${distfile}.part"
-		verify_cksum "$curfile" "$distfile" "$cksum"
+		verify_cksum "$curfile" "$distfile" "$cksum" "$filesum"
 		return 0
 	done
 	return 1
 }
 
+# Fetch one missing distfile; runs as a job of hook()'s pool with its output
+# going to a per-file log, so it succeeds only by reaching the end.
+fetch_distfile() {
+	local curfile="$1" distfile="$srcdir/$1" i cksum lockfd storefd
+	set -- ${_file_idxs["$curfile"]}
+	i="$1"
+	cksum="${_checksums[$i]}"
+
+	# If file lock cannot be acquired wait until it's available. The lock
+	# is a file of its own: xbps-fetch resumes from ${distfile}.part and
+	# renames it into place, so locking (or truncating) that one would not
+	# serialize anything. It is never removed, or waiters holding it open
+	# would lock a different file than newcomers.
+	exec {lockfd}>>"${distfile}.lock"
+	while ! flock -w 1 $lockfd; do
+		msg_warn "$pkgver: ${curfile} is already being downloaded, waiting for 1s ...\n"
+	done
+
+	if [[ ! -f "$distfile" ]]; then
+		# Builds in other masterdirs share $XBPS_SRCDISTDIR: one of them
+		# downloads a given source into by_sha256, the others link it.
+		if [ -n "$cksum" ] && [ "${cksum:0:1}" != "@" ]; then
+			mkdir -p "$XBPS_SRCDISTDIR/.locks"
+			exec {storefd}>"$XBPS_SRCDISTDIR/.locks/$cksum"
+			flock $storefd
+		fi
+
+		# If distfile does not exist, try to link to it.
+		if link_cksum "$curfile" "$distfile" "$cksum"; then
+			:
+		# If distfile does not exist, download it from a mirror location.
+		elif try_mirrors "$curfile" "$distfile" "$cksum" "${_distfiles[$i]}" "$XBPS_DISTFILES_MIRROR"; then
+			verify_cksum "$curfile" "$distfile" "$cksum" "$cksum"
+		elif ! try_urls "$curfile"; then
+			if try_mirrors "$curfile" "$distfile" "$cksum" "${_distfiles[$i]}" "$XBPS_DISTFILES_FALLBACK"; then
+				verify_cksum "$curfile" "$distfile" "$cksum" "$cksum"
+			else
+				msg_error "$pkgver: failed to fetch '$curfile'.\n"
+			fi
+		fi
+	fi
+	[[ $errors -eq 0 ]]
+}
+
 hook() {
 	local srcdir="$XBPS_SRCDISTDIR/$pkgname-$version"
-	local dfcount=0 dfgood=0 errors=0 max_retries
+	local dfcount=0 dfgood=0 errors=0 max_retries logdir n running=0
 
 	local -a _distfiles=($distfiles)
 	local -a _checksums=($checksum)
 	local -A _file_idxs
+	local -a _order
 
 	# Create a map from target file to index in _distfiles/_checksums
 	for i in ${!_distfiles[@]}; do
@@ -265,38 +358,28 @@ hook() {
 	# We're done, if all distfiles were found and had good checksums
 	[[ $dfcount -eq $dfgood ]] && return
 
-	# Download missing distfiles and verify their checksums
+	# Download missing distfiles, up to XBPS_FETCH_JOBS at a time; logs are
+	# replayed in the order of the template's distfiles.
+	logdir=$(mktemp -d "$srcdir/.fetch.XXXXXXXX") || msg_error "$pkgver: cannot create fetch logs dir!\n"
 	for curfile in ${!_file_idxs[@]}; do
-		distfile="$srcdir/$curfile"
 		set -- ${_file_idxs["$curfile"]}
-		i="$1"
-
-		# If file lock cannot be acquired wait until it's available.
-		while ! flock -w 1 "${distfile}.part" true; do
-			msg_warn "$pkgver: ${curfile} is already being downloaded, waiting for 1s ...\n"
-		done
-
-		if [[ -f "$distfile" ]]; then
-			continue
-		fi
-
-		# If distfile does not exist, try to link to it.
-		if link_cksum "$curfile" "$distfile" "${_checksums[$i]}"; then
-			continue
-		fi
-
-		# If distfile does not exist, download it from a mirror location.
-		if try_mirrors "$curfile" "$distfile" "${_checksums[$i]}" "${_distfiles[$i]}" "$XBPS_DISTFILES_MIRROR"; then
-			continue
+		_order[$1]="$curfile"
+	done
+	for n in ${!_order[@]}; do
+		if [ $running -ge ${XBPS_FETCH_JOBS:-4} ]; then
+			wait -n
+			running=$((running - 1))
 		fi
+		{ fetch_distfile "${_order[$n]}" && : > "$logdir/$n.ok"; } > "$logdir/$n.log" 2>&1 &
+		running=$((running + 1))
+	done
+	wait
 
-		if ! try_urls "$curfile"; then
-			if try_mirrors "$curfile" "$distfile" "${_checksums[$i]}" "${_distfiles[$i]}" "$XBPS_DISTFILES_FALLBACK"; then
-				continue
-			fi
-			msg_error "$pkgver: failed to fetch '$curfile'.\n"
-		fi
+	for n in ${!_order[@]}; do
+		cat "$logdir/$n.log"
+		[ -e "$logdir/$n.ok" ] || errors=$((errors + 1))
 	done
+	rm -rf "$logdir"
 
 	unset TAR_CMD
 
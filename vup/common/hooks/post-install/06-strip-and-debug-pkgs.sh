@@ -56,93 +56,132 @@ create_debug_pkg() {
 	return 0
 }
 
+# Strips one candidate file; runs as a job of hook()'s pool, so its output
+# goes to a per-file log and a non-zero return marks the build as failed.
+strip_file() {
+	local f="$1" x= type= nopie_found=
+
+	case "$(file -bi "$f")" in
+	application/x-executable*)
+		chmod +w "$f"
+		if [[ $(file $f) =~ "statically linked" ]]; then
+			# static binary
+			if ! $STRIPCMD "$f"; then
+				msg_red "$pkgver: failed to strip ${f#$PKGDESTDIR}\n"
+				return 1
+			fi
+			echo "   Stripped static executable: ${f#$PKGDESTDIR}"
+		else
+			make_debug "$f"
+			if ! $STRIPCMD "$f"; then
+				msg_red "$pkgver: failed to strip ${f#$PKGDESTDIR}\n"
+				return 1
+			fi
+			echo "   Stripped executable: ${f#$PKGDESTDIR}"
+			for x in ${nopie_files}; do
+				if [ "$x" = "${f#$PKGDESTDIR}" ]; then
+					nopie_found=1
+					break
+				fi
+			done
+			if [ -z "$nopie" ] && [ -z "$nopie_found" ]; then
+				msg_red "$pkgver: non-PIE executable found in PIE build: ${f#$PKGDESTDIR}\n"
+				return 1
+			fi
+			attach_debug "$f"
+		fi
+		;;
+	application/x-sharedlib*|application/x-pie-executable*)
+		type="$(file -b "$f")"
+		if [[ $type =~ "no machine" ]]; then
+			# using ELF as a container format (e.g. guile)
+			echo "   Ignoring ELF file without machine set: ${f#$PKGDESTDIR}"
+			return 0
+		fi
+
+		chmod +w "$f"
+		# shared library
+		make_debug "$f"
+		if ! $STRIPCMD --strip-unneeded "$f"; then
+			msg_red "$pkgver: failed to strip ${f#$PKGDESTDIR}\n"
+			return 1
+		fi
+		if [[ $type =~ "interpreter " ]]; then
+			echo "   Stripped position-independent executable: ${f#$PKGDESTDIR}"
+		else
+			echo "   Stripped library: ${f#$PKGDESTDIR}"
+		fi
+		attach_debug "$f"
+		;;
+	application/x-archive*)
+		chmod +w "$f"
+		if ! $STRIPCMD --strip-debug "$f"; then
+			msg_red "$pkgver: failed to strip ${f#$PKGDESTDIR}\n"
+			return 1
+		fi
+		echo "   Stripped static library: ${f#$PKGDESTDIR}";;
+	esac
+}
+
 hook() {
-	local fname= x= f= _soname= STRIPCMD=
+	local fname= x= f= i= found= magic= logdir= running=0 njobs= rval=0 STRIPCMD=
+	local -a files candidates
 
 	if [ -n "$nostrip" ]; then
 		return 0
 	fi
 
 	STRIPCMD=/usr/bin/$STRIP
+	njobs=${XBPS_MAKEJOBS:-1}
 
-	find ${PKGDESTDIR} -type f | while read -r f; do
+	# Pick ELF objects and ar archives by their magic, without forking per
+	# file: packages bundling Electron/Chromium ship thousands of resources.
+	mapfile -d '' files < <(find ${PKGDESTDIR} -type f -print0 | LC_ALL=C sort -z)
+	for f in "${files[@]}"; do
 		if [[ $f =~ ^${PKGDESTDIR}/usr/lib/debug/ ]]; then
 			continue
 		fi
 
 		fname=${f##*/}
+		found=
 		for x in ${nostrip_files}; do
 			if [ "$x" = "$fname" -o "$x" = "${f#$PKGDESTDIR}" ]; then
 				found=1
 				break
 			fi
 		done
-		if [ -n "$found" ]; then
-			unset found
-			continue
-		fi
-		case "$(file -bi "$f")" in
-		application/x-executable*)
-			chmod +w "$f"
-			if [[ $(file $f) =~ "statically linked" ]]; then
-				# static binary
-				if ! $STRIPCMD "$f"; then
-					msg_red "$pkgver: failed to strip ${f#$PKGDESTDIR}\n"
-					return 1
-				fi
-				echo "   Stripped static executable: ${f#$PKGDESTDIR}"
-			else
-				make_debug "$f"
-				if ! $STRIPCMD "$f"; then
-					msg_red "$pkgver: failed to strip ${f#$PKGDESTDIR}\n"
-					return 1
-				fi
-				echo "   Stripped executable: ${f#$PKGDESTDIR}"
-				unset nopie_found
-				for x in ${nopie_files}; do
-					if [ "$x" = "${f#$PKGDESTDIR}" ]; then
-						nopie_found=1
-						break
-					fi
-				done
-				if [ -z "$nopie" ] && [ -z "$nopie_found" ]; then
-					msg_red "$pkgver: non-PIE executable found in PIE build: ${f#$PKGDESTDIR}\n"
-					return 1
-				fi
-				attach_debug "$f"
-			fi
-			;;
-		application/x-sharedlib*|application/x-pie-executable*)
-			local type="$(file -b "$f")"
-			if [[ $type =~ "no machine" ]]; then
-				# using ELF as a container format (e.g. guile)
-				echo "   Ignoring ELF file without machine set: ${f#$PKGDESTDIR}"
-				continue
-			fi
+		[ -n "$found" ] && continue
 
-			chmod +w "$f"
-			# shared library
-			make_debug "$f"
-			if ! $STRIPCMD --strip-unneeded "$f"; then
-				msg_red "$pkgver: failed to strip ${f#$PKGDESTDIR}\n"
-				return 1
-			fi
-			if [[ $type =~ "interpreter " ]]; then
-				echo "   Stripped position-independent executable: ${f#$PKGDESTDIR}"
-			else
-				echo "   Stripped library: ${f#$PKGDESTDIR}"
-			fi
-			attach_debug "$f"
-			;;
-		application/x-archive*)
-			chmod +w "$f"
-			if ! $STRIPCMD --strip-debug "$f"; then
-				msg_red "$pkgver: failed to strip ${f#$PKGDESTDIR}\n"
-				return 1
-			fi
-			echo "   Stripped static library: ${f#$PKGDESTDIR}";;
+		magic=
+		LC_ALL=C read -r -N 7 magic < "$f" 2>/dev/null || :
+		case "$magic" in
+		$'\x7fELF'*|'!<arch>'|'!<thin>') candidates+=("$f");;
 		esac
 	done
+	[ ${#candidates[@]} -eq 0 ] && return 0
+
+	# Strip on up to XBPS_MAKEJOBS files at a time; each job logs to its
+	# own file, replayed in path order so the output is the same for any
+	# job count.
+	logdir=$(mktemp -d -p "${XBPS_STATEDIR}" ${pkgname}_strip_XXXXXXXX) || return 1
+	for i in "${!candidates[@]}"; do
+		if [ $running -ge $njobs ]; then
+			wait -n
+			running=$((running - 1))
+		fi
+		{ strip_file "${candidates[$i]}" || : > "${logdir}/${i}.failed"; } \
+			> "${logdir}/${i}.log" 2>&1 &
+		running=$((running + 1))
+	done
+	wait
+
+	for i in "${!candidates[@]}"; do
+		cat "${logdir}/${i}.log"
+		[ -e "${logdir}/${i}.failed" ] && rval=1
+	done
+	rm -rf "${logdir}"
+	[ $rval -ne 0 ] && return 1
+
 	create_debug_pkg
 	return $?
 }
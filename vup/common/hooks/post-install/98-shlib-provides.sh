@@ -10,6 +10,9 @@ collect_sonames() {
 	local _suffix="${3:-}"
 	local _shlib_dir="${XBPS_STATEDIR}/shlib-provides"
 	local _no_soname=$(mktemp) || exit 1
+	local _kind _val
+	local -a _libs
+	local -A _sonames
 
 	mkdir -p "${_shlib_dir}" || exit 1
 	if [ ! -d ${_destdir} ]; then
@@ -19,32 +22,38 @@ collect_sonames() {
 	fi
 
 
-	# real pkg
-	find ${_destdir} -type f -name "*.so*" | while read f; do
-		_fname="${f##*/}"
-		case "$(file -bi "$f")" in
-		application/x-sharedlib*|application/x-pie-executable*)
-			# shared library
-			_soname=$(${OBJDUMP} -p "$f"|awk '/SONAME/{print $2}')
-			if [ -n "$noshlibprovides" ]; then
-				# register all shared lib for rt-deps between sub-pkg
-				echo "${_fname}" >>${_no_soname}
-				continue
-			fi
-			# Register all versioned sonames, and
-			# unversioned sonames only when in libdir.
-			if [[ ${_soname} =~ ${_versioned_pattern} ]] ||
-			   [[ ${_soname} =~ ${_pattern} &&
-			   	( -e ${_destdir}/usr/lib/${_fname} ||
-				  -e ${_destdir}/usr/lib32/${_fname} ) ]]; then
-				echo "${_soname}" >> ${_tmpfile}
-				echo "   SONAME ${_soname} from ${f##${_destdir}}"
-			else
-				# register all shared lib for rt-deps between sub-pkg
-				echo "${_fname}" >>${_no_soname}
-			fi
+	# real pkg: shared libraries and PIEs named *.so*, from a single scan
+	while IFS=$'\t' read -r _kind f _val; do
+		case "$_kind" in
+		DYN)
+			case "${f##*/}" in
+			*.so*) _libs+=("$f") ;;
+			esac
 			;;
+		SONAME) _sonames[$f]=$_val ;;
 		esac
+	done < <("${XBPS_COMMONDIR}"/scripts/scan-elf-deps elf ${_destdir})
+
+	for f in "${_libs[@]}"; do
+		_fname="${f##*/}"
+		_soname="${_sonames[$f]}"
+		if [ -n "$noshlibprovides" ]; then
+			# register all shared lib for rt-deps between sub-pkg
+			echo "${_fname}" >>${_no_soname}
+			continue
+		fi
+		# Register all versioned sonames, and
+		# unversioned sonames only when in libdir.
+		if [[ ${_soname} =~ ${_versioned_pattern} ]] ||
+		   [[ ${_soname} =~ ${_pattern} &&
+		   	( -e ${_destdir}/usr/lib/${_fname} ||
+			  -e ${_destdir}/usr/lib32/${_fname} ) ]]; then
+			echo "${_soname}" >> ${_tmpfile}
+			echo "   SONAME ${_soname} from ${f}"
+		else
+			# register all shared lib for rt-deps between sub-pkg
+			echo "${_fname}" >>${_no_soname}
+		fi
 	done
 
 	for f in ${shlib_provides}; do
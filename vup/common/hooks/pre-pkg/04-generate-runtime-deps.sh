@@ -4,68 +4,49 @@
 #	- Generates rdeps file with run-time dependencies for xbps-create(1)
 #	- Generates shlib-requires file for xbps-create(1)
 
-add_rundep() {
-    local dep="$1" i= rpkgdep= _depname= found=
-
-    _depname="$($XBPS_UHELPER_CMD getpkgdepname ${dep} 2>/dev/null)"
-    if [ -z "${_depname}" ]; then
-        _depname="$($XBPS_UHELPER_CMD getpkgname ${dep} 2>/dev/null)"
-    fi
-
-    for i in ${run_depends}; do
-        rpkgdep="$($XBPS_UHELPER_CMD getpkgdepname $i 2>/dev/null)"
-        if [ -z "$rpkgdep" ]; then
-            rpkgdep="$($XBPS_UHELPER_CMD getpkgname $i 2>/dev/null)"
-        fi
-        if [ "${rpkgdep}" != "${_depname}" ]; then
-            continue
-        fi
-        $XBPS_UHELPER_CMD cmpver "$i" "$dep"
-        rval=$?
-        if [ $rval -eq 255 ]; then
-            run_depends="${run_depends/${i}/${dep}}"
-        fi
-        found=1
-    done
-    if [ -z "$found" ]; then
-        run_depends+=" ${dep}"
-    fi
-}
-
+# Library names and versions are compared by scan-elf-deps in one process,
+# rather than by xbps-uhelper calls for every (dep, run_depends entry) pair.
 store_pkgdestdir_rundeps() {
         if [ -n "$run_depends" ]; then
-            for f in ${run_depends}; do
-                _curdep="$(echo "$f" | sed -e 's,\(.*\)?.*,\1,')"
-                if [ -z "$($XBPS_UHELPER_CMD getpkgdepname ${_curdep} 2>/dev/null)" -a \
-                     -z "$($XBPS_UHELPER_CMD getpkgname ${_curdep} 2>/dev/null)" ]; then
-                    _curdep="${_curdep}>=0"
-                fi
-                printf "%s " "${_curdep}"
-            done > "${XBPS_STATEDIR}/${pkgname}-rdeps"
+            "${XBPS_COMMONDIR}"/scripts/scan-elf-deps normdeps ${run_depends} \
+                > "${XBPS_STATEDIR}/${pkgname}-rdeps"
         fi
 }
 
+# Reads scan-elf-deps records, prints the NEEDED sonames and Qt private API
+# versions of the files not in skiprdeps.
 parse_shlib_needed() {
-    while read -r f; do
-        lf=${f#${PKGDESTDIR}}
-	    if [ "${skiprdeps/${lf}/}" != "${skiprdeps}" ]; then
-		    msg_normal "Skipping dependency scan for ${lf}\n" >&3
-		    continue
-	    fi
-        read -n4 elfmagic < "$f"
-        if [ "$elfmagic" = $'\177ELF' ]; then
-            $OBJDUMP -p "$f" |
-            awk '
-                /NEEDED/{print $2;}
-                /Qt_5_PRIVATE_API/{next;}
-                /Qt_[0-9]*_PRIVATE_API/{print $NF;}
-            '
-        fi
+    local kind lf val skipped=
+
+    while IFS=$'\t' read -r kind lf val; do
+        case "$kind" in
+        FILE)
+            skipped=
+            if [ "${skiprdeps/${lf}/}" != "${skiprdeps}" ]; then
+                msg_normal "Skipping dependency scan for ${lf}\n" >&3
+                skipped=1
+            fi
+            ;;
+        NEEDED)
+            if [ -z "$skipped" ]; then
+                echo "$val"
+            fi
+            ;;
+        VERNEED)
+            if [ -z "$skipped" ]; then
+                case "$val" in
+                Qt_5_PRIVATE_API) ;;
+                Qt_[0-9]*_PRIVATE_API) echo "$val" ;;
+                esac
+            fi
+            ;;
+        esac
     done
 }
 
 hook() {
-    local depsftmp f lf j mapshlibs sorequires _curdep elfmagic broken_shlibs verify_deps
+    local f j mapshlibs sorequires broken_shlibs verify_deps
+    local -a rdeps
     local _shlib_dir="${XBPS_STATEDIR}/shlib-provides"
     local _shlibtmp
 
@@ -83,16 +64,13 @@ hook() {
         return 0
     fi
 
-    depsftmp=$(mktemp) || exit 1
-    find ${PKGDESTDIR} -type f -perm -u+w > $depsftmp 2>/dev/null
-
     for f in ${shlib_requires}; do
         verify_deps+=" ${f}"
     done
 
     _shlibtmp=$(mktemp) || exit 1
-    parse_shlib_needed 3>&1 >"$_shlibtmp" <"$depsftmp"
-    rm -f "$depsftmp"
+    parse_shlib_needed 3>&1 >"$_shlibtmp" \
+        < <("${XBPS_COMMONDIR}"/scripts/scan-elf-deps elf -w ${PKGDESTDIR})
     verify_deps=$(sort <"$_shlibtmp" | uniq)
     rm -f "$_shlibtmp"
 
@@ -154,8 +132,11 @@ hook() {
             sorequires+="${f} "
         fi
         echo "   SONAME: $f <-> ${_sdep}"
-        add_rundep "${_sdep}"
+        rdeps+=("${_sdep}")
     done
+    if [ ${#rdeps[@]} -gt 0 ]; then
+        run_depends=$("${XBPS_COMMONDIR}"/scripts/scan-elf-deps mergedeps "${run_depends}" "${rdeps[@]}")
+    fi
     #
     # If pkg uses any unknown SONAME error out.
     #
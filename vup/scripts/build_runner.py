@@ -4,21 +4,40 @@ import sys
 import subprocess
 import json
 import shutil
-import glob
 import time
 import re
+import threading
 
 # Import shared config
 try:
     from config import NATIVE_ARCH, parse_template_archs, arch_supported
+    from pkggraph import build_order, load_durations, load_graph
 except ImportError:
     sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
     from config import NATIVE_ARCH, parse_template_archs, arch_supported
+    from pkggraph import build_order, load_durations, load_graph
 
 
-def run_command(cmd, log_file=None):
-    """Run a command and capture output to log_file if provided."""
-    print(f"Running: {' '.join(cmd)}")
+# Serialises console output of concurrent builds
+_print_lock = threading.Lock()
+
+# xbps-src's own record of each binpkg it writes (00-gen-pkg.sh hook);
+# the repository is a chroot path under /host
+CREATED_BINPKG_RE = re.compile(r"Creating (\S+\.xbps) for repository (\S+) \.\.\.")
+
+
+def log(msg):
+    """print() that keeps lines of concurrent builds apart."""
+    with _print_lock:
+        print(msg, flush=True)
+
+
+def run_command(cmd, log_file=None, prefix=None):
+    """
+    Run a command and capture output to log_file if provided.
+    With a prefix (concurrent builds), echoed lines are tagged with it.
+    """
+    log(f"{prefix + ' ' if prefix else ''}Running: {' '.join(cmd)}")
     
     if log_file:
         with open(log_file, "w") as f:
@@ -34,7 +53,9 @@ def run_command(cmd, log_file=None):
                 stdout = process.stdout
                 assert stdout is not None
                 for line in stdout:
-                    sys.stdout.write(line)
+                    with _print_lock:
+                        sys.stdout.write(f"{prefix} {line}" if prefix else line)
+                        sys.stdout.flush()
                     f.write(line)
                 
                 process.wait()
@@ -65,29 +86,251 @@ def needs_alt_host(arch):
     return bool(sep) and base == NATIVE_ARCH
 
 
+def default_masterdir(host):
+    """Masterdir xbps-src uses for a host when -m is not given."""
+    masterdir = f"masterdir-{host}"
+    if host == NATIVE_ARCH and not os.path.isdir(masterdir) and os.path.isdir("masterdir"):
+        return "masterdir"
+    return masterdir
+
+
+def masterdir_ready(masterdir):
+    return os.path.isdir(masterdir) and os.path.exists(os.path.join(masterdir, ".xbps_chroot_init"))
+
+
+def ensure_masterdir(host, masterdir=None, alt_host=False):
+    """
+    Make sure a masterdir for host is bootstrapped. Worker masterdirs are
+    cloned from the host's default masterdir when it is ready (reflinked
+    where the filesystem allows), otherwise bootstrapped with -m.
+    """
+    base = default_masterdir(host)
+    masterdir = masterdir or base
+    if masterdir_ready(masterdir):
+        return True
+
+    if masterdir != base and masterdir_ready(base):
+        log(f"[bootstrap] Cloning {base} into {masterdir}...")
+        shutil.rmtree(masterdir, ignore_errors=True)
+        if subprocess.call(["cp", "-a", "--reflink=auto", base, masterdir]) == 0:
+            return True
+
+    log(f"[bootstrap] Creating {masterdir}...")
+    cmd = ["./xbps-src"]
+    if alt_host:
+        cmd += ["-A", host]
+    if masterdir != base:
+        cmd += ["-m", masterdir]
+    return subprocess.call(cmd + ["binary-bootstrap"]) == 0
+
+
 def ensure_alt_masterdir(arch):
     """Bootstrap masterdir-<arch> if it doesn't exist yet."""
-    masterdir = f"masterdir-{arch}"
-    if os.path.isdir(masterdir) and os.path.exists(os.path.join(masterdir, ".xbps_chroot_init")):
-        return True
-    print(f"[bootstrap] Creating masterdir-{arch}...")
-    return subprocess.call(
-        ["./xbps-src", "-A", arch, "binary-bootstrap"]
-    ) == 0
+    return ensure_masterdir(arch, alt_host=True)
 
 
-def main():
+def worker_masterdir(host, slot):
+    """Masterdir of a worker; worker 0 uses the default one."""
+    if slot == 0:
+        return None
+    return f"masterdir-{host}-w{slot}"
+
+
+def run_pool(jobs, workers, build):
+    """
+    Run build(job, slot) for every job on up to `workers` threads, taking
+    jobs in list order once the jobs named in job["after"] are done. vuru src
+    places a package's VUP deps in hostdir/binpkgs and removes them
+    afterwards, so jobs sharing a VUP dep (job["locks"]) never run at the
+    same time.
+    """
+    pending = list(jobs)
+    held = set()
+    done = set()
+    cond = threading.Condition()
+
+    def runnable(job):
+        return not (job["locks"] & held) and job["after"] <= done
+
+    def worker(slot):
+        while True:
+            with cond:
+                while True:
+                    if not pending:
+                        return
+                    job = next((j for j in pending if runnable(j)), None)
+                    if job:
+                        break
+                    cond.wait()
+                pending.remove(job)
+                held.update(job["locks"])
+            try:
+                build(job, slot)
+            finally:
+                with cond:
+                    held.difference_update(job["locks"])
+                    done.add(job["name"])
+                    cond.notify_all()
+
+    threads = [threading.Thread(target=worker, args=(slot,)) for slot in range(workers)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+
+def collect_binpkgs(pkg, log_file):
+    """
+    Binpkgs written by a build, as recorded by xbps-src in its log. Falls back
+    to scanning hostdir/binpkgs if the log has no record.
+    """
+    found = []
+    try:
+        with open(log_file, "r", errors="replace") as f:
+            for line in f:
+                m = CREATED_BINPKG_RE.search(line)
+                if not m:
+                    continue
+                repo = m.group(2)
+                if repo == "/host" or repo.startswith("/host/"):
+                    repo = "hostdir" + repo[len("/host"):]
+                path = os.path.join(repo, m.group(1))
+                if os.path.exists(path) and path not in found:
+                    found.append(path)
+    except OSError:
+        pass
+    if found:
+        return found
+
+    for root, dirs, files in os.walk("hostdir/binpkgs"):
+        for file in files:
+            if file.startswith(f"{pkg}-") and file.endswith(".xbps"):
+                found.append(os.path.join(root, file))
+    return found
+
+
+def build_package(pkg, pkg_src, arch, masterdir=None, makejobs=None, prefix=None, dist_dir="dist"):
+    """Build one package into hostdir/binpkgs, copy its binpkgs to dist_dir and return its report entry."""
+    pkg_dest = os.path.join("srcpkgs", pkg)
+    log_file = f"build-logs/{pkg}.log"
+
+    result_entry = {
+        "name": pkg,
+        "status": "pending",
+        "start_time": time.time()
+    }
+
+    log(f"[{pkg}] Setup...")
+    # Clean previous overlay
+    if os.path.exists(pkg_dest):
+        shutil.rmtree(pkg_dest)
+    
+    # Copy new template
+    shutil.copytree(pkg_src, pkg_dest)
+
+    log(f"[{pkg}] Building for {arch}...")
+
+    # Worker options; xbps-src accepts them after the package name
+    extra = []
+    if masterdir:
+        extra += ["-m", masterdir]
+    if makejobs:
+        extra += ["-j", str(makejobs)]
+
+    alt_host = needs_alt_host(arch)
+    host = arch if alt_host else NATIVE_ARCH
+    if alt_host or masterdir:
+        ready = ensure_masterdir(host, masterdir, alt_host=alt_host)
+    else:
+        ready = True
+
+    if not ready:
+        name = masterdir or default_masterdir(host)
+        log(f"[{pkg}] FAILED to bootstrap {name}")
+        result_entry["status"] = "failure"
+        result_entry["end_time"] = time.time()
+        result_entry["duration"] = result_entry["end_time"] - result_entry["start_time"]
+        result_entry["error_log"] = f"Could not bootstrap {name}"
+        if os.path.exists(pkg_dest):
+            shutil.rmtree(pkg_dest)
+        return result_entry
+
+    if alt_host:
+        # Same-CPU different-libc: native build via -A <arch> in its own
+        # masterdir (e.g. masterdir-x86_64-musl), not cross-build via -a.
+        # vuru's wrapper doesn't accept -A, so we drive xbps-src directly.
+        # VUP dep resolution is skipped here — currently only matters for
+        # prebuilt-binary packages, which don't have VUP deps.
+        build_cmd = ["./xbps-src", "-A", arch, "pkg", pkg]
+    elif has_vuru():
+        # Use vuru src if available - it handles VUP dependency resolution
+        # by downloading deps to hostdir/binpkgs before running xbps-src
+        if arch == NATIVE_ARCH:
+            build_cmd = ["vuru", "src", "pkg", pkg]
+        else:
+            build_cmd = ["vuru", "src", "-a", arch, "pkg", pkg]
+    else:
+        # Fallback to plain xbps-src
+        if arch == NATIVE_ARCH:
+            build_cmd = ["./xbps-src", "pkg", pkg]
+        else:
+            build_cmd = ["./xbps-src", "-a", arch, "pkg", pkg]
+
+    success = run_command(build_cmd + extra, log_file=log_file, prefix=prefix)
+    
+    result_entry["end_time"] = time.time()
+    result_entry["duration"] = result_entry["end_time"] - result_entry["start_time"]
+    
+    if success:
+        log(f"[{pkg}] Build SUCCESS")
+        result_entry["status"] = "success"
+    else:
+        log(f"[{pkg}] Build FAILED")
+        result_entry["status"] = "failure"
+        
+        # Extract last 30 lines of log for summary
+        try:
+            with open(log_file, "r") as f:
+                lines = f.readlines()
+                result_entry["error_log"] = "".join(lines[-30:])
+        except:
+            result_entry["error_log"] = "Could not read log file."
+
+    # Clean up
+    if os.path.exists(pkg_dest):
+        shutil.rmtree(pkg_dest)
+
+    # Move binpkgs on success
+    if success:
+        os.makedirs(dist_dir, exist_ok=True)
+        for b in collect_binpkgs(pkg, log_file):
+             log(f"[{pkg}] Found binary: {b}")
+             shutil.copy2(b, dist_dir)
+
+    return result_entry
+
+
+def select_units(srcpkgs_root):
+    """
+    (category, pkg) pairs to build: UNITS="category/pkg ..." (a bin-packed
+    CI job spanning categories), or the PACKAGES of CATEGORY.
+    """
+    units_env = os.environ.get("UNITS", "").split()
+    if units_env:
+        units = []
+        for unit in units_env:
+            category, _, pkg = unit.partition("/")
+            if os.path.isdir(os.path.join(srcpkgs_root, category, pkg)):
+                units.append((category, pkg))
+            else:
+                print(f"[{pkg}] Skipping - {unit} does not exist")
+        return units
+
     category = os.environ.get("CATEGORY")
     if not category:
-        print("Error: CATEGORY environment variable not set.")
+        print("Error: CATEGORY or UNITS environment variable not set.")
         sys.exit(1)
-    
-    arch = os.environ.get("ARCH", NATIVE_ARCH)
-    print(f"Building for architecture: {arch}")
-
-    # Assumes we are running from 'void-packages' directory
-    # and vup checkout is at '../vup'
-    vup_src_path = f"../vup/vup/srcpkgs/{category}"
+    vup_src_path = os.path.join(srcpkgs_root, category)
     
     if not os.path.exists(vup_src_path):
         print(f"Category path {vup_src_path} does not exist.")
@@ -98,11 +341,6 @@ def main():
             json.dump(report, f)
         sys.exit(0)
 
-    results = []
-    
-    # Ensure logs directory exists
-    os.makedirs("build-logs", exist_ok=True)
-
     all_packages = [p for p in os.listdir(vup_src_path) if os.path.isdir(os.path.join(vup_src_path, p))]
     all_packages.sort()
 
@@ -114,11 +352,25 @@ def main():
         packages = [p for p in all_packages if p in whitelist]
 
     print(f"Found {len(packages)} packages to build in {category}: {', '.join(packages)}")
+    return [(category, p) for p in packages]
+
+
+def main():
+    arch = os.environ.get("ARCH", NATIVE_ARCH)
+    print(f"Building for architecture: {arch}")
+
+    # Assumes we are running from 'void-packages' directory
+    # and vup checkout is at '../vup'
+    srcpkgs_root = "../vup/vup/srcpkgs"
+    units = select_units(srcpkgs_root)
+    multi_category = bool(os.environ.get("UNITS", "").split())
+    
+    # Ensure logs directory exists
+    os.makedirs("build-logs", exist_ok=True)
 
-    for pkg in packages:
-        pkg_src = os.path.join(vup_src_path, pkg)
-        pkg_dest = os.path.join("srcpkgs", pkg)
-        log_file = f"build-logs/{pkg}.log"
+    category_of = {}
+    for category, pkg in units:
+        pkg_src = os.path.join(srcpkgs_root, category, pkg)
         
         # Check if this package supports the target architecture
         template_path = os.path.join(pkg_src, "template")
@@ -127,103 +379,83 @@ def main():
         if not arch_supported(pkg_archs, arch):
             print(f"[{pkg}] Skipping - not supported on {arch} (archs: {pkg_archs})")
             continue
-        
-        result_entry = {
-            "name": pkg,
-            "status": "pending",
-            "start_time": time.time()
-        }
+        category_of[pkg] = category
 
-        print(f"[{pkg}] Setup...")
-        # Clean previous overlay
-        if os.path.exists(pkg_dest):
-            shutil.rmtree(pkg_dest)
-        
-        # Copy new template
-        shutil.copytree(pkg_src, pkg_dest)
-
-        print(f"[{pkg}] Building for {arch}...")
-
-        if needs_alt_host(arch):
-            # Same-CPU different-libc: native build via -A <arch> in its own
-            # masterdir (e.g. masterdir-x86_64-musl), not cross-build via -a.
-            # vuru's wrapper doesn't accept -A, so we drive xbps-src directly.
-            # VUP dep resolution is skipped here — currently only matters for
-            # prebuilt-binary packages, which don't have VUP deps.
-            if not ensure_alt_masterdir(arch):
-                print(f"[{pkg}] FAILED to bootstrap masterdir-{arch}")
-                result_entry["status"] = "failure"
-                result_entry["end_time"] = time.time()
-                result_entry["duration"] = result_entry["end_time"] - result_entry["start_time"]
-                result_entry["error_log"] = f"Could not bootstrap masterdir-{arch}"
-                if os.path.exists(pkg_dest):
-                    shutil.rmtree(pkg_dest)
-                results.append(result_entry)
-                continue
-            build_cmd = ["./xbps-src", "-A", arch, "pkg", pkg]
-        elif has_vuru():
-            # Use vuru src if available - it handles VUP dependency resolution
-            # by downloading deps to hostdir/binpkgs before running xbps-src
-            if arch == NATIVE_ARCH:
-                build_cmd = ["vuru", "src", "pkg", pkg]
-            else:
-                build_cmd = ["vuru", "src", "-a", arch, "pkg", pkg]
-        else:
-            # Fallback to plain xbps-src
-            if arch == NATIVE_ARCH:
-                build_cmd = ["./xbps-src", "pkg", pkg]
-            else:
-                build_cmd = ["./xbps-src", "-a", arch, "pkg", pkg]
+    # Dependencies first, so dependents pick up the new binpkgs from
+    # hostdir/binpkgs instead of the released ones
+    graph = load_graph(srcpkgs_root)
+    buildable = build_order(graph, category_of)
 
-        success = run_command(build_cmd, log_file=log_file)
-        
-        result_entry["end_time"] = time.time()
-        result_entry["duration"] = result_entry["end_time"] - result_entry["start_time"]
-        
-        if success:
-            print(f"[{pkg}] Build SUCCESS")
-            result_entry["status"] = "success"
-        else:
-            print(f"[{pkg}] Build FAILED")
-            result_entry["status"] = "failure"
-            
-            # Extract last 30 lines of log for summary
+    def build_args(pkg):
+        category = category_of[pkg]
+        dist_dir = os.path.join("dist", category) if multi_category else "dist"
+        return pkg, os.path.join(srcpkgs_root, category, pkg), arch, dist_dir
+
+    by_name = {}
+    workers = max(1, min(int(os.environ.get("BUILD_JOBS", "1")), len(buildable) or 1))
+    if workers == 1:
+        for pkg in buildable:
+            pkg, pkg_src, arch, dist_dir = build_args(pkg)
+            by_name[pkg] = build_package(pkg, pkg_src, arch, dist_dir=dist_dir)
+    else:
+        # Longest first by earlier runs; packages never built before are
+        # assumed to be as long as the longest known one
+        durations = load_durations(os.environ.get("REPORT_HISTORY", "report-*.json"), arch)
+        unknown = max(durations.values(), default=0)
+        position = {pkg: i for i, pkg in enumerate(buildable)}
+        jobs = []
+        for pkg in buildable:
+            deps = graph.get(pkg, {}).get("deps", set())
+            jobs.append({
+                "name": pkg,
+                "locks": set(deps),
+                # Only earlier packages, so a dependency cycle can't stall the pool
+                "after": {d for d in deps if d in position and position[d] < position[pkg]},
+            })
+        jobs.sort(key=lambda j: -durations.get(j["name"], unknown))
+
+        host = arch if needs_alt_host(arch) else NATIVE_ARCH
+        if not ensure_masterdir(host, alt_host=needs_alt_host(arch)):
+            print(f"Warning: could not bootstrap {default_masterdir(host)}, workers bootstrap their own")
+        makejobs = max(1, (os.cpu_count() or 1) // workers)
+        print(f"Building {len(jobs)} packages with {workers} workers ({makejobs} make jobs each)")
+
+        def build(job, slot):
+            pkg, pkg_src, arch, dist_dir = build_args(job["name"])
             try:
-                with open(log_file, "r") as f:
-                    lines = f.readlines()
-                    result_entry["error_log"] = "".join(lines[-30:])
-            except:
-                result_entry["error_log"] = "Could not read log file."
+                by_name[pkg] = build_package(
+                    pkg,
+                    pkg_src,
+                    arch,
+                    masterdir=worker_masterdir(host, slot),
+                    makejobs=makejobs,
+                    prefix=f"[{pkg}]",
+                    dist_dir=dist_dir,
+                )
+            except Exception as e:
+                log(f"[{pkg}] Build FAILED: {e}")
+                by_name[pkg] = {"name": pkg, "status": "failure", "error_log": str(e)}
 
-        # Clean up
-        if os.path.exists(pkg_dest):
-            shutil.rmtree(pkg_dest)
+        run_pool(jobs, workers, build)
 
-        # Move binpkgs on success
-        if success:
-            found_bins = []
-            # Recursively find all binpkgs for this package
-            for root, dirs, files in os.walk("hostdir/binpkgs"):
-                for file in files:
-                    if file.startswith(f"{pkg}-") and file.endswith(".xbps"):
-                        found_bins.append(os.path.join(root, file))
-
-            os.makedirs("dist", exist_ok=True)
-            for b in found_bins:
-                 print(f"[{pkg}] Found binary: {b}")
-                 shutil.copy2(b, "dist/")
-                 
-        results.append(result_entry)
-
-    # Write Report
-    report = {
-        "category": category,
-        "arch": arch,
-        "results": results
-    }
-    
-    with open(f"report-{category}-{arch}.json", "w") as f:
-        json.dump(report, f, indent=2)
+    # Write Report (one per category, results in unit order)
+    results = {} if multi_category else {os.environ["CATEGORY"]: []}
+    for category, pkg in units:
+        results.setdefault(category, [])
+        if pkg in by_name:
+            results[category].append(by_name[pkg])
+
+    job = os.environ.get("JOB")
+    for category, cat_results in results.items():
+        report = {
+            "category": category,
+            "arch": arch,
+            "results": cat_results
+        }
+        
+        name = f"report-{category}-{arch}-{job}.json" if job else f"report-{category}-{arch}.json"
+        with open(name, "w") as f:
+            json.dump(report, f, indent=2)
 
 if __name__ == "__main__":
     main()
@@ -1,4 +1,17 @@
 #!/usr/bin/env python3
+"""
+Decide what CI builds for a push or PR and emit the GitHub Actions matrices.
+
+Changed packages are extended with their VUP reverse dependencies (from the
+template dependency graph), expanded to (package, arch) units and bin-packed
+into build jobs of about TARGET_JOB_SECONDS by recorded build durations, so a
+handful of short builds share one runner and bootstrap. A package is always
+packed with the changed packages it depends on, so the job builds them first
+and the dependent links against the new binpkgs.
+
+Outputs: matrix (build jobs: job, arch, units "category/pkg ..."),
+release_matrix (category, arch pairs to publish) and should_run.
+"""
 import os
 import subprocess
 import json
@@ -7,9 +20,21 @@ import sys
 # Import shared config
 try:
     from config import SUPPORTED_ARCHS, parse_template_archs, get_positive_archs
+    from pkggraph import load_durations, load_graph, with_dependents
 except ImportError:
     sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
     from config import SUPPORTED_ARCHS, parse_template_archs, get_positive_archs
+    from pkggraph import load_durations, load_graph, with_dependents
+
+# Build time a job is filled up to; packages longer than that get a job of
+# their own
+TARGET_JOB_SECONDS = int(os.environ.get("TARGET_JOB_SECONDS", 40 * 60))
+
+# Assumed build time of a package with no recorded duration
+DEFAULT_BUILD_SECONDS = 10 * 60
+
+# Earlier build reports (restored from the CI cache)
+REPORT_HISTORY = os.environ.get("REPORT_HISTORY", "reports-history/*.json")
 
 def get_changes():
     event = os.environ.get("GITHUB_EVENT_NAME")
@@ -74,6 +99,64 @@ def get_category_archs(category_path, packages=None):
     
     return sorted(list(archs)) if archs else SUPPORTED_ARCHS
 
+def package_archs(category_path, pkg):
+    """Architectures a package is built for."""
+    template_path = os.path.join(category_path, pkg, "template")
+    if not os.path.exists(template_path):
+        return []
+    pkg_archs = get_positive_archs(parse_template_archs(template_path))
+    return sorted(pkg_archs) if pkg_archs else list(SUPPORTED_ARCHS)
+
+
+def connected_groups(graph, names):
+    """Split names into groups linked by dependencies among them."""
+    names = set(names)
+    parent = {n: n for n in names}
+
+    def find(n):
+        while parent[n] != n:
+            parent[n] = parent[parent[n]]
+            n = parent[n]
+        return n
+
+    for n in names:
+        for d in graph[n]["deps"]:
+            if d in names:
+                parent[find(n)] = find(d)
+
+    groups = {}
+    for n in names:
+        groups.setdefault(find(n), []).append(n)
+    return [sorted(g) for g in groups.values()]
+
+
+def pack_jobs(graph, units, capacity):
+    """
+    First-fit decreasing: units is {arch: {name: seconds}}. Returns a list of
+    (arch, [names], seconds); dependency-linked packages of an arch stay together.
+    """
+    jobs = []
+    for arch in sorted(units):
+        durations = units[arch]
+        items = []
+        for group in connected_groups(graph, durations):
+            items.append((sum(durations[n] for n in group), group))
+        items.sort(key=lambda item: (-item[0], item[1]))
+
+        bins = []
+        for seconds, group in items:
+            for b in bins:
+                if b[0] + seconds <= capacity:
+                    b[0] += seconds
+                    b[1].extend(group)
+                    break
+            else:
+                bins.append([seconds, list(group)])
+        for seconds, names in bins:
+            jobs.append((arch, sorted(names), seconds))
+    return jobs
+
+
 def pick_canary(category_path):
     """
     Pick a canary package for smoke-testing CI changes.
@@ -123,8 +206,10 @@ def main():
 
     all_cats = [d for d in os.listdir("vup/srcpkgs") if os.path.isdir(os.path.join("vup/srcpkgs", d))]
 
+    graph = load_graph("vup/srcpkgs")
+
+    changed = set()
     target_cats = set()
-    cat_pkgs = {}
     build_all = False
     smoke_only = False
 
@@ -140,79 +225,91 @@ def main():
                 build_all = True
                 break
 
-            # Check for category changes
+            # Check for package changes
             # Expected path: vup/srcpkgs/<category>/<pkg>/...
             if f.startswith("vup/srcpkgs/"):
                 parts = f.split("/")
-                if len(parts) > 2 and parts[2] in all_cats:
-                    cat = parts[2]
-                    target_cats.add(cat)
-
-                    if cat not in cat_pkgs:
-                        cat_pkgs[cat] = set()
-
-                    if len(parts) > 3:
-                        cat_pkgs[cat].add(parts[3])
+                if len(parts) > 3 and parts[2] in all_cats:
+                    if parts[3] in graph:
+                        changed.add(parts[3])
+                    else:
+                        # Removed package: only the category's release changes
+                        target_cats.add(parts[2])
 
     if build_all:
         smoke_only = False
+        selected = set(graph)
+    else:
+        selected = with_dependents(graph, changed)
+        for pkg in sorted(selected - changed):
+            print(f"[rdeps] {graph[pkg]['category']}/{pkg}: depends on a changed package")
 
     if smoke_only:
         overrides = load_canary_overrides()
         for cat in all_cats:
-            target_cats.add(cat)
             cat_path = os.path.join("vup/srcpkgs", cat)
             canary = overrides.get(cat) or pick_canary(cat_path)
-            if canary:
-                if cat not in cat_pkgs:
-                    cat_pkgs[cat] = set()
-                cat_pkgs[cat].add(canary)
+            if canary and canary in graph:
+                selected.add(canary)
                 print(f"[smoke] {cat}: canary={canary}")
 
-    if build_all:
-        target_list = sorted(list(set(all_cats)))
-    else:
-        target_list = sorted(list(target_cats))
-    
+    # For PR checks, only build x86_64 to keep CI fast.
+    # Full multi-arch builds happen on merge (push event).
+    is_pr = os.environ.get("GITHUB_EVENT_NAME") in ("pull_request", "pull_request_target")
+
+    units = {}
+    for pkg in sorted(selected):
+        category = graph[pkg]["category"]
+        for arch in package_archs(os.path.join("vup/srcpkgs", category), pkg):
+            if is_pr and arch != "x86_64":
+                continue
+            units.setdefault(arch, {})[pkg] = None
+    for arch, pkgs in units.items():
+        durations = load_durations(REPORT_HISTORY, arch)
+        for pkg in pkgs:
+            pkgs[pkg] = durations.get(pkg, DEFAULT_BUILD_SECONDS)
+    if is_pr:
+        print("PR mode: filtered to x86_64 only")
+
+    includes = []
+    releases = set()
+    counts = {}
+    for arch, names, seconds in pack_jobs(graph, units, TARGET_JOB_SECONDS):
+        counts[arch] = counts.get(arch, 0) + 1
+        job = f"{arch}-job{counts[arch]}"
+        unit_list = [f"{graph[n]['category']}/{n}" for n in names]
+        print(f"Job '{job}': {len(names)} packages, ~{seconds / 60:.0f} min: {' '.join(unit_list)}")
+        includes.append({"job": job, "arch": arch, "units": " ".join(unit_list)})
+        releases.update((graph[n]["category"], arch) for n in names)
+
+    # Categories with nothing to build still get their release refreshed
+    # (e.g. a package was removed)
+    for cat in sorted(target_cats):
+        cat_path = os.path.join("vup/srcpkgs", cat)
+        for arch in get_category_archs(cat_path, None):
+            if not is_pr or arch == "x86_64":
+                releases.add((cat, arch))
+
     output_file = os.environ.get("GITHUB_OUTPUT")
-    
-    if not target_list:
+
+    if not includes and not releases:
         print("No changes detected.")
         if output_file:
             with open(output_file, "a") as gh:
                 gh.write("should_run=false\n")
+                gh.write("should_build=false\n")
                 gh.write('matrix={"include":[]}\n')
+                gh.write('release_matrix={"include":[]}\n')
     else:
-        # Build matrix with category + arch combinations
-        includes = []
-        for cat in target_list:
-            cat_path = os.path.join("vup/srcpkgs", cat)
-            
-            # Determine packages
-            if build_all or cat not in cat_pkgs or not cat_pkgs[cat]:
-                pkg_str = "ALL"
-                archs = get_category_archs(cat_path, None)  # All packages
-            else:
-                pkg_str = " ".join(sorted(list(cat_pkgs[cat])))
-                archs = get_category_archs(cat_path, cat_pkgs[cat])  # Only changed packages
-
-            print(f"Category '{cat}' needs architectures: {archs} (packages: {pkg_str})")
-            for arch in archs:
-                includes.append({"category": cat, "arch": arch, "packages": pkg_str})
-        
-        # For PR checks, only build x86_64 to keep CI fast.
-        # Full multi-arch builds happen on merge (push event).
-        is_pr = os.environ.get("GITHUB_EVENT_NAME") in ("pull_request", "pull_request_target")
-        if is_pr:
-            includes = [i for i in includes if i["arch"] == "x86_64"]
-            print(f"PR mode: filtered to x86_64 only ({len(includes)} jobs)")
-
-        print(f"Total build jobs: {len(includes)}")
+        print(f"Total build jobs: {len(includes)} ({sum(len(u) for u in units.values())} package/arch units)")
         matrix_json = json.dumps({"include": includes})
+        release_json = json.dumps({"include": [{"category": c, "arch": a} for c, a in sorted(releases)]})
         if output_file:
             with open(output_file, "a") as gh:
                 gh.write("should_run=true\n")
+                gh.write(f"should_build={'true' if includes else 'false'}\n")
                 gh.write(f"matrix={matrix_json}\n")
+                gh.write(f"release_matrix={release_json}\n")
 
 if __name__ == "__main__":
     main()
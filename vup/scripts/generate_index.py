@@ -4,9 +4,15 @@ Generate the package index for VUP.
 Creates public/index.json with package metadata and URLs for both GitHub releases and R2.
 """
 
+import gzip
+import hashlib
+import io
 import json
 import os
 import re
+import struct
+import subprocess
+import tarfile
 
 # Import shared config
 try:
@@ -30,29 +36,210 @@ except ImportError:
     )
 
 
+# Template variables copied into the index so clients can resolve
+# dependencies without fetching templates
+INDEX_FIELDS = ("version", "revision", "short_desc", "depends", "makedepends", "hostmakedepends")
+
+# Fields holding whitespace-separated package lists
+LIST_FIELDS = ("depends", "makedepends", "hostmakedepends")
+
+
 def parse_template(template_path):
     """
-    Parses a void-linux template file to extract version and revision.
-    Very basic regex parsing - in a real scenario, could source the file.
+    Parses a void-linux template file to extract the fields in INDEX_FIELDS.
+    Very basic parsing - in a real scenario, could source the file.
+    Handles multi-line quoted values; variable substitution is not expanded
+    and entries containing '$' are dropped from dependency lists.
+    Returns (fields, content).
     """
-    version = None
-    revision = None
+    fields = {}
 
     with open(template_path, "r") as f:
         content = f.read()
 
-        # Regex for version and revision
-        # Note: This handles simple 'version=1.2.3' and 'revision=1'
-        # It does NOT handle variable substitution like 'version=${_ver}'
-        v_match = re.search(r"^version=([^\s#]+)", content, re.MULTILINE)
-        r_match = re.search(r"^revision=([^\s#]+)", content, re.MULTILINE)
+    lines = content.splitlines()
+    i = 0
+    while i < len(lines):
+        m = re.match(r"^(\w+)=(.*)$", lines[i])
+        i += 1
+        if not m or m.group(1) not in INDEX_FIELDS or m.group(1) in fields:
+            continue
+
+        name, value = m.group(1), m.group(2)
+        if value.startswith('"') and '"' not in value[1:]:
+            # Multi-line value - collect until the closing quote
+            parts = [value[1:]]
+            while i < len(lines):
+                line = lines[i]
+                i += 1
+                if '"' in line:
+                    parts.append(line[: line.index('"')])
+                    break
+                parts.append(line)
+            value = " ".join(parts)
+        elif value.startswith(("'", '"')):
+            quote = value[0]
+            end = value.find(quote, 1)
+            value = value[1:end] if end > 0 else value[1:]
+        else:
+            # Unquoted: stop at whitespace or a comment
+            words = value.split("#", 1)[0].split()
+            value = words[0] if words else ""
+
+        if name in LIST_FIELDS:
+            fields[name] = [d for d in value.split() if "$" not in d]
+        else:
+            fields[name] = value.strip()
+
+    return fields, content
+
+
+def git_blob_hash(content):
+    """Same value as `git hash-object` for the template (identifies its revision)."""
+    data = content.encode()
+    return hashlib.sha1(b"blob %d\0" % len(data) + data).hexdigest()
+
+
+def fetch_release_assets(tag):
+    """
+    Return {asset name: (size, sha256)} for a release, or {} when unavailable.
+    sha256 is "" for assets uploaded before GitHub recorded digests.
+    Needs GITHUB_REPOSITORY and an authenticated gh CLI.
+    """
+    repo = os.environ.get("GITHUB_REPOSITORY", "")
+    if not repo:
+        return {}
+
+    try:
+        out = subprocess.check_output(
+            ["gh", "api", f"repos/{repo}/releases/tags/{tag}"],
+            stderr=subprocess.DEVNULL,
+        )
+        assets = json.loads(out).get("assets", [])
+    except (subprocess.CalledProcessError, FileNotFoundError, ValueError):
+        return {}
+
+    result = {}
+    for a in assets:
+        digest = a.get("digest") or ""
+        sha256 = digest[len("sha256:"):] if digest.startswith("sha256:") else ""
+        result[a["name"]] = (a.get("size", 0), sha256)
+    return result
+
+
+# Sharded index: public/manifest.json lists public/shards/<category>.{json,bin}
+MANIFEST_VERSION = 1
+SHARDS_DIR = "shards"
+
+# Every <category>/<pkg>/template in one archive, unpacked by `vuru sync`
+TEMPLATES_ARCHIVE = "templates.tar.gz"
+
+# Binary index (index.bin) layout - keep in sync with vuru/src/core/index/binary.odin
+# All integers are little-endian u32 unless noted. Strings are (offset, length)
+# pairs into the string pool; lists are (start, count) pairs into a table.
+#   header   : magic "VUPI", version, count, record_size, records_off,
+#              lists_off, lists_count, archs_off, archs_count, pool_off,
+#              pool_size, reserved
+#   records  : one per package, sorted by name (bytewise) for binary search:
+#              name, version, category, short_desc, template_hash (strings),
+#              depends, makedepends, hostmakedepends (lists of strings),
+#              archs (list of arch entries), flags, reserved
+#   lists    : string table referenced by dependency lists
+#   archs    : arch, repo_url, binpkg filename, binpkg sha256 (strings),
+#              binpkg size (u64)
+#   pool     : deduplicated UTF-8 string data
+BINARY_INDEX_MAGIC = b"VUPI"
+BINARY_INDEX_VERSION = 2
+BINARY_HEADER = struct.Struct("<4s11I")
+BINARY_RECORD = struct.Struct("<20I")
+BINARY_STR = struct.Struct("<2I")
+BINARY_ARCH = struct.Struct("<8IQ")
+
+# Record flag: dependency lists are present
+BINARY_FLAG_HAS_DEPS = 1
+
+
+def write_binary_index(index, path):
+    """Write the packages of index in the compact binary format."""
+    pool = bytearray()
+    pool_offsets = {}
+
+    def intern(s):
+        data = s.encode()
+        if data not in pool_offsets:
+            pool_offsets[data] = len(pool)
+            pool.extend(data)
+        return pool_offsets[data], len(data)
+
+    lists = []
+    archs = []
+
+    def add_list(items):
+        start = len(lists)
+        lists.extend(intern(item) for item in items)
+        return start, len(items)
+
+    packages = index["packages"]
+    records = bytearray()
+    for name in sorted(packages, key=lambda n: n.encode()):
+        pkg = packages[name]
+
+        arch_start = len(archs)
+        for arch in pkg["archs"]:
+            binpkg = pkg.get("binpkgs", {}).get(arch, {})
+            archs.append(
+                (
+                    *intern(arch),
+                    *intern(pkg["repo_urls"].get(arch, "")),
+                    *intern(binpkg.get("filename", "")),
+                    *intern(binpkg.get("sha256", "")),
+                    binpkg.get("size", 0),
+                )
+            )
+
+        records += BINARY_RECORD.pack(
+            *intern(name),
+            *intern(pkg["version"]),
+            *intern(pkg["category"]),
+            *intern(pkg.get("short_desc", "")),
+            *intern(pkg.get("template_hash", "")),
+            *add_list(pkg.get("depends", [])),
+            *add_list(pkg.get("makedepends", [])),
+            *add_list(pkg.get("hostmakedepends", [])),
+            arch_start,
+            len(archs) - arch_start,
+            BINARY_FLAG_HAS_DEPS if "depends" in pkg else 0,
+            0,
+        )
 
-        if v_match:
-            version = v_match.group(1).strip("\"'")
-        if r_match:
-            revision = r_match.group(1).strip("\"'")
+    records_off = BINARY_HEADER.size
+    lists_off = records_off + len(records)
+    archs_off = lists_off + len(lists) * BINARY_STR.size
+    pool_off = archs_off + len(archs) * BINARY_ARCH.size
 
-    return version, revision
+    with open(path, "wb") as f:
+        f.write(
+            BINARY_HEADER.pack(
+                BINARY_INDEX_MAGIC,
+                BINARY_INDEX_VERSION,
+                len(packages),
+                BINARY_RECORD.size,
+                records_off,
+                lists_off,
+                len(lists),
+                archs_off,
+                len(archs),
+                pool_off,
+                len(pool),
+                0,
+            )
+        )
+        f.write(records)
+        for entry in lists:
+            f.write(BINARY_STR.pack(*entry))
+        for entry in archs:
+            f.write(BINARY_ARCH.pack(*entry))
+        f.write(pool)
 
 
 def generate_index():
@@ -81,6 +268,9 @@ def generate_index():
         ]
     )
 
+    # Release asset sizes, fetched once per tag
+    release_assets = {}
+
     for category in categories:
         cat_dir = os.path.join(SRCPKGS_DIR, category)
         packages = sorted(
@@ -92,7 +282,9 @@ def generate_index():
             if not os.path.exists(template_path):
                 continue
 
-            version, revision = parse_template(template_path)
+            fields, content = parse_template(template_path)
+            version = fields.get("version")
+            revision = fields.get("revision")
 
             if version and revision:
                 full_version = f"{version}_{revision}"
@@ -106,16 +298,34 @@ def generate_index():
                 # Build repo_urls dict per architecture
                 # GitHub releases hold the repodata (index) and packages
                 repo_urls = {}
+                binpkgs = {}
 
                 for arch in archs:
                     tag = f"{category}-{arch}-current"
                     repo_urls[arch] = f"{BASE_URL}/{tag}"
 
+                    if tag not in release_assets:
+                        release_assets[tag] = fetch_release_assets(tag)
+
+                    filename = f"{pkg}-{full_version}.{arch}.xbps"
+                    size, sha256 = release_assets[tag].get(filename, (0, ""))
+                    binpkgs[arch] = {
+                        "filename": filename,
+                        "size": size,
+                        "sha256": sha256,
+                    }
+
                 index["packages"][pkg] = {
                     "category": category,
                     "version": full_version,
+                    "short_desc": fields.get("short_desc", ""),
+                    "depends": fields.get("depends", []),
+                    "makedepends": fields.get("makedepends", []),
+                    "hostmakedepends": fields.get("hostmakedepends", []),
+                    "template_hash": git_blob_hash(content),
                     "archs": archs,
                     "repo_urls": repo_urls,
+                    "binpkgs": binpkgs,
                 }
                 print(
                     f"Indexed: {pkg} -> {category} ({full_version}) [{', '.join(archs)}]"
@@ -129,6 +339,117 @@ def generate_index():
         json.dump(index, f, indent=2)
     print("Generated public/index.json")
 
+    write_binary_index(index, "public/index.bin")
+    print("Generated public/index.bin")
+
+    write_shards(index, "public")
+    print("Generated public/manifest.json")
+
+
+def file_entry(public_dir, rel_path):
+    """Manifest entry (path, sha256, size) for a generated file."""
+    with open(os.path.join(public_dir, rel_path), "rb") as f:
+        data = f.read()
+    return {
+        "path": rel_path,
+        "sha256": hashlib.sha256(data).hexdigest(),
+        "size": len(data),
+    }
+
+
+def write_shards(index, public_dir):
+    """
+    Write one index shard per category (JSON and binary) plus manifest.json.
+    Clients compare shard hashes against their cached manifest and only
+    download the shards that changed.
+    """
+    shards_dir = os.path.join(public_dir, SHARDS_DIR)
+    os.makedirs(shards_dir, exist_ok=True)
+
+    by_category = {}
+    for name, pkg in index["packages"].items():
+        by_category.setdefault(pkg["category"], {})[name] = pkg
+
+    manifest = {"version": MANIFEST_VERSION, "shards": {}}
+    for category in sorted(by_category):
+        shard = {"packages": by_category[category]}
+        json_path = f"{SHARDS_DIR}/{category}.json"
+        bin_path = f"{SHARDS_DIR}/{category}.bin"
+
+        # Stable output so unchanged categories keep their hash
+        with open(os.path.join(public_dir, json_path), "w") as f:
+            json.dump(shard, f, indent=2, sort_keys=True)
+        write_binary_index(shard, os.path.join(public_dir, bin_path))
+
+        manifest["shards"][category] = {
+            "packages": len(shard["packages"]),
+            "json": file_entry(public_dir, json_path),
+            "bin": file_entry(public_dir, bin_path),
+        }
+
+    snapshot = write_template_snapshot(public_dir)
+    if snapshot:
+        manifest["templates"] = snapshot
+
+    with open(os.path.join(public_dir, "manifest.json"), "w") as f:
+        json.dump(manifest, f, indent=2)
+
+
+def source_commit():
+    """Commit the index is generated from ("" outside a git checkout)."""
+    commit = os.environ.get("GITHUB_SHA", "")
+    if commit:
+        return commit
+    try:
+        return subprocess.check_output(
+            ["git", "rev-parse", "HEAD"], stderr=subprocess.DEVNULL, text=True
+        ).strip()
+    except (subprocess.CalledProcessError, FileNotFoundError):
+        return ""
+
+
+def write_template_snapshot(public_dir):
+    """
+    Archive every srcpkgs template as <category>/<pkg>/template. The archive
+    is reproducible (sorted, fixed metadata) so it only changes with the
+    templates. Returns the manifest entry, or None when there is nothing to
+    archive.
+    """
+    buf = io.BytesIO()
+    count = 0
+    with tarfile.open(fileobj=buf, mode="w", format=tarfile.PAX_FORMAT) as tar:
+        for category in sorted(os.listdir(SRCPKGS_DIR)):
+            cat_dir = os.path.join(SRCPKGS_DIR, category)
+            if not os.path.isdir(cat_dir):
+                continue
+            for pkg in sorted(os.listdir(cat_dir)):
+                path = os.path.join(cat_dir, pkg, "template")
+                if not os.path.isfile(path):
+                    continue
+                with open(path, "rb") as f:
+                    data = f.read()
+                info = tarfile.TarInfo(f"{category}/{pkg}/template")
+                info.size = len(data)
+                info.mode = 0o644
+                tar.addfile(info, io.BytesIO(data))
+                count += 1
+
+    if count == 0:
+        return None
+
+    with open(os.path.join(public_dir, TEMPLATES_ARCHIVE), "wb") as f:
+        with gzip.GzipFile(fileobj=f, mode="wb", mtime=0) as gz:
+            gz.write(buf.getvalue())
+
+    commit = source_commit()
+    entry = file_entry(public_dir, TEMPLATES_ARCHIVE)
+    return {
+        # Names the snapshot directory on clients; fall back to the content hash
+        "commit": commit or entry["sha256"],
+        "templates": count,
+        "archive": entry,
+    }
+
 
 if __name__ == "__main__":
     generate_index()
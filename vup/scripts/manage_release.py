@@ -1,9 +1,16 @@
 #!/usr/bin/env python3
 """
 Manage VUP releases - handles both GitHub releases (repodata) and Cloudflare R2 (packages).
+
+With --manifest, a release is synchronized incrementally: it publishes a
+small manifest.json (filename, size, sha256, pkgver of every package) and
+only that and the repodata are downloaded. New build outputs are compared
+against it, so only new assets are uploaded, only superseded ones deleted,
+and the repodata is updated with `xbps-rindex -a` on the new files alone.
 """
 
 import glob
+import hashlib
 import json
 import os
 import re
@@ -12,6 +19,13 @@ import sys
 from functools import cmp_to_key
 from typing import Literal, overload
 
+# Import shared helpers
+try:
+    from generate_index import fetch_release_assets
+except ImportError:
+    sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+    from generate_index import fetch_release_assets
+
 # Configuration from environment
 REPO: str = os.environ.get("GITHUB_REPOSITORY", "")
 CATEGORY: str = os.environ.get("CATEGORY", "")
@@ -19,6 +33,14 @@ ARCH: str = os.environ.get("ARCH", "x86_64")
 TAG_NAME: str = f"{CATEGORY}-{ARCH}-current"
 DIST_DIR: str = "dist"
 
+# Published with every release in manifest mode
+MANIFEST_NAME: str = "manifest.json"
+MANIFEST_VERSION: int = 1
+
+# Assets to delete remotely, written by `prune --manifest` (outside DIST_DIR,
+# so it is not uploaded)
+PLAN_FILE: str = "release-plan.json"
+
 
 @overload
 def run_command(cmd: list[str], capture_output: Literal[True]) -> str | None: ...
@@ -60,64 +82,92 @@ def get_pkg_name(filename):
 
 
 def get_pkg_ver(filename):
-    # Try xbps-uhelper first
-    if os.path.exists(filename):
-        res = run_command(["xbps-uhelper", "binpkgver", filename], capture_output=True)
-        if res:
-            return res
-
-    # Fallback regex extraction from filename
-    # <name>-<version>_<revision>.<arch>.xbps
+    """Return the version_revision of a binpkg from its <pkgver>.<arch>.xbps name."""
     base = os.path.basename(filename)
-    match = re.search(r"-([0-9][^-]*_[0-9]+)\.[^.]*\.xbps$", base)
-    if match:
-        return match.group(1)
+    if base.endswith(".xbps"):
+        base = base[: -len(".xbps")]
+        # Strip the .<arch> suffix (same as xbps_binpkg_pkgver)
+        base = base.rsplit(".", 1)[0]
+    return xbps_pkg_version(base)
 
+
+def xbps_pkg_version(pkgver):
+    """Port of libxbps xbps_pkg_version(): version part after the last '-'."""
+    dash = pkgver.rfind("-")
+    if dash < 0:
+        return None
+    suffix = pkgver[dash:]
+    if "_" not in suffix:
+        return None
+    for c in suffix:
+        if c == "_":
+            break
+        if c.isdigit():
+            return suffix[1:]
     return None
 
 
-def parse_ver_rev(version_str):
-    """Splits version_revision string into (version, revision_int)."""
-    if "_" in version_str:
-        ver, rev = version_str.rsplit("_", 1)
-        try:
-            return ver, int(rev)
-        except ValueError:
-            return ver, 0
-    return version_str, 0
-
-
-def python_ver_cmp(v1, v2):
-    """Fallback comparison logic."""
-    ver1, rev1 = parse_ver_rev(v1)
-    ver2, rev2 = parse_ver_rev(v2)
-
-    if ver1 == ver2:
-        return 1 if rev1 > rev2 else (-1 if rev1 < rev2 else 0)
-
-    # Simple version comparison - split by common separators and compare parts
-    def normalize(v):
-        # Split version string into comparable parts
-        parts = re.split(r"[._-]", v)
-        result = []
-        for p in parts:
-            # Try to convert to int for numeric comparison
-            try:
-                result.append((0, int(p)))
-            except ValueError:
-                result.append((1, p))  # String parts sort after numbers
-        return result
+# Component values from libxbps lib/external/dewey.c
+_DEWEY_MODIFIERS = (
+    ("alpha", -3),
+    ("beta", -2),
+    ("pre", -1),
+    ("rc", -1),
+    ("pl", 0),
+    (".", 0),
+)
+
+
+def _dewey_components(version):
+    """Split a version like dewey's mkversion(); returns (components, revision)."""
+    comps = []
+    revision = 0
+    i = 0
+    n = len(version)
+    while i < n:
+        c = version[i]
+        if "0" <= c <= "9":
+            j = i
+            while j < n and "0" <= version[j] <= "9":
+                j += 1
+            comps.append(int(version[i:j]))
+            i = j
+            continue
+
+        lower = version[i:].lower()
+        for mod, value in _DEWEY_MODIFIERS:
+            if lower.startswith(mod):
+                comps.append(value)
+                i += len(mod)
+                break
+        else:
+            if c == "_":
+                j = i + 1
+                while j < n and "0" <= version[j] <= "9":
+                    j += 1
+                revision = int(version[i + 1 : j] or 0)
+                i = j
+            elif "a" <= c.lower() <= "z":
+                comps.append(0)
+                comps.append(ord(c.lower()) - ord("a") + 1)
+                i += 1
+            else:
+                i += 1
+    return comps, revision
 
-    try:
-        n1, n2 = normalize(ver1), normalize(ver2)
-        if n1 > n2:
-            return 1
-        if n1 < n2:
-            return -1
-    except Exception:
-        pass
 
-    return 1 if v1 > v2 else -1
+def xbps_cmpver(v1, v2):
+    """In-process equivalent of `xbps-uhelper cmpver`: returns -1, 0 or 1."""
+    c1, r1 = _dewey_components(v1)
+    c2, r2 = _dewey_components(v2)
+    for i in range(max(len(c1), len(c2))):
+        a = c1[i] if i < len(c1) else 0
+        b = c2[i] if i < len(c2) else 0
+        if a != b:
+            return 1 if a > b else -1
+    if r1 != r2:
+        return 1 if r1 > r2 else -1
+    return 0
 
 
 def download_release():
@@ -159,28 +209,7 @@ def xbps_ver_cmp(f1, f2):
         print(f"Warning: Could not determine version for {f1} or {f2}")
         return 0
 
-    # Python Fallback for same version different revision (most common cleanup case)
-    val1, rev1 = parse_ver_rev(v1)
-    val2, rev2 = parse_ver_rev(v2)
-
-    if val1 == val2:
-        return 1 if rev1 > rev2 else (-1 if rev1 < rev2 else 0)
-
-    # Try xbps-uhelper cmpver for different versions
-    try:
-        ret = subprocess.call(
-            ["xbps-uhelper", "cmpver", v1, v2],
-            stdout=subprocess.DEVNULL,
-            stderr=subprocess.DEVNULL,
-        )
-        if ret == 1:
-            return 1
-        if ret == 255:
-            return -1
-    except Exception:
-        pass
-
-    return python_ver_cmp(v1, v2)
+    return xbps_cmpver(v1, v2)
 
 
 def clean_stale_sigs():
@@ -299,28 +328,221 @@ def clean_remote_assets():
         )
 
 
+def file_sha256(path):
+    h = hashlib.sha256()
+    with open(path, "rb") as f:
+        for chunk in iter(lambda: f.read(1024 * 1024), b""):
+            h.update(chunk)
+    return h.hexdigest()
+
+
+def binpkg_pkgver(filename):
+    """<pkgver> of a <pkgver>.<arch>.xbps filename."""
+    return os.path.basename(filename)[: -len(".xbps")].rsplit(".", 1)[0]
+
+
+def manifest_from_assets():
+    """
+    Manifest of a release that has none yet (published before manifest mode),
+    from the asset sizes and digests GitHub records.
+    """
+    packages = {}
+    for name, (size, sha256) in fetch_release_assets(TAG_NAME).items():
+        if name.endswith(".xbps"):
+            packages[name] = {"size": size, "sha256": sha256, "pkgver": binpkg_pkgver(name)}
+    return {"version": MANIFEST_VERSION, "packages": packages}
+
+
+def load_manifest():
+    path = os.path.join(DIST_DIR, MANIFEST_NAME)
+    try:
+        with open(path) as f:
+            manifest = json.load(f)
+        if manifest.get("version") == MANIFEST_VERSION:
+            return manifest
+        print(f"Warning: unsupported {MANIFEST_NAME} version, rebuilding it")
+    except (OSError, ValueError):
+        pass
+    return {"version": MANIFEST_VERSION, "packages": {}}
+
+
+def download_manifest():
+    """Download only the manifest and the repodata of the release."""
+    print(f"Downloading manifest and repodata from {TAG_NAME}...")
+    os.makedirs(DIST_DIR, exist_ok=True)
+
+    if not REPO:
+        print("ERROR: GITHUB_REPOSITORY not set")
+        return
+
+    if not run_command(
+        ["gh", "release", "view", TAG_NAME, "--repo", REPO], capture_output=True
+    ):
+        print(f"Release {TAG_NAME} not found. Starting fresh.")
+        return
+
+    run_command(
+        [
+            "gh",
+            "release",
+            "download",
+            TAG_NAME,
+            "--repo",
+            REPO,
+            "--dir",
+            DIST_DIR,
+            "--pattern",
+            MANIFEST_NAME,
+            "--pattern",
+            "*-repodata*",
+        ]
+    )
+
+    path = os.path.join(DIST_DIR, MANIFEST_NAME)
+    if not os.path.exists(path):
+        print(f"No {MANIFEST_NAME} in {TAG_NAME}; building it from the asset list")
+        with open(path, "w") as f:
+            json.dump(manifest_from_assets(), f, indent=2, sort_keys=True)
+
+
+def prune_manifest():
+    """
+    Reconcile the new binpkgs in DIST_DIR with the manifest: drop outputs that
+    are already published (same file) or older than the published version,
+    and record the published packages they supersede for clean_remote.
+    """
+    print("Comparing new packages against the release manifest...")
+    manifest = load_manifest()
+    published = manifest["packages"]
+
+    by_name = {}
+    for name in published:
+        pkgname = get_pkg_name(name)
+        if pkgname:
+            by_name.setdefault(pkgname, []).append(name)
+
+    new = {}
+    for f in glob.glob(os.path.join(DIST_DIR, "*.xbps")):
+        pkgname = get_pkg_name(f)
+        if not pkgname:
+            print(f"Warning: Could not determine package name for {os.path.basename(f)}")
+            continue
+        new.setdefault(pkgname, []).append(f)
+
+    superseded = []
+    for pkgname, fpaths in sorted(new.items()):
+        # Newest local build only
+        fpaths.sort(key=cmp_to_key(xbps_ver_cmp), reverse=True)
+        for old in fpaths[1:]:
+            print(f"Removing old version: {os.path.basename(old)}")
+            remove_with_sigs(old)
+        path = fpaths[0]
+        filename = os.path.basename(path)
+        sha256 = file_sha256(path)
+
+        current = by_name.get(pkgname, [])
+        entry = published.get(filename)
+        if entry and entry.get("sha256") == sha256:
+            print(f"Unchanged: {filename}")
+            remove_with_sigs(path)
+            continue
+        newer = [c for c in current if c != filename and xbps_ver_cmp(c, path) > 0]
+        if newer:
+            print(f"Skipping {filename}: {newer[0]} is newer")
+            remove_with_sigs(path)
+            continue
+
+        for c in current:
+            if c != filename:
+                print(f"Superseded: {c} -> {filename}")
+                superseded.append(c)
+                del published[c]
+        published[filename] = {
+            "size": os.path.getsize(path),
+            "sha256": sha256,
+            "pkgver": binpkg_pkgver(filename),
+        }
+        print(f"New: {filename}")
+
+    with open(os.path.join(DIST_DIR, MANIFEST_NAME), "w") as f:
+        json.dump(manifest, f, indent=2, sort_keys=True)
+
+    delete = []
+    for name in superseded:
+        delete += [name, name + ".sig", name + ".sig2"]
+    with open(PLAN_FILE, "w") as f:
+        json.dump({"tag": TAG_NAME, "delete": delete}, f, indent=2)
+    print(f"{len(published)} packages in the manifest, {len(superseded)} to delete remotely")
+
+
+def remove_with_sigs(path):
+    for f in (path, path + ".sig", path + ".sig2"):
+        if os.path.exists(f):
+            os.remove(f)
+
+
+def clean_remote_superseded():
+    """Delete the remote assets prune --manifest marked as superseded."""
+    print("Deleting superseded remote assets...")
+
+    if not REPO:
+        print("ERROR: GITHUB_REPOSITORY not set")
+        return
+
+    try:
+        with open(PLAN_FILE) as f:
+            plan = json.load(f)
+    except (OSError, ValueError):
+        print(f"No {PLAN_FILE}; run prune --manifest first.")
+        return
+    if plan.get("tag") != TAG_NAME:
+        print(f"{PLAN_FILE} is for {plan.get('tag')}, not {TAG_NAME}")
+        return
+
+    remote = set(fetch_release_assets(TAG_NAME))
+    to_delete = [a for a in plan.get("delete", []) if a in remote]
+    if not to_delete:
+        print("Remote is clean.")
+        return
+
+    for asset in to_delete:
+        print(f"Deleting remote asset: {asset}")
+        run_command(
+            ["gh", "release", "delete-asset", TAG_NAME, asset, "--repo", REPO, "--yes"]
+        )
+
+
 # ============================================================================
 # Main
 # ============================================================================
 
 if __name__ == "__main__":
-    if len(sys.argv) < 2:
-        print("Usage: manage_release.py [download|prune|clean_remote]")
+    args = [a for a in sys.argv[1:] if a != "--manifest"]
+    manifest_mode = "--manifest" in sys.argv[1:]
+    if not args:
+        print("Usage: manage_release.py [download|prune|clean_remote] [--manifest]")
         print()
         print("Commands:")
         print("  download     - Download existing release assets from GitHub")
         print("  prune        - Remove old package versions locally")
         print("  clean_remote - Delete obsolete assets from GitHub release")
+        print()
+        print("--manifest: synchronize through the release manifest; download only")
+        print("fetches the manifest and repodata, prune keeps only new packages and")
+        print("clean_remote deletes only the packages they superseded")
         sys.exit(1)
 
-    cmd = sys.argv[1]
+    cmd = args[0]
     if cmd == "download":
-        download_release()
+        download_manifest() if manifest_mode else download_release()
     elif cmd == "prune":
-        prune_local()
-        clean_stale_sigs()
+        if manifest_mode:
+            prune_manifest()
+        else:
+            prune_local()
+            clean_stale_sigs()
     elif cmd == "clean_remote":
-        clean_remote_assets()
+        clean_remote_superseded() if manifest_mode else clean_remote_assets()
     else:
         print(f"Unknown command: {cmd}")
         sys.exit(1)
@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+"""
+VUP package dependency graph and recorded build durations, shared by
+check_changes.py (what to rebuild, how to split it into CI jobs) and
+build_runner.py (build order).
+
+The graph is read from the templates, the same fields the enriched index
+publishes; only edges between VUP packages are kept.
+"""
+
+import argparse
+import glob
+import json
+import os
+import re
+
+# Import template parsing
+try:
+    from generate_index import LIST_FIELDS, parse_template
+except ImportError:
+    import sys
+
+    sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+    from generate_index import LIST_FIELDS, parse_template
+
+
+def dep_name(dep):
+    """Package name of a dependency entry ("foo>=1.0" -> "foo")."""
+    return re.split(r"[<>=]", dep, maxsplit=1)[0]
+
+
+def load_graph(srcpkgs_root):
+    """
+    Returns {name: {"category": str, "deps": set}} for every package under
+    srcpkgs_root/<category>/<pkg>/template; deps are the VUP packages it
+    depends on at build or run time.
+    """
+    packages = {}
+    raw_deps = {}
+    for category in sorted(os.listdir(srcpkgs_root)):
+        cat_path = os.path.join(srcpkgs_root, category)
+        if not os.path.isdir(cat_path):
+            continue
+        for pkg in sorted(os.listdir(cat_path)):
+            template_path = os.path.join(cat_path, pkg, "template")
+            if not os.path.isfile(template_path):
+                continue
+            try:
+                fields, _ = parse_template(template_path)
+            except OSError:
+                fields = {}
+            packages[pkg] = {"category": category, "deps": set()}
+            raw_deps[pkg] = {dep_name(d) for field in LIST_FIELDS for d in fields.get(field, [])}
+
+    for pkg, deps in raw_deps.items():
+        packages[pkg]["deps"] = {d for d in deps if d in packages and d != pkg}
+    return packages
+
+
+def reverse_deps(graph):
+    """{name: set of packages depending on it}"""
+    rdeps = {name: set() for name in graph}
+    for name, info in graph.items():
+        for d in info["deps"]:
+            rdeps[d].add(name)
+    return rdeps
+
+
+def with_dependents(graph, names):
+    """names plus every package depending on them, directly or not."""
+    rdeps = reverse_deps(graph)
+    affected = set()
+    stack = [n for n in names if n in graph]
+    while stack:
+        name = stack.pop()
+        if name in affected:
+            continue
+        affected.add(name)
+        stack.extend(rdeps[name] - affected)
+    return affected
+
+
+def build_order(graph, names):
+    """names sorted so that every package comes after its dependencies among names."""
+    names = set(names)
+    order = []
+    state = {}
+
+    def visit(name):
+        if state.get(name):
+            return  # Done, or a cycle: leave it where it is
+        state[name] = "visiting"
+        for d in sorted(graph.get(name, {}).get("deps", ())):
+            if d in names:
+                visit(d)
+        state[name] = "done"
+        order.append(name)
+
+    for name in sorted(names):
+        visit(name)
+    return order
+
+
+def load_durations(pattern, arch=None):
+    """
+    Build durations by package from earlier reports (report-*.json), the most
+    recent run of each package winning. With an arch, reports for other
+    archs are ignored.
+    """
+    durations = {}
+    latest = {}
+    for path in glob.glob(pattern):
+        try:
+            with open(path) as f:
+                report = json.load(f)
+        except (OSError, ValueError):
+            continue
+        if not isinstance(report, dict):
+            continue
+        if arch and report.get("arch", arch) != arch:
+            continue
+        for r in report.get("results", []):
+            name, duration = r.get("name"), r.get("duration")
+            if not name or duration is None:
+                continue
+            end = r.get("end_time", 0)
+            if end >= latest.get(name, -1):
+                latest[name] = end
+                durations[name] = duration
+    return durations
+
+
+def main():
+    parser = argparse.ArgumentParser(description="VUP package dependency graph")
+    sub = parser.add_subparsers(dest="command", required=True)
+    order = sub.add_parser("order", help="print category/pkg units in build order")
+    order.add_argument("srcpkgs", help="srcpkgs directory")
+    order.add_argument("units", nargs="*", help="category/pkg")
+    args = parser.parse_args()
+
+    if args.command == "order":
+        categories = {}
+        for unit in args.units:
+            category, _, pkg = unit.partition("/")
+            categories[pkg] = category
+        graph = load_graph(args.srcpkgs)
+        print(" ".join(f"{categories[p]}/{p}" for p in build_order(graph, categories)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,267 @@
+package main
+
+import "base:runtime"
+import "core:fmt"
+import "core:math"
+import "core:mem"
+import "core:mem/virtual"
+import "core:os"
+import "core:slice"
+import "core:strconv"
+import "core:strings"
+import "core:time"
+
+import index "../src/core/index"
+import resolve "../src/core/resolve"
+import search "../src/core/search"
+import template "../src/core/template"
+import utils "../src/utils"
+
+// Micro-benchmarks of vuru's hot paths over a generated data set (see
+// run.py, which prepares it and the sandbox). Each benchmark runs in a fresh
+// arena per iteration; one extra iteration goes through a tracking allocator
+// to count allocations. Results are printed as one JSON object per line.
+//
+// Usage: vuru-bench <data dir> [iterations]
+
+DEFAULT_ITERATIONS :: 20
+
+// Inputs loaded once, outside the timed region (heap-allocated)
+Bench_Data :: struct {
+	packages:  int,
+	index_src: string,
+	idx:       index.Index,
+	queries:   []string,
+	targets:   []string,
+	templates: []string,
+	diff_old:  []string,
+	diff_new:  []string,
+}
+
+Bench :: struct {
+	name: string,
+	body: proc(data: ^Bench_Data),
+}
+
+BENCHES := [?]Bench {
+	{"parse_index", bench_parse_index},
+	{"search_vup", bench_search},
+	{"resolve_deps", bench_resolve},
+	{"template_parse", bench_template_parse},
+	{"template_lex", bench_template_lex},
+	{"diff_write_unified", bench_diff},
+}
+
+main :: proc() {
+	if len(os.args) < 2 {
+		fmt.eprintln("Usage: vuru-bench <data dir> [iterations]")
+		os.exit(1)
+	}
+	iterations := DEFAULT_ITERATIONS
+	if len(os.args) > 2 {
+		n, ok := strconv.parse_int(os.args[2])
+		if !ok || n < 1 {
+			fmt.eprintln("iterations must be a positive number")
+			os.exit(1)
+		}
+		iterations = n
+	}
+
+	context.allocator = runtime.heap_allocator()
+	data, ok := load_data(os.args[1])
+	if !ok {
+		fmt.eprintf("Could not load bench data from %s\n", os.args[1])
+		os.exit(1)
+	}
+
+	for b in BENCHES {
+		run_bench(b, &data, iterations)
+	}
+}
+
+@(private)
+run_bench :: proc(b: Bench, data: ^Bench_Data, iterations: int) {
+	samples := make([]f64, iterations)
+	defer delete(samples)
+
+	for i in 0 ..< iterations {
+		arena: virtual.Arena
+		if virtual.arena_init_growing(&arena) != nil {
+			return
+		}
+		context.allocator = virtual.arena_allocator(&arena)
+
+		start := time.tick_now()
+		b.body(data)
+		samples[i] = time.duration_milliseconds(time.tick_since(start))
+
+		free_all(context.temp_allocator)
+		virtual.arena_destroy(&arena)
+	}
+
+	allocs, bytes := count_allocations(b, data)
+
+	slice.sort(samples)
+	median := samples[iterations / 2]
+	p95 := samples[min(int(math.ceil(0.95 * f64(iterations))) - 1, iterations - 1)]
+	fmt.printf(
+		"{\"bench\":\"%s\",\"packages\":%d,\"iterations\":%d,\"median_ms\":%.3f,\"p95_ms\":%.3f,\"allocs\":%d,\"alloc_bytes\":%d}\n",
+		b.name,
+		data.packages,
+		iterations,
+		median,
+		p95,
+		allocs,
+		bytes,
+	)
+}
+
+// Allocations (count, bytes) of one run, both allocators tracked
+@(private)
+count_allocations :: proc(b: Bench, data: ^Bench_Data) -> (i64, i64) {
+	arena: virtual.Arena
+	if virtual.arena_init_growing(&arena) != nil {
+		return 0, 0
+	}
+	defer virtual.arena_destroy(&arena)
+
+	track, track_temp: mem.Tracking_Allocator
+	mem.tracking_allocator_init(&track, virtual.arena_allocator(&arena), runtime.heap_allocator())
+	mem.tracking_allocator_init(&track_temp, context.temp_allocator, runtime.heap_allocator())
+	defer mem.tracking_allocator_destroy(&track)
+	defer mem.tracking_allocator_destroy(&track_temp)
+
+	{
+		context.allocator = mem.tracking_allocator(&track)
+		context.temp_allocator = mem.tracking_allocator(&track_temp)
+		b.body(data)
+	}
+	free_all(context.temp_allocator)
+
+	return track.total_allocation_count + track_temp.total_allocation_count,
+		track.total_memory_allocated + track_temp.total_memory_allocated
+}
+
+@(private)
+bench_parse_index :: proc(data: ^Bench_Data) {
+	idx, _ := index.parse_index(data.index_src)
+	_ = idx
+}
+
+// Search index build plus a handful of queries, as `vuru search` does
+// without a cached search index
+@(private)
+bench_search :: proc(data: ^Bench_Data) {
+	si := build_search_index(&data.idx)
+	for q in data.queries {
+		_ = search.search_query(&si, q, false)
+	}
+}
+
+@(private)
+bench_resolve :: proc(data: ^Bench_Data) {
+	sources := resolve.Sources {
+		index = &data.idx,
+	}
+	res, _ := resolve.resolve_deps(data.targets, &sources, true)
+	_ = res
+}
+
+@(private)
+bench_template_parse :: proc(data: ^Bench_Data) {
+	for content in data.templates {
+		_, _ = template.template_parse(content)
+	}
+}
+
+// Lexing alone, never served from the parsed-template cache
+@(private)
+bench_template_lex :: proc(data: ^Bench_Data) {
+	for content in data.templates {
+		_ = template.template_lex(content)
+	}
+}
+
+@(private)
+bench_diff :: proc(data: ^Bench_Data) {
+	for old, i in data.diff_old {
+		b := strings.builder_make(context.temp_allocator)
+		utils.diff_write_unified(&b, old, data.diff_new[i], "old", "new")
+	}
+}
+
+@(private)
+build_search_index :: proc(idx: ^index.Index, allocator := context.allocator) -> search.Search_Index {
+	docs := make([dynamic]search.Search_Doc, context.temp_allocator)
+	for name in index.index_names(idx) {
+		pkg, _ := index.index_get_package(idx, name)
+		append(
+			&docs,
+			search.Search_Doc {
+				name = name,
+				desc = pkg.short_desc,
+				version = pkg.version,
+				category = pkg.category,
+				source = .VUP,
+			},
+		)
+	}
+	return search.search_index_build(docs[:], 0, false, allocator)
+}
+
+@(private)
+load_data :: proc(dir: string) -> (data: Bench_Data, ok: bool) {
+	data.index_src = utils.read_file(utils.path_join(dir, "index.json")) or_return
+	data.idx = index.parse_index(data.index_src) or_return
+	data.packages = index.index_count(&data.idx)
+
+	data.queries = read_lines(utils.path_join(dir, "queries.txt")) or_return
+	data.targets = read_lines(utils.path_join(dir, "targets.txt")) or_return
+	data.templates = read_dir_files(utils.path_join(dir, "templates")) or_return
+
+	diffs := read_dir_files(utils.path_join(dir, "diffs")) or_return
+	// Files come in sorted <name>.new, <name>.old pairs
+	data.diff_old = make([]string, len(diffs) / 2)
+	data.diff_new = make([]string, len(diffs) / 2)
+	for i in 0 ..< len(diffs) / 2 {
+		data.diff_new[i] = diffs[2 * i]
+		data.diff_old[i] = diffs[2 * i + 1]
+	}
+	return data, true
+}
+
+@(private)
+read_lines :: proc(path: string) -> ([]string, bool) {
+	content, ok := utils.read_file(path)
+	if !ok {
+		return nil, false
+	}
+	lines := make([dynamic]string)
+	for line in strings.split_lines_iterator(&content) {
+		if len(line) > 0 {
+			append(&lines, line)
+		}
+	}
+	return lines[:], true
+}
+
+// Contents of the files of a directory, sorted by name
+@(private)
+read_dir_files :: proc(dir: string) -> ([]string, bool) {
+	d, err := os.open(dir)
+	if err != os.ERROR_NONE {
+		return nil, false
+	}
+	defer os.close(d)
+
+	infos, _ := os.read_dir(d, -1, context.allocator)
+	slice.sort_by(infos, proc(a, b: os.File_Info) -> bool {return a.name < b.name})
+
+	contents := make([dynamic]string)
+	for fi in infos {
+		if content, ok := utils.read_file(utils.path_join(dir, fi.name)); ok {
+			append(&contents, content)
+		}
+	}
+	return contents[:], true
+}
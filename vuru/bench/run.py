@@ -0,0 +1,318 @@
+#!/usr/bin/env python3
+"""
+Benchmark suite for vuru.
+
+Generates synthetic indexes (1k/10k/50k packages by default) with a realistic
+dependency fan-out, plus templates and diff pairs, then:
+
+  - runs the vuru-bench micro-benchmarks (parse_index, search_vup,
+    resolve_deps, template_parse, template_lex, diff_write_unified) on each size
+  - times `vuru update` end to end (index refresh, pkgdb load,
+    xbps_upgrade_all) in a sandbox whose xbps-*, sudo and curl are shims from
+    bench/shims with a configurable latency
+
+Results are written as JSON (--output); with --baseline, medians are compared
+against an earlier run and regressions over --threshold fail the run.
+"""
+
+import argparse
+import json
+import os
+import platform
+import random
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+SHIMS_DIR = os.path.join(BENCH_DIR, "shims")
+
+CATEGORIES = [
+    "browsers", "development", "editors", "games", "graphics", "libs",
+    "multimedia", "network", "system", "utils",
+]
+WORDS = [
+    "fast", "simple", "modern", "tiny", "secure", "graphical", "terminal",
+    "library", "editor", "client", "server", "tool", "manager", "viewer",
+    "player", "compiler", "framework", "daemon", "plugin", "font",
+]
+
+# Share of dependencies drawn from a small set of hub packages (libc-like
+# libraries most packages depend on)
+HUB_SHARE = 0.4
+HUB_COUNT = 50
+TEMPLATES = 200
+DIFFS = 100
+QUERIES = ["code", "lib", "fast-tool", "ed", "player-12", "net", "zz"]
+TARGETS = 20
+
+
+def xbps_arch():
+    machine = platform.machine()
+    return {"armv7l": "armv7l", "arm64": "aarch64"}.get(machine, machine)
+
+
+def package_name(i):
+    return f"{WORDS[i % len(WORDS)]}-{WORDS[(i // len(WORDS)) % len(WORDS)]}-{i}"
+
+
+def generate_index(count, arch, rng):
+    """Index JSON; packages only depend on earlier ones, so there are no cycles."""
+    packages = {}
+    names = []
+    for i in range(count):
+        name = package_name(i)
+        deps = []
+        if i > 0:
+            fan_out = min(i, int(rng.lognormvariate(1.2, 0.8)))
+            for _ in range(fan_out):
+                if rng.random() < HUB_SHARE:
+                    deps.append(names[rng.randrange(min(i, HUB_COUNT))])
+                else:
+                    deps.append(names[rng.randrange(i)])
+        version = f"{rng.randint(0, 9)}.{rng.randint(0, 30)}.{rng.randint(0, 99)}"
+        category = CATEGORIES[i % len(CATEGORIES)]
+        packages[name] = {
+            "version": f"{version}_1",
+            "category": category,
+            "short_desc": " ".join(rng.sample(WORDS, 4)).capitalize(),
+            "depends": sorted(set(deps)),
+            "makedepends": [names[rng.randrange(i)]] if i > 0 and rng.random() < 0.3 else [],
+            "hostmakedepends": ["pkg-config"] if rng.random() < 0.5 else [],
+            "template_hash": f"{rng.getrandbits(256):064x}",
+            "repo_urls": {
+                arch: f"https://github.com/vup-linux/vup/releases/download/{category}-{arch}-current",
+            },
+            "binpkgs": {
+                arch: {
+                    "filename": f"{name}-{version}_1.{arch}.xbps",
+                    "sha256": f"{rng.getrandbits(256):064x}",
+                    "size": rng.randint(10_000, 200_000_000),
+                },
+            },
+        }
+        names.append(name)
+    return {"packages": packages}, names
+
+
+def generate_template(name, pkg, rng):
+    deps = "\n".join(f" {d}" for d in pkg["depends"])
+    lines = [
+        f"# Template file for '{name}'",
+        f"pkgname={name}",
+        f"version={pkg['version'].rsplit('_', 1)[0]}",
+        "revision=1",
+        'archs="x86_64 aarch64"',
+        'hostmakedepends="pkg-config"',
+        f'depends="\n{deps}\n"' if deps else 'depends=""',
+        f'short_desc="{pkg["short_desc"]}"',
+        'maintainer="Bench <bench@example.org>"',
+        'license="MIT"',
+        f'homepage="https://example.org/{name}"',
+        f'distfiles="https://example.org/{name}/${{version}}/{name}-${{version}}.tar.gz"',
+        f'checksum={rng.getrandbits(256):064x}',
+        "",
+        'case "$XBPS_TARGET_MACHINE" in',
+        '\tx86_64) _arch="x64" ;;',
+        '\taarch64) _arch="arm64" ;;',
+        "esac",
+        "",
+        "do_install() {",
+        "\tvmkdir usr/bin",
+        f'\tvbin "${{wrksrc}}/{name}"',
+        '\tvlicense LICENSE',
+        "}",
+    ]
+    return "\n".join(lines) + "\n"
+
+
+def mutate_template(content, rng):
+    lines = content.split("\n")
+    for _ in range(rng.randint(1, 5)):
+        i = rng.randrange(len(lines))
+        lines[i] = lines[i] + " # changed" if rng.random() < 0.5 else rng.choice(WORDS)
+    return "\n".join(lines)
+
+
+def write(path, content):
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, "w") as f:
+        f.write(content)
+
+
+def generate_data(data_dir, count, arch, seed):
+    rng = random.Random(seed + count)
+    index, names = generate_index(count, arch, rng)
+    write(os.path.join(data_dir, "index.json"), json.dumps(index))
+
+    # Resolve the most recent packages: the deepest dependency chains
+    write(os.path.join(data_dir, "targets.txt"), "\n".join(names[-TARGETS:]) + "\n")
+    write(os.path.join(data_dir, "queries.txt"), "\n".join(QUERIES) + "\n")
+
+    for n in rng.sample(names, min(TEMPLATES, count)):
+        write(os.path.join(data_dir, "templates", n), generate_template(n, index["packages"][n], rng))
+    for n in rng.sample(names, min(DIFFS, count)):
+        old = generate_template(n, index["packages"][n], rng)
+        write(os.path.join(data_dir, "diffs", f"{n}.old"), old)
+        write(os.path.join(data_dir, "diffs", f"{n}.new"), mutate_template(old, rng))
+    return index, names
+
+
+def make_sandbox(root, index, names, latency):
+    """Sandbox for vuru: shims first on PATH, a served index, an empty rootdir."""
+    for d in ("home", "cache", "tmp", "root", "www/vup"):
+        os.makedirs(os.path.join(root, d), exist_ok=True)
+    write(os.path.join(root, "www/vup/index.json"), json.dumps(index))
+
+    # Installed: a tenth of the VUP packages, each one version behind
+    installed = []
+    for n in names[:: 10]:
+        installed.append(f"ii {n}-0.0.1_1 {index['packages'][n]['short_desc']}")
+    write(os.path.join(root, "installed.txt"), "\n".join(installed) + "\n")
+    write(os.path.join(root, "manual.txt"), "\n".join(f"{n}-0.0.1_1" for n in names[:: 20]) + "\n")
+
+    env = dict(os.environ)
+    env.update({
+        "HOME": os.path.join(root, "home"),
+        "XDG_CACHE_HOME": os.path.join(root, "cache"),
+        "TMPDIR": os.path.join(root, "tmp"),
+        "VURU_NO_DAEMON": "1",
+        "BENCH_ROOT": root,
+        "BENCH_LATENCY": str(latency),
+        "PATH": SHIMS_DIR + os.pathsep + env.get("PATH", ""),
+    })
+    return env
+
+
+def summarize(name, packages, samples):
+    samples = sorted(samples)
+    p95 = samples[min(len(samples) - 1, max(0, int(0.95 * len(samples) + 0.5) - 1))]
+    return {
+        "bench": name,
+        "packages": packages,
+        "iterations": len(samples),
+        "median_ms": round(statistics.median(samples), 3),
+        "p95_ms": round(p95, 3),
+    }
+
+
+def run_micro(bench_bin, data_dir, iterations, env):
+    out = subprocess.run(
+        [bench_bin, data_dir, str(iterations)],
+        env=env, check=True, capture_output=True, text=True,
+    ).stdout
+    return [json.loads(line) for line in out.splitlines() if line.startswith("{")]
+
+
+def run_update(vuru, env, root, packages, iterations):
+    """Time `vuru update` with a cold cache first, then revalidating (304)."""
+    cmd = [vuru, "-y", "-n", "-r", os.path.join(root, "root"), "update"]
+    results = []
+    for name, cold in (("update_cold", True), ("update_warm", False)):
+        samples = []
+        for _ in range(iterations):
+            if cold:
+                shutil.rmtree(env["XDG_CACHE_HOME"], ignore_errors=True)
+                os.makedirs(env["XDG_CACHE_HOME"])
+            start = time.perf_counter()
+            proc = subprocess.run(cmd, env=env, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+            samples.append((time.perf_counter() - start) * 1000)
+            if proc.returncode != 0:
+                print(f"warning: {' '.join(cmd)} exited with {proc.returncode}", file=sys.stderr)
+                sys.stderr.write(proc.stderr.decode(errors="replace")[-2000:])
+                break
+        results.append(summarize(name, packages, samples))
+    return results
+
+
+def compare(results, baseline_path, threshold):
+    """Print median changes against a baseline; returns the regressions."""
+    with open(baseline_path) as f:
+        baseline = {(r["bench"], r["packages"]): r for r in json.load(f)["results"]}
+
+    regressions = []
+    for r in results:
+        base = baseline.get((r["bench"], r["packages"]))
+        if not base or base["median_ms"] <= 0:
+            continue
+        change = (r["median_ms"] - base["median_ms"]) / base["median_ms"]
+        mark = ""
+        if change > threshold:
+            mark = "  REGRESSION"
+            regressions.append(r)
+        print(f"{r['bench']:<16} {r['packages']:>6}  {base['median_ms']:>10.3f} -> "
+              f"{r['median_ms']:>10.3f} ms  {change:+.1%}{mark}")
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Run the vuru benchmark suite")
+    parser.add_argument("--vuru", default="build/vuru", help="vuru binary")
+    parser.add_argument("--bench-bin", default="build/vuru-bench", help="vuru-bench binary")
+    parser.add_argument("--sizes", default="1000,10000,50000",
+                        help="comma-separated index sizes (packages)")
+    parser.add_argument("--iterations", type=int, default=20, help="micro-benchmark iterations")
+    parser.add_argument("--e2e-iterations", type=int, default=5, help="vuru update runs per size")
+    parser.add_argument("--latency", type=float, default=0.0,
+                        help="seconds each shimmed tool sleeps (curl: per parallel round)")
+    parser.add_argument("--seed", type=int, default=1, help="data generator seed")
+    parser.add_argument("--output", help="write results as JSON to this file")
+    parser.add_argument("--baseline", help="compare medians against an earlier --output")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="median slowdown counted as a regression (default 0.10)")
+    parser.add_argument("--keep", action="store_true", help="keep the generated data")
+    args = parser.parse_args()
+
+    arch = xbps_arch()
+    work = tempfile.mkdtemp(prefix="vuru-bench-")
+    results = []
+    try:
+        for count in (int(s) for s in args.sizes.split(",") if s):
+            print(f"== {count} packages", file=sys.stderr)
+            data_dir = os.path.join(work, f"data-{count}")
+            index, names = generate_data(data_dir, count, arch, args.seed)
+
+            # The micro-benchmarks run in the sandbox too: resolve_deps asks
+            # xbps-query for dependencies outside the index
+            root = os.path.join(work, f"sandbox-{count}")
+            env = make_sandbox(root, index, names, args.latency)
+
+            for r in run_micro(args.bench_bin, data_dir, args.iterations, env):
+                results.append(r)
+                print(f"{r['bench']:<16} median {r['median_ms']:>10.3f} ms  p95 {r['p95_ms']:>10.3f} ms  "
+                      f"{r['allocs']} allocs", file=sys.stderr)
+
+            if args.e2e_iterations > 0:
+                for r in run_update(args.vuru, env, root, count, args.e2e_iterations):
+                    results.append(r)
+                    print(f"{r['bench']:<16} median {r['median_ms']:>10.3f} ms  p95 {r['p95_ms']:>10.3f} ms",
+                          file=sys.stderr)
+    finally:
+        if args.keep:
+            print(f"Data kept in {work}", file=sys.stderr)
+        else:
+            shutil.rmtree(work, ignore_errors=True)
+
+    report = {
+        "arch": arch,
+        "latency": args.latency,
+        "seed": args.seed,
+        "results": results,
+    }
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(report, f, indent=2)
+            f.write("\n")
+    else:
+        json.dump(report, sys.stdout, indent=2)
+        print()
+
+    if args.baseline and compare(results, args.baseline, args.threshold):
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
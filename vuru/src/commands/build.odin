@@ -7,9 +7,11 @@ import utils "../utils"
 import "core:fmt"
 
 // Build command implementation
+// Builds the packages and every VUP dependency without a prebuilt binary, in
+// dependency order, independent ones concurrently (-j).
 build_run :: proc(args: []string, config: ^Config) -> int {
 	if len(args) == 0 {
-		fmt.println("Usage: vuru build <package> [packages...]")
+		fmt.println("Usage: vuru build [-j <jobs>] <package> [packages...]")
 		return 1
 	}
 
@@ -28,27 +30,45 @@ build_run :: proc(args: []string, config: ^Config) -> int {
 
 	exit_code := 0
 
+	targets := make([dynamic]string, context.temp_allocator)
 	for pkg_name in args {
-		pkg, ok := index.index_get_package(&idx, pkg_name)
-		if !ok {
+		if !index.index_has_package(&idx, pkg_name) {
 			errors.log_error("Package '%s' not found in VUP index", pkg_name)
 			exit_code = 1
 			continue
 		}
+		append(&targets, pkg_name)
+	}
+	if len(targets) == 0 {
+		return 1
+	}
 
-		if !builder.build_package(&cfg, pkg_name, pkg.category) {
-			exit_code = 1
-		} else {
-			errors.log_info("Successfully built %s", pkg_name)
-
-			// Show where the package is
-			if path, path_ok := builder.get_built_package_path(
-				&cfg,
-				pkg_name,
-				context.temp_allocator,
-			); path_ok {
-				errors.log_info("Package file: %s", path)
-			}
+	srcpkgs := utils.path_join(cfg.vup_dir, "srcpkgs", allocator = context.temp_allocator)
+	plan, plan_err := builder.build_plan_make(&idx, targets[:], srcpkgs, true, config.force_build)
+	if plan_err.kind != nil {
+		errors.print_error(plan_err)
+		return 1
+	}
+	builder.build_plan_print(&plan)
+
+	if config.dry_run {
+		return exit_code
+	}
+
+	if !builder.build_plan_run(&cfg, &plan, &idx, config.jobs) {
+		return 1
+	}
+
+	for pkg_name in targets {
+		errors.log_info("Successfully built %s", pkg_name)
+
+		// Show where the package is
+		if path, path_ok := builder.get_built_package_path(
+			&cfg,
+			pkg_name,
+			context.temp_allocator,
+		); path_ok {
+			errors.log_info("Package file: %s", path)
 		}
 	}
 
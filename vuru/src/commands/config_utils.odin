@@ -20,4 +20,10 @@ config_free :: proc(c: ^Config) {
 	if len(c.rootdir) > 0 {
 		delete(c.rootdir, c.allocator)
 	}
+	if len(c.rootdirs) > 0 {
+		delete(c.rootdirs, c.allocator)
+	}
+	if len(c.category) > 0 {
+		delete(c.category, c.allocator)
+	}
 }
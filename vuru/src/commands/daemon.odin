@@ -0,0 +1,334 @@
+package commands
+
+import "core:fmt"
+import "core:mem/virtual"
+import "core:slice"
+import "core:strings"
+import "core:sys/linux"
+import "core:time"
+
+import config "../core/config"
+import daemon "../core/daemon"
+import errors "../core/errors"
+import index "../core/index"
+import resolve "../core/resolve"
+import search "../core/search"
+import xbps "../core/xbps"
+
+// Quiet period after a change to the inputs before the daemon reloads
+DAEMON_RELOAD_DELAY :: 500 * time.Millisecond
+
+// How often an idle daemon checks whether the index is past its TTL
+DAEMON_REVALIDATE_INTERVAL :: 5 * time.Minute
+
+// Fields per search result record on the wire
+SEARCH_RECORD_FIELDS :: 6
+
+// Resident state, rebuilt as a whole when its inputs change
+@(private)
+Daemon_State :: struct {
+	arena:   virtual.Arena, // Owns everything below
+	index:   ^index.Index,
+	sources: resolve.Sources, // Installed snapshot
+	search:  search.Search_Index,
+	watch:   linux.Fd,
+}
+
+// Daemon command implementation (vuru daemon, or vuru installed as vurud).
+// Runs in the foreground until killed; manages its own memory instead of the
+// per-command arena.
+daemon_run :: proc(args: []string, config: ^Config) -> int {
+	if len(config.rootdir) > 0 {
+		errors.log_error("The daemon serves the host system only (--rootdir is not supported)")
+		return 1
+	}
+
+	path, path_ok := daemon.daemon_socket_path(context.allocator)
+	if !path_ok {
+		errors.log_error("Could not determine the daemon socket path")
+		return 1
+	}
+	defer delete(path)
+
+	listen_fd, listen_ok := daemon.daemon_listen(path)
+	if !listen_ok {
+		errors.log_error("Could not listen on %s (is vurud already running?)", path)
+		return 1
+	}
+	defer daemon.daemon_close(listen_fd, path)
+
+	state := daemon_state_load(config.index_url)
+	if state == nil {
+		errors.log_error("Failed to load package index")
+		return 1
+	}
+	defer daemon_state_free(state)
+	errors.log_info("vurud: %d packages, listening on %s", index.index_count(state.index), path)
+
+	dirty := false
+	changed_at: time.Tick
+	last_revalidate := time.tick_now()
+
+	for {
+		free_all(context.temp_allocator)
+
+		// Reap detached index refreshes
+		for {
+			pid, _ := linux.waitpid(-1, nil, {.WNOHANG}, nil)
+			if pid <= 0 do break
+		}
+
+		if dirty && time.tick_since(changed_at) >= DAEMON_RELOAD_DELAY {
+			dirty = false
+			if next := daemon_state_load(config.index_url); next != nil {
+				daemon_state_free(state)
+				state = next
+			} else {
+				errors.log_warning("vurud: reload failed, serving the previous state")
+			}
+		}
+
+		if time.tick_since(last_revalidate) >= DAEMON_REVALIDATE_INTERVAL {
+			last_revalidate = time.tick_now()
+			index.index_revalidate_if_stale(config.index_url)
+		}
+
+		timeout := DAEMON_REVALIDATE_INTERVAL if !dirty else DAEMON_RELOAD_DELAY
+		fds := [2]linux.Poll_Fd{{fd = listen_fd, events = {.IN}}, {fd = state.watch, events = {.IN}}}
+		ready, poll_err := linux.poll(fds[:], i32(time.duration_milliseconds(timeout)))
+		if poll_err == .EINTR || ready == 0 {
+			continue
+		}
+		if poll_err != nil {
+			errors.log_error("vurud: poll failed: %v", poll_err)
+			return 1
+		}
+
+		if .IN in fds[1].revents && daemon.watcher_drain(state.watch, daemon_input_changed) {
+			if !dirty {
+				changed_at = time.tick_now()
+			}
+			dirty = true
+		}
+
+		if .IN in fds[0].revents {
+			if conn, req, ok := daemon.daemon_accept(listen_fd); ok {
+				daemon.daemon_respond(conn, daemon_handle(state, req, config.index_url))
+			}
+		}
+	}
+}
+
+// Load the resident state; nil if the index can't be loaded
+@(private)
+daemon_state_load :: proc(index_url: string) -> ^Daemon_State {
+	s := new(Daemon_State)
+	if virtual.arena_init_growing(&s.arena) != nil {
+		free(s)
+		return nil
+	}
+	heap := context.allocator
+	context.allocator = virtual.arena_allocator(&s.arena)
+	defer free_all(context.temp_allocator)
+
+	idx, ok := index.index_load_or_fetch(index_url, false, context.allocator)
+	if !ok {
+		virtual.arena_destroy(&s.arena)
+		free(s, heap)
+		return nil
+	}
+	s.index = new_clone(idx)
+	s.sources = resolve.sources_load(s.index, "", load_official = false, allocator = context.allocator)
+	s.search = search_index_open(s.index, "", full_corpus = true, allocator = context.allocator)
+
+	watch_ok: bool
+	s.watch, watch_ok = daemon.watcher_open(daemon_watch_dirs())
+	if !watch_ok {
+		errors.log_warning("vurud: could not watch for changes, the index will not be reloaded")
+	}
+	return s
+}
+
+// Free the resident state
+@(private)
+daemon_state_free :: proc(s: ^Daemon_State) {
+	if s.watch >= 0 {
+		linux.close(s.watch)
+	}
+	index.index_free(s.index) // Unmaps the binary index
+	virtual.arena_destroy(&s.arena)
+	free(s)
+}
+
+// Directories holding the inputs of the resident state
+@(private)
+daemon_watch_dirs :: proc() -> []string {
+	dirs := make([dynamic]string, context.temp_allocator)
+
+	if cache_dir, ok := config.get_cache_dir(context.temp_allocator); ok {
+		append(&dirs, cache_dir, strings.concatenate({cache_dir, "/shards"}, context.temp_allocator))
+	}
+	append(&dirs, xbps.rootdir_path("", xbps.PKGDB_DIR))
+
+	if arch, ok := config.get_arch(); ok {
+		for file in xbps.repodata_files("", arch) {
+			if slash := strings.last_index_byte(file, '/'); slash > 0 && !slice.contains(dirs[:], file[:slash]) {
+				append(&dirs, file[:slash])
+			}
+		}
+	}
+
+	return dirs[:]
+}
+
+// Whether a changed file name is an input of the resident state
+@(private)
+daemon_input_changed :: proc(name: string) -> bool {
+	// Downloads in progress
+	if strings.contains(name, ".tmp") {
+		return false
+	}
+	if strings.has_prefix(name, "pkgdb-") && strings.has_suffix(name, ".plist") {
+		return true
+	}
+	return(
+		strings.has_suffix(name, ".json") ||
+		strings.has_suffix(name, ".bin") ||
+		strings.has_suffix(name, "-repodata") \
+	)
+}
+
+// Answer one request from the resident state
+@(private)
+daemon_handle :: proc(s: ^Daemon_State, req: daemon.Request, index_url: string) -> daemon.Response {
+	if req.index_url != index_url {
+		return {status = .Mismatch}
+	}
+
+	fields := make([dynamic]string, context.temp_allocator)
+
+	switch req.op {
+	case .Ping:
+	case .Search:
+		if len(req.args) < 2 {
+			return {status = .Error}
+		}
+		categories: []string
+		if len(req.args[1]) > 0 {
+			categories = strings.split(req.args[1], ",", context.temp_allocator)
+		}
+		vup_only := .Vup_Only in req.flags || categories != nil
+
+		vup_results, official_results := collect_search_results(
+			&s.search,
+			&s.sources,
+			req.args[0],
+			vup_only,
+			.Desc in req.flags,
+			categories,
+		)
+		search_results_encode(&fields, vup_results[:])
+		search_results_encode(&fields, official_results[:])
+	case .Info:
+		if len(req.args) < 1 {
+			return {status = .Error}
+		}
+		pkg, found := index.index_get_package(s.index, req.args[0])
+		if !found {
+			return {status = .Not_Found}
+		}
+		package_info_encode(&fields, pkg)
+	case .List:
+		append(&fields, ..installed_pkgvers(&s.sources.installed))
+	case .Outdated:
+		for pkg in outdated_packages(s.index, &s.sources.installed) {
+			append(&fields, pkg.name, pkg.installed, pkg.available)
+		}
+	}
+
+	return {status = .Ok, fields = fields[:]}
+}
+
+// Run searches through the daemon; false if it is not available
+search_via_daemon :: proc(queries: []string, config: ^Config, vup_only: bool) -> bool {
+	flags: daemon.Flags
+	if config.description_search do flags += {.Desc}
+	if vup_only do flags += {.Vup_Only}
+
+	// Ask for everything first so a failure falls back before anything is printed
+	responses := make([]daemon.Response, len(queries), context.temp_allocator)
+	for query, i in queries {
+		resp, ok := daemon.daemon_call(.Search, flags, config.index_url, {query, config.category})
+		if !ok {
+			return false
+		}
+		responses[i] = resp
+	}
+
+	for resp, i in responses {
+		if i > 0 {fmt.println()}
+		vup_results, official_results := search_results_decode(resp.fields)
+		show_search_results(queries[i], vup_results[:], official_results[:])
+	}
+	return true
+}
+
+// Encode search results as records of SEARCH_RECORD_FIELDS fields
+@(private)
+search_results_encode :: proc(fields: ^[dynamic]string, results: []Search_Result) {
+	for r in results {
+		append(fields, r.source, r.name, r.version, r.category, "1" if r.installed else "", r.desc)
+	}
+}
+
+@(private)
+search_results_decode :: proc(
+	fields: []string,
+) -> (
+	vup_results: [dynamic]Search_Result,
+	official_results: [dynamic]Search_Result,
+) {
+	vup_results = make([dynamic]Search_Result, context.temp_allocator)
+	official_results = make([dynamic]Search_Result, context.temp_allocator)
+
+	for i := 0; i + SEARCH_RECORD_FIELDS <= len(fields); i += SEARCH_RECORD_FIELDS {
+		f := fields[i:][:SEARCH_RECORD_FIELDS]
+		r := Search_Result {
+			source    = f[0],
+			name      = f[1],
+			version   = f[2],
+			category  = f[3],
+			installed = len(f[4]) > 0,
+			desc      = f[5],
+		}
+		if r.source == "vup" {
+			append(&vup_results, r)
+		} else {
+			append(&official_results, r)
+		}
+	}
+	return vup_results, official_results
+}
+
+// Encode the fields of a package shown by vuru query (architectures last)
+@(private)
+package_info_encode :: proc(fields: ^[dynamic]string, pkg: index.Package_Info) {
+	append(fields, pkg.version, pkg.category, pkg.short_desc)
+	for arch in pkg.repo_urls {
+		append(fields, arch)
+	}
+}
+
+// Decode a package from an Info response (repo_urls only carries the architectures)
+package_info_decode :: proc(fields: []string) -> index.Package_Info {
+	pkg := index.Package_Info {
+		version    = fields[0],
+		category   = fields[1],
+		short_desc = fields[2],
+		repo_urls  = make(map[string]string, len(fields) - 3, context.temp_allocator),
+	}
+	for arch in fields[3:] {
+		pkg.repo_urls[arch] = ""
+	}
+	return pkg
+}
@@ -1,9 +1,12 @@
 package commands
 
-import utils "../utils"
 import "core:fmt"
+import "core:strings"
 
-// Fetch command - wrapper around xbps-fetch
+import errors "../core/errors"
+import net "../core/net"
+
+// Fetch command - downloads every URL into the current directory at once
 fetch_run :: proc(args: []string, config: ^Config) -> int {
 	if len(args) == 0 {
 		fmt.println("Usage: vuru fetch <url> [urls...]")
@@ -11,16 +14,58 @@ fetch_run :: proc(args: []string, config: ^Config) -> int {
 		return 1
 	}
 
-	cmd := make([dynamic]string, context.temp_allocator)
-	append(&cmd, "xbps-fetch")
+	reqs := make([]net.Request, len(args), context.temp_allocator)
+	for url, i in args {
+		name := fetch_file_name(url)
+		if len(name) == 0 {
+			errors.log_error("Can't derive a file name from %s", url)
+			return 1
+		}
+		reqs[i] = net.Request {
+			url  = url,
+			dest = name,
+		}
+	}
+
+	batch := net.batch_start(reqs)
+	failed := 0
+	for {
+		i, ok := net.batch_next(&batch)
+		if !ok {
+			break
+		}
 
-	if config.verbose {
-		append(&cmd, "-v")
+		res := batch.results[i]
+		if res.status != .Ok {
+			errors.log_error("Failed to fetch %s (HTTP %d)", args[i], res.http_code)
+			failed += 1
+		} else if config.verbose {
+			errors.log_info("%s: done", reqs[i].dest)
+		}
 	}
 
-	for url in args {
-		append(&cmd, url)
+	return 0 if failed == 0 else 1
+}
+
+// Last path component of a URL, without query or fragment
+@(private)
+fetch_file_name :: proc(url: string) -> string {
+	path := url
+	if end := strings.index_any(path, "?#"); end >= 0 {
+		path = path[:end]
+	}
+	if scheme := strings.index(path, "://"); scheme >= 0 {
+		path = path[scheme + 3:]
+		if slash := strings.index_byte(path, '/'); slash >= 0 {
+			path = path[slash:]
+		} else {
+			return "" // Host only
+		}
 	}
 
-	return utils.run_command(cmd[:])
+	name := path[strings.last_index_byte(path, '/') + 1:]
+	if name == "." || name == ".." {
+		return ""
+	}
+	return name
 }
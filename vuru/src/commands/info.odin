@@ -48,6 +48,7 @@ info_run :: proc(args: []string, config: ^Config) -> int {
 				pkg.category,
 				pkg_name,
 				context.temp_allocator,
+				pkg.template_hash,
 			); tmpl_ok {
 				if len(tmpl.depends) > 0 {
 					fmt.printf(
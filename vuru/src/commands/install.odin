@@ -1,9 +1,11 @@
 package commands
 
 import "core:fmt"
+import "core:slice"
 import "core:strings"
 
 import builder "../core/builder"
+import config "../core/config"
 import errors "../core/errors"
 import index "../core/index"
 import resolve "../core/resolve"
@@ -41,43 +43,29 @@ install_run :: proc(args: []string, config: ^Config) -> int {
 		return 1
 	}
 
-	// Resolve dependencies for all packages at once
-	res, res_ok := resolve.resolve_deps(args, &idx, config.force_build)
-	if !res_ok {
-		if len(res.errors) > 0 {
-			for err in res.errors {
-				errors.print_error(err)
-			}
-		} else {
-			errors.log_error("Failed to resolve dependencies")
-		}
-		return 1
+	if len(config.rootdirs) > 0 {
+		return install_batch(args, &idx, config)
 	}
 
-	// Check for missing packages
-	if len(res.missing) > 0 {
-		if len(res.errors) > 0 {
-			for err in res.errors {
-				errors.print_error(err)
-			}
-		} else {
-			errors.log_error(
-				"Cannot resolve: %s",
-				strings.join(res.missing[:], ", ", context.temp_allocator),
-			)
-		}
+	// Installed snapshot and official repodata, shared by the whole resolution
+	sources := resolve.sources_load(&idx, config.rootdir)
+
+	// Resolve dependencies for all packages at once
+	res, res_ok := resolve.resolve_deps(args, &sources, config.force_build)
+	if !resolution_check(&res, res_ok) {
 		return 1
 	}
 
+	// Create transaction
+	tx := transaction.transaction_from_resolution(&res, &sources)
+
 	// Dry run - just show what would happen
 	if config.dry_run {
 		resolve.resolution_print(&res)
+		transaction.transaction_print_download(&tx, config.rootdir)
 		return 0
 	}
 
-	// Create transaction
-	tx := transaction.transaction_from_resolution(&res)
-
 	transaction.transaction_print(&tx)
 
 	// Confirm unless -y
@@ -87,57 +75,191 @@ install_run :: proc(args: []string, config: ^Config) -> int {
 	}
 
 	// Get build config if needed
-	build_cfg: builder.Build_Config
-	has_build := false
-	for item in tx.items {
-		if item.op == .Build_Install {
-			has_build = true
-			break
-		}
+	build_cfg, cfg_ok := install_build_config(&tx)
+	if !cfg_ok {
+		return 1
 	}
 
-	if has_build {
-		cfg_result, cfg_ok := builder.default_build_config()
-		if !cfg_ok {
-			errors.log_error("VUP repository not found. Run 'vuru clone' first.")
+	// Execute
+	if !transaction.transaction_execute(&tx, &build_cfg, &idx, config.rootdir, config.yes, config.jobs) {
+		return 1
+	}
+
+	return 0
+}
+
+// Install into every rootdir of --rootdirs. Rootdirs in the same installed
+// state are resolved once together (against the first of them); the
+// resulting transactions are then executed as one batch.
+@(private)
+install_batch :: proc(args: []string, idx: ^index.Index, config: ^Config) -> int {
+	rootdirs, list_ok := rootdir_list(config.rootdirs)
+	if !list_ok {
+		return 1
+	}
+	members, group_ok := rootdir_groups(rootdirs)
+	if !group_ok {
+		return 1
+	}
+	errors.log_info("%d rootdir(s) in %d distinct state(s)", len(rootdirs), len(members))
+
+	groups := make([]transaction.Batch_Group, len(members), context.temp_allocator)
+	for m, i in members {
+		sources := resolve.sources_load(idx, m[0])
+		res, res_ok := resolve.resolve_deps(args, &sources, config.force_build)
+		if !resolution_check(&res, res_ok) {
+			errors.log_error("Could not resolve for %s", strings.join(m, ", ", context.temp_allocator))
 			return 1
 		}
-		build_cfg = cfg_result
+		groups[i] = transaction.Batch_Group {
+			rootdirs = m,
+			tx       = transaction.transaction_from_resolution(&res, &sources),
+		}
 	}
 
-	// Execute
-	if !transaction.transaction_execute(&tx, &build_cfg, config.yes) {
+	for &g in groups {
+		fmt.printf("\n%s:\n", strings.join(g.rootdirs, ", ", context.temp_allocator))
+		transaction.transaction_print(&g.tx)
+	}
+
+	merged := transaction.transaction_merge(groups)
+	if config.dry_run {
+		transaction.transaction_print_download(&merged, "")
+		return 0
+	}
+
+	// Confirm unless -y
+	if !config.yes && !transaction.transaction_confirm(&merged) {
+		errors.log_info("Installation cancelled")
+		return 0
+	}
+
+	build_cfg, cfg_ok := install_build_config(&merged)
+	if !cfg_ok {
+		return 1
+	}
+
+	if !transaction.transaction_execute_batch(groups, &build_cfg, idx, config.jobs) {
 		return 1
 	}
 
 	return 0
 }
 
-// System upgrade (xbps-install -u)
-install_update :: proc(config: ^Config) -> int {
-	cmd: [dynamic; 16]string
-	append(&cmd, "sudo", "xbps-install", "-u")
+// Rootdirs of a --rootdirs value: comma-separated, or "@file" with one per
+// line (blank lines and #-comments ignored), duplicates dropped
+@(private)
+rootdir_list :: proc(spec: string) -> ([]string, bool) {
+	entries: []string
+	if strings.has_prefix(spec, "@") {
+		content, ok := utils.read_file(spec[1:], context.temp_allocator)
+		if !ok {
+			errors.log_error("Cannot read rootdir list %s", spec[1:])
+			return nil, false
+		}
+		entries, _ = strings.split_lines(content, context.temp_allocator)
+	} else {
+		entries = strings.split(spec, ",", context.temp_allocator)
+	}
 
-	if config.dry_run {
-		append(&cmd, "-n")
+	rootdirs := make([dynamic]string, context.temp_allocator)
+	for entry in entries {
+		rootdir := entry
+		if hash := strings.index_byte(rootdir, '#'); hash >= 0 {
+			rootdir = rootdir[:hash]
+		}
+		rootdir = strings.trim_space(rootdir)
+		if len(rootdir) > 0 && !slice.contains(rootdirs[:], rootdir) {
+			append(&rootdirs, rootdir)
+		}
 	}
-	if config.yes {
-		append(&cmd, "-y")
+	if len(rootdirs) == 0 {
+		errors.log_error("--rootdirs: no rootdirs given")
+		return nil, false
 	}
-	if config.verbose {
-		append(&cmd, "-v")
+	return rootdirs[:], true
+}
+
+// Rootdirs grouped by installed state (xbps.state_fingerprint), in order of
+// first appearance
+@(private)
+rootdir_groups :: proc(rootdirs: []string) -> ([][]string, bool) {
+	arch, arch_ok := config.get_arch()
+	if !arch_ok {
+		errors.print_error(errors.make_error(.Arch_Detection_Failed))
+		return nil, false
 	}
-	if len(config.rootdir) > 0 {
-		append(&cmd, "-r", config.rootdir)
+
+	members := make([dynamic][dynamic]string, context.temp_allocator)
+	by_state := make(map[u64]int, allocator = context.temp_allocator)
+	for rootdir in rootdirs {
+		state := xbps.state_fingerprint(rootdir, arch)
+		g, found := by_state[state]
+		if !found {
+			g = len(members)
+			by_state[state] = g
+			append(&members, make([dynamic]string, context.temp_allocator))
+		}
+		append(&members[g], rootdir)
 	}
 
-	errors.log_info("Updating system packages...")
-	sys_ret := utils.run_command(cmd[:])
+	groups := make([][]string, len(members), context.temp_allocator)
+	for m, i in members {
+		groups[i] = m[:]
+	}
+	return groups, true
+}
+
+// Print the errors of a failed resolution; false if it failed
+@(private)
+resolution_check :: proc(res: ^resolve.Resolution, ok: bool) -> bool {
+	if !ok {
+		if len(res.errors) > 0 {
+			for err in res.errors {
+				errors.print_error(err)
+			}
+		} else {
+			errors.log_error("Failed to resolve dependencies")
+		}
+		return false
+	}
+
+	// Check for missing packages
+	if len(res.missing) > 0 {
+		if len(res.errors) > 0 {
+			for err in res.errors {
+				errors.print_error(err)
+			}
+		} else {
+			errors.log_error(
+				"Cannot resolve: %s",
+				strings.join(res.missing[:], ", ", context.temp_allocator),
+			)
+		}
+		return false
+	}
+	return true
+}
 
-	if sys_ret != 0 {
-		return sys_ret
+// Build config, loaded only when the transaction builds from source
+@(private)
+install_build_config :: proc(tx: ^transaction.Transaction) -> (builder.Build_Config, bool) {
+	for item in tx.items {
+		if item.op != .Build_Install {
+			continue
+		}
+		cfg, ok := builder.default_build_config()
+		if !ok {
+			errors.log_error("VUP repository not found. Run 'vuru clone' first.")
+			return {}, false
+		}
+		return cfg, true
 	}
+	return {}, true
+}
 
-	// Also update VUP packages
+// System upgrade (xbps-install -u): official and VUP packages in one transaction
+install_update :: proc(config: ^Config) -> int {
+	errors.log_info("Updating system packages...")
 	return update_run(nil, config)
 }
@@ -1,8 +1,10 @@
 package commands
 
 import "core:fmt"
+import "core:slice"
 import "core:strings"
 
+import daemon "../core/daemon"
 import errors "../core/errors"
 import index "../core/index"
 import resolve "../core/resolve"
@@ -17,6 +19,11 @@ query_run :: proc(args: []string, config: ^Config) -> int {
 		return query_list(config)
 	}
 
+	// Mode: VUP packages with a newer version (--outdated)
+	if config.outdated {
+		return query_outdated(config)
+	}
+
 	// Mode: find file owner (--ownedby)
 	if config.ownedby && len(args) > 0 {
 		return query_ownedby(args[0], config)
@@ -45,17 +52,102 @@ query_run :: proc(args: []string, config: ^Config) -> int {
 
 // List installed packages (xbps-query -l)
 query_list :: proc(config: ^Config) -> int {
-	list, ok := xbps.list_installed(utils.run_command_output, context.temp_allocator)
+	if len(config.rootdir) == 0 {
+		if resp, ok := daemon.daemon_call(.List, {}, config.index_url, nil); ok {
+			for pkgver in resp.fields {
+				fmt.println(pkgver)
+			}
+			return 0
+		}
+	}
+
+	db, ok := xbps.pkgdb_load(config.rootdir, context.temp_allocator)
 	if !ok {
 		return 1
 	}
 
-	for item in list {
-		fmt.printf("%s-%s\n", item[0], item[1])
+	for pkgver in installed_pkgvers(&db) {
+		fmt.println(pkgver)
 	}
 	return 0
 }
 
+// Installed pkgvers sorted by package name
+installed_pkgvers :: proc(db: ^xbps.Pkgdb, allocator := context.temp_allocator) -> []string {
+	names := make([dynamic]string, 0, len(db.packages), context.temp_allocator)
+	for name in db.packages {
+		append(&names, name)
+	}
+	slice.sort(names[:])
+
+	pkgvers := make([]string, len(names), allocator)
+	for name, i in names {
+		pkgvers[i] = db.packages[name].pkgver
+	}
+	return pkgvers
+}
+
+// Installed VUP package with a newer version in the index
+Outdated_Package :: struct {
+	name:      string,
+	installed: string,
+	available: string,
+}
+
+// List installed VUP packages that have updates (name installed -> available)
+query_outdated :: proc(config: ^Config) -> int {
+	if len(config.rootdir) == 0 {
+		if resp, ok := daemon.daemon_call(.Outdated, {}, config.index_url, nil); ok {
+			for i := 0; i + 2 < len(resp.fields); i += 3 {
+				fmt.printf("%s %s -> %s\n", resp.fields[i], resp.fields[i + 1], resp.fields[i + 2])
+			}
+			return 0
+		}
+	}
+
+	idx, ok := index.index_load_or_fetch(config.index_url, false)
+	if !ok {
+		errors.log_error("Failed to load package index")
+		return 1
+	}
+
+	db, db_ok := xbps.pkgdb_load(config.rootdir, context.temp_allocator)
+	if !db_ok {
+		return 1
+	}
+
+	for pkg in outdated_packages(&idx, &db) {
+		fmt.printf("%s %s -> %s\n", pkg.name, pkg.installed, pkg.available)
+	}
+	return 0
+}
+
+// Installed packages whose index version is newer, sorted by name
+outdated_packages :: proc(
+	idx: ^index.Index,
+	db: ^xbps.Pkgdb,
+	allocator := context.temp_allocator,
+) -> []Outdated_Package {
+	result := make([dynamic]Outdated_Package, allocator)
+	for name, installed in db.packages {
+		pkg, found := index.index_get_package(idx, name)
+		if !found || len(pkg.version) == 0 {
+			continue
+		}
+		if version_gt(pkg.version, installed.version) {
+			append(
+				&result,
+				Outdated_Package{name = name, installed = installed.version, available = pkg.version},
+			)
+		}
+	}
+
+	slice.sort_by(result[:], proc(a, b: Outdated_Package) -> bool {
+		return a.name < b.name
+	})
+	return result[:]
+}
+
 // Find package owning a file (xbps-query -o)
 query_ownedby :: proc(file: string, config: ^Config) -> int {
 	cmd: [dynamic; 8]string
@@ -91,21 +183,25 @@ query_deps :: proc(pkg: string, config: ^Config) -> int {
 
 // Show package info (default mode) - searches VUP first, then official
 query_info :: proc(args: []string, config: ^Config) -> int {
-	// Load VUP index
-	idx, ok := index.index_load_or_fetch(config.index_url, false)
-	if !ok {
-		errors.log_error("Failed to load package index")
-		return 1
-	}
+	// The index is only loaded when no daemon answers the lookups
+	idx: index.Index
+	have_index := false
 
 	for pkg_name in args {
+		pkg, found, lookup_ok := query_lookup(pkg_name, config, &idx, &have_index)
+		if !lookup_ok {
+			errors.log_error("Failed to load package index")
+			return 1
+		}
+
 		// Check VUP first
-		if pkg, found := index.index_get_package(&idx, pkg_name); found {
+		if found {
 			// Always fetch template for complete info
 			tmpl, tmpl_ok := resolve.fetch_and_parse_template(
 				pkg.category,
 				pkg_name,
 				context.temp_allocator,
+				pkg.template_hash,
 			)
 			if tmpl_ok {
 			}
@@ -185,6 +281,37 @@ query_info :: proc(args: []string, config: ^Config) -> int {
 	return 0
 }
 
+// Look up a VUP package through the daemon, loading the index on first need
+query_lookup :: proc(
+	name: string,
+	config: ^Config,
+	idx: ^index.Index,
+	have_index: ^bool,
+) -> (
+	pkg: index.Package_Info,
+	found: bool,
+	ok: bool,
+) {
+	if !have_index^ {
+		if resp, daemon_ok := daemon.daemon_call(.Info, {}, config.index_url, {name}); daemon_ok {
+			if resp.status == .Not_Found || len(resp.fields) < 3 {
+				return {}, false, true
+			}
+			return package_info_decode(resp.fields), true, true
+		}
+
+		loaded, load_ok := index.index_load_or_fetch(config.index_url, false)
+		if !load_ok {
+			return {}, false, false
+		}
+		idx^ = loaded
+		have_index^ = true
+	}
+
+	pkg, found = index.index_get_package(idx, name)
+	return pkg, found, true
+}
+
 // Print help for query command
 query_help :: proc() {
 	fmt.println("Usage: vuru query [options] <package>")
@@ -195,6 +322,7 @@ query_help :: proc() {
 	fmt.println("  -f, --files     Show package files")
 	fmt.println("  -x, --deps      Show dependencies")
 	fmt.println("  --ownedby       Find package owning a file")
+	fmt.println("  --outdated      List VUP packages with updates")
 	fmt.println()
 	fmt.println("Options:")
 	fmt.println("  -R, --recursive Show full dependency tree")
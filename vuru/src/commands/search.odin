@@ -2,10 +2,15 @@ package commands
 
 import "core:fmt"
 import "core:os"
+import "core:slice"
 import "core:strings"
 
+import config "../core/config"
 import errors "../core/errors"
 import index "../core/index"
+import resolve "../core/resolve"
+import search "../core/search"
+import xbps "../core/xbps"
 import utils "../utils"
 
 // Threshold for using pager
@@ -28,60 +33,112 @@ search_run :: proc(args: []string, config: ^Config) -> int {
 		return 1
 	}
 
+	// Category-scoped searches only need those shards and no official repodata
+	categories: []string
+	vup_only := config.vup_only
+	if len(config.category) > 0 {
+		categories = strings.split(config.category, ",", context.temp_allocator)
+		vup_only = true
+	}
+
+	// A running daemon answers from its resident state
+	if len(config.rootdir) == 0 && search_via_daemon(args, config, vup_only) {
+		return 0
+	}
+
 	// Load index
-	idx, ok := index.index_load_or_fetch(config.index_url, false)
+	idx, ok := index.index_load_or_fetch(config.index_url, false, categories = categories)
 	if !ok {
 		errors.log_error("Failed to load package index")
 		return 1
 	}
 
+	// Installed state and the search index are loaded once for all queries
+	sources := resolve.sources_load(&idx, config.rootdir, load_official = false)
+	si := search_index_open(&idx, config.rootdir, full_corpus = categories == nil && !vup_only)
+
 	for query, i in args {
 		if i > 0 {fmt.println()}
-		unified_search(&idx, query, config.vup_only, config.description_search)
+		unified_search(&si, &sources, query, vup_only, config.description_search, categories)
 	}
 
 	return 0
 }
 
-// Search VUP index for packages matching a query
-search_vup :: proc(
+// Open the persisted search index, rebuilding it when the cached VUP index or
+// the official repodata changed since it was written. A partial corpus
+// (category or VUP-only search) is indexed in memory and never persisted.
+search_index_open :: proc(
 	idx: ^index.Index,
-	query: string,
-	description_search: bool,
-) -> [dynamic]Search_Result {
-	results := make([dynamic]Search_Result, context.temp_allocator)
-	query_lower := strings.to_lower(query, context.temp_allocator)
+	rootdir: string,
+	full_corpus: bool,
+	allocator := context.temp_allocator,
+) -> search.Search_Index {
+	arch, arch_ok := config.get_arch()
+
+	files := make([dynamic]string, context.temp_allocator)
+	append(&files, ..index.index_cache_files())
+	if arch_ok {
+		append(&files, ..xbps.repodata_files(rootdir, arch))
+	}
+	fingerprint := search.corpus_fingerprint(files[:])
 
-	for name, pkg in idx.packages {
-		name_lower := strings.to_lower(name, context.temp_allocator)
-		desc_lower := strings.to_lower(pkg.short_desc, context.temp_allocator)
+	cache_dir, dir_ok := config.get_cache_dir(context.temp_allocator)
+	path := search.search_index_path(cache_dir) if dir_ok else ""
 
-		match_name := strings.contains(name_lower, query_lower)
-		match_desc := description_search && strings.contains(desc_lower, query_lower)
+	// The persisted index covers the whole corpus, so it serves partial searches too
+	if dir_ok {
+		if si, loaded := search.search_index_load(path, fingerprint, allocator); loaded {
+			return si
+		}
+	}
 
-		if match_name || match_desc {
-			installed := utils.run_command_silent({"xbps-query", name}) == 0
+	docs := make([dynamic]search.Search_Doc, context.temp_allocator)
+	for name in index.index_names(idx) {
+		pkg, _ := index.index_get_package(idx, name)
+		append(
+			&docs,
+			search.Search_Doc {
+				name = name,
+				desc = pkg.short_desc,
+				version = pkg.version,
+				category = pkg.category,
+				source = .VUP,
+			},
+		)
+	}
 
-			append(
-				&results,
-				Search_Result {
-					name = name,
-					version = pkg.version,
-					desc = pkg.short_desc,
-					source = "vup",
-					installed = installed,
-					category = pkg.category,
-				},
-			)
-		}
+	// Official indexes are large; the temp allocator can grow
+	official: xbps.Repodata
+	has_official := false
+	if full_corpus && arch_ok {
+		official, has_official = xbps.repodata_load(rootdir, arch, context.temp_allocator)
+	}
+	defer xbps.repodata_free(&official)
+
+	for name, pkg in official.packages {
+		append(
+			&docs,
+			search.Search_Doc {
+				name = name,
+				desc = pkg.short_desc,
+				version = pkg.version,
+				source = .Official,
+			},
+		)
 	}
 
-	return results
+	si := search.search_index_build(docs[:], fingerprint, has_official, allocator)
+	if full_corpus && dir_ok && !search.search_index_save(&si, path) {
+		errors.log_warning("Could not write search index: %s", path)
+	}
+	return si
 }
 
-// Search official Void repos
+// Search official Void repos with xbps-query (no cached repodata available)
 search_official :: proc(query: string, description_search: bool) -> [dynamic]Search_Result {
 	results := make([dynamic]Search_Result, context.temp_allocator)
+	query_lower := strings.to_lower(query, context.temp_allocator)
 
 	output, ok := utils.run_command_output({"xbps-query", "-Rs", query}, context.temp_allocator)
 	if !ok {
@@ -117,12 +174,8 @@ search_official :: proc(query: string, description_search: bool) -> [dynamic]Sea
 
 			// Filter by name if not searching descriptions
 			// xbps-query -Rs searches both, so we manually filter if needed
-			if !description_search {
-				name_lower := strings.to_lower(name, context.temp_allocator)
-				query_lower := strings.to_lower(query, context.temp_allocator)
-				if !strings.contains(name_lower, query_lower) {
-					continue
-				}
+			if !description_search && !utils.contains_fold(name, query_lower) {
+				continue
 			}
 
 			append(
@@ -221,18 +274,85 @@ format_search_results :: proc(
 
 // Unified search across VUP and official repos
 unified_search :: proc(
-	idx: ^index.Index,
+	si: ^search.Search_Index,
+	sources: ^resolve.Sources,
+	query: string,
+	vup_only: bool,
+	description_search: bool,
+	categories: []string = nil,
+) {
+	vup_results, official_results := collect_search_results(
+		si,
+		sources,
+		query,
+		vup_only,
+		description_search,
+		categories,
+	)
+	show_search_results(query, vup_results[:], official_results[:])
+}
+
+// Run a query against the search index, VUP and official results in rank order
+collect_search_results :: proc(
+	si: ^search.Search_Index,
+	sources: ^resolve.Sources,
 	query: string,
 	vup_only: bool,
 	description_search: bool,
+	categories: []string = nil,
+) -> (
+	vup_results: [dynamic]Search_Result,
+	official_results: [dynamic]Search_Result,
 ) {
-	vup_results := search_vup(idx, query, description_search)
+	vup_results = make([dynamic]Search_Result, context.temp_allocator)
+	official_results = make([dynamic]Search_Result, context.temp_allocator)
 
-	official_results: [dynamic]Search_Result
-	if !vup_only {
+	for hit in search.search_query(si, query, description_search) {
+		doc := search.search_index_doc(si, hit.doc)
+		installed := xbps.pkgdb_is_installed(&sources.installed, doc.name)
+
+		switch doc.source {
+		case .VUP:
+			if categories != nil && !slice.contains(categories, doc.category) {
+				continue
+			}
+			append(
+				&vup_results,
+				Search_Result {
+					name = doc.name,
+					version = doc.version,
+					desc = doc.desc,
+					source = "vup",
+					installed = installed,
+					category = doc.category,
+				},
+			)
+		case .Official:
+			if vup_only {
+				continue
+			}
+			append(
+				&official_results,
+				Search_Result {
+					name = doc.name,
+					version = doc.version,
+					desc = doc.desc,
+					source = "official",
+					installed = installed,
+				},
+			)
+		}
+	}
+
+	if !vup_only && !si.has_official {
 		official_results = search_official(query, description_search)
 	}
 
+	return vup_results, official_results
+}
+
+// Print search results, through the pager when there are many
+show_search_results :: proc(query: string, vup_results: []Search_Result, official_results: []Search_Result) {
 	total := len(vup_results) + len(official_results)
 
 	if total == 0 {
@@ -241,7 +361,7 @@ unified_search :: proc(
 	}
 
 	// Format results
-	output := format_search_results(vup_results[:], official_results[:], context.temp_allocator)
+	output := format_search_results(vup_results, official_results, context.temp_allocator)
 
 	// Use pager if more than threshold
 	if total > PAGER_THRESHOLD {
@@ -18,6 +18,7 @@ src_run :: proc(args: []string, config: ^Config) -> int {
 	src_cfg := builder.Config {
 		index_url = config.index_url,
 		repo_url  = "https://github.com/VUP-Linux/vup/releases/download", // TODO: Configurable?
+		jobs      = config.jobs,
 	}
 
 	ok, err := builder.xbps_src_main(args, &src_cfg)
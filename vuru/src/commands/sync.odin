@@ -2,6 +2,7 @@ package commands
 
 import errors "../core/errors"
 import index "../core/index"
+import template "../core/template"
 
 // Sync command implementation
 sync_run :: proc(args: []string, config: ^Config) -> int {
@@ -12,6 +13,23 @@ sync_run :: proc(args: []string, config: ^Config) -> int {
 		return 1
 	}
 
+	// Rebuild the search index now rather than on the next search
+	search_index_open(&idx, config.rootdir, full_corpus = true)
+
+	// All templates of the index's commit in one download, so later commands
+	// read them locally
+	if snap, url, has_snap := index.index_template_snapshot(config.index_url); has_snap {
+		archive := template.Snapshot_Archive {
+			commit = snap.commit,
+			url    = url,
+			sha256 = snap.file.sha256,
+			size   = snap.file.size,
+		}
+		if !template.snapshot_sync(archive) {
+			errors.log_warning("Template snapshot not updated, templates will be fetched individually")
+		}
+	}
+
 	errors.log_info("Package index synchronized")
 	return 0
 }
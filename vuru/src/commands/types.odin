@@ -9,6 +9,9 @@ Config :: struct {
 	vup_dir:            string,
 	arch:               string,
 	rootdir:            string, // -r, --rootdir
+	rootdirs:           string, // --rootdirs: comma-separated rootdirs, or @file with one per line
+	category:           string, // --category, comma-separated VUP categories
+	jobs:               int, // -j, --jobs: concurrent package builds (0: default)
 
 	// Runtime flags
 	yes:                bool, // -y, --yes
@@ -17,6 +20,7 @@ Config :: struct {
 	vup_only:           bool, // --vup-only
 	description_search: bool, // -d, --desc
 	verbose:            bool, // -v, --verbose
+	stats:              bool, // --stats
 
 	// XBPS-aligned flags
 	sync:               bool, // -S, sync repos
@@ -28,6 +32,7 @@ Config :: struct {
 	show_files:         bool, // -f, show files
 	show_deps:          bool, // -x, show deps
 	ownedby:            bool, // query: find file owner
+	outdated:           bool, // query: list VUP packages with updates
 
 	// Allocator for owned strings
 	allocator:          mem.Allocator,
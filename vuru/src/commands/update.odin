@@ -2,6 +2,7 @@ package commands
 
 import "core:fmt"
 import "core:os"
+import "core:slice"
 import "core:strings"
 
 import config "../core/config"
@@ -11,62 +12,58 @@ import template "../core/template"
 import xbps "../core/xbps"
 import utils "../utils"
 
-MAX_UPGRADES :: 64
-
 Upgrade_Info :: struct {
 	name:            string,
 	installed_ver:   string,
 	new_ver:         string,
 	repo_url:        string,
 	category:        string,
+	template_hash:   string, // Git blob hash of the new template (index)
 	new_template:    string,
 	cached_template: string,
 }
 
 // Update command implementation
+// Official and VUP packages are upgraded together, in one xbps transaction.
 update_run :: proc(args: []string, config: ^Config) -> int {
-	// args ignored for update (except maybe specific packages, but update usually means all)
-	// cmd_update in main.odin called xbps_upgrade_all(idx, args.yes)
+	// Revalidate the index while the installed snapshot is read
+	refresh := index.index_refresh_start(config.index_url)
+	db, db_ok := xbps.pkgdb_load(config.rootdir, context.temp_allocator)
 
-	// Load index (force sync)
-	idx, ok := index.index_load_or_fetch(config.index_url, true)
+	idx, ok := index.index_refresh_wait(&refresh)
 	if !ok {
 		errors.log_error("Failed to load package index")
 		return 1
 	}
-
-	// Update official Void packages first
-	ret := xbps.upgrade_all_official(config.yes, utils.run_command)
-	if ret != 0 {
-		return ret
+	if !db_ok {
+		errors.log_error("Failed to read the installed package database")
+		return 1
 	}
 
-	// Then update VUP packages
-	return xbps_upgrade_all(&idx, config.yes)
+	return xbps_upgrade_all(&idx, &db, config.yes, config.dry_run, config.verbose, config.rootdir)
 }
 
-// Compare versions using xbps-uhelper
+// Compare versions (native xbps_cmpver)
 version_gt :: proc(v1: string, v2: string) -> bool {
-	return xbps.version_greater_than(v1, v2, utils.run_command)
-}
-
-// Get the currently installed version of a package
-get_installed_version :: proc(pkg_name: string, allocator := context.allocator) -> (string, bool) {
-	return xbps.get_installed_version(pkg_name, utils.run_command_output, allocator)
+	return xbps.version_greater_than(v1, v2)
 }
 
-// Parse installed package line from xbps-query -l
-parse_installed_pkg :: proc(line: string) -> (name: string, version: string, ok: bool) {
-	parts := strings.fields(line, context.temp_allocator)
-	if len(parts) < 2 {
-		return "", "", false
+// Fetch the new templates and show their diffs in less as they arrive:
+// the pager reads from a pipe, so the first diff is on screen while later
+// templates are still downloading. Fills new_template and cached_template.
+// Returns whether the user confirmed, and false for fetched if a template
+// could not be fetched.
+show_batch_review :: proc(upgrades: []Upgrade_Info) -> (confirmed: bool, fetched: bool) {
+	reqs := make([]template.Template_Request, len(upgrades), context.temp_allocator)
+	for u, i in upgrades {
+		reqs[i] = template.Template_Request {
+			category  = u.category,
+			pkg_name  = u.name,
+			blob_hash = u.template_hash,
+		}
 	}
+	stream := template.template_stream_start(reqs)
 
-	return xbps.parse_pkgver(parts[1])
-}
-
-// Show batched diffs in less pager
-show_batch_review :: proc(upgrades: []Upgrade_Info) -> bool {
 	builder := strings.builder_make(context.temp_allocator)
 
 	strings.write_string(&builder, "VUP Package Upgrade Review\n")
@@ -78,7 +75,18 @@ show_batch_review :: proc(upgrades: []Upgrade_Info) -> bool {
 	}
 	strings.write_string(&builder, "\n")
 
-	for u, i in upgrades {
+	pager := utils.pager_open()
+	utils.pager_write(&pager, strings.to_string(builder))
+
+	fetched = true
+	for {
+		i, content, ok := template.template_stream_next(&stream, context.temp_allocator)
+		if !ok {
+			break
+		}
+		u := &upgrades[i]
+
+		strings.builder_reset(&builder)
 		strings.write_string(
 			&builder,
 			"━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n",
@@ -97,34 +105,33 @@ show_batch_review :: proc(upgrades: []Upgrade_Info) -> bool {
 			"━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n",
 		)
 
+		if len(content) == 0 {
+			fetched = false
+			strings.write_string(&builder, "(Failed to fetch the template)\n\n")
+			utils.pager_write(&pager, strings.to_string(builder))
+			continue
+		}
+		u.new_template = content
+
+		cached, cached_ok := template.cache_get_template(u.name, context.temp_allocator)
+		u.cached_template = cached if cached_ok else ""
+
 		if len(u.cached_template) > 0 {
-			diff, diff_ok := utils.diff_generate(
-				u.cached_template,
-				u.new_template,
-				context.temp_allocator,
-			)
-			if diff_ok && len(diff) > 0 {
-				strings.write_string(&builder, diff)
-				strings.write_string(&builder, "\n")
-			}
+			utils.diff_write_unified(&builder, u.cached_template, u.new_template, "installed", "new")
+			strings.write_string(&builder, "\n")
 		} else {
 			strings.write_string(&builder, "(New package - showing full template)\n\n")
 			strings.write_string(&builder, u.new_template)
 			strings.write_string(&builder, "\n")
 		}
 		strings.write_string(&builder, "\n")
+		utils.pager_write(&pager, strings.to_string(builder))
 	}
 
-	content := strings.to_string(builder)
-	review_path, path_ok := utils.diff_write_temp_file(content, context.temp_allocator)
-	if !path_ok {
-		errors.log_error("Failed to create review file")
-		return false
+	utils.pager_close(&pager)
+	if !fetched {
+		return false, false
 	}
-	defer os.remove(review_path)
-
-	// Show in less
-	utils.diff_show_pager(review_path)
 
 	// Prompt for confirmation
 	fmt.printf("Proceed with %d upgrade(s)? [Y/n] ", len(upgrades))
@@ -133,164 +140,121 @@ show_batch_review :: proc(upgrades: []Upgrade_Info) -> bool {
 	n, _ := os.read(os.stdin, buf[:])
 
 	if n <= 0 {
-		return false
+		return false, true
 	}
 
 	input := strings.trim_space(string(buf[:n]))
 	input_lower := strings.to_lower(input, context.temp_allocator)
 
-	return len(input) == 0 || input_lower == "y" || input_lower == "yes"
+	return len(input) == 0 || input_lower == "y" || input_lower == "yes", true
 }
 
-// Upgrade all VUP packages
-xbps_upgrade_all :: proc(idx: ^index.Index, yes: bool) -> int {
+// Upgrade all packages, reviewing the VUP ones first (unless yes)
+// Outdated VUP packages come from one pass joining the installed snapshot
+// against the index; they are upgraded with everything else in a single
+// xbps-install that has each VUP repository added, and verified against the
+// pkgdb written by that transaction.
+xbps_upgrade_all :: proc(
+	idx: ^index.Index,
+	db: ^xbps.Pkgdb,
+	yes: bool,
+	dry_run: bool,
+	verbose: bool,
+	rootdir: string,
+) -> int {
+	utils.stats_span("xbps_upgrade_all")
 	errors.log_info("Checking for VUP package updates...")
 
-	output, ok := utils.run_command_output({"xbps-query", "-l"})
-	if !ok {
-		errors.log_error("Failed to run xbps-query")
+	arch, arch_ok := config.get_arch()
+	if !arch_ok {
+		errors.print_error(errors.make_error(.Arch_Detection_Failed))
 		return -1
 	}
 
+	upgrades := make([dynamic]Upgrade_Info, context.temp_allocator)
+	repos := make([dynamic]string, context.temp_allocator) // VUP repositories, once each
 
-	upgrades: [dynamic]Upgrade_Info
-
-
-	// Phase 1: Collect packages needing upgrade
-	lines := output
-	for line in strings.split_lines_iterator(&lines) {
-		if len(upgrades) >= MAX_UPGRADES {
-			break
-		}
-
-		name, installed_ver, parse_ok := parse_installed_pkg(line)
-		if !parse_ok {continue}
-
-		pkg, pkg_ok := index.index_get_package(idx, name)
-		if !pkg_ok {continue}
-
-		if len(pkg.version) == 0 || len(pkg.repo_urls) == 0 || len(pkg.category) == 0 {
+	for o in outdated_packages(idx, db) {
+		pkg, _ := index.index_get_package(idx, o.name)
+		repo_url, url_ok := pkg.repo_urls[arch]
+		if !url_ok || len(pkg.category) == 0 {
 			continue
 		}
 
-		// Get architecture-specific repo URL
-		arch, arch_ok := config.get_arch()
-		if !arch_ok {continue}
-
-
-		repo_url, url_ok := pkg.repo_urls[arch]
-		if !url_ok {continue}
-
-		if version_gt(pkg.version, installed_ver) {
-			append(
-				&upgrades,
-				Upgrade_Info {
-					name = strings.clone(name),
-					installed_ver = strings.clone(installed_ver),
-					new_ver = strings.clone(pkg.version),
-					repo_url = strings.clone(repo_url),
-					category = strings.clone(pkg.category),
-				},
-			)
+		append(
+			&upgrades,
+			Upgrade_Info {
+				name = o.name,
+				installed_ver = o.installed,
+				new_ver = o.available,
+				repo_url = repo_url,
+				category = pkg.category,
+				template_hash = pkg.template_hash,
+			},
+		)
+		if !slice.contains(repos[:], repo_url) {
+			append(&repos, repo_url)
 		}
 	}
 
 	if len(upgrades) == 0 {
 		errors.log_info("All VUP packages are up to date")
-		return 0
-	}
-
-	// Print summary
-	fmt.println()
-	fmt.printf("%d package(s) to upgrade:\n", len(upgrades))
-	for u in upgrades {
-		fmt.printf("  %s: %s -> %s\n", u.name, u.installed_ver, u.new_ver)
+	} else {
+		// Print summary
+		fmt.println()
+		fmt.printf("%d VUP package(s) to upgrade:\n", len(upgrades))
+		for u in upgrades {
+			fmt.printf("  %s: %s -> %s\n", u.name, u.installed_ver, u.new_ver)
+		}
+		fmt.println()
 	}
-	fmt.println()
 
-	// Phase 2: Fetch templates (unless --yes)
+	// Review the new templates (fetched concurrently) unless --yes
 	confirmed := yes
-	if !yes {
-		errors.log_info("Fetching templates for review...")
-
-		for &u in upgrades {
-			new_tmpl, tmpl_ok := template.fetch_template(u.category, u.name)
-			if !tmpl_ok {
-				errors.log_error("Failed to fetch template for %s", u.name)
-				return -1
-			}
-			u.new_template = new_tmpl
-
-			cached, cached_ok := template.cache_get_template(u.name)
-			u.cached_template = cached if cached_ok else ""
+	if !yes && !dry_run && len(upgrades) > 0 {
+		review_ok, fetched := show_batch_review(upgrades[:])
+		if !fetched {
+			errors.log_error("Could not fetch every template for review")
+			return -1
 		}
-
-		// Phase 3: Show batch review
-		if !show_batch_review(upgrades[:]) {
+		if !review_ok {
 			errors.log_info("Upgrade cancelled by user")
 			return 0
 		}
 		confirmed = true
 	}
 
-	// Phase 4: Perform upgrades
-	upgraded := 0
-	err_count := 0
-
-	// Group upgrades by repo URL for batch execution
-	Upgrade_Group :: struct {
-		repo_url: string,
-		upgrades: [dynamic]^Upgrade_Info,
+	// One transaction for official and VUP packages
+	errors.log_info("Upgrading packages...")
+	ret := xbps.upgrade_all_with_repos(repos[:], confirmed, dry_run, verbose, rootdir, utils.run_command)
+	if ret != 0 {
+		errors.log_error("Upgrade failed")
+		return ret
 	}
-	groups := make([dynamic]Upgrade_Group, context.temp_allocator)
-
-	for &u in upgrades {
-		found := false
-		for &group in groups {
-			if group.repo_url == u.repo_url {
-				append(&group.upgrades, &u)
-				found = true
-				break
-			}
-		}
-		if !found {
-			append(&groups, Upgrade_Group{
-				repo_url = u.repo_url,
-				upgrades = make([dynamic]^Upgrade_Info, context.temp_allocator),
-			})
-			append(&groups[len(groups) - 1].upgrades, &u)
-		}
+	if dry_run || len(upgrades) == 0 {
+		return 0
 	}
 
-	for group in groups {
-		pkg_names := make([dynamic]string, context.temp_allocator)
-		for u in group.upgrades {
-			append(&pkg_names, u.name)
-		}
-
-		errors.log_info("Upgrading %d package(s) from VUP...", len(pkg_names))
-
-		if xbps.upgrade_packages_from_repo(group.repo_url, pkg_names[:], confirmed, utils.run_command) != 0 {
-			errors.log_error("Failed to upgrade %d package(s)", len(pkg_names))
-			err_count += 1
-		} else {
-			for u in group.upgrades {
-				new_ver, ver_ok := get_installed_version(u.name, context.temp_allocator)
-				if ver_ok && new_ver != u.installed_ver {
-					upgraded += 1
-					if len(u.new_template) > 0 {
-						template.cache_save_template(u.name, u.new_template)
-					}
-				}
-			}
-		}
+	// Verify against the snapshot the transaction left behind
+	after, after_ok := xbps.pkgdb_load(rootdir, context.temp_allocator)
+	if !after_ok {
+		errors.log_warning("Could not read the package database to verify the upgrade")
+		return 0
 	}
 
-	if upgraded > 0 {
-		errors.log_info("Upgraded %d package(s)", upgraded)
-	} else if err_count == 0 {
-		errors.log_info("All VUP packages are up to date")
+	upgraded := 0
+	for u in upgrades {
+		new_ver, ver_ok := xbps.pkgdb_installed_version(&after, u.name)
+		if !ver_ok || new_ver == u.installed_ver {
+			errors.log_warning("%s was not upgraded", u.name)
+			continue
+		}
+		upgraded += 1
+		if len(u.new_template) > 0 {
+			template.cache_save_template(u.name, u.new_template)
+		}
 	}
 
-	return -1 if err_count > 0 else 0
+	errors.log_info("Upgraded %d VUP package(s)", upgraded)
+	return 0 if upgraded == len(upgrades) else -1
 }
@@ -0,0 +1,187 @@
+package builder
+
+import "core:crypto/hash"
+import "core:encoding/hex"
+import "core:fmt"
+import "core:os"
+import "core:strings"
+import "core:sys/linux"
+
+import errors "../../core/errors"
+import index "../../core/index"
+import net "../../core/net"
+import utils "../../utils"
+import config "../config"
+
+// Persistent binary package cache shared by every build and masterdir
+// (<cache>/binpkgs). Packages are stored once, by content:
+//   objects/<sha256>.xbps   package data
+//   names/<filename>        sha256 of the package published under that name
+// and hardlinked into hostdir/binpkgs (reflink or copy across filesystems).
+
+BINPKG_CACHE_DIR :: "binpkgs"
+
+// Maximum number of concurrent package downloads
+MAX_PARALLEL_DOWNLOADS :: 4
+
+Binpkg_Cache :: struct {
+	objects: string,
+	names:   string,
+}
+
+// A package to download into the cache
+Binpkg_Request :: struct {
+	name:     string,
+	url:      string,
+	expected: index.Binpkg_Info, // Verified when the index publishes size/sha256
+}
+
+// Open (and create) the cache in the user cache directory
+binpkg_cache_open :: proc() -> (Binpkg_Cache, bool) {
+	cache_dir, ok := config.get_cache_dir(context.temp_allocator)
+	if !ok {
+		return {}, false
+	}
+
+	c := Binpkg_Cache {
+		objects = utils.path_join(cache_dir, BINPKG_CACHE_DIR, "objects", allocator = context.temp_allocator),
+		names   = utils.path_join(cache_dir, BINPKG_CACHE_DIR, "names", allocator = context.temp_allocator),
+	}
+	if !utils.mkdir_p(c.objects) || !utils.mkdir_p(c.names) {
+		return {}, false
+	}
+	return c, true
+}
+
+// Find the cached object for a package; misses when the index publishes a
+// different size or digest for the same filename (the asset was replaced)
+binpkg_cache_lookup :: proc(c: ^Binpkg_Cache, bin: index.Binpkg_Info) -> (string, bool) {
+	recorded, ok := utils.read_file(name_path(c, bin.filename), context.temp_allocator)
+	if !ok {
+		return "", false
+	}
+
+	sha := strings.trim_space(recorded)
+	if len(sha) == 0 || (len(bin.sha256) > 0 && !strings.equal_fold(sha, bin.sha256)) {
+		return "", false
+	}
+
+	object := object_path(c, sha)
+	fi, err := os.stat(object, context.temp_allocator)
+	if err != os.ERROR_NONE || (bin.size > 0 && fi.size != bin.size) {
+		return "", false
+	}
+	return object, true
+}
+
+// Download packages into the cache in parallel and verify them.
+// Returns the object path of each request (empty where it failed).
+binpkg_cache_fetch :: proc(c: ^Binpkg_Cache, reqs: []Binpkg_Request) -> ([]string, bool) {
+	downloads := make([]net.Request, len(reqs), context.temp_allocator)
+	for r, i in reqs {
+		downloads[i] = net.Request {
+			url    = r.url,
+			dest   = fmt.tprintf("%s/.%s.dl", c.objects, r.expected.filename), // .part resumed next time
+			size   = r.expected.size,
+			sha256 = r.expected.sha256,
+		}
+	}
+
+	results := net.download(downloads, MAX_PARALLEL_DOWNLOADS)
+
+	objects := make([]string, len(reqs), context.temp_allocator)
+	all_ok := true
+	for r, i in reqs {
+		defer os.remove(downloads[i].dest)
+
+		#partial switch results[i].status {
+		case .Ok:
+		case .Checksum_Mismatch:
+			errors.log_error("Checksum mismatch for %s", r.expected.filename)
+			all_ok = false
+			continue
+		case:
+			errors.log_error("Failed to download %s from %s", r.name, r.url)
+			all_ok = false
+			continue
+		}
+
+		object, adopt_ok := binpkg_cache_adopt(c, downloads[i].dest, r.expected)
+		if !adopt_ok {
+			all_ok = false
+			continue
+		}
+		objects[i] = object
+	}
+
+	return objects, all_ok
+}
+
+// Move a package downloaded by net.download (.Ok: size and sha256 already
+// checked against expected) into the cache. The published digest is the
+// object key; only a package published without one is hashed here.
+// Returns the object path.
+binpkg_cache_adopt :: proc(c: ^Binpkg_Cache, path: string, expected: index.Binpkg_Info) -> (string, bool) {
+	sha := expected.sha256
+	if len(sha) == 0 {
+		hashed, ok := binpkg_file_sha256(path)
+		if !ok {
+			return "", false
+		}
+		sha = hashed
+	}
+
+	object := object_path(c, sha)
+	if !os.exists(object) && os.rename(path, object) != os.ERROR_NONE {
+		return "", false
+	}
+	utils.write_file(name_path(c, expected.filename), sha)
+	return object, true
+}
+
+// Hex sha256 of a package file the download engine did not verify, read in
+// chunks
+binpkg_file_sha256 :: proc(path: string) -> (string, bool) {
+	f, err := os.open(path)
+	if err != os.ERROR_NONE {
+		return "", false
+	}
+	defer os.close(f)
+
+	ctx: hash.Context
+	hash.init(&ctx, .SHA256)
+
+	buf: [64 * 1024]u8
+	for {
+		n, _ := os.read(f, buf[:])
+		if n <= 0 {
+			break
+		}
+		hash.update(&ctx, buf[:n])
+	}
+
+	digest: [32]u8
+	hash.final(&ctx, digest[:])
+	return string(hex.encode(digest[:], context.temp_allocator)), true
+}
+
+// Place a cached object at dest: hardlink, else reflink or copy
+binpkg_cache_link :: proc(object: string, dest: string) -> bool {
+	src := strings.clone_to_cstring(object, context.temp_allocator)
+	dst := strings.clone_to_cstring(dest, context.temp_allocator)
+	if linux.link(src, dst) == nil {
+		return true
+	}
+	// Different filesystem
+	return utils.run_command({"cp", "--reflink=auto", object, dest}) == 0
+}
+
+@(private)
+object_path :: proc(c: ^Binpkg_Cache, sha: string) -> string {
+	return fmt.tprintf("%s/%s.xbps", c.objects, strings.to_lower(sha, context.temp_allocator))
+}
+
+@(private)
+name_path :: proc(c: ^Binpkg_Cache, filename: string) -> string {
+	return utils.path_join(c.names, filename, allocator = context.temp_allocator)
+}
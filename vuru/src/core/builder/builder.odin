@@ -191,14 +191,17 @@ get_built_package_path :: proc(
 	return strings.clone(strings.trim_space(first_line), allocator), true
 }
 
-// Show xbps-src build log
+// Show xbps-src build log (the scheduler's log of the last build, if any)
 show_build_log :: proc(cfg: ^Build_Config, pkg_name: string) {
-	log_path := utils.path_join(
-		cfg.vup_dir,
-		"masterdir/builddir",
-		fmt.tprintf("%s.log", pkg_name),
-		allocator = context.temp_allocator,
-	)
+	log_path := build_log_path(cfg, pkg_name)
+	if !os.exists(log_path) {
+		log_path = utils.path_join(
+			cfg.vup_dir,
+			"masterdir/builddir",
+			fmt.tprintf("%s.log", pkg_name),
+			allocator = context.temp_allocator,
+		)
+	}
 
 	if os.exists(log_path) {
 		utils.run_command({"less", "+G", log_path})
@@ -0,0 +1,235 @@
+package builder
+
+import "core:fmt"
+import "core:slice"
+import "core:strings"
+
+import errors "../../core/errors"
+import index "../../core/index"
+import template "../../core/template"
+import xbps "../../core/xbps"
+import utils "../../utils"
+import config "../config"
+
+// Build plan for VUP packages: the transitive closure of their VUP
+// dependencies. Packages with a prebuilt binary for the host architecture are
+// pulled from the VUP repo (their runtime dependencies are followed as well);
+// everything else is built from source after the packages it needs.
+
+// A package to build
+Build_Node :: struct {
+	name:       string,
+	category:   string,
+	deps:       []int, // Nodes that must be built first
+	dependents: [dynamic]int, // Nodes waiting for this one
+}
+
+Build_Plan :: struct {
+	nodes:    [dynamic]Build_Node, // In dependency order
+	prebuilt: [dynamic]string, // VUP packages placed as binaries
+}
+
+@(private)
+Visit_State :: enum {
+	Unvisited,
+	Visiting,
+	Done,
+}
+
+// State of the depth-first walk that fills a plan
+@(private)
+Plan_Walk :: struct {
+	plan:    ^Build_Plan,
+	idx:     ^index.Index,
+	srcpkgs: string, // Local checkout (srcpkgs/<category>/<pkg>/template), may be empty
+	arch:    string,
+	force:   bool, // Build everything, even packages with binaries
+	targets: map[string]bool, // Always built
+	state:   map[string]Visit_State,
+	needs:   map[string][]int, // Nodes a consumer of the package waits for
+}
+
+// Plan the targets and their VUP dependencies. Targets are built when
+// build_targets is set and pulled like any dependency otherwise.
+build_plan_make :: proc(
+	idx: ^index.Index,
+	targets: []string,
+	srcpkgs: string,
+	build_targets: bool,
+	force_build: bool,
+	allocator := context.allocator,
+) -> (
+	Build_Plan,
+	errors.Error,
+) {
+	context.allocator = allocator
+
+	plan := Build_Plan {
+		nodes    = make([dynamic]Build_Node),
+		prebuilt = make([dynamic]string),
+	}
+
+	arch, arch_ok := config.get_arch()
+	if !arch_ok {
+		return plan, errors.make_error(.Arch_Detection_Failed)
+	}
+
+	w := Plan_Walk {
+		plan    = &plan,
+		idx     = idx,
+		srcpkgs = srcpkgs,
+		arch    = arch,
+		force   = force_build,
+		targets = make(map[string]bool, allocator = context.temp_allocator),
+		state   = make(map[string]Visit_State, allocator = context.temp_allocator),
+		needs   = make(map[string][]int, allocator = context.temp_allocator),
+	}
+	if build_targets {
+		for target in targets {
+			w.targets[target] = true
+		}
+	}
+
+	for target in targets {
+		if _, err := plan_visit(&w, target); err.kind != nil {
+			return plan, err
+		}
+	}
+
+	return plan, {}
+}
+
+// Print what will be pulled and what will be built, in order
+build_plan_print :: proc(plan: ^Build_Plan) {
+	if len(plan.prebuilt) > 0 {
+		fmt.printf(
+			"\n%s:: Prebuilt VUP packages (%d):%s %s\n",
+			errors.COLOR_INFO,
+			len(plan.prebuilt),
+			errors.COLOR_RESET,
+			strings.join(plan.prebuilt[:], " ", context.temp_allocator),
+		)
+	}
+	if len(plan.nodes) > 0 {
+		fmt.printf("\n%s:: Build order (%d):%s\n", errors.COLOR_INFO, len(plan.nodes), errors.COLOR_RESET)
+		for node, i in plan.nodes {
+			fmt.printf("   %d. %s/%s", i + 1, node.category, node.name)
+			if len(node.deps) > 0 {
+				after := make([]string, len(node.deps), context.temp_allocator)
+				for d, j in node.deps {
+					after[j] = plan.nodes[d].name
+				}
+				fmt.printf(" (after %s)", strings.join(after, ", ", context.temp_allocator))
+			}
+			fmt.println()
+		}
+	}
+	fmt.println()
+}
+
+// Visit a package after its dependencies (post-order, so nodes are appended in
+// dependency order). Returns the nodes a consumer of the package waits for:
+// the package itself when it is built, else the builds its binary needs.
+@(private)
+plan_visit :: proc(w: ^Plan_Walk, name: string) -> (needs: []int, err: errors.Error) {
+	switch w.state[name] {
+	case .Visiting:
+		return nil, errors.make_error(.Dependency_Cycle, name)
+	case .Done:
+		return w.needs[name], {}
+	case .Unvisited:
+	}
+
+	pkg, found := index.index_get_package(w.idx, name)
+	if !found {
+		return nil, errors.make_error(.Package_Not_Found, name)
+	}
+	if !utils.is_valid_identifier(name) || !utils.is_valid_identifier(pkg.category) {
+		return nil, errors.make_error(.Package_Not_Found, fmt.tprintf("invalid name %s", name))
+	}
+
+	key := strings.clone(name, context.temp_allocator)
+	w.state[key] = .Visiting
+
+	_, has_binary := pkg.repo_urls[w.arch]
+	build := key in w.targets || w.force || !has_binary
+
+	waits := make([dynamic]int)
+	for pattern in package_deps(w, key, pkg, build) {
+		dep := xbps.pkgpattern_name(pattern)
+		if len(dep) == 0 || dep == key || !index.index_has_package(w.idx, dep) {
+			continue // Official package
+		}
+
+		dep_needs, dep_err := plan_visit(w, dep)
+		if dep_err.kind != nil {
+			return nil, dep_err
+		}
+		for n in dep_needs {
+			if !slice.contains(waits[:], n) {
+				append(&waits, n)
+			}
+		}
+	}
+
+	if build {
+		node := len(w.plan.nodes)
+		for d in waits {
+			append(&w.plan.nodes[d].dependents, node)
+		}
+		append(
+			&w.plan.nodes,
+			Build_Node {
+				name = strings.clone(key),
+				category = strings.clone(pkg.category),
+				deps = waits[:],
+				dependents = make([dynamic]int),
+			},
+		)
+		needs = slice.clone([]int{node})
+	} else {
+		append(&w.plan.prebuilt, strings.clone(key))
+		needs = waits[:]
+	}
+
+	w.state[key] = .Done
+	w.needs[key] = needs
+	return needs, {}
+}
+
+// Dependency patterns of a package: everything when it is built, runtime
+// dependencies when its binary is pulled. A build uses the local checkout's
+// template; otherwise the index lists are used (older indexes lack them, so
+// the template is fetched).
+@(private)
+package_deps :: proc(w: ^Plan_Walk, name: string, pkg: index.Package_Info, build: bool) -> []string {
+	if build && len(w.srcpkgs) > 0 {
+		path := utils.path_join(w.srcpkgs, pkg.category, name, "template", allocator = context.temp_allocator)
+		if tmpl, ok := template.template_parse_file(path, context.temp_allocator); ok {
+			return template.template_all_deps(&tmpl, context.temp_allocator)
+		}
+	}
+
+	if pkg.has_deps {
+		if !build {
+			return pkg.depends
+		}
+		return slice.concatenate(
+			[][]string{pkg.depends, pkg.makedepends, pkg.hostmakedepends},
+			context.temp_allocator,
+		)
+	}
+
+	content, fetch_ok := template.fetch_template(pkg.category, name, context.temp_allocator, pkg.template_hash)
+	if fetch_ok {
+		if tmpl, ok := template.template_parse(content, context.temp_allocator); ok {
+			if !build {
+				return tmpl.depends
+			}
+			return template.template_all_deps(&tmpl, context.temp_allocator)
+		}
+	}
+
+	errors.log_warning("Could not read the dependencies of %s", name)
+	return nil
+}
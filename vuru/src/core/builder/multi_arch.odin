@@ -0,0 +1,175 @@
+package builder
+
+import "core:fmt"
+import "core:strings"
+import "core:time"
+
+import errors "../../core/errors"
+import utils "../../utils"
+import config "../config"
+
+// `vuru src -a <t1>,<t2>,... <command> <pkg>`: VUP dependencies are placed
+// and the distfiles fetched once (hostdir is shared by every masterdir),
+// then one xbps-src per target runs concurrently, each in its own masterdir
+// so their builddirs don't collide:
+//   - the native arch in the default masterdir
+//   - a same-CPU other-libc target (x86_64-musl on x86_64) as host -A in
+//     masterdir-<target>, as xbps-src can't cross-build to it
+//   - any other target cross-built with -a in masterdir-<native>-<target>,
+//     cloned from the native masterdir before the concurrent runs start
+// Each target logs to hostdir/logs/<pkg>-<target>.log.
+
+// Whether target must be built as another host (-A) rather than cross (-a)
+needs_alt_host :: proc(target: string, native: string) -> bool {
+	if target == native {
+		return false
+	}
+	dash := strings.index_byte(target, '-')
+	return dash > 0 && target[:dash] == native
+}
+
+// Run cmd_args (an xbps-src package command for pkg_name) for every target
+xbps_src_multi_arch :: proc(
+	xbps_src_path: string,
+	targets: []string,
+	cmd_args: []string,
+	pkg_name: string,
+) -> (
+	bool,
+	errors.Error,
+) {
+	native, arch_ok := config.get_arch()
+	if !arch_ok {
+		return false, errors.make_error(.Arch_Detection_Failed)
+	}
+
+	base := xbps_src_base_dir(xbps_src_path)
+	log_dir := utils.path_join(base, "hostdir", "logs", allocator = context.temp_allocator)
+	if !utils.mkdir_p(log_dir) {
+		return false, errors.make_error(.Cache_Dir_Failed, log_dir)
+	}
+
+	if cmd_args[0] != "fetch" {
+		errors.log_info("Fetching distfiles for %s...", pkg_name)
+		if !run_xbps_src(xbps_src_path, {"fetch", pkg_name}) {
+			return false, errors.make_error(.Command_Failed, fmt.tprintf("xbps-src fetch %s", pkg_name))
+		}
+	}
+
+	if !multi_arch_prepare(base, native, targets) {
+		return false, errors.make_error(.Command_Failed, "masterdir setup")
+	}
+
+	cmds := make([][]string, len(targets), context.temp_allocator)
+	logs := make([]string, len(targets), context.temp_allocator)
+	for target, i in targets {
+		logs[i] = utils.path_join(log_dir, fmt.tprintf("%s-%s.log", pkg_name, target), allocator = context.temp_allocator)
+		cmds[i] = multi_arch_command(base, native, target, len(targets), cmd_args, logs[i])
+	}
+
+	errors.log_info(
+		"Running xbps-src %s for %s...",
+		strings.join(cmd_args, " ", context.temp_allocator),
+		strings.join(targets, ", ", context.temp_allocator),
+	)
+	started := time.tick_now()
+	codes := utils.run_commands_parallel(cmds, len(cmds), context.temp_allocator)
+	elapsed := time.duration_round(time.tick_since(started), time.Second)
+
+	failed := make([dynamic]string, context.temp_allocator)
+	for code, i in codes {
+		if code == 0 {
+			errors.log_info("%s: done", targets[i])
+			continue
+		}
+		append(&failed, targets[i])
+		errors.log_error("%s: xbps-src exited with %d", targets[i], code)
+		utils.run_command({"tail", "-n", fmt.tprintf("%d", FAILED_LOG_LINES), logs[i]})
+		errors.log_info("Full log: %s", logs[i])
+	}
+
+	if len(failed) > 0 {
+		return false,
+			errors.make_error(
+				.Build_Failed,
+				fmt.tprintf("%s for %s", pkg_name, strings.join(failed[:], ", ", context.temp_allocator)),
+			)
+	}
+	errors.log_info("%s done for %d targets in %v", pkg_name, len(targets), elapsed)
+	return true, {}
+}
+
+// Directory containing xbps-src
+@(private)
+xbps_src_base_dir :: proc(xbps_src_path: string) -> string {
+	slash := strings.last_index_byte(xbps_src_path, '/')
+	if slash < 0 {
+		return "."
+	}
+	if slash == 0 {
+		return "/"
+	}
+	return xbps_src_path[:slash]
+}
+
+// Create the masterdir of every cross target that lacks one, one at a time
+// before any xbps-src runs: the native masterdir must not be cloned while
+// the native build installs its dependencies into it
+@(private)
+multi_arch_prepare :: proc(base: string, native: string, targets: []string) -> bool {
+	for target in targets {
+		if target == native || needs_alt_host(target, native) {
+			continue
+		}
+
+		script := strings.builder_make(context.temp_allocator)
+		fmt.sbprintf(&script, "cd %s || exit 1; ", sh_quote(base))
+		fmt.sbprintf(&script, "md=%s; src=%s; [ -d \"$src\" ] || src=masterdir; ", sh_quote(fmt.tprintf("masterdir-%s-%s", native, target)), sh_quote(fmt.tprintf("masterdir-%s", native)))
+		fmt.sbprintf(&script, "[ -e \"$md/.xbps_chroot_init\" ] && exit 0; ")
+		fmt.sbprintf(&script, "if [ ! -d \"$md\" ] && [ -e \"$src/.xbps_chroot_init\" ]; then exec cp -a --reflink=auto \"$src\" \"$md\"; fi; ")
+		fmt.sbprintf(&script, "exec ./xbps-src -m \"$md\" binary-bootstrap")
+
+		errors.log_info("Preparing masterdir for %s...", target)
+		if utils.run_command({"sh", "-c", strings.to_string(script)}) != 0 {
+			errors.log_error("%s: could not create its masterdir", target)
+			return false
+		}
+	}
+	return true
+}
+
+// Shell command running cmd_args for one target in its masterdir (an
+// alt-host masterdir is bootstrapped first when needed), output to log_path
+@(private)
+multi_arch_command :: proc(
+	base: string,
+	native: string,
+	target: string,
+	jobs: int,
+	cmd_args: []string,
+	log_path: string,
+) -> []string {
+	script := strings.builder_make(context.temp_allocator)
+	fmt.sbprintf(&script, "exec >%s 2>&1; ", sh_quote(log_path))
+	fmt.sbprintf(&script, "cd %s || exit 1; ", sh_quote(base))
+
+	flags := ""
+	if needs_alt_host(target, native) {
+		masterdir := sh_quote(fmt.tprintf("masterdir-%s", target))
+		fmt.sbprintf(&script, "[ -e %s/.xbps_chroot_init ] || ./xbps-src -A %s binary-bootstrap || exit 1; ", masterdir, sh_quote(target))
+		flags = fmt.tprintf("-A %s", sh_quote(target))
+	} else if target != native {
+		masterdir := sh_quote(fmt.tprintf("masterdir-%s-%s", native, target))
+		flags = fmt.tprintf("-m %s -a %s", masterdir, sh_quote(target))
+	}
+
+	fmt.sbprintf(&script, "mj=$(( $(nproc) / %d )); [ \"$mj\" -ge 1 ] || mj=1; ", jobs)
+	fmt.sbprintf(&script, "exec ./xbps-src %s -j \"$mj\"", flags)
+	for arg in cmd_args {
+		fmt.sbprintf(&script, " %s", sh_quote(arg))
+	}
+
+	cmd := make([]string, 3, context.temp_allocator)
+	cmd[0], cmd[1], cmd[2] = "sh", "-c", strings.to_string(script)
+	return cmd
+}
@@ -0,0 +1,239 @@
+package builder
+
+import "core:fmt"
+import "core:os"
+import "core:strings"
+import "core:time"
+
+import errors "../../core/errors"
+import index "../../core/index"
+import utils "../../utils"
+
+// Parallel executor for a Build_Plan. A node starts once everything it
+// depends on is built; independent nodes build concurrently, each job in its
+// own masterdir (masterdir, masterdir-1, ...; bootstrapped on first use) with
+// the CPUs split between jobs. Output goes to one log per package under
+// hostdir/logs; the terminal only shows progress.
+
+// Packages built at once when no job count is given
+DEFAULT_BUILD_JOBS :: 2
+
+// Lines of a failed build's log shown in the terminal
+FAILED_LOG_LINES :: 20
+
+@(private)
+Node_State :: enum {
+	Waiting,
+	Running,
+	Built,
+	Failed,
+	Skipped, // A dependency failed
+}
+
+@(private)
+Build_Job :: struct {
+	node:    int,
+	slot:    int, // Masterdir index
+	started: time.Tick,
+}
+
+// Run a plan: place the prebuilt packages in hostdir/binpkgs, then build the
+// nodes, at most jobs at a time (0: DEFAULT_BUILD_JOBS). Returns false if any
+// node failed or could not be built.
+build_plan_run :: proc(cfg: ^Build_Config, plan: ^Build_Plan, idx: ^index.Index, jobs: int) -> bool {
+	utils.stats_span("build_plan_run")
+	binpkgs := utils.path_join(cfg.hostdir, "binpkgs", allocator = context.temp_allocator)
+	if !utils.mkdir_p(binpkgs) || !utils.mkdir_p(build_log_dir(cfg)) {
+		errors.log_error("Could not create %s", cfg.hostdir)
+		return false
+	}
+
+	placed, place_err := place_vup_deps(idx, plan.prebuilt[:], binpkgs)
+	defer cleanup_vup_deps(binpkgs, placed[:])
+	if place_err.kind != nil {
+		errors.print_error(place_err)
+		return false
+	}
+	if ok, err := update_binpkgs_index(binpkgs, placed[:]); !ok {
+		errors.print_error(err)
+		return false
+	}
+
+	n := len(plan.nodes)
+	if n == 0 {
+		return true
+	}
+	jobs := min(jobs if jobs > 0 else DEFAULT_BUILD_JOBS, n)
+
+	states := make([]Node_State, n, context.temp_allocator)
+	pending := make([]int, n, context.temp_allocator) // Unbuilt dependencies
+	for node, i in plan.nodes {
+		pending[i] = len(node.deps)
+	}
+
+	pool := utils.pool_make(jobs, context.temp_allocator)
+	defer utils.pool_destroy(&pool)
+	running := make(map[int]Build_Job, allocator = context.temp_allocator) // By pool index
+	free_slots := make([dynamic]int, 0, jobs, context.temp_allocator)
+	for slot := jobs - 1; slot >= 0; slot -= 1 {
+		append(&free_slots, slot)
+	}
+
+	started, finished := 0, 0
+	for finished < n {
+		// Start ready nodes (in plan order) while slots are free
+		for len(free_slots) > 0 {
+			i := next_ready(states, pending)
+			if i < 0 {
+				break
+			}
+
+			node := &plan.nodes[i]
+			slot := pop(&free_slots)
+			id := utils.pool_add(&pool, build_job_command(cfg, node, slot, jobs), .Inherit)
+			started += 1
+			states[i] = .Running
+			running[id] = Build_Job {
+				node    = i,
+				slot    = slot,
+				started = time.tick_now(),
+			}
+			errors.log_info("[%d/%d] Building %s/%s", started, n, node.category, node.name)
+		}
+
+		if len(running) == 0 {
+			break
+		}
+
+		id, res, ok := utils.pool_next(&pool)
+		if !ok {
+			break
+		}
+		job := running[id]
+		delete_key(&running, id)
+		code := res.code
+		append(&free_slots, job.slot)
+		finished += 1
+
+		node := &plan.nodes[job.node]
+		elapsed := time.duration_round(time.tick_since(job.started), time.Second)
+		if code == 0 {
+			states[job.node] = .Built
+			for d in node.dependents {
+				pending[d] -= 1
+			}
+			errors.log_info("[%d/%d] Built %s in %v", finished, n, node.name, elapsed)
+		} else {
+			states[job.node] = .Failed
+			errors.log_error("[%d/%d] Build of %s failed after %v", finished, n, node.name, elapsed)
+			show_log_tail(cfg, node.name)
+			finished += skip_dependents(plan, states, job.node)
+		}
+	}
+
+	return build_summary(plan, states)
+}
+
+// Path of the log of a package built by build_plan_run
+build_log_path :: proc(cfg: ^Build_Config, pkg_name: string) -> string {
+	return utils.path_join(build_log_dir(cfg), fmt.tprintf("%s.log", pkg_name), allocator = context.temp_allocator)
+}
+
+@(private)
+build_log_dir :: proc(cfg: ^Build_Config) -> string {
+	return utils.path_join(cfg.hostdir, "logs", allocator = context.temp_allocator)
+}
+
+// Masterdir of a job slot; slot 0 is the default one
+@(private)
+build_masterdir :: proc(cfg: ^Build_Config, slot: int) -> string {
+	if slot == 0 {
+		return cfg.masterdir
+	}
+	return fmt.tprintf("%s-%d", cfg.masterdir, slot)
+}
+
+// Shell command building one node in the masterdir of slot, output to its log
+@(private)
+build_job_command :: proc(cfg: ^Build_Config, node: ^Build_Node, slot: int, jobs: int) -> []string {
+	masterdir := sh_quote(build_masterdir(cfg, slot))
+	pkg := fmt.tprintf("%s/%s", node.category, node.name)
+
+	script := strings.builder_make(context.temp_allocator)
+	fmt.sbprintf(&script, "exec >%s 2>&1; ", sh_quote(build_log_path(cfg, node.name)))
+	fmt.sbprintf(&script, "cd %s || exit 1; ", sh_quote(cfg.vup_dir))
+	fmt.sbprintf(&script, "[ -d %s ] || ./xbps-src -m %s binary-bootstrap || exit 1; ", masterdir, masterdir)
+	fmt.sbprintf(&script, "mj=$(( $(nproc) / %d )); [ \"$mj\" -ge 1 ] || mj=1; ", jobs)
+	fmt.sbprintf(&script, "./xbps-src -m %s -j \"$mj\" pkg %s", masterdir, pkg)
+	if cfg.clean_after {
+		fmt.sbprintf(&script, " && { ./xbps-src -m %s clean %s || true; }", masterdir, node.name)
+	}
+
+	cmd := make([]string, 3, context.temp_allocator)
+	cmd[0], cmd[1], cmd[2] = "sh", "-c", strings.to_string(script)
+	return cmd
+}
+
+// First waiting node whose dependencies are all built, or -1
+@(private)
+next_ready :: proc(states: []Node_State, pending: []int) -> int {
+	for state, i in states {
+		if state == .Waiting && pending[i] == 0 {
+			return i
+		}
+	}
+	return -1
+}
+
+// Mark everything depending on a failed node as skipped; returns the count
+@(private)
+skip_dependents :: proc(plan: ^Build_Plan, states: []Node_State, failed: int) -> int {
+	count := 0
+	for d in plan.nodes[failed].dependents {
+		if states[d] == .Waiting {
+			states[d] = .Skipped
+			count += 1 + skip_dependents(plan, states, d)
+		}
+	}
+	return count
+}
+
+@(private)
+show_log_tail :: proc(cfg: ^Build_Config, pkg_name: string) {
+	log_path := build_log_path(cfg, pkg_name)
+	if !os.exists(log_path) {
+		return
+	}
+	utils.run_command({"tail", "-n", fmt.tprintf("%d", FAILED_LOG_LINES), log_path})
+	errors.log_info("Full log: %s", log_path)
+}
+
+// Report failed and skipped nodes; true if everything was built
+@(private)
+build_summary :: proc(plan: ^Build_Plan, states: []Node_State) -> bool {
+	failed := make([dynamic]string, context.temp_allocator)
+	skipped := make([dynamic]string, context.temp_allocator)
+	for state, i in states {
+		#partial switch state {
+		case .Failed:
+			append(&failed, plan.nodes[i].name)
+		case .Skipped, .Waiting:
+			append(&skipped, plan.nodes[i].name)
+		}
+	}
+
+	if len(failed) > 0 {
+		errors.log_error("Failed to build: %s", strings.join(failed[:], " ", context.temp_allocator))
+	}
+	if len(skipped) > 0 {
+		errors.log_warning("Not built (a dependency failed): %s", strings.join(skipped[:], " ", context.temp_allocator))
+	}
+	return len(failed) == 0 && len(skipped) == 0
+}
+
+// Single-quote a string for sh
+@(private)
+sh_quote :: proc(s: string) -> string {
+	escaped, _ := strings.replace_all(s, "'", "'\\''", context.temp_allocator)
+	return fmt.tprintf("'%s'", escaped)
+}
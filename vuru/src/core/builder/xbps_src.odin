@@ -2,11 +2,13 @@ package builder
 
 import "core:fmt"
 import "core:os"
+import "core:slice"
 import "core:strings"
 
 import errors "../../core/errors"
 import index "../../core/index"
 import template "../../core/template"
+import xbps "../../core/xbps"
 import utils "../../utils"
 import config "../config"
 
@@ -21,6 +23,7 @@ import config "../config"
 Config :: struct {
 	index_url: string,
 	repo_url:  string,
+	jobs:      int, // Concurrent builds of VUP dependencies (0: default)
 }
 
 // Commands that operate on a package template and need dependency resolution
@@ -83,17 +86,20 @@ get_binpkgs_dir :: proc(xbps_src_path: string, allocator := context.allocator) -
 }
 
 
-// Update the local repo index after adding packages
-update_binpkgs_index :: proc(binpkgs_dir: string) -> (bool, errors.Error) {
-	errors.log_info("Updating local repository index...")
+// Register newly placed packages in the local repo index (existing entries are kept)
+update_binpkgs_index :: proc(binpkgs_dir: string, files: []string) -> (bool, errors.Error) {
+	if len(files) == 0 {
+		return true, {}
+	}
 
-	// xbps-rindex -a <path>/*.xbps doesn't work directly
-	// Weneed to pass individual .xbps files or use a glob in shell
-	// Better: use xbps-rindex -fa with glob
+	errors.log_info("Updating local repository index...")
 
-	pattern := fmt.tprintf("%s/*.xbps", binpkgs_dir)
-	args := []string{"sh", "-c", fmt.tprintf("xbps-rindex -fa %s", pattern)}
-	if utils.run_command(args) != 0 {
+	cmd := make([dynamic]string, 0, len(files) + 2, context.temp_allocator)
+	append(&cmd, "xbps-rindex", "-fa")
+	for f in files {
+		append(&cmd, utils.path_join(binpkgs_dir, f, allocator = context.temp_allocator))
+	}
+	if utils.run_command(cmd[:]) != 0 {
 		return false, errors.make_error(.Command_Failed, "xbps-rindex -fa")
 	}
 
@@ -148,6 +154,8 @@ find_package_template :: proc(srcpkgs_dir: string, pkg_name: string) -> string {
 }
 
 // Cleanup VUP dependencies from hostdir/binpkgs
+// Only the links are removed (the cache keeps the packages); the repo index
+// drops their entries instead of being regenerated.
 cleanup_vup_deps :: proc(binpkgs_dir: string, installed_pkgs: []string) {
 	if len(installed_pkgs) == 0 {
 		return
@@ -168,77 +176,108 @@ cleanup_vup_deps :: proc(binpkgs_dir: string, installed_pkgs: []string) {
 		}
 	}
 
-	if arch, ok := config.get_arch(); ok {
-		repodata := fmt.tprintf("%s/%s-repodata", binpkgs_dir, arch)
-		if os.exists(repodata) {
-			os.remove(repodata)
-		}
-		delete(arch)
-	}
+	// Remove index entries whose package file is gone
+	utils.run_command_silent({"xbps-rindex", "-c", binpkgs_dir})
 }
 
-// Appends installed filename to the list if successful
-download_vup_pkg_to_binpkgs_and_get_filename :: proc(
+// Place VUP dependencies in hostdir/binpkgs from the persistent package cache,
+// downloading missing ones in parallel. Returns the filenames placed (for
+// cleanup); packages already in binpkgs are left alone.
+place_vup_deps :: proc(
 	idx: ^index.Index,
-	pkg_name: string,
+	deps: []string,
 	binpkgs_dir: string,
 ) -> (
-	bool,
+	[dynamic]string,
 	errors.Error,
-	string, // Filename (empty if failed or skipped)
 ) {
-	pkg, ok := index.index_get_package(idx, pkg_name)
-	if !ok {
-		return false, errors.make_error(.Package_Not_Found, pkg_name), ""
-	}
+	placed: [dynamic]string
 
-	// Get architecture
 	arch, arch_ok := config.get_arch()
-
 	if !arch_ok {
-		return false, errors.make_error(.Arch_Detection_Failed), ""
+		return placed, errors.make_error(.Arch_Detection_Failed)
 	}
 
-	// Get repo URL for this arch
-	repo_url, url_ok := pkg.repo_urls[arch]
-	if !url_ok {
-		return false,
-			errors.make_error(.Arch_Not_Supported, fmt.tprintf("%s for %s", pkg_name, arch)),
-			""
+	cache, cache_ok := binpkg_cache_open()
+	if !cache_ok {
+		return placed, errors.make_error(.Cache_Dir_Failed, "binpkg cache")
 	}
 
-	// Build the .xbps filename (pkgname-version.arch.xbps)
-	xbps_filename := fmt.tprintf("%s-%s.%s.xbps", pkg_name, pkg.version, arch)
+	Wanted :: struct {
+		dest:   string,
+		bin:    index.Binpkg_Info,
+		object: string,
+	}
+	wanted := make([dynamic]Wanted, context.temp_allocator)
+	missing := make([dynamic]Binpkg_Request, context.temp_allocator)
+	missing_slot := make([dynamic]int, context.temp_allocator)
+
+	for dep in deps {
+		pkg, ok := index.index_get_package(idx, dep)
+		if !ok {
+			return placed, errors.make_error(.Package_Not_Found, dep)
+		}
 
-	// Full URL to the .xbps file
-	full_url := fmt.tprintf("%s/%s", repo_url, xbps_filename)
+		repo_url, url_ok := pkg.repo_urls[arch]
+		if !url_ok {
+			return placed,
+				errors.make_error(.Arch_Not_Supported, fmt.tprintf("%s for %s", dep, arch))
+		}
+
+		// Indexes without binpkg metadata: pkgname-version.arch.xbps
+		bin := pkg.binpkgs[arch]
+		if len(bin.filename) == 0 {
+			bin.filename = fmt.tprintf("%s-%s.%s.xbps", dep, pkg.version, arch)
+		}
+		if strings.contains_rune(bin.filename, '/') || bin.filename[0] == '.' {
+			return placed, errors.make_error(.Download_Failed, fmt.tprintf("invalid filename %s", bin.filename))
+		}
 
-	// Destination path
-	dest_path := utils.path_join(binpkgs_dir, xbps_filename, allocator = context.temp_allocator)
+		dest := utils.path_join(binpkgs_dir, bin.filename, allocator = context.temp_allocator)
+		if os.exists(dest) {
+			errors.log_info("%s already in binpkgs", dep)
+			continue
+		}
 
-	// Check if already exists
-	if os.exists(dest_path) {
-		errors.log_info("%s already in binpkgs", pkg_name)
-		return true, {}, "" // Skipped, so don't mark for cleanup
+		w := Wanted {
+			dest = dest,
+			bin  = bin,
+		}
+		if object, hit := binpkg_cache_lookup(&cache, bin); hit {
+			w.object = object
+		} else {
+			append(
+				&missing,
+				Binpkg_Request{name = dep, url = fmt.tprintf("%s/%s", repo_url, bin.filename), expected = bin},
+			)
+			append(&missing_slot, len(wanted))
+		}
+		append(&wanted, w)
 	}
 
-	// Create binpkgs dir if needed
-	if !utils.mkdir_p(binpkgs_dir) {
-		return false, errors.make_error(.Cache_Dir_Failed, binpkgs_dir), ""
+	if len(wanted) > len(missing) {
+		errors.log_info("%d VUP package(s) found in the package cache", len(wanted) - len(missing))
 	}
 
-	// Download the package
-	errors.log_info("Downloading %s to hostdir/binpkgs...", pkg_name)
+	if len(missing) > 0 {
+		errors.log_info("Downloading %d VUP package(s)...", len(missing))
+		objects, fetch_ok := binpkg_cache_fetch(&cache, missing[:])
+		if !fetch_ok {
+			return placed, errors.make_error(.Download_Failed, "VUP dependencies")
+		}
+		for object, i in objects {
+			wanted[missing_slot[i]].object = object
+		}
+	}
 
-	// Use curl to download (-L to follow redirects)
-	curl_args := []string{"curl", "-fsSL", "-o", dest_path, full_url}
-	if utils.run_command(curl_args) != 0 {
-		return false,
-			errors.make_error(.Download_Failed, fmt.tprintf("%s from %s", pkg_name, full_url)),
-			""
+	for w in wanted {
+		if !binpkg_cache_link(w.object, w.dest) {
+			return placed, errors.make_error(.Command_Failed, fmt.tprintf("link %s", w.dest))
+		}
+		append(&placed, strings.clone(w.bin.filename))
 	}
 
-	return true, {}, xbps_filename
+	return placed, {}
 }
 
 // Install VUP dependencies for a package before building
@@ -246,6 +285,7 @@ install_vup_deps_for_pkg :: proc(
 	pkg_name: string,
 	xbps_src_path: string,
 	idx: ^index.Index,
+	cfg_jobs: int,
 ) -> (
 	bool,
 	errors.Error,
@@ -294,9 +334,9 @@ install_vup_deps_for_pkg :: proc(
 	vup_deps: [dynamic]string
 
 
-	for dep in all_deps {
+	for pattern in all_deps {
 		// Check if it's in VUP index
-		if dep in idx.packages {
+		if dep := xbps.pkgpattern_name(pattern); index.index_has_package(idx, dep) {
 			append(&vup_deps, dep)
 		}
 	}
@@ -306,6 +346,19 @@ install_vup_deps_for_pkg :: proc(
 		return true, {}, installed_files
 	}
 
+	// Dependencies of the VUP packages themselves, transitively. Ones without
+	// a binary for this architecture are built in the VUP checkout first.
+	vup_cfg, have_checkout := default_build_config(context.temp_allocator)
+	vup_srcpkgs := ""
+	if have_checkout {
+		vup_srcpkgs = utils.path_join(vup_cfg.vup_dir, "srcpkgs", allocator = context.temp_allocator)
+	}
+
+	plan, plan_err := build_plan_make(idx, vup_deps[:], vup_srcpkgs, false, false, context.temp_allocator)
+	if plan_err.kind != nil {
+		return false, plan_err, installed_files
+	}
+
 	fmt.printf(
 		"\n%s:: VUP dependencies detected for '%s':%s\n",
 		errors.COLOR_INFO,
@@ -313,7 +366,7 @@ install_vup_deps_for_pkg :: proc(
 		errors.COLOR_RESET,
 	)
 	for dep in vup_deps {
-		pkg_info := idx.packages[dep]
+		pkg_info, _ := index.index_get_package(idx, dep)
 		fmt.printf(
 			"   %s%s%s (%s)\n",
 			errors.COLOR_INFO,
@@ -322,24 +375,54 @@ install_vup_deps_for_pkg :: proc(
 			pkg_info.version,
 		)
 	}
-	fmt.println()
+	build_plan_print(&plan)
 
-	// Download VUP deps to hostdir/binpkgs
+	// Place VUP deps in hostdir/binpkgs
 	binpkgs := get_binpkgs_dir(xbps_src_path, context.temp_allocator)
-	errors.log_info("Downloading VUP dependencies to %s...", binpkgs)
+	if !utils.mkdir_p(binpkgs) {
+		return false, errors.make_error(.Cache_Dir_Failed, binpkgs), installed_files
+	}
 
-	for dep in vup_deps {
-		dl_ok, dl_err, filename := download_vup_pkg_to_binpkgs_and_get_filename(idx, dep, binpkgs)
-		if !dl_ok {
-			return false, dl_err, installed_files
+	if len(plan.nodes) > 0 {
+		if !have_checkout {
+			return false,
+				errors.make_error(.VUP_Repo_Not_Found, fmt.tprintf("needed to build %s", plan.nodes[0].name)),
+				installed_files
+		}
+		if !build_plan_run(&vup_cfg, &plan, idx, cfg_jobs) {
+			return false, errors.make_error(.Build_Failed, plan.nodes[0].name), installed_files
 		}
-		if filename != "" {
+	}
+
+	errors.log_info("Preparing VUP dependencies in %s...", binpkgs)
+
+	placed, place_err := place_vup_deps(idx, plan.prebuilt[:], binpkgs)
+	for f in placed {
+		append(&installed_files, f)
+	}
+	if place_err.kind != nil {
+		return false, place_err, installed_files
+	}
+
+	// Packages built above, from the VUP checkout's binpkgs
+	for node in plan.nodes {
+		path, path_ok := get_built_package_path(&vup_cfg, node.name, context.temp_allocator)
+		if !path_ok {
+			return false, errors.make_error(.Build_Failed, node.name), installed_files
+		}
+		filename := path[strings.last_index_byte(path, '/') + 1:]
+		dest := utils.path_join(binpkgs, filename, allocator = context.temp_allocator)
+		if !os.exists(dest) {
+			if !binpkg_cache_link(path, dest) {
+				return false, errors.make_error(.Command_Failed, fmt.tprintf("link %s", dest)), installed_files
+			}
+			append(&placed, strings.clone(filename))
 			append(&installed_files, strings.clone(filename))
 		}
 	}
 
 	// Update the local repo index so xbps-src can find them
-	idx_ok, idx_err := update_binpkgs_index(binpkgs)
+	idx_ok, idx_err := update_binpkgs_index(binpkgs, placed[:])
 	if !idx_ok {
 		return false, idx_err, installed_files
 	}
@@ -473,16 +556,17 @@ is_valid_cross_target :: proc(target: string) -> bool {
 	return false
 }
 
-// Parse top-level flags from args, returning the cross target (if any), remaining args, and success status
+// Parse top-level flags from args, returning the cross targets (-a, comma
+// separated; none for a native build), remaining args, and success status
 parse_top_level_flags :: proc(
 	args: []string,
 ) -> (
-	cross_target: string,
+	cross_targets: []string,
 	cmd_args: []string,
 	ok: bool,
 ) {
 	i := 0
-	target := ""
+	targets := make([dynamic]string, context.temp_allocator)
 
 	// Parse leading flags before the command
 	for i < len(args) {
@@ -492,26 +576,32 @@ parse_top_level_flags :: proc(
 			// Cross-compile flag
 			if i + 1 >= len(args) {
 				errors.log_error("Option -a requires a target architecture")
-				return "", nil, false
+				return nil, nil, false
 			}
-			target = args[i + 1]
-			if !is_valid_cross_target(target) {
-				errors.log_error("Invalid cross-compile target: %s", target)
-				errors.log_info("Run 'vuru src' to see supported targets")
-				return "", nil, false
+			clear(&targets)
+			parts := strings.split(args[i + 1], ",", context.temp_allocator)
+			for target in parts {
+				if !is_valid_cross_target(target) {
+					errors.log_error("Invalid cross-compile target: %s", target)
+					errors.log_info("Run 'vuru src' to see supported targets")
+					return nil, nil, false
+				}
+				if !slice.contains(targets[:], target) {
+					append(&targets, target)
+				}
 			}
 			i += 2
 		} else if strings.has_prefix(arg, "-") {
 			// Other top-level flags we might add later
 			errors.log_error("Unknown option: %s", arg)
-			return "", nil, false
+			return nil, nil, false
 		} else {
 			// Found the command, return remaining args
 			break
 		}
 	}
 
-	return target, args[i:], true
+	return targets[:], args[i:], true
 }
 
 // Main entry point for xbps-src wrapper
@@ -522,10 +612,11 @@ xbps_src_main :: proc(args: []string, config: ^Config) -> (bool, errors.Error) {
 	}
 
 	// Parse top-level flags like -a <target>
-	cross_target, cmd_args, parse_ok := parse_top_level_flags(args)
+	cross_targets, cmd_args, parse_ok := parse_top_level_flags(args)
 	if !parse_ok {
 		return false, {}
 	}
+	cross_target := cross_targets[0] if len(cross_targets) == 1 else ""
 
 	if len(cmd_args) == 0 {
 		xbps_src_usage()
@@ -543,6 +634,12 @@ xbps_src_main :: proc(args: []string, config: ^Config) -> (bool, errors.Error) {
 		cmd = "pkg"
 	}
 
+	multi_arch := len(cross_targets) > 1
+	if multi_arch && (host_install || !is_package_command(cmd)) {
+		errors.log_error("Several -a targets only work with package commands other than install")
+		return false, {}
+	}
+
 	// Find xbps-src
 	xbps_src_path, found := find_xbps_src()
 	if !found {
@@ -580,7 +677,7 @@ xbps_src_main :: proc(args: []string, config: ^Config) -> (bool, errors.Error) {
 		} else {
 
 
-			ok, err, deps := install_vup_deps_for_pkg(pkg_name, xbps_src_path, &idx)
+			ok, err, deps := install_vup_deps_for_pkg(pkg_name, xbps_src_path, &idx, config.jobs)
 
 			// Transfer dependencies to the main list
 			for d in deps {
@@ -594,6 +691,10 @@ xbps_src_main :: proc(args: []string, config: ^Config) -> (bool, errors.Error) {
 		}
 	}
 
+	if multi_arch {
+		return xbps_src_multi_arch(xbps_src_path, cross_targets, cmd_args, extract_pkg_name(cmd, remaining_args))
+	}
+
 	// Build the full xbps-src args, including -a if specified
 	xbps_args: [dynamic]string
 
@@ -635,13 +736,15 @@ xbps_src_main :: proc(args: []string, config: ^Config) -> (bool, errors.Error) {
 }
 
 xbps_src_usage :: proc() {
-	fmt.println("Usage: vuru src [-a <target>] <command> [options] [package]")
+	fmt.println("Usage: vuru src [-a <target>[,<target>...]] <command> [options] [package]")
 	fmt.println()
 	fmt.println("Wrapper for xbps-src that automatically installs VUP dependencies.")
 	fmt.println("Run this from within a void-packages checkout.")
 	fmt.println()
 	fmt.println("Options:")
-	fmt.println("  -a <target>  Cross compile packages for target architecture")
+	fmt.println("  -a <target>  Cross compile packages for target architecture; with")
+	fmt.println("               several (-a aarch64,x86_64-musl) the builds run at once,")
+	fmt.println("               each in its own masterdir, logs in hostdir/logs")
 	fmt.println()
 	fmt.println("Commands:")
 	fmt.println("  pkg <pkgname>        Build binary package for <pkgname>")
@@ -671,5 +774,8 @@ xbps_src_usage :: proc() {
 	fmt.println("  # Cross-compile for ARM:")
 	fmt.println("  vuru src -a armv7l pkg visual-studio-code")
 	fmt.println()
+	fmt.println("  # Build for several architectures at once:")
+	fmt.println("  vuru src -a x86_64,aarch64,x86_64-musl pkg visual-studio-code")
+	fmt.println()
 	fmt.println("VUP dependencies are automatically installed before building.")
 }
@@ -1,6 +1,7 @@
 package config
 
 import "core:os"
+import "core:strconv"
 import "core:strings"
 import "core:sys/linux"
 
@@ -55,3 +56,17 @@ get_tmpdir :: proc() -> string {
 	}
 	return "/tmp"
 }
+
+// Get the index cache TTL in seconds from VURU_INDEX_TTL, if set
+get_index_ttl :: proc() -> (i64, bool) {
+	value := os.get_env("VURU_INDEX_TTL", context.temp_allocator)
+	if len(value) == 0 {
+		return 0, false
+	}
+
+	ttl, ok := strconv.parse_i64(value)
+	if !ok || ttl < 0 {
+		return 0, false
+	}
+	return ttl, true
+}
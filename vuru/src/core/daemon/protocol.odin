@@ -0,0 +1,407 @@
+package daemon
+
+import "core:mem"
+import "core:os"
+import "core:strings"
+import "core:sys/linux"
+
+import config "../config"
+
+// Local query API of the vuru daemon (vurud). The daemon keeps the index, the
+// installed snapshot and the search index resident and answers requests on a
+// Unix socket; the CLI uses it when one is running and does the work
+// in-process otherwise.
+//
+// Every message is a u32 length followed by the payload (little-endian):
+//   request:  u8 version, u8 op, u8 flags, u16 count, strings (index URL first)
+//   response: u8 status, u32 count, strings
+// A string is a u32 length followed by its bytes.
+
+DAEMON_SOCKET :: "vurud.sock"
+PROTOCOL_VERSION :: 1
+
+// Upper bound for a single message (a description search over everything)
+MAX_MESSAGE_SIZE :: 64 * 1024 * 1024
+
+// How long a client waits for an answer before doing the work itself
+CLIENT_TIMEOUT_MS :: 2000
+
+// How long the daemon waits for a connected client to send its request
+SERVER_TIMEOUT_MS :: 1000
+
+Op :: enum u8 {
+	Ping     = 0,
+	Search   = 1, // args: query, comma-separated categories
+	Info     = 2, // args: package name
+	List     = 3, // installed pkgvers
+	Outdated = 4, // installed VUP packages with a newer version in the index
+}
+
+Flag :: enum u8 {
+	Desc     = 0, // Search descriptions too
+	Vup_Only = 1,
+}
+
+Flags :: bit_set[Flag;u8]
+
+Status :: enum u8 {
+	Ok        = 0,
+	Not_Found = 1,
+	Mismatch  = 2, // Daemon serves a different index URL or protocol version
+	Error     = 3,
+}
+
+Request :: struct {
+	op:        Op,
+	flags:     Flags,
+	index_url: string,
+	args:      []string,
+}
+
+Response :: struct {
+	status: Status,
+	fields: []string, // Flat; each op defines how many fields make a record
+}
+
+// Get the socket path ($XDG_RUNTIME_DIR, else the cache directory)
+daemon_socket_path :: proc(allocator := context.temp_allocator) -> (string, bool) {
+	runtime_dir := os.get_env("XDG_RUNTIME_DIR", context.temp_allocator)
+	if len(runtime_dir) > 0 && runtime_dir[0] == '/' {
+		return strings.concatenate({runtime_dir, "/", DAEMON_SOCKET}, allocator), true
+	}
+
+	cache_dir, ok := config.get_cache_dir(context.temp_allocator)
+	if !ok {
+		return "", false
+	}
+	return strings.concatenate({cache_dir, "/", DAEMON_SOCKET}, allocator), true
+}
+
+// Send a request to the running daemon. Fails fast when no daemon runs, when
+// VURU_NO_DAEMON is set, or when the daemon serves another index, so callers
+// can fall back to in-process work.
+daemon_call :: proc(
+	op: Op,
+	flags: Flags,
+	index_url: string,
+	args: []string,
+	allocator := context.temp_allocator,
+) -> (
+	Response,
+	bool,
+) {
+	if len(os.get_env("VURU_NO_DAEMON", context.temp_allocator)) > 0 {
+		return {}, false
+	}
+
+	path, path_ok := daemon_socket_path()
+	if !path_ok || !os.exists(path) {
+		return {}, false
+	}
+
+	addr, addr_ok := socket_addr(path)
+	if !addr_ok {
+		return {}, false
+	}
+
+	fd, sock_err := linux.socket(.UNIX, .STREAM, {.CLOEXEC}, linux.Protocol(0))
+	if sock_err != nil {
+		return {}, false
+	}
+	defer linux.close(fd)
+
+	if linux.connect(fd, &addr) != nil {
+		return {}, false
+	}
+
+	req := Request {
+		op        = op,
+		flags     = flags,
+		index_url = index_url,
+		args      = args,
+	}
+	if !write_all(fd, request_encode(req)) {
+		return {}, false
+	}
+
+	data, read_ok := read_message(fd, CLIENT_TIMEOUT_MS, allocator)
+	if !read_ok {
+		return {}, false
+	}
+
+	resp, decode_ok := response_decode(data, allocator)
+	if !decode_ok || resp.status == .Mismatch || resp.status == .Error {
+		return {}, false
+	}
+	return resp, true
+}
+
+// Create the listening socket. Fails if another daemon is already running;
+// a socket left behind by a daemon that died is replaced.
+daemon_listen :: proc(path: string) -> (linux.Fd, bool) {
+	addr, addr_ok := socket_addr(path)
+	if !addr_ok {
+		return -1, false
+	}
+
+	if probe, err := linux.socket(.UNIX, .STREAM, {.CLOEXEC}, linux.Protocol(0)); err == nil {
+		running := linux.connect(probe, &addr) == nil
+		linux.close(probe)
+		if running {
+			return -1, false
+		}
+	}
+	os.remove(path)
+
+	fd, sock_err := linux.socket(.UNIX, .STREAM, {.CLOEXEC}, linux.Protocol(0))
+	if sock_err != nil {
+		return -1, false
+	}
+	if linux.bind(fd, &addr) != nil || linux.listen(fd, 16) != nil {
+		linux.close(fd)
+		return -1, false
+	}
+	return fd, true
+}
+
+// Close the listening socket and remove its path
+daemon_close :: proc(fd: linux.Fd, path: string) {
+	linux.close(fd)
+	os.remove(path)
+}
+
+// Accept one connection and read its request (views into temp memory)
+daemon_accept :: proc(listen_fd: linux.Fd) -> (conn: linux.Fd, req: Request, ok: bool) {
+	peer: linux.Sock_Addr_Un
+	accept_err: linux.Errno
+	conn, accept_err = linux.accept(listen_fd, &peer, {.CLOEXEC})
+	if accept_err != nil {
+		return -1, {}, false
+	}
+
+	data, read_ok := read_message(conn, SERVER_TIMEOUT_MS, context.temp_allocator)
+	if !read_ok {
+		linux.close(conn)
+		return -1, {}, false
+	}
+
+	req, ok = request_decode(data, context.temp_allocator)
+	if !ok {
+		// Unknown protocol version: tell the client to work in-process
+		write_all(conn, response_encode({status = .Mismatch}))
+		linux.close(conn)
+		return -1, {}, false
+	}
+	return conn, req, true
+}
+
+// Send the response and close the connection
+daemon_respond :: proc(conn: linux.Fd, resp: Response) -> bool {
+	defer linux.close(conn)
+	return write_all(conn, response_encode(resp))
+}
+
+@(private)
+socket_addr :: proc(path: string) -> (linux.Sock_Addr_Un, bool) {
+	addr := linux.Sock_Addr_Un {
+		sun_family = .UNIX,
+	}
+	if len(path) >= len(addr.sun_path) {
+		return {}, false
+	}
+	copy(addr.sun_path[:], path)
+	return addr, true
+}
+
+@(private)
+request_encode :: proc(req: Request) -> []u8 {
+	b := make([dynamic]u8, 4, context.temp_allocator)
+	append(&b, PROTOCOL_VERSION, u8(req.op), transmute(u8)req.flags)
+	count := u16le(len(req.args) + 1)
+	append(&b, ..mem.ptr_to_bytes(&count))
+	put_string(&b, req.index_url)
+	for arg in req.args {
+		put_string(&b, arg)
+	}
+	return finish_message(&b)
+}
+
+@(private)
+request_decode :: proc(data: []u8, allocator := context.temp_allocator) -> (req: Request, ok: bool) {
+	r := Reader {
+		data = data,
+	}
+	version := get_u8(&r) or_return
+	op := get_u8(&r) or_return
+	flags := get_u8(&r) or_return
+	count := get_u16(&r) or_return
+	if version != PROTOCOL_VERSION || op > u8(max(Op)) || count == 0 {
+		return {}, false
+	}
+
+	req.op = Op(op)
+	req.flags = transmute(Flags)flags
+	req.index_url = get_string(&r) or_return
+	args := make([]string, int(count) - 1, allocator)
+	for &arg in args {
+		arg = get_string(&r) or_return
+	}
+	req.args = args
+	return req, true
+}
+
+@(private)
+response_encode :: proc(resp: Response) -> []u8 {
+	b := make([dynamic]u8, 4, context.temp_allocator)
+	append(&b, u8(resp.status))
+	count := u32le(len(resp.fields))
+	append(&b, ..mem.ptr_to_bytes(&count))
+	for f in resp.fields {
+		put_string(&b, f)
+	}
+	return finish_message(&b)
+}
+
+@(private)
+response_decode :: proc(data: []u8, allocator := context.temp_allocator) -> (resp: Response, ok: bool) {
+	r := Reader {
+		data = data,
+	}
+	status := get_u8(&r) or_return
+	count := get_u32(&r) or_return
+	if status > u8(max(Status)) || int(count) > len(data) / 4 {
+		return {}, false
+	}
+
+	resp.status = Status(status)
+	resp.fields = make([]string, int(count), allocator)
+	for &f in resp.fields {
+		f = get_string(&r) or_return
+	}
+	return resp, true
+}
+
+@(private)
+put_string :: proc(b: ^[dynamic]u8, s: string) {
+	n := u32le(len(s))
+	append(b, ..mem.ptr_to_bytes(&n))
+	append(b, s)
+}
+
+// Fill in the length prefix reserved at the start of b
+@(private)
+finish_message :: proc(b: ^[dynamic]u8) -> []u8 {
+	n := u32le(len(b) - 4)
+	copy(b[:4], mem.ptr_to_bytes(&n))
+	return b[:]
+}
+
+@(private)
+Reader :: struct {
+	data: []u8,
+	off:  int,
+}
+
+@(private)
+get_u8 :: proc(r: ^Reader) -> (u8, bool) {
+	if r.off >= len(r.data) {
+		return 0, false
+	}
+	r.off += 1
+	return r.data[r.off - 1], true
+}
+
+@(private)
+get_u16 :: proc(r: ^Reader) -> (u16, bool) {
+	if len(r.data) - r.off < 2 {
+		return 0, false
+	}
+	v := u16((^u16le)(raw_data(r.data[r.off:]))^)
+	r.off += 2
+	return v, true
+}
+
+@(private)
+get_u32 :: proc(r: ^Reader) -> (u32, bool) {
+	if len(r.data) - r.off < 4 {
+		return 0, false
+	}
+	v := u32((^u32le)(raw_data(r.data[r.off:]))^)
+	r.off += 4
+	return v, true
+}
+
+// Read a string (a view into the message)
+@(private)
+get_string :: proc(r: ^Reader) -> (s: string, ok: bool) {
+	n := int(get_u32(r) or_return)
+	if n > len(r.data) - r.off {
+		return "", false
+	}
+	s = string(r.data[r.off:][:n])
+	r.off += n
+	return s, true
+}
+
+// Write everything; MSG_NOSIGNAL keeps a vanished peer from killing the daemon
+@(private)
+write_all :: proc(fd: linux.Fd, data: []u8) -> bool {
+	off := 0
+	for off < len(data) {
+		n, err := linux.send(fd, data[off:], {.NOSIGNAL})
+		if err == .EINTR {
+			continue
+		}
+		if err != nil || n <= 0 {
+			return false
+		}
+		off += n
+	}
+	return true
+}
+
+// Read exactly len(buf) bytes, waiting at most timeout_ms for each chunk
+@(private)
+read_exact :: proc(fd: linux.Fd, buf: []u8, timeout_ms: i32) -> bool {
+	off := 0
+	for off < len(buf) {
+		fds := [1]linux.Poll_Fd{{fd = fd, events = {.IN}}}
+		ready, poll_err := linux.poll(fds[:], timeout_ms)
+		if poll_err == .EINTR {
+			continue
+		}
+		if poll_err != nil || ready == 0 {
+			return false
+		}
+
+		n, err := linux.read(fd, buf[off:])
+		if err == .EINTR {
+			continue
+		}
+		if err != nil || n <= 0 {
+			return false
+		}
+		off += n
+	}
+	return true
+}
+
+// Read one length-prefixed message
+@(private)
+read_message :: proc(fd: linux.Fd, timeout_ms: i32, allocator := context.temp_allocator) -> ([]u8, bool) {
+	header: [4]u8
+	if !read_exact(fd, header[:], timeout_ms) {
+		return nil, false
+	}
+
+	n := int(transmute(u32le)header)
+	if n > MAX_MESSAGE_SIZE {
+		return nil, false
+	}
+
+	data := make([]u8, n, allocator)
+	if !read_exact(fd, data, timeout_ms) {
+		return nil, false
+	}
+	return data, true
+}
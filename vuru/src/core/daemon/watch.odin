@@ -0,0 +1,76 @@
+package daemon
+
+import "core:strings"
+import "core:sys/linux"
+
+// inotify watcher for the files the daemon's resident state is built from.
+// Only directories are watched: the cache and pkgdb files are replaced by
+// rename, which a watch on the file itself would not survive.
+
+// Events that mean a file in a watched directory was (re)written or removed
+WATCH_EVENTS :: linux.Inotify_Event_Mask{.CLOSE_WRITE, .MOVED_TO, .MOVED_FROM, .DELETE}
+
+// Event queue overflowed; changes were lost
+@(private)
+IN_Q_OVERFLOW :: 0x4000
+
+// Fixed part of a struct inotify_event; name (len bytes, NUL padded) follows
+@(private)
+Inotify_Header :: struct #packed {
+	wd:     i32,
+	mask:   u32,
+	cookie: u32,
+	len:    u32,
+}
+
+// Watch dirs (missing ones are skipped); returns the non-blocking inotify fd
+watcher_open :: proc(dirs: []string) -> (linux.Fd, bool) {
+	fd, err := linux.inotify_init1({.NONBLOCK, .CLOEXEC})
+	if err != nil {
+		return -1, false
+	}
+
+	watched := 0
+	for dir in dirs {
+		cdir := strings.clone_to_cstring(dir, context.temp_allocator)
+		if _, watch_err := linux.inotify_add_watch(fd, cdir, WATCH_EVENTS); watch_err == nil {
+			watched += 1
+		}
+	}
+
+	if watched == 0 {
+		linux.close(fd)
+		return -1, false
+	}
+	return fd, true
+}
+
+// Read all pending events; true if any names a file relevant() accepts
+watcher_drain :: proc(fd: linux.Fd, relevant: proc(name: string) -> bool) -> bool {
+	buf: [4096]u8
+	changed := false
+
+	for {
+		n, err := linux.read(fd, buf[:])
+		if err == .EINTR {
+			continue
+		}
+		if err != nil || n <= 0 {
+			// EAGAIN: drained
+			return changed
+		}
+
+		off := 0
+		for off + size_of(Inotify_Header) <= n {
+			ev := (^Inotify_Header)(raw_data(buf[off:]))
+			name_start := off + size_of(Inotify_Header)
+			name_end := min(name_start + int(ev.len), n)
+			off = name_end
+
+			name := strings.trim_right_null(string(buf[name_start:name_end]))
+			if ev.mask & IN_Q_OVERFLOW != 0 || (len(name) > 0 && relevant(name)) {
+				changed = true
+			}
+		}
+	}
+}
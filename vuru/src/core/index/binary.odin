@@ -0,0 +1,235 @@
+package index
+
+import "core:os"
+import "core:strings"
+import "core:sys/linux"
+
+// Compact binary index (index.bin), published next to index.json.
+// The file is mmap'd and served as zero-copy views, so loading it does not
+// scale with the number of packages. Layout must match write_binary_index()
+// in vup/scripts/generate_index.py.
+
+BINARY_INDEX_MAGIC :: "VUPI"
+BINARY_INDEX_VERSION :: 2
+
+// Record flag: dependency lists are present
+BINARY_FLAG_HAS_DEPS :: 1
+
+Binary_Header :: struct #packed {
+	magic:       [4]u8,
+	version:     u32le,
+	count:       u32le,
+	record_size: u32le,
+	records_off: u32le,
+	lists_off:   u32le,
+	lists_count: u32le,
+	archs_off:   u32le,
+	archs_count: u32le,
+	pool_off:    u32le,
+	pool_size:   u32le,
+	reserved:    u32le,
+}
+
+// String reference into the pool
+Binary_Str :: struct #packed {
+	off: u32le,
+	len: u32le,
+}
+
+// Range in the lists or archs table
+Binary_List :: struct #packed {
+	start: u32le,
+	count: u32le,
+}
+
+Binary_Record :: struct #packed {
+	name:            Binary_Str,
+	version:         Binary_Str,
+	category:        Binary_Str,
+	short_desc:      Binary_Str,
+	template_hash:   Binary_Str,
+	depends:         Binary_List,
+	makedepends:     Binary_List,
+	hostmakedepends: Binary_List,
+	archs:           Binary_List,
+	flags:           u32le,
+	reserved:        u32le,
+}
+
+Binary_Arch :: struct #packed {
+	arch:     Binary_Str,
+	repo_url: Binary_Str,
+	filename: Binary_Str,
+	sha256:   Binary_Str,
+	size:     u64le,
+}
+
+// Mapped index.bin; all slices point into the mapping
+Mapped_Index :: struct {
+	data:    []u8,
+	records: []Binary_Record,
+	lists:   []Binary_Str,
+	archs:   []Binary_Arch,
+	pool:    string,
+}
+
+// Map an index.bin file. The returned Index owns the mapping (index_free unmaps it).
+load_index_from_binary :: proc(path: string, allocator := context.allocator) -> (Index, bool) {
+	idx := index_make(allocator)
+	if !index_map_binary(&idx, path) {
+		index_free(&idx)
+		return {}, false
+	}
+	return idx, true
+}
+
+// Map a binary index file (whole index or one shard) and add it to idx
+index_map_binary :: proc(idx: ^Index, path: string) -> bool {
+	fi, stat_err := os.stat(path, context.temp_allocator)
+	if stat_err != os.ERROR_NONE || fi.size < size_of(Binary_Header) {
+		return false
+	}
+
+	cpath := strings.clone_to_cstring(path, context.temp_allocator)
+	fd, open_err := linux.open(cpath, {})
+	if open_err != nil {
+		return false
+	}
+	defer linux.close(fd)
+
+	size := uint(fi.size)
+	addr, mmap_err := linux.mmap(0, size, {.READ}, {.PRIVATE}, fd)
+	if mmap_err != nil {
+		return false
+	}
+
+	data := ([^]u8)(addr)[:size]
+	m, ok := mapped_index_validate(data)
+	if !ok {
+		linux.munmap(addr, size)
+		return false
+	}
+
+	append(&idx.mapped, m)
+	return true
+}
+
+// Unmap a mapped index
+mapped_index_free :: proc(m: ^Mapped_Index) {
+	if m == nil || m.data == nil do return
+	linux.munmap(raw_data(m.data), uint(len(m.data)))
+	m^ = {}
+}
+
+// Check the header and table bounds; string references are checked on access
+@(private)
+mapped_index_validate :: proc(data: []u8) -> (Mapped_Index, bool) {
+	h := (^Binary_Header)(raw_data(data))
+	if string(h.magic[:]) != BINARY_INDEX_MAGIC || h.version != BINARY_INDEX_VERSION {
+		return {}, false
+	}
+	if int(h.record_size) != size_of(Binary_Record) {
+		return {}, false
+	}
+
+	in_bounds :: proc(data: []u8, off: u32le, count: u32le, elem_size: int) -> bool {
+		return int(off) <= len(data) && int(count) <= (len(data) - int(off)) / elem_size
+	}
+
+	if !in_bounds(data, h.records_off, h.count, size_of(Binary_Record)) ||
+	   !in_bounds(data, h.lists_off, h.lists_count, size_of(Binary_Str)) ||
+	   !in_bounds(data, h.archs_off, h.archs_count, size_of(Binary_Arch)) ||
+	   !in_bounds(data, h.pool_off, h.pool_size, 1) {
+		return {}, false
+	}
+
+	return Mapped_Index {
+			data = data,
+			records = ([^]Binary_Record)(raw_data(data[h.records_off:]))[:h.count],
+			lists = ([^]Binary_Str)(raw_data(data[h.lists_off:]))[:h.lists_count],
+			archs = ([^]Binary_Arch)(raw_data(data[h.archs_off:]))[:h.archs_count],
+			pool = string(data[h.pool_off:][:h.pool_size]),
+		},
+		true
+}
+
+// Resolve a string reference (empty if out of bounds)
+@(private)
+mapped_str :: #force_inline proc(m: ^Mapped_Index, s: Binary_Str) -> string {
+	off, n := int(s.off), int(s.len)
+	if off > len(m.pool) || n > len(m.pool) - off {
+		return ""
+	}
+	return m.pool[off:][:n]
+}
+
+// Binary search the sorted name table
+mapped_find :: proc(m: ^Mapped_Index, name: string) -> (^Binary_Record, bool) {
+	lo, hi := 0, len(m.records)
+	for lo < hi {
+		mid := lo + (hi - lo) / 2
+		rec := &m.records[mid]
+		switch key := mapped_str(m, rec.name); {
+		case key < name:
+			lo = mid + 1
+		case key > name:
+			hi = mid
+		case:
+			return rec, true
+		}
+	}
+	return nil, false
+}
+
+// Build a Package_Info view for a record. Strings point into the mapping;
+// only the slices and maps are allocated.
+mapped_package_info :: proc(
+	m: ^Mapped_Index,
+	rec: ^Binary_Record,
+	allocator := context.temp_allocator,
+) -> Package_Info {
+	pkg := Package_Info {
+		version         = mapped_str(m, rec.version),
+		category        = mapped_str(m, rec.category),
+		short_desc      = mapped_str(m, rec.short_desc),
+		template_hash   = mapped_str(m, rec.template_hash),
+		has_deps        = rec.flags & BINARY_FLAG_HAS_DEPS != 0,
+		depends         = mapped_list(m, rec.depends, allocator),
+		makedepends     = mapped_list(m, rec.makedepends, allocator),
+		hostmakedepends = mapped_list(m, rec.hostmakedepends, allocator),
+	}
+
+	start, count := int(rec.archs.start), int(rec.archs.count)
+	if start > len(m.archs) || count > len(m.archs) - start {
+		return pkg
+	}
+
+	pkg.repo_urls = make(map[string]string, count, allocator)
+	pkg.binpkgs = make(map[string]Binpkg_Info, count, allocator)
+	for &a in m.archs[start:][:count] {
+		arch := mapped_str(m, a.arch)
+		pkg.repo_urls[arch] = mapped_str(m, a.repo_url)
+		pkg.binpkgs[arch] = Binpkg_Info {
+			filename = mapped_str(m, a.filename),
+			sha256   = mapped_str(m, a.sha256),
+			size     = i64(a.size),
+		}
+	}
+
+	return pkg
+}
+
+// Resolve a string list reference into views
+@(private)
+mapped_list :: proc(m: ^Mapped_Index, l: Binary_List, allocator := context.temp_allocator) -> []string {
+	start, count := int(l.start), int(l.count)
+	if count == 0 || start > len(m.lists) || count > len(m.lists) - start {
+		return nil
+	}
+
+	result := make([]string, count, allocator)
+	for s, i in m.lists[start:][:count] {
+		result[i] = mapped_str(m, s)
+	}
+	return result
+}
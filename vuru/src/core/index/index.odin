@@ -4,10 +4,13 @@ import "core:encoding/json"
 import "core:fmt"
 import "core:os"
 import "core:strings"
+import "core:sys/linux"
+import "core:time"
 
 import "../../utils"
 import config "../config"
 import errors "../errors"
+import net "../net"
 
 // Validate URL - checks for valid scheme and dangerous characters
 is_valid_url :: proc(url: string) -> bool {
@@ -33,35 +36,42 @@ is_valid_url :: proc(url: string) -> bool {
 // Parse index from JSON content
 parse_index :: proc(content: string, allocator := context.allocator) -> (Index, bool) {
 	idx := index_make(allocator)
+	if !parse_index_into(&idx, content) {
+		index_free(&idx)
+		return {}, false
+	}
+	return idx, true
+}
+
+// Parse index JSON (whole index or one shard) and add its packages to idx
+parse_index_into :: proc(idx: ^Index, content: string) -> bool {
+	allocator := idx.allocator
+	interner := &idx.interner
 
 	// Parse JSON using temp allocator since we clone what we need
 	parsed, err := json.parse(transmute([]u8)content, allocator = context.temp_allocator)
 	if err != .None {
 		errors.log_error("Failed to parse index JSON")
-		index_free(&idx)
-		return {}, false
+		return false
 	}
 
 	root, ok := parsed.(json.Object)
 	if !ok {
 		errors.log_error("Invalid index format")
-		index_free(&idx)
-		return {}, false
+		return false
 	}
 
 	// Get the "packages" object from root
 	packages_val, has_packages := root["packages"]
 	if !has_packages {
 		errors.log_error("Index missing 'packages' field")
-		index_free(&idx)
-		return {}, false
+		return false
 	}
 
 	packages_obj, is_packages_obj := packages_val.(json.Object)
 	if !is_packages_obj {
 		errors.log_error("Index 'packages' field is not an object")
-		index_free(&idx)
-		return {}, false
+		return false
 	}
 
 	// Iterate packages
@@ -83,7 +93,7 @@ parse_index :: proc(content: string, allocator := context.allocator) -> (Index,
 		// Parse category
 		if v, has := pkg_obj["category"]; has {
 			if s, is_str := v.(json.String); is_str {
-				pkg.category = strings.clone(s, allocator)
+				pkg.category = utils.intern_string(interner, s)
 			}
 		}
 
@@ -94,25 +104,97 @@ parse_index :: proc(content: string, allocator := context.allocator) -> (Index,
 			}
 		}
 
+		// Parse dependency lists (absent in indexes generated before they were added)
+		if v, has := pkg_obj["depends"]; has {
+			pkg.depends = parse_string_array(v, interner, allocator)
+			pkg.has_deps = true
+		}
+		if v, has := pkg_obj["makedepends"]; has {
+			pkg.makedepends = parse_string_array(v, interner, allocator)
+		}
+		if v, has := pkg_obj["hostmakedepends"]; has {
+			pkg.hostmakedepends = parse_string_array(v, interner, allocator)
+		}
+
+		// Parse template_hash
+		if v, has := pkg_obj["template_hash"]; has {
+			if s, is_str := v.(json.String); is_str {
+				pkg.template_hash = strings.clone(s, allocator)
+			}
+		}
+
+		// Parse binpkgs map
+		if v, has := pkg_obj["binpkgs"]; has {
+			if bins_obj, is_bins_obj := v.(json.Object); is_bins_obj {
+				pkg.binpkgs = make(map[string]Binpkg_Info, allocator = allocator)
+				for arch, bin_val in bins_obj {
+					bin_obj, is_bin_obj := bin_val.(json.Object)
+					if !is_bin_obj {
+						continue
+					}
+
+					bin := Binpkg_Info{}
+					if f, is_str := bin_obj["filename"].(json.String); is_str {
+						bin.filename = strings.clone(f, allocator)
+					}
+					if h, is_str := bin_obj["sha256"].(json.String); is_str {
+						bin.sha256 = strings.clone(h, allocator)
+					}
+					#partial switch size in bin_obj["size"] {
+					case json.Integer:
+						bin.size = size
+					case json.Float:
+						bin.size = i64(size)
+					}
+					pkg.binpkgs[utils.intern_string(interner, arch)] = bin
+				}
+			}
+		}
+
 		// Parse repo_urls map
 		if v, has := pkg_obj["repo_urls"]; has {
 			if urls_obj, is_urls_obj := v.(json.Object); is_urls_obj {
 				pkg.repo_urls = make(map[string]string, allocator = allocator)
 				for arch, url_val in urls_obj {
 					if url_str, is_url_str := url_val.(json.String); is_url_str {
-						pkg.repo_urls[strings.clone(arch, allocator)] = strings.clone(
+						pkg.repo_urls[utils.intern_string(interner, arch)] = utils.intern_string(
+							interner,
 							url_str,
-							allocator,
 						)
 					}
 				}
 			}
 		}
 
-		idx.packages[strings.clone(name, allocator)] = pkg
+		if name in idx.packages {
+			package_info_free(&pkg, allocator)
+			continue
+		}
+		idx.packages[utils.intern_string(interner, name)] = pkg
+	}
+
+	return true
+}
+
+// Intern a JSON array of strings (non-string elements are skipped)
+@(private)
+parse_string_array :: proc(
+	v: json.Value,
+	interner: ^utils.Interner,
+	allocator := context.allocator,
+) -> []string {
+	arr, is_arr := v.(json.Array)
+	if !is_arr {
+		return nil
 	}
 
-	return idx, true
+	result := make([dynamic]string, 0, len(arr), allocator)
+	for elem in arr {
+		if s, is_str := elem.(json.String); is_str {
+			append(&result, utils.intern_string(interner, s))
+		}
+	}
+	return result[:]
 }
 
 // Load index from file
@@ -125,13 +207,43 @@ load_index_from_file :: proc(path: string, allocator := context.allocator) -> (I
 	return parse_index(content, allocator)
 }
 
+// Default time an index is considered fresh, in seconds.
+// Override with VURU_INDEX_TTL; the effective value is kept in index.json.ttl.
+DEFAULT_INDEX_TTL :: 60 * 60
+
+// A refresh lock younger than this means a background refresh is running
+REFRESH_LOCK_AGE :: 2 * 60
+
+// Outcome of a revalidation (also the exit code of a refresh process)
+Revalidate_Result :: enum int {
+	Updated      = 0,
+	Not_Modified = 1,
+	Failed       = 2,
+}
+
+// Revalidation running concurrently in a child process
+Index_Refresh :: struct {
+	url:     string,
+	pid:     linux.Pid,
+	started: bool,
+}
+
 // Get cache paths for index files
 @(private)
 Cache_Paths :: struct {
-	dir:   string,
-	index: string,
-	etag:  string,
-	temp:  string,
+	dir:         string,
+	index:       string,
+	etag:        string,
+	ttl:         string, // "<last validated, unix seconds> <ttl seconds>"
+	lock:        string, // Present while a background refresh runs
+	temp:        string, // Temp files are per process so refreshes never collide
+	binary:      string, // index.bin, preferred over index.json when present
+	binary_temp: string,
+	manifest:      string, // Sharded index, preferred over both when present
+	manifest_etag: string,
+	manifest_temp: string,
+	shards:        string, // Directory of cached <category>.bin/.json shards
+	pid:           linux.Pid,
 }
 
 @(private)
@@ -141,61 +253,68 @@ get_cache_paths :: proc() -> (Cache_Paths, bool) {
 		return {}, false
 	}
 
+	pid := linux.getpid()
+	cache_file :: proc(dir: string, name: string) -> string {
+		return utils.path_join(dir, name, allocator = context.temp_allocator)
+	}
+
 	return Cache_Paths {
 			dir = cache_dir,
-			index = utils.path_join(cache_dir, "index.json", allocator = context.temp_allocator),
-			etag = utils.path_join(
-				cache_dir,
-				"index.json.etag",
-				allocator = context.temp_allocator,
-			),
-			temp = utils.path_join(
-				cache_dir,
-				"index.json.tmp",
-				allocator = context.temp_allocator,
-			),
+			index = cache_file(cache_dir, "index.json"),
+			etag = cache_file(cache_dir, "index.json.etag"),
+			ttl = cache_file(cache_dir, "index.json.ttl"),
+			lock = cache_file(cache_dir, "index.json.lock"),
+			temp = cache_file(cache_dir, fmt.tprintf("index.json.tmp.%d", pid)),
+			binary = cache_file(cache_dir, "index.bin"),
+			binary_temp = cache_file(cache_dir, fmt.tprintf("index.bin.tmp.%d", pid)),
+			manifest = cache_file(cache_dir, "manifest.json"),
+			manifest_etag = cache_file(cache_dir, "manifest.json.etag"),
+			manifest_temp = cache_file(cache_dir, fmt.tprintf("manifest.json.tmp.%d", pid)),
+			shards = cache_file(cache_dir, "shards"),
+			pid = pid,
 		},
 		true
 }
 
-// Fetch index from URL, returns HTTP status code
+// Fetch index (or manifest) from URL into out_path, returns the HTTP status
+// code and the response's ETag; false if the server could not be reached
 @(private)
 fetch_index_from_url :: proc(
 	url: string,
-	paths: Cache_Paths,
+	out_path: string,
 	old_etag: string,
 ) -> (
 	status: string,
+	etag: string,
 	ok: bool,
 ) {
-	curl_args := make([dynamic]string, context.temp_allocator)
-
-	append(&curl_args, "curl", "-s", "-L", "-w", "%{http_code}")
-
-	// Use conditional request if we have an etag
-	if len(old_etag) > 0 {
-		append(&curl_args, "-H", fmt.tprintf("If-None-Match: %s", old_etag))
+	// Conditional request if we have an etag
+	res := net.download_one(net.Request{url = url, dest = out_path, etag = old_etag})
+	if res.http_code == 0 {
+		return "", "", false
 	}
-
-	append(&curl_args, "-o", paths.temp, url)
-
-	output, cmd_ok := utils.run_command_output(curl_args[:], context.temp_allocator)
-	if !cmd_ok {
-		return "", false
+	if res.status == .Failed && res.http_code == 200 {
+		return "", "", false
 	}
-
-	return strings.trim_space(output), true
+	return fmt.tprintf("%d", res.http_code), res.etag, true
 }
 
 // Load or fetch index - main entry point
+// Without force_update a cached index is always served immediately; once it
+// is older than the TTL a detached process revalidates it for the next run.
+// force_update blocks on a conditional request (vuru sync).
+// With categories set only those shards are loaded (sharded indexes only).
 index_load_or_fetch :: proc(
 	url: string,
 	force_update: bool,
 	allocator := context.allocator,
+	categories: []string = nil,
 ) -> (
 	Index,
 	bool,
 ) {
+	utils.stats_span("index_load_or_fetch")
+
 	// Validate URL first
 	if !is_valid_url(url) {
 		errors.log_error("Invalid or unsafe URL provided")
@@ -215,72 +334,321 @@ index_load_or_fetch :: proc(
 		return {}, false
 	}
 
-	// Try to load from cache if not forced
-	if !force_update && os.exists(paths.index) {
-		if idx, ok := load_index_from_file(paths.index, allocator); ok {
+	// Serve from cache if not forced (stale-while-revalidate)
+	if !force_update && cache_exists(paths) {
+		if !cache_is_fresh(paths) && !refresh_in_progress(paths) {
+			spawn_refresh(url, paths, detach = true)
+		}
+		if idx, ok := load_cached_index(paths, allocator, categories); ok {
 			return idx, true
 		}
 	}
 
-	// Read existing ETag for conditional request
+	errors.log_info("Fetching index...")
+
+	switch revalidate(url, paths) {
+	case .Not_Modified:
+		errors.log_info("Index not modified (cached)")
+	case .Updated:
+		errors.log_info("Index updated")
+	case .Failed:
+		errors.log_error("Failed to fetch index")
+		return try_fallback_to_cache(paths, allocator, categories)
+	}
+
+	return load_cached_index(paths, allocator, categories)
+}
+
+// Start revalidating the index in a child process (see index_refresh_wait)
+index_refresh_start :: proc(url: string) -> Index_Refresh {
+	r := Index_Refresh {
+		url = url,
+	}
+
+	if !is_valid_url(url) {
+		return r
+	}
+
+	paths, paths_ok := get_cache_paths()
+	if !paths_ok || !utils.mkdir_p(paths.dir) {
+		return r
+	}
+
+	r.pid, r.started = spawn_refresh(url, paths, detach = false)
+	return r
+}
+
+// Wait for a refresh started with index_refresh_start and load the result
+// Falls back to a blocking fetch if the refresh could not be started.
+index_refresh_wait :: proc(r: ^Index_Refresh, allocator := context.allocator) -> (Index, bool) {
+	if !r.started {
+		return index_load_or_fetch(r.url, true, allocator)
+	}
+	r.started = false
+
+	status: u32
+	result := Revalidate_Result.Failed
+	if _, err := linux.waitpid(r.pid, &status, {}, nil); err == nil && (status & 0x7f) == 0 {
+		if code := int((status & 0xff00) >> 8); code <= int(Revalidate_Result.Failed) {
+			result = Revalidate_Result(code)
+		}
+	}
+
+	paths, paths_ok := get_cache_paths()
+	if !paths_ok {
+		errors.log_error("Could not determine cache directory")
+		return {}, false
+	}
+
+	switch result {
+	case .Not_Modified:
+		errors.log_info("Index not modified (cached)")
+	case .Updated:
+		errors.log_info("Index updated")
+	case .Failed:
+		errors.log_error("Failed to fetch index")
+		return try_fallback_to_cache(paths, allocator)
+	}
+
+	return load_cached_index(paths, allocator)
+}
+
+// Start a detached refresh once the cached index is past its TTL
+// (for long-running callers that hold an index instead of reloading it)
+index_revalidate_if_stale :: proc(url: string) {
+	if !is_valid_url(url) {
+		return
+	}
+
+	paths, paths_ok := get_cache_paths()
+	if !paths_ok || !cache_exists(paths) {
+		return
+	}
+
+	if !cache_is_fresh(paths) && !refresh_in_progress(paths) {
+		spawn_refresh(url, paths, detach = true)
+	}
+}
+
+// Conditionally re-download the index and swap it in atomically
+// Sharded indexes are preferred; index.json is used when no manifest is published.
+@(private)
+revalidate :: proc(url: string, paths: Cache_Paths) -> Revalidate_Result {
+	if result, has_manifest := sync_shards(url, paths); has_manifest {
+		if result != .Failed {
+			write_ttl_stamp(paths)
+		}
+		return result
+	}
+
+	defer os.remove(paths.temp)
+
+	// Only send the ETag if the cached copy it belongs to still exists
 	old_etag := ""
-	if !force_update && os.exists(paths.etag) {
+	if os.exists(paths.index) {
 		if content, ok := utils.read_file(paths.etag, context.temp_allocator); ok {
 			old_etag = strings.trim_space(content)
 		}
 	}
 
-	errors.log_info("Fetching index...")
-
-	// Fetch from URL
-	status, fetch_ok := fetch_index_from_url(url, paths, old_etag)
+	status, etag, fetch_ok := fetch_index_from_url(url, paths.temp, old_etag)
 	if !fetch_ok {
-		errors.log_error("Failed to fetch index")
-		os.remove(paths.temp)
-		return try_fallback_to_cache(paths.index, allocator)
+		return .Failed
 	}
 
-	// Handle response based on status
 	switch status {
 	case "304":
-		// Not modified - use cache
-		errors.log_info("Index not modified (cached)")
-		os.remove(paths.temp)
-		return load_index_from_file(paths.index, allocator)
+		// Pick up index.bin if an older vuru only cached the JSON
+		if !os.exists(paths.binary) && fetch_binary_index(url, paths) {
+			if os.rename(paths.binary_temp, paths.binary) != os.ERROR_NONE {
+				os.remove(paths.binary_temp)
+			}
+		}
+		write_ttl_stamp(paths)
+		utils.stats_cache("index (ETag)", hit = true)
+		return .Not_Modified
 
 	case "200":
-		// Success - move temp file to index
-		errors.log_info("Index updated")
-		os.remove(paths.index)
+		utils.stats_cache("index (ETag)", hit = false)
+		// Fetch index.bin first so both files are swapped in together
+		bin_ok := fetch_binary_index(url, paths)
 
 		if os.rename(paths.temp, paths.index) != os.ERROR_NONE {
-			errors.log_error("Failed to save index")
-			os.remove(paths.temp)
-			return {}, false
+			os.remove(paths.binary_temp)
+			return .Failed
+		}
+
+		// A stale index.bin must never shadow the new index.json
+		if !bin_ok || os.rename(paths.binary_temp, paths.binary) != os.ERROR_NONE {
+			os.remove(paths.binary_temp)
+			os.remove(paths.binary)
+		}
+
+		if len(etag) > 0 {
+			utils.write_file(paths.etag, etag)
+		} else {
+			os.remove(paths.etag)
+		}
+
+		write_ttl_stamp(paths)
+		return .Updated
+	}
+
+	return .Failed
+}
+
+// Fork a process that revalidates the index and exits with a Revalidate_Result.
+// A detached refresh outlives the command and reports nothing.
+@(private)
+spawn_refresh :: proc(url: string, paths: Cache_Paths, detach: bool) -> (linux.Pid, bool) {
+	if detach {
+		utils.write_file(paths.lock, "")
+	}
+
+	pid, err := linux.fork()
+	if err != nil {
+		if detach do os.remove(paths.lock)
+		return 0, false
+	}
+
+	if pid == 0 {
+		// Child - keep the terminal clean
+		if detach {
+			linux.setsid()
+		}
+		if null_fd, null_err := linux.open("/dev/null", {.RDWR}); null_err == nil {
+			linux.dup2(null_fd, linux.STDOUT_FILENO)
+			linux.dup2(null_fd, linux.STDERR_FILENO)
+			linux.close(null_fd)
 		}
 
-		return load_index_from_file(paths.index, allocator)
+		// Per-process temp files for this child
+		child_paths, _ := get_cache_paths()
+		result := revalidate(url, child_paths)
 
-	case:
-		// Unexpected status
-		errors.log_error("Unexpected HTTP status: %s", status)
-		os.remove(paths.temp)
-		return try_fallback_to_cache(paths.index, allocator)
+		if detach {
+			os.remove(paths.lock)
+		}
+		os.exit(int(result))
 	}
+
+	return pid, true
+}
+
+// Check whether the cached index was validated within the TTL
+@(private)
+cache_is_fresh :: proc(paths: Cache_Paths) -> bool {
+	checked_at, ttl := read_ttl_stamp(paths)
+	now := time.to_unix_seconds(time.now())
+	return checked_at > 0 && now - checked_at < ttl
+}
+
+// Check for a background refresh started recently by another command
+@(private)
+refresh_in_progress :: proc(paths: Cache_Paths) -> bool {
+	fi, err := os.stat(paths.lock, context.temp_allocator)
+	if err != os.ERROR_NONE {
+		return false
+	}
+	age := time.duration_seconds(time.since(fi.modification_time))
+	return age < REFRESH_LOCK_AGE
+}
+
+// Read the last validation time and TTL (VURU_INDEX_TTL takes precedence)
+@(private)
+read_ttl_stamp :: proc(paths: Cache_Paths) -> (checked_at: i64, ttl: i64) {
+	ttl = DEFAULT_INDEX_TTL
+
+	if content, ok := utils.read_file(paths.ttl, context.temp_allocator); ok {
+		fields := strings.fields(content, context.temp_allocator)
+		if len(fields) >= 1 {
+			checked_at = i64(utils.parse_int(fields[0]))
+		}
+		if len(fields) >= 2 {
+			ttl = i64(utils.parse_int(fields[1]))
+		}
+	}
+
+	if env_ttl, ok := config.get_index_ttl(); ok {
+		ttl = env_ttl
+	}
+
+	return checked_at, ttl
+}
+
+// Record a successful validation now
+@(private)
+write_ttl_stamp :: proc(paths: Cache_Paths) {
+	_, ttl := read_ttl_stamp(paths)
+	now := time.to_unix_seconds(time.now())
+	utils.write_file(paths.ttl, fmt.tprintf("%d %d\n", now, ttl))
 }
 
 // Try to load from cache as fallback
 @(private)
 try_fallback_to_cache :: proc(
-	index_path: string,
+	paths: Cache_Paths,
 	allocator := context.allocator,
+	categories: []string = nil,
 ) -> (
 	Index,
 	bool,
 ) {
-	if os.exists(index_path) {
+	if cache_exists(paths) {
 		errors.log_info("Using cached index as fallback")
-		return load_index_from_file(index_path, allocator)
+		return load_cached_index(paths, allocator, categories)
 	}
 	return {}, false
 }
+
+// Paths of the cached index files, for fingerprinting data derived from them
+index_cache_files :: proc(allocator := context.temp_allocator) -> []string {
+	paths, ok := get_cache_paths()
+	if !ok {
+		return nil
+	}
+
+	files := make([]string, 4, allocator)
+	files[0], files[1], files[2], files[3] = paths.manifest, paths.shards, paths.binary, paths.index
+	return files
+}
+
+// Check for any cached index (sharded or monolithic)
+@(private)
+cache_exists :: proc(paths: Cache_Paths) -> bool {
+	return os.exists(paths.manifest) || os.exists(paths.index)
+}
+
+// Load the cached index: shards, then mapped index.bin, then index.json
+@(private)
+load_cached_index :: proc(
+	paths: Cache_Paths,
+	allocator := context.allocator,
+	categories: []string = nil,
+) -> (
+	Index,
+	bool,
+) {
+	if os.exists(paths.manifest) {
+		if idx, ok := load_cached_shards(paths, categories, allocator); ok {
+			return idx, true
+		}
+	}
+	if os.exists(paths.binary) {
+		if idx, ok := load_index_from_binary(paths.binary, allocator); ok {
+			return idx, true
+		}
+	}
+	return load_index_from_file(paths.index, allocator)
+}
+
+// Fetch index.bin published next to index.json into paths.binary_temp
+@(private)
+fetch_binary_index :: proc(url: string, paths: Cache_Paths) -> bool {
+	if !strings.has_suffix(url, ".json") {
+		return false
+	}
+	bin_url := strings.concatenate({strings.trim_suffix(url, ".json"), ".bin"}, context.temp_allocator)
+
+	return net.download_one(net.Request{url = bin_url, dest = paths.binary_temp}).status == .Ok
+}
@@ -0,0 +1,390 @@
+package index
+
+import "core:encoding/json"
+import "core:fmt"
+import "core:os"
+import "core:slice"
+import "core:strings"
+
+import "../../utils"
+import errors "../errors"
+import net "../net"
+
+// Category-sharded index. manifest.json (next to index.json) lists one shard
+// per category with its hash; a sync downloads only the shards whose hash
+// changed since the cached manifest, in parallel. Servers without a manifest
+// are served through the monolithic index.json as before.
+
+MANIFEST_VERSION :: 1
+
+// Maximum number of concurrent shard downloads
+MAX_PARALLEL_SHARDS :: 8
+
+// One published shard file
+Shard_File :: struct {
+	sha256: string,
+	size:   i64,
+}
+
+// Manifest entry for a category
+Shard_Info :: struct {
+	category: string,
+	packages: int,
+	json:     Shard_File,
+	bin:      Shard_File, // Preferred; empty if the server only publishes JSON
+}
+
+// Archive of every template at the commit the index was generated from
+Template_Snapshot :: struct {
+	commit:  string,
+	archive: string, // Path next to index.json
+	file:    Shard_File,
+}
+
+// Parsed manifest.json (views into the temp-allocated JSON tree)
+Manifest :: struct {
+	shards:    [dynamic]Shard_Info,
+	templates: Template_Snapshot, // Empty commit if none is published
+}
+
+// URL of a file published next to index.json
+@(private)
+sibling_url :: proc(index_url: string, name: string) -> (string, bool) {
+	slash := strings.last_index_byte(index_url, '/')
+	if slash < 0 || !strings.has_suffix(index_url, ".json") {
+		return "", false
+	}
+	return strings.concatenate({index_url[:slash + 1], name}, context.temp_allocator), true
+}
+
+// Parse manifest.json content
+@(private)
+parse_manifest :: proc(content: string) -> (Manifest, bool) {
+	parsed, err := json.parse(transmute([]u8)content, allocator = context.temp_allocator)
+	if err != .None {
+		return {}, false
+	}
+
+	root, ok := parsed.(json.Object)
+	if !ok {
+		return {}, false
+	}
+
+	#partial switch v in root["version"] {
+	case json.Integer:
+		if v != MANIFEST_VERSION do return {}, false
+	case json.Float:
+		if v != MANIFEST_VERSION do return {}, false
+	case:
+		return {}, false
+	}
+
+	shards_obj, is_obj := root["shards"].(json.Object)
+	if !is_obj {
+		return {}, false
+	}
+
+	parse_file :: proc(v: json.Value) -> Shard_File {
+		obj, is_file_obj := v.(json.Object)
+		if !is_file_obj {
+			return {}
+		}
+
+		f := Shard_File{}
+		if s, is_str := obj["sha256"].(json.String); is_str {
+			f.sha256 = s
+		}
+		#partial switch size in obj["size"] {
+		case json.Integer:
+			f.size = size
+		case json.Float:
+			f.size = i64(size)
+		}
+		return f
+	}
+
+	m := Manifest {
+		shards = make([dynamic]Shard_Info, 0, len(shards_obj), context.temp_allocator),
+	}
+
+	if snap, has_snap := root["templates"].(json.Object); has_snap {
+		commit, _ := snap["commit"].(json.String)
+		path := ""
+		if archive, is_file_obj := snap["archive"].(json.Object); is_file_obj {
+			path, _ = archive["path"].(json.String)
+		}
+		if len(commit) > 0 && len(path) > 0 && !strings.contains(path, "..") {
+			m.templates = Template_Snapshot {
+				commit  = commit,
+				archive = path,
+				file    = parse_file(snap["archive"]),
+			}
+		}
+	}
+	for category, value in shards_obj {
+		// Category names become cache file names
+		if !utils.is_valid_identifier(category) {
+			continue
+		}
+
+		obj, is_shard_obj := value.(json.Object)
+		if !is_shard_obj {
+			continue
+		}
+
+		info := Shard_Info {
+			category = category,
+			json     = parse_file(obj["json"]),
+			bin      = parse_file(obj["bin"]),
+		}
+		#partial switch n in obj["packages"] {
+		case json.Integer:
+			info.packages = int(n)
+		case json.Float:
+			info.packages = int(n)
+		}
+
+		if len(info.bin.sha256) > 0 || len(info.json.sha256) > 0 {
+			append(&m.shards, info)
+		}
+	}
+
+	return m, true
+}
+
+// Template snapshot listed in the cached manifest, with its download URL
+index_template_snapshot :: proc(url: string) -> (snap: Template_Snapshot, archive_url: string, ok: bool) {
+	paths := get_cache_paths() or_return
+	manifest := load_manifest_file(paths.manifest) or_return
+	if len(manifest.templates.commit) == 0 {
+		return {}, "", false
+	}
+	archive_url = sibling_url(url, manifest.templates.archive) or_return
+	return manifest.templates, archive_url, true
+}
+
+// Load the cached manifest
+@(private)
+load_manifest_file :: proc(path: string) -> (Manifest, bool) {
+	content, ok := utils.read_file(path, context.temp_allocator)
+	if !ok {
+		return {}, false
+	}
+	return parse_manifest(content)
+}
+
+// Find a category in a manifest
+@(private)
+manifest_find :: proc(m: ^Manifest, category: string) -> (Shard_Info, bool) {
+	for s in m.shards {
+		if s.category == category {
+			return s, true
+		}
+	}
+	return {}, false
+}
+
+// The shard file a client uses (binary when published) and its extension
+@(private)
+shard_file :: proc(info: Shard_Info) -> (file: Shard_File, ext: string) {
+	if len(info.bin.sha256) > 0 {
+		return info.bin, ".bin"
+	}
+	return info.json, ".json"
+}
+
+// Local cache path of a shard
+@(private)
+shard_cache_path :: proc(paths: Cache_Paths, info: Shard_Info) -> string {
+	_, ext := shard_file(info)
+	return utils.path_join(
+		paths.shards,
+		strings.concatenate({info.category, ext}, context.temp_allocator),
+		allocator = context.temp_allocator,
+	)
+}
+
+// Synchronize cached shards with the published manifest.
+// has_manifest is false when the server does not publish one (use index.json).
+@(private)
+sync_shards :: proc(url: string, paths: Cache_Paths) -> (result: Revalidate_Result, has_manifest: bool) {
+	manifest_url, url_ok := sibling_url(url, "manifest.json")
+	if !url_ok {
+		return .Failed, false
+	}
+
+	defer os.remove(paths.manifest_temp)
+
+	old, old_ok := load_manifest_file(paths.manifest)
+
+	old_etag := ""
+	if old_ok {
+		if content, ok := utils.read_file(paths.manifest_etag, context.temp_allocator); ok {
+			old_etag = strings.trim_space(content)
+		}
+	}
+
+	status, etag, fetch_ok := fetch_index_from_url(manifest_url, paths.manifest_temp, old_etag)
+	if !fetch_ok {
+		// Network failure: the index.json route would fail as well
+		return .Failed, old_ok
+	}
+
+	manifest: Manifest
+	switch status {
+	case "304":
+		manifest = old
+	case "200":
+		content, read_ok := utils.read_file(paths.manifest_temp, context.temp_allocator)
+		if !read_ok {
+			return .Failed, true
+		}
+		parsed, parse_ok := parse_manifest(content)
+		if !parse_ok {
+			errors.log_error("Invalid index manifest: %s", manifest_url)
+			return .Failed, true
+		}
+		manifest = parsed
+	case:
+		// No manifest published (404) or server error - legacy index.json
+		return .Failed, false
+	}
+
+	if !utils.mkdir_p(paths.shards) {
+		return .Failed, true
+	}
+
+	// Shards that are missing locally or whose hash changed
+	stale := make([dynamic]Shard_Info, context.temp_allocator)
+	for info in manifest.shards {
+		local := shard_cache_path(paths, info)
+		file, _ := shard_file(info)
+
+		prev, had := manifest_find(&old, info.category)
+		prev_file, _ := shard_file(prev)
+		if had && old_ok && prev_file.sha256 == file.sha256 && os.exists(local) {
+			continue
+		}
+		append(&stale, info)
+	}
+
+	if !download_shards(url, paths, stale[:]) {
+		return .Failed, true
+	}
+
+	if status == "200" {
+		if os.rename(paths.manifest_temp, paths.manifest) != os.ERROR_NONE {
+			return .Failed, true
+		}
+		if len(etag) > 0 {
+			utils.write_file(paths.manifest_etag, etag)
+		} else {
+			os.remove(paths.manifest_etag)
+		}
+	}
+
+	remove_orphaned_shards(paths, &manifest)
+
+	if status == "200" || len(stale) > 0 {
+		return .Updated, true
+	}
+	return .Not_Modified, true
+}
+
+// Download shards in parallel; each is verified and moved into the cache as
+// soon as it is in
+@(private)
+download_shards :: proc(url: string, paths: Cache_Paths, shards: []Shard_Info) -> bool {
+	if len(shards) == 0 {
+		return true
+	}
+
+	reqs := make([]net.Request, len(shards), context.temp_allocator)
+	for info, i in shards {
+		file, ext := shard_file(info)
+		shard_url, _ := sibling_url(url, fmt.tprintf("shards/%s%s", info.category, ext))
+		reqs[i] = net.Request {
+			url    = shard_url,
+			dest   = shard_cache_path(paths, info),
+			size   = file.size,
+			sha256 = file.sha256,
+		}
+	}
+
+	all_ok := true
+	for res in net.download(reqs, MAX_PARALLEL_SHARDS) {
+		if res.status != .Ok {
+			all_ok = false
+		}
+	}
+	return all_ok
+}
+
+// Remove cached shards of categories that are no longer published
+@(private)
+remove_orphaned_shards :: proc(paths: Cache_Paths, manifest: ^Manifest) {
+	d, err := os.open(paths.shards)
+	if err != os.ERROR_NONE {
+		return
+	}
+	file_infos, _ := os.read_dir(d, -1, context.temp_allocator)
+	os.close(d)
+
+	for fi in file_infos {
+		// Downloads in progress (or to be resumed)
+		if fi.type == .Directory || strings.contains(fi.name, ".tmp.") || strings.has_suffix(fi.name, net.PART_SUFFIX) {
+			continue
+		}
+
+		dot := strings.last_index_byte(fi.name, '.')
+		if dot <= 0 {
+			continue
+		}
+
+		info, found := manifest_find(manifest, fi.name[:dot])
+		_, ext := shard_file(info)
+		if !found || fi.name[dot:] != ext {
+			os.remove(utils.path_join(paths.shards, fi.name, allocator = context.temp_allocator))
+		}
+	}
+}
+
+// Load cached shards into one Index (only the given categories when not nil)
+@(private)
+load_cached_shards :: proc(
+	paths: Cache_Paths,
+	categories: []string,
+	allocator := context.allocator,
+) -> (
+	Index,
+	bool,
+) {
+	manifest, ok := load_manifest_file(paths.manifest)
+	if !ok {
+		return {}, false
+	}
+
+	idx := index_make(allocator)
+	for info in manifest.shards {
+		if categories != nil && !slice.contains(categories, info.category) {
+			continue
+		}
+
+		path := shard_cache_path(paths, info)
+		_, ext := shard_file(info)
+
+		loaded := false
+		if ext == ".bin" {
+			loaded = index_map_binary(&idx, path)
+		} else if content, read_ok := utils.read_file(path, context.temp_allocator); read_ok {
+			loaded = parse_index_into(&idx, content)
+		}
+
+		if !loaded {
+			index_free(&idx)
+			return {}, false
+		}
+	}
+
+	return idx, true
+}
@@ -2,67 +2,127 @@ package index
 
 import "core:mem"
 
+import "../../utils"
+
+// Expected binary package for one architecture
+Binpkg_Info :: struct {
+	filename: string, // <pkgver>.<arch>.xbps
+	sha256:   string, // Hex digest; empty if unknown
+	size:     i64, // 0 if unknown
+}
+
 // Package metadata from index
 Package_Info :: struct {
-	version:    string,
-	category:   string,
-	short_desc: string,
-	repo_urls:  map[string]string,
+	version:         string,
+	category:        string,
+	short_desc:      string,
+	depends:         []string,
+	makedepends:     []string,
+	hostmakedepends: []string,
+	template_hash:   string, // Git blob hash of the template
+	has_deps:        bool, // Dependency lists are present (index generated with them)
+	repo_urls:       map[string]string,
+	binpkgs:         map[string]Binpkg_Info, // Keyed by arch
 }
 
 // Package index structure
+// Entries come from parsed JSON (packages) and/or mapped binary index files
+// (one per shard); use the index_* procs rather than the fields.
 Index :: struct {
 	packages:  map[string]Package_Info,
+	mapped:    [dynamic]Mapped_Index,
+	interner:  utils.Interner, // Names, categories, arches, URLs and deps of parsed packages
 	allocator: mem.Allocator,
 }
 
 // Free all resources in a Package_Info
+// Interned strings (category, dependency names, arches, URLs) belong to the index.
 package_info_free :: proc(pkg: ^Package_Info, allocator: mem.Allocator) {
 	if pkg == nil do return
 	
 	if len(pkg.version) > 0 do delete(pkg.version, allocator)
-	if len(pkg.category) > 0 do delete(pkg.category, allocator)
 	if len(pkg.short_desc) > 0 do delete(pkg.short_desc, allocator)
-	
-	// Free repo_urls map entries
-	for arch, url in pkg.repo_urls {
-		delete(arch, allocator)
-		delete(url, allocator)
-	}
+	if len(pkg.template_hash) > 0 do delete(pkg.template_hash, allocator)
+
+	delete(pkg.depends, allocator)
+	delete(pkg.makedepends, allocator)
+	delete(pkg.hostmakedepends, allocator)
 	delete(pkg.repo_urls)
+
+	for _, bin in pkg.binpkgs {
+		delete(bin.filename, allocator)
+		delete(bin.sha256, allocator)
+	}
+	delete(pkg.binpkgs)
 }
 
 // Free index and all its allocations
 index_free :: proc(idx: ^Index) {
 	if idx == nil do return
 	
-	for name, &pkg in idx.packages {
+	for _, &pkg in idx.packages {
 		package_info_free(&pkg, idx.allocator)
-		delete(name, idx.allocator)
 	}
 	delete(idx.packages)
+	utils.interner_destroy(&idx.interner) // Package names included
+
+	for &m in idx.mapped {
+		mapped_index_free(&m)
+	}
+	delete(idx.mapped)
 }
 
 // Create a new empty Index
 index_make :: proc(allocator := context.allocator) -> Index {
 	return Index {
 		packages  = make(map[string]Package_Info, allocator = allocator),
+		mapped    = make([dynamic]Mapped_Index, allocator),
+		interner  = utils.interner_make(allocator),
 		allocator = allocator,
 	}
 }
 
 // Get package from index (returns a view, not a copy)
+// For a mapped index the slices and maps of the view live in the temp allocator.
 index_get_package :: proc(idx: ^Index, name: string) -> (Package_Info, bool) {
+	for &m in idx.mapped {
+		if rec, ok := mapped_find(&m, name); ok {
+			return mapped_package_info(&m, rec), true
+		}
+	}
 	pkg, ok := idx.packages[name]
 	return pkg, ok
 }
 
 // Check if package exists in index
 index_has_package :: proc(idx: ^Index, name: string) -> bool {
+	for &m in idx.mapped {
+		if _, ok := mapped_find(&m, name); ok {
+			return true
+		}
+	}
 	return name in idx.packages
 }
 
 // Get number of packages in index
 index_count :: proc(idx: ^Index) -> int {
-	return len(idx.packages)
+	count := len(idx.packages)
+	for m in idx.mapped {
+		count += len(m.records)
+	}
+	return count
+}
+
+// List all package names (views; order is unspecified)
+index_names :: proc(idx: ^Index, allocator := context.temp_allocator) -> []string {
+	names := make([dynamic]string, 0, index_count(idx), allocator)
+	for &m in idx.mapped {
+		for &rec in m.records {
+			append(&names, mapped_str(&m, rec.name))
+		}
+	}
+	for name in idx.packages {
+		append(&names, name)
+	}
+	return names[:]
 }
@@ -0,0 +1,466 @@
+package net
+
+import "core:crypto/hash"
+import "core:encoding/hex"
+import "core:fmt"
+import "core:os"
+import "core:strings"
+import "core:sys/linux"
+
+import utils "../../utils"
+
+// Download engine shared by every network operation. A batch of transfers is
+// handed to one curl process running them with --parallel, so connections to
+// the same host are reused (HTTP/2 multiplexed where the server offers it)
+// and at most max_parallel run at once. curl reports each finished transfer
+// on a pipe; it is verified (size, sha256) and moved into place right away,
+// while the rest are still downloading.
+//
+// Transfers go to <dest>.part. With a known sha256 an interrupted .part is
+// resumed with a Range request on the next attempt; anything else starts over.
+// The sha256 is computed as the .part grows: between curl's reports, the new
+// bytes of every running transfer are fed to its hash (from the page cache),
+// so only the last chunk is left to hash once a transfer finishes.
+
+// Concurrent transfers when the caller does not say
+DEFAULT_MAX_PARALLEL :: 8
+
+PART_SUFFIX :: ".part"
+
+// How often the .part files are hashed while curl runs (milliseconds)
+HASH_INTERVAL_MS :: 100
+
+Request :: struct {
+	url:    string,
+	dest:   string,
+	size:   i64, // Expected size, 0 if unknown
+	sha256: string, // Expected digest, "" if unknown (no resumption then)
+	etag:   string, // Sent as If-None-Match
+}
+
+Status :: enum {
+	Pending,
+	Ok,
+	Not_Modified, // 304 for an If-None-Match request; dest untouched
+	Failed,
+	Checksum_Mismatch,
+}
+
+Result :: struct {
+	status:    Status,
+	http_code: int,
+	etag:      string, // Of the response, "" if none
+}
+
+// Transfers in flight
+Batch :: struct {
+	reqs:    []Request,
+	results: []Result,
+	pid:     linux.Pid,
+	out:     linux.Fd, // curl's per-transfer report lines
+	buf:     [dynamic]u8,
+	ready:   [dynamic]int, // Finished but not yet returned by batch_next
+	resumed: []bool,
+	hashes:  []Part_Hash,
+	epfd:    linux.Fd, // Watches out, to hash between reports; -1 if none
+}
+
+// Running sha256 of a .part file
+@(private)
+Part_Hash :: struct {
+	ctx:     hash.Context,
+	hashed:  i64, // Bytes fed so far
+	enabled: bool, // The request has a sha256
+}
+
+// Start a batch. Finished transfers are returned by batch_next in
+// completion order. Everything is temp-allocated.
+batch_start :: proc(reqs: []Request, max_parallel := DEFAULT_MAX_PARALLEL) -> Batch {
+	b := Batch {
+		reqs    = reqs,
+		results = make([]Result, len(reqs), context.temp_allocator),
+		buf     = make([dynamic]u8, context.temp_allocator),
+		ready   = make([dynamic]int, context.temp_allocator),
+		resumed = make([]bool, len(reqs), context.temp_allocator),
+		hashes  = make([]Part_Hash, len(reqs), context.temp_allocator),
+		out     = -1,
+		epfd    = -1,
+	}
+
+	config := strings.builder_make(context.temp_allocator)
+	transfers := 0
+	for r, i in reqs {
+		part := part_path(r.dest)
+		resume := len(r.sha256) > 0
+		if resume {
+			hash.init(&b.hashes[i].ctx, .SHA256)
+			b.hashes[i].enabled = true
+		}
+		if !resume {
+			os.remove(part)
+		} else if fi, err := os.stat(part, context.temp_allocator); err == os.ERROR_NONE {
+			// A complete .part left by an earlier run only needs verifying
+			if r.size > 0 && fi.size >= r.size {
+				b.results[i].http_code = 200
+				finish_transfer(&b, i, 0)
+				continue
+			}
+			b.resumed[i] = fi.size > 0
+		}
+
+		write_transfer(&config, r, i, resume, transfers > 0)
+		transfers += 1
+	}
+
+	if transfers > 0 && !spawn_curl(&b, strings.to_string(config), max_parallel) {
+		for &res, i in b.results {
+			if res.status == .Pending {
+				res.status = .Failed
+				append(&b.ready, i)
+			}
+		}
+	}
+	return b
+}
+
+// Wait for the next finished transfer; false once all were returned
+batch_next :: proc(b: ^Batch) -> (int, bool) {
+	for len(b.ready) == 0 {
+		if b.out < 0 {
+			return 0, false
+		}
+		if !read_reports(b) {
+			batch_close(b)
+		}
+	}
+	return pop_front(&b.ready), true
+}
+
+// Wait for every transfer of a batch
+batch_wait :: proc(b: ^Batch) {
+	for {
+		if _, ok := batch_next(b); !ok {
+			break
+		}
+	}
+}
+
+// Download in parallel and wait for all of them. Resumed transfers that fail
+// (e.g. the server refused the range) are retried once from the start.
+download :: proc(reqs: []Request, max_parallel := DEFAULT_MAX_PARALLEL) -> []Result {
+	utils.stats_span("download")
+	b := batch_start(reqs, max_parallel)
+	batch_wait(&b)
+
+	retry := make([dynamic]Request, context.temp_allocator)
+	slots := make([dynamic]int, context.temp_allocator)
+	for res, i in b.results {
+		if res.status == .Failed && b.resumed[i] {
+			os.remove(part_path(reqs[i].dest))
+			append(&retry, reqs[i])
+			append(&slots, i)
+		}
+	}
+	if len(retry) > 0 {
+		again := download(retry[:], max_parallel)
+		for res, j in again {
+			b.results[slots[j]] = res
+		}
+	}
+
+	return b.results
+}
+
+// Download one file
+download_one :: proc(req: Request) -> Result {
+	return download({req}, 1)[0]
+}
+
+part_path :: proc(dest: string) -> string {
+	return strings.concatenate({dest, PART_SUFFIX}, context.temp_allocator)
+}
+
+// Per-transfer options of the curl config read from stdin
+@(private)
+write_transfer :: proc(b: ^strings.Builder, r: Request, i: int, resume: bool, after_other: bool) {
+	if after_other {
+		strings.write_string(b, "next\n")
+	}
+	fmt.sbprintf(b, "url = %s\n", config_quote(r.url))
+	fmt.sbprintf(b, "output = %s\n", config_quote(part_path(r.dest)))
+	strings.write_string(b, "silent\nlocation\nfail\n")
+	if resume {
+		strings.write_string(b, "continue-at = -\n")
+	}
+	if len(r.etag) > 0 {
+		fmt.sbprintf(b, "header = %s\n", config_quote(fmt.tprintf("If-None-Match: %s", r.etag)))
+	}
+	// "<exit code> <http code> <request> <bytes> <etag>", one line per finished transfer
+	fmt.sbprintf(b, "write-out = \"%%{exitcode} %%{http_code} %d %%{size_download} %%header{etag}\\n\"\n", i)
+}
+
+@(private)
+config_quote :: proc(s: string) -> string {
+	escaped, _ := strings.replace_all(s, "\\", "\\\\", context.temp_allocator)
+	escaped, _ = strings.replace_all(escaped, "\"", "\\\"", context.temp_allocator)
+	return fmt.tprintf("\"%s\"", escaped)
+}
+
+// Start curl with the config on its stdin and the reports on a pipe
+@(private)
+spawn_curl :: proc(b: ^Batch, config: string, max_parallel: int) -> bool {
+	in_fds: [2]linux.Fd
+	if linux.pipe2(&in_fds, {.CLOEXEC}) != nil {
+		return false
+	}
+
+	args := []string {
+		"curl",
+		"--no-progress-meter", // Per-transfer "silent" does not cover the parallel meter
+		"--parallel",
+		"--parallel-max",
+		fmt.tprintf("%d", max(max_parallel, 1)),
+		"--config",
+		"-",
+	}
+	child, ok := utils.spawn_process(args, .Capture, stdin = in_fds[0])
+	linux.close(in_fds[0])
+	if !ok {
+		linux.close(in_fds[1])
+		return false
+	}
+
+	// curl reads its whole config before the first transfer (should it exit
+	// early, the write fails with EPIPE instead of killing us)
+	old_sigpipe := utils.signal(utils.SIGPIPE, utils.SIG_IGN)
+	defer utils.signal(utils.SIGPIPE, old_sigpipe)
+
+	data := transmute([]u8)config
+	for len(data) > 0 {
+		n, write_err := linux.write(in_fds[1], data)
+		if write_err == .EINTR {
+			continue
+		}
+		if write_err != nil || n <= 0 {
+			break
+		}
+		data = data[n:]
+	}
+	linux.close(in_fds[1])
+
+	b.pid = child.pid
+	b.out = child.out
+
+	if epfd, err := linux.epoll_create1({.FDCLOEXEC}); err == nil {
+		ev := linux.EPoll_Event {
+			events = {.IN},
+		}
+		if linux.epoll_ctl(epfd, .ADD, b.out, &ev) == nil {
+			b.epfd = epfd
+		} else {
+			linux.close(epfd)
+		}
+	}
+	return true
+}
+
+// Read report lines from curl; false at end of output. While curl is
+// quiet, the running transfers are hashed.
+@(private)
+read_reports :: proc(b: ^Batch) -> bool {
+	if b.epfd >= 0 {
+		events: [1]linux.EPoll_Event
+		n, err := linux.epoll_wait(b.epfd, &events[0], 1, HASH_INTERVAL_MS)
+		if err == .EINTR {
+			return true
+		}
+		if err == nil && n == 0 {
+			for &h, i in b.hashes {
+				if h.enabled && b.results[i].status == .Pending {
+					part_hash_update(&h, part_path(b.reqs[i].dest))
+				}
+			}
+			return true
+		}
+	}
+
+	chunk: [4096]u8
+	n, err := linux.read(b.out, chunk[:])
+	if err == .EINTR {
+		return true
+	}
+	if err != nil || n <= 0 {
+		return false
+	}
+	append(&b.buf, ..chunk[:n])
+
+	for {
+		nl := -1
+		for c, j in b.buf {
+			if c == '\n' {
+				nl = j
+				break
+			}
+		}
+		if nl < 0 {
+			break
+		}
+		handle_report(b, string(b.buf[:nl]))
+		remove_range(&b.buf, 0, nl + 1)
+	}
+	return true
+}
+
+@(private)
+handle_report :: proc(b: ^Batch, line: string) {
+	line := line
+	exit_code := utils.parse_int(next_field(&line))
+	http_code := utils.parse_int(next_field(&line))
+	i := utils.parse_int(next_field(&line))
+	bytes := i64(utils.parse_int(next_field(&line)))
+	if i < 0 || i >= len(b.reqs) || b.results[i].status != .Pending {
+		return
+	}
+	utils.stats_download(url_kind(b.reqs[i].url), bytes)
+
+	b.results[i].http_code = http_code
+	b.results[i].etag = strings.clone(strings.trim_space(line), context.temp_allocator)
+	finish_transfer(b, i, exit_code)
+}
+
+// Verify a finished transfer and move it into place
+@(private)
+finish_transfer :: proc(b: ^Batch, i: int, exit_code: int) {
+	r := b.reqs[i]
+	res := &b.results[i]
+	part := part_path(r.dest)
+	append(&b.ready, i)
+
+	switch {
+	case res.http_code == 304:
+		res.status = .Not_Modified
+		os.remove(part)
+		return
+	case exit_code != 0 || res.http_code >= 400:
+		res.status = .Failed
+		// An interrupted download with a known digest is resumed next time
+		if len(r.sha256) == 0 || exit_code == 22 {
+			os.remove(part)
+		}
+		return
+	}
+
+	if fi, err := os.stat(part, context.temp_allocator); err != os.ERROR_NONE || (r.size > 0 && fi.size != r.size) {
+		res.status = .Checksum_Mismatch
+		os.remove(part)
+		return
+	}
+	if len(r.sha256) > 0 {
+		sha, ok := part_hash_final(&b.hashes[i], part)
+		if !ok || !strings.equal_fold(sha, r.sha256) {
+			res.status = .Checksum_Mismatch
+			os.remove(part)
+			return
+		}
+	}
+
+	if os.rename(part, r.dest) != os.ERROR_NONE {
+		res.status = .Failed
+		os.remove(part)
+		return
+	}
+	res.status = .Ok
+}
+
+// Feed the bytes appended to a .part since the last call (none yet if curl
+// has not created it). A file that shrank was restarted: hash it anew.
+@(private)
+part_hash_update :: proc(h: ^Part_Hash, path: string) -> bool {
+	f, err := os.open(path)
+	if err != os.ERROR_NONE {
+		return false
+	}
+	defer os.close(f)
+
+	if fi, stat_err := os.stat(path, context.temp_allocator); stat_err == os.ERROR_NONE && fi.size < h.hashed {
+		hash.init(&h.ctx, .SHA256)
+		h.hashed = 0
+	}
+
+	buf: [64 * 1024]u8
+	for {
+		n, _ := os.read_at(f, buf[:], h.hashed)
+		if n <= 0 {
+			break
+		}
+		hash.update(&h.ctx, buf[:n])
+		h.hashed += i64(n)
+	}
+	return true
+}
+
+// Hash the rest of a finished .part; hex sha256
+@(private)
+part_hash_final :: proc(h: ^Part_Hash, path: string) -> (string, bool) {
+	if !part_hash_update(h, path) {
+		return "", false
+	}
+	digest: [32]u8
+	hash.final(&h.ctx, digest[:])
+	h.enabled = false
+	return string(hex.encode(digest[:], context.temp_allocator)), true
+}
+
+// curl exited: whatever it did not report failed
+@(private)
+batch_close :: proc(b: ^Batch) {
+	linux.close(b.out)
+	b.out = -1
+	if b.epfd >= 0 {
+		linux.close(b.epfd)
+		b.epfd = -1
+	}
+	utils.wait_process(b.pid)
+
+	for &res, i in b.results {
+		if res.status == .Pending {
+			res.status = .Failed
+			if len(b.reqs[i].sha256) == 0 {
+				os.remove(part_path(b.reqs[i].dest))
+			}
+			append(&b.ready, i)
+		}
+	}
+}
+
+// Kind of file behind a URL, for the download statistics
+@(private)
+url_kind :: proc(url: string) -> string {
+	path := url
+	if end := strings.index_any(path, "?#"); end >= 0 {
+		path = path[:end]
+	}
+	switch {
+	case strings.has_suffix(path, ".xbps"), strings.has_suffix(path, ".sig2"):
+		return "package"
+	case strings.has_suffix(path, "/template"):
+		return "template"
+	case strings.has_suffix(path, ".tar.gz"):
+		return "template snapshot"
+	case strings.has_suffix(path, ".json"), strings.has_suffix(path, ".bin"):
+		return "index"
+	}
+	return "other"
+}
+
+@(private)
+next_field :: proc(s: ^string) -> string {
+	s^ = strings.trim_left(s^, " ")
+	end := strings.index_byte(s^, ' ')
+	if end < 0 {
+		end = len(s^)
+	}
+	field := s^[:end]
+	s^ = s^[end:]
+	return field
+}
@@ -10,36 +10,49 @@ import xbps "../../core/xbps"
 import utils "../../utils"
 import config "../config"
 
-// Check if a package is installed (silently)
-is_pkg_installed :: proc(name: string) -> bool {
-	return utils.run_command_silent({"xbps-query", name}) == 0
-}
+// Load the installed snapshot and official repodata for rootdir ("" = host)
+// Official tables are large, so they default to the temp allocator.
+sources_load :: proc(
+	idx: ^index.Index,
+	rootdir: string,
+	load_official := true,
+	allocator := context.temp_allocator,
+) -> Sources {
+	s := Sources {
+		index = idx,
+	}
 
-// Get the installed version of a package
-// Returns empty string if not installed
-get_installed_version :: proc(name: string) -> (version: string, ok: bool) {
-	output, cmd_ok := utils.run_command_output({"xbps-query", name}, context.temp_allocator)
-	if !cmd_ok {
-		return "", false
+	db_ok: bool
+	s.installed, db_ok = xbps.pkgdb_load(rootdir, allocator)
+	if !db_ok {
+		errors.log_warning("Could not read installed packages, assuming none are installed")
 	}
 
-	// Parse pkgver from output
-	for line in strings.split_lines_iterator(&output) {
-		if strings.has_prefix(line, "pkgver:") {
-			value := strings.trim_space(line[7:])
-			// Use xbps-uhelper for correct parsing of packages with dashes in names
-			_, version, parse_ok := xbps.parse_pkgver(value)
-			if parse_ok {
-				return version, true
-			}
-		}
+	if !load_official {
+		return s
 	}
+	if arch, arch_ok := config.get_arch(); arch_ok {
+		s.official, s.has_official = xbps.repodata_load(rootdir, arch, allocator)
+	}
+	return s
+}
 
-	return "", false
+// Free resources owned by Sources (the index is not owned)
+sources_free :: proc(s: ^Sources) {
+	xbps.pkgdb_free(&s.installed)
+	xbps.repodata_free(&s.official)
 }
 
 // Check if package exists in official Void repos
-is_in_official_repos :: proc(name: string) -> (version: string, ok: bool) {
+lookup_official :: proc(s: ^Sources, name: string) -> (version: string, ok: bool) {
+	if s.has_official {
+		if pkg, found := xbps.repodata_get(&s.official, name); found {
+			return pkg.version, true
+		}
+		return "", false
+	}
+
+	// No cached repodata: ask xbps directly
 	output, cmd_ok := utils.run_command_output({"xbps-query", "-R", name}, context.temp_allocator)
 	if !cmd_ok {
 		return "", false
@@ -49,7 +62,6 @@ is_in_official_repos :: proc(name: string) -> (version: string, ok: bool) {
 	for line in strings.split_lines_iterator(&output) {
 		if strings.has_prefix(line, "pkgver:") {
 			value := strings.trim_space(line[7:])
-			// Use xbps-uhelper for correct parsing of packages with dashes in names
 			_, version, parse_ok := xbps.parse_pkgver(value)
 			if parse_ok {
 				return version, true
@@ -61,40 +73,41 @@ is_in_official_repos :: proc(name: string) -> (version: string, ok: bool) {
 }
 
 // Resolve a single package - returns a Resolved_Package with allocated strings
-// Caller must free the package on success, or handle that nothing was allocated on failure
+// Name, category and repo URL are interned in names; only the version is owned.
 resolve_package :: proc(
 	name: string,
-	idx: ^index.Index,
+	sources: ^Sources,
 	arch: string,
 	depth: int,
+	names: ^utils.Interner,
 	allocator := context.allocator,
 ) -> (
 	Resolved_Package,
 	bool,
 ) {
 	// 1. Check if already installed
-	installed_ver, is_installed := get_installed_version(name)
+	installed_ver, is_installed := xbps.pkgdb_installed_version(&sources.installed, name)
 
 	// 2. Check VUP index for binary
-	if vup_pkg, ok := index.index_get_package(idx, name); ok {
+	if vup_pkg, ok := index.index_get_package(sources.index, name); ok {
 		if url, url_ok := vup_pkg.repo_urls[arch]; url_ok {
 			// If installed, check if VUP has a newer version
 			if is_installed {
-				if xbps.version_greater_than(vup_pkg.version, installed_ver, utils.run_command) {
+				if xbps.version_greater_than(vup_pkg.version, installed_ver) {
 					// VUP has a newer version - mark for upgrade
 					return Resolved_Package {
-							name = strings.clone(name, allocator),
+							name = utils.intern_string(names, name),
 							source = .VUP,
 							version = strings.clone(vup_pkg.version, allocator),
-							repo_url = strings.clone(url, allocator),
-							category = strings.clone(vup_pkg.category, allocator),
+							repo_url = utils.intern_string(names, url),
+							category = utils.intern_string(names, vup_pkg.category),
 							depth = depth,
 						},
 						true
 				} else {
 					// Already up to date
 					return Resolved_Package {
-							name    = strings.clone(name, allocator),
+							name    = utils.intern_string(names, name),
 							source  = .Official, // Treat as satisfied (empty version = already installed)
 							version = "",
 							depth   = depth,
@@ -103,11 +116,11 @@ resolve_package :: proc(
 			}
 			// Not installed - install from VUP
 			return Resolved_Package {
-					name = strings.clone(name, allocator),
+					name = utils.intern_string(names, name),
 					source = .VUP,
 					version = strings.clone(vup_pkg.version, allocator),
-					repo_url = strings.clone(url, allocator),
-					category = strings.clone(vup_pkg.category, allocator),
+					repo_url = utils.intern_string(names, url),
+					category = utils.intern_string(names, vup_pkg.category),
 					depth = depth,
 				},
 				true
@@ -117,7 +130,7 @@ resolve_package :: proc(
 	// 3. Already installed but not in VUP index - satisfied
 	if is_installed {
 		return Resolved_Package {
-				name    = strings.clone(name, allocator),
+				name    = utils.intern_string(names, name),
 				source  = .Official, // Treat as satisfied (empty version = already installed)
 				version = "",
 				depth   = depth,
@@ -125,9 +138,9 @@ resolve_package :: proc(
 	}
 
 	// 4. Check official Void repos
-	if version, ok := is_in_official_repos(name); ok {
+	if version, ok := lookup_official(sources, name); ok {
 		return Resolved_Package {
-				name = strings.clone(name, allocator),
+				name = utils.intern_string(names, name),
 				source = .Official,
 				version = strings.clone(version, allocator),
 				depth = depth,
@@ -140,15 +153,17 @@ resolve_package :: proc(
 }
 
 // Resolve dependencies for one or more target packages
+// sources are only read, so one load can serve several resolutions.
 resolve_deps :: proc(
 	targets: []string,
-	idx: ^index.Index,
+	sources: ^Sources,
 	include_makedeps: bool,
 	allocator := context.allocator,
 ) -> (
 	Resolution,
 	bool,
 ) {
+	utils.stats_span("resolve_deps")
 	res := resolution_make(strings.join(targets, " ", allocator), allocator)
 
 	arch, arch_ok := config.get_arch()
@@ -158,126 +173,147 @@ resolve_deps :: proc(
 	}
 
 
-	// Track visited packages to avoid cycles - keys are owned by this map
-	visited := make(map[string]bool, allocator = allocator)
-
+	// Every name is enqueued at most once. Names are interned in res.names,
+	// which holds the one copy shared by the queue, the lists and the packages.
+	seen := make(map[utils.Str_Id]bool, allocator = allocator)
 
-	// Queue of packages to process - using proper struct with int depth
-	queue := make([dynamic]Queue_Item, allocator)
-
-
-	// Add all targets to queue
+	// Level-synchronous BFS: the whole frontier is resolved, and the next one is
+	// built from the index (or from templates fetched concurrently for the level)
+	frontier := make([dynamic]Queue_Item, allocator)
 	for target in targets {
-		append(&queue, Queue_Item{name = strings.clone(target, allocator), depth = 0})
-	}
-
-	for len(queue) > 0 {
-		// Pop from front
-		item := queue[0]
-		ordered_remove(&queue, 0)
-
-		// Check if already visited
-		if item.name in visited {
-
-			continue
-		}
-
-		// Mark as visited - clone for the map, we'll use item.name then free it
-		visited[strings.clone(item.name, allocator)] = true
-
-		// Resolve this package
-		pkg, ok := resolve_package(item.name, idx, arch, item.depth, allocator)
-		if !ok {
-			// Not found - add to missing list (clone persists)
-			cloned_name := strings.clone(item.name, allocator)
-			append(&res.missing, cloned_name)
-
-			// Add detailed error - use the cloned name that will persist
-			if item.depth == 0 {
-				append(&res.errors, errors.make_error(.Package_Not_Found, cloned_name))
-			} else {
-				append(&res.errors, errors.make_error(.Dependency_Not_Found, cloned_name))
-			}
-
-
+		id := utils.intern(&res.names, target)
+		if id in seen {
 			continue
 		}
+		seen[id] = true
+		append(&frontier, Queue_Item{name = id, depth = 0})
+	}
 
-		// Handle based on source
-		switch pkg.source {
-		case .Official:
-			if len(pkg.version) == 0 {
-				// Already installed - add to satisfied, free the pkg
-				append(&res.satisfied, strings.clone(item.name, allocator))
+	for depth := 0; len(frontier) > 0; depth += 1 {
+		next := make([dynamic]Queue_Item, allocator)
+		fetches := make([dynamic]template.Template_Request, context.temp_allocator)
+
+		for item in frontier {
+			name := utils.interned(&res.names, item.name)
+			pkg, ok := resolve_package(name, sources, arch, item.depth, &res.names, allocator)
+			if !ok {
+				// Not found - the interned name persists with the resolution
+				append(&res.missing, name)
+				if item.depth == 0 {
+					append(&res.errors, errors.make_error(.Package_Not_Found, name))
+				} else {
+					append(&res.errors, errors.make_error(.Dependency_Not_Found, name))
+				}
 
-			} else {
-				// Needs to be installed from official repos
-				append(&res.to_install, pkg)
+				continue
 			}
 
-		case .VUP:
-			append(&res.to_install, pkg)
-
-			// Resolve VUP package dependencies from template
-			if tmpl, tmpl_ok := fetch_and_parse_template(pkg.category, item.name, allocator);
-			   tmpl_ok {
-				// Queue runtime dependencies
-				for dep in tmpl.depends {
-					if dep not_in visited {
-						append(
-							&queue,
-							Queue_Item {
-								name = strings.clone(dep, allocator),
-								depth = item.depth + 1,
-							},
-						)
-					}
+			// Handle based on source
+			switch pkg.source {
+			case .Official:
+				if len(pkg.version) == 0 {
+					// Already installed
+					append(&res.satisfied, name)
+				} else {
+					// Needs to be installed from official repos
+					append(&res.to_install, pkg)
 				}
 
-				// Queue build dependencies if requested
-				if include_makedeps {
-					for dep in tmpl.makedepends {
-						if dep not_in visited {
-							append(
-								&queue,
-								Queue_Item {
-									name = strings.clone(dep, allocator),
-									depth = item.depth + 1,
-								},
-							)
-						}
+			case .VUP:
+				append(&res.to_install, pkg)
+
+				// Dependencies come from the index; older indexes lack them, so
+				// fall back to the template, fetched with the rest of the level
+				if info, info_ok := index.index_get_package(sources.index, pkg.name);
+				   info_ok && info.has_deps {
+					enqueue_deps(&next, &seen, &res.names, info.depends, depth + 1)
+					if include_makedeps {
+						enqueue_deps(&next, &seen, &res.names, info.makedepends, depth + 1)
+						enqueue_deps(&next, &seen, &res.names, info.hostmakedepends, depth + 1)
 					}
+				} else {
+					append(
+						&fetches,
+						template.Template_Request {
+							category = pkg.category,
+							pkg_name = pkg.name,
+							blob_hash = info.template_hash if info_ok else "",
+						},
+					)
 				}
 
-				// Free template after extracting deps
+			case .VUP_Build:
+				append(&res.to_build, pkg)
 
+			case .Unknown:
+				append(&res.missing, name)
 			}
+		}
 
-		case .VUP_Build:
-			append(&res.to_build, pkg)
+		// Fetch the remaining templates of this level in parallel
+		contents := template.fetch_templates(fetches[:], context.temp_allocator)
 
-		case .Unknown:
-			append(&res.missing, strings.clone(item.name, allocator))
+		// Complete the next frontier, deduplicated against everything seen so far
+		for content in contents {
+			if len(content) == 0 {
+				continue
+			}
 
-		}
+			tmpl, tmpl_ok := template.template_parse(content, context.temp_allocator)
+			if !tmpl_ok {
+				continue
+			}
 
-		// Free the queue item's name - we've extracted what we need
+			enqueue_deps(&next, &seen, &res.names, tmpl.depends, depth + 1)
+			if include_makedeps {
+				enqueue_deps(&next, &seen, &res.names, tmpl.makedepends, depth + 1)
+				enqueue_deps(&next, &seen, &res.names, tmpl.hostmakedeps, depth + 1)
+			}
+		}
 
+		delete(frontier)
+		frontier = next
 	}
+	delete(frontier)
 
 	return res, true
 }
 
-// Fetch and parse a VUP template
+// Append the dependencies not seen yet to the next frontier
+// Version constraints ("foo>=1.0") are dropped; only the name is resolved.
+@(private)
+enqueue_deps :: proc(
+	next: ^[dynamic]Queue_Item,
+	seen: ^map[utils.Str_Id]bool,
+	names: ^utils.Interner,
+	deps: []string,
+	depth: int,
+) {
+	for pattern in deps {
+		dep := xbps.pkgpattern_name(pattern)
+		if len(dep) == 0 {
+			continue
+		}
+		id := utils.intern(names, dep)
+		if id in seen {
+			continue
+		}
+		seen[id] = true
+		append(next, Queue_Item{name = id, depth = depth})
+	}
+}
+
+// Fetch and parse a VUP template (blob_hash: the index's template_hash, if known)
 fetch_and_parse_template :: proc(
 	category: string,
 	pkg_name: string,
 	allocator := context.allocator,
+	blob_hash := "",
 ) -> (
 	template.Template,
 	bool,
 ) {
-	content, ok := template.fetch_template(category, pkg_name, context.temp_allocator)
+	content, ok := template.fetch_template(category, pkg_name, context.temp_allocator, blob_hash)
 	if !ok {
 		return {}, false
 	}
@@ -4,7 +4,10 @@ import "core:mem"
 import "core:strings"
 
 import errors "../../core/errors"
+import index "../../core/index"
 import template "../../core/template"
+import xbps "../../core/xbps"
+import utils "../../utils"
 
 // Package source - where a package comes from
 Package_Source :: enum {
@@ -44,21 +47,30 @@ Resolution :: struct {
 
 	// Detailed errors for each failure
 	errors:     [dynamic]errors.Error,
+
+	// Package names, categories and repo URLs referenced above
+	names:      utils.Interner,
 	allocator:  mem.Allocator,
 }
 
+// Package data consulted during resolution, loaded once per run
+Sources :: struct {
+	index:        ^index.Index, // VUP index (not owned)
+	installed:    xbps.Pkgdb, // Installed-package snapshot
+	official:     xbps.Repodata, // Official repository tables
+	has_official: bool, // false: repodata cache unavailable, use xbps-query -R
+}
+
 // Internal queue item for BFS traversal
 Queue_Item :: struct {
-	name:  string,
+	name:  utils.Str_Id,
 	depth: int,
 }
 
-// Free all resources in a Resolved_Package
+// Free all resources in a Resolved_Package (name, category and repo URL are
+// interned in the resolution)
 resolved_package_free :: proc(pkg: ^Resolved_Package, allocator: mem.Allocator) {
-	if len(pkg.name) > 0 do delete(pkg.name, allocator)
 	if len(pkg.version) > 0 do delete(pkg.version, allocator)
-	if len(pkg.repo_url) > 0 do delete(pkg.repo_url, allocator)
-	if len(pkg.category) > 0 do delete(pkg.category, allocator)
 	if pkg.template != nil {
 		template.template_free(pkg.template)
 		free(pkg.template, allocator)
@@ -82,17 +94,10 @@ resolution_free :: proc(r: ^Resolution) {
 	}
 	delete(r.to_build)
 
-	// Free satisfied strings
-	for s in r.satisfied {
-		delete(s, r.allocator)
-	}
+	// Names are interned
 	delete(r.satisfied)
-
-	// Free missing strings
-	for s in r.missing {
-		delete(s, r.allocator)
-	}
 	delete(r.missing)
+	utils.interner_destroy(&r.names)
 
 	// Free target
 	if len(r.target) > 0 {
@@ -112,6 +117,7 @@ resolution_make :: proc(target: string = "", allocator := context.allocator) ->
 		satisfied = make([dynamic]string, allocator),
 		missing = make([dynamic]string, allocator),
 		errors = make([dynamic]errors.Error, allocator),
+		names = utils.interner_make(allocator),
 		allocator = allocator,
 	}
 }
@@ -0,0 +1,229 @@
+package search
+
+import "core:slice"
+import "core:strings"
+
+import "../../utils"
+
+// Ranked queries against a Search_Index. Substring matches are found by
+// intersecting the posting lists of the query trigrams and verifying the
+// survivors; names within a small edit distance rank below them.
+
+SCORE_EXACT :: 1000
+SCORE_PREFIX :: 800
+SCORE_SUBSTRING :: 600
+SCORE_DESC :: 300
+SCORE_FUZZY :: 100 // Minus the edit distance
+
+// Matched document and its rank
+Search_Hit :: struct {
+	doc:   int,
+	score: int,
+	name:  string, // View into the index
+}
+
+// Run a query; hits are ordered by score, then shorter name, then name
+search_query :: proc(
+	si: ^Search_Index,
+	query: string,
+	description_search: bool,
+	allocator := context.temp_allocator,
+) -> []Search_Hit {
+	q := strings.to_lower(query, context.temp_allocator)
+
+	// Best score per document
+	best := make(map[int]int, allocator = context.temp_allocator)
+	add_hit :: proc(best: ^map[int]int, doc: int, score: int) {
+		if prev, ok := best^[doc]; !ok || score > prev {
+			best^[doc] = score
+		}
+	}
+
+	if len(q) < 3 {
+		// Too short for trigrams: scan the document table
+		for id in 0 ..< len(si.docs) {
+			doc := search_index_doc(si, id)
+			if score, ok := name_score(doc.name, q); ok {
+				add_hit(&best, id, score)
+			} else if description_search && utils.contains_fold(doc.desc, q) {
+				add_hit(&best, id, SCORE_DESC)
+			}
+		}
+	} else {
+		for id in query_candidates(si, q, 0) {
+			doc := search_index_doc(si, int(id))
+			if score, ok := name_score(doc.name, q); ok {
+				add_hit(&best, int(id), score)
+			}
+		}
+
+		if description_search {
+			for id in query_candidates(si, q, DESC_GRAM_BIT) {
+				doc := search_index_doc(si, int(id))
+				if utils.contains_fold(doc.desc, q) {
+					add_hit(&best, int(id), SCORE_DESC)
+				}
+			}
+		}
+
+		fuzzy_matches(si, q, &best)
+	}
+
+	hits := make([]Search_Hit, len(best), allocator)
+	i := 0
+	for doc, score in best {
+		hits[i] = Search_Hit {
+			doc   = doc,
+			score = score,
+			name  = search_index_doc(si, doc).name,
+		}
+		i += 1
+	}
+
+	slice.sort_by(hits, proc(a, b: Search_Hit) -> bool {
+		if a.score != b.score {
+			return a.score > b.score
+		}
+		if len(a.name) != len(b.name) {
+			return len(a.name) < len(b.name)
+		}
+		return a.name < b.name
+	})
+
+	return hits
+}
+
+// Score a name against a lowercased query (false if it does not contain it)
+@(private)
+name_score :: proc(name: string, q: string) -> (int, bool) {
+	switch {
+	case len(name) == len(q) && strings.equal_fold(name, q):
+		return SCORE_EXACT, true
+	case len(name) > len(q) && strings.equal_fold(name[:len(q)], q):
+		return SCORE_PREFIX, true
+	case utils.contains_fold(name, q):
+		return SCORE_SUBSTRING, true
+	}
+	return 0, false
+}
+
+// Posting list of a gram (empty if no document contains it)
+@(private)
+gram_postings :: proc(si: ^Search_Index, gram: u32) -> []u32le {
+	lo, hi := 0, len(si.grams)
+	for lo < hi {
+		mid := lo + (hi - lo) / 2
+		g := u32(si.grams[mid].gram)
+		switch {
+		case g < gram:
+			lo = mid + 1
+		case g > gram:
+			hi = mid
+		case:
+			start, count := int(si.grams[mid].start), int(si.grams[mid].count)
+			if start > len(si.postings) || count > len(si.postings) - start {
+				return nil
+			}
+			return si.postings[start:][:count]
+		}
+	}
+	return nil
+}
+
+// Documents containing every trigram of q (names, or descriptions with DESC_GRAM_BIT)
+@(private)
+query_candidates :: proc(si: ^Search_Index, q: string, bit: u32) -> []u32le {
+	n := len(q) - 2
+	lists := make([][]u32le, n, context.temp_allocator)
+	for i in 0 ..< n {
+		lists[i] = gram_postings(si, trigram_key(q[i:]) | bit)
+		if len(lists[i]) == 0 {
+			return nil
+		}
+	}
+
+	// Intersect starting from the shortest list
+	slice.sort_by(lists, proc(a, b: []u32le) -> bool {return len(a) < len(b)})
+
+	result := slice.clone(lists[0], context.temp_allocator)
+	for list in lists[1:] {
+		kept := 0
+		j := 0
+		for id in result {
+			for j < len(list) && list[j] < id {
+				j += 1
+			}
+			if j == len(list) {
+				break
+			}
+			if list[j] == id {
+				result[kept] = id
+				kept += 1
+			}
+		}
+		result = result[:kept]
+		if kept == 0 {
+			break
+		}
+	}
+
+	return result
+}
+
+// Add names within a small edit distance of q. Candidates must share enough
+// trigrams with q (q-gram lemma) before the distance is computed.
+@(private)
+fuzzy_matches :: proc(si: ^Search_Index, q: string, best: ^map[int]int) {
+	k := 1 if len(q) <= 5 else 2
+	grams := len(q) - 2
+
+	shared := make(map[u32]int, allocator = context.temp_allocator)
+	for i in 0 ..< grams {
+		for id in gram_postings(si, trigram_key(q[i:])) {
+			shared[u32(id)] += 1
+		}
+	}
+
+	min_shared := max(grams - 3 * k, 1)
+	for id, count in shared {
+		if count < min_shared || int(id) in best^ {
+			continue
+		}
+
+		name := search_index_doc(si, int(id)).name
+		if abs(len(name) - len(q)) > k {
+			continue
+		}
+
+		lower := strings.to_lower(name, context.temp_allocator)
+		if dist, ok := bounded_levenshtein(lower, q, k); ok {
+			best^[int(id)] = SCORE_FUZZY - dist
+		}
+	}
+}
+
+// Edit distance between a and b if it is at most k
+@(private)
+bounded_levenshtein :: proc(a: string, b: string, k: int) -> (int, bool) {
+	prev := make([]int, len(b) + 1, context.temp_allocator)
+	curr := make([]int, len(b) + 1, context.temp_allocator)
+	for j in 0 ..= len(b) {
+		prev[j] = j
+	}
+
+	for i in 1 ..= len(a) {
+		curr[0] = i
+		row_min := i
+		for j in 1 ..= len(b) {
+			cost := 0 if a[i - 1] == b[j - 1] else 1
+			curr[j] = min(prev[j] + 1, curr[j - 1] + 1, prev[j - 1] + cost)
+			row_min = min(row_min, curr[j])
+		}
+		if row_min > k {
+			return 0, false
+		}
+		prev, curr = curr, prev
+	}
+
+	return prev[len(b)], prev[len(b)] <= k
+}
@@ -0,0 +1,343 @@
+package search
+
+import "core:mem"
+import "core:os"
+import "core:slice"
+import "core:strings"
+import "core:time"
+
+import "../../utils"
+
+// Trigram search index over package names and descriptions (VUP and official).
+// Built once per corpus change and persisted as search.idx in the cache
+// directory; the fingerprint of the source files decides when to rebuild.
+// Queries intersect posting lists instead of scanning every package.
+
+SEARCH_INDEX_MAGIC :: "VUPS"
+SEARCH_INDEX_VERSION :: 1
+SEARCH_INDEX_FILE :: "search.idx"
+
+// Gram keys of description trigrams carry this bit (names use the plain key)
+DESC_GRAM_BIT :: u32(1) << 24
+
+// Header flag: official repodata was part of the corpus
+FLAG_HAS_OFFICIAL :: 1
+
+Doc_Source :: enum u32 {
+	VUP      = 0,
+	Official = 1,
+}
+
+// Package document to index
+Search_Doc :: struct {
+	name:     string,
+	desc:     string,
+	version:  string,
+	category: string, // VUP only
+	source:   Doc_Source,
+}
+
+Search_Header :: struct #packed {
+	magic:          [4]u8,
+	version:        u32le,
+	fingerprint:    u64le,
+	flags:          u32le,
+	doc_count:      u32le,
+	gram_count:     u32le,
+	postings_count: u32le,
+	pool_size:      u32le,
+	reserved:       u32le,
+}
+
+// String reference into the pool
+Search_Str :: struct #packed {
+	off: u32le,
+	len: u32le,
+}
+
+Doc_Record :: struct #packed {
+	name:     Search_Str,
+	desc:     Search_Str,
+	version:  Search_Str,
+	category: Search_Str,
+	source:   u32le,
+	reserved: u32le,
+}
+
+// Posting list of one trigram (sorted by gram for binary search)
+Gram_Record :: struct #packed {
+	gram:  u32le,
+	start: u32le,
+	count: u32le,
+}
+
+// Loaded or freshly built index; all slices are views into data
+Search_Index :: struct {
+	data:         []u8,
+	fingerprint:  u64,
+	has_official: bool,
+	docs:         []Doc_Record,
+	grams:        []Gram_Record,
+	postings:     []u32le,
+	pool:         string,
+}
+
+// Fingerprint a corpus from the size and mtime of its source files
+corpus_fingerprint :: proc(files: []string) -> u64 {
+	// FNV-1a over (path, size, mtime) of each existing file
+	h: u64 = 0xcbf29ce484222325
+	mix :: proc(h: ^u64, data: []u8) {
+		for b in data {
+			h^ = (h^ ~ u64(b)) * 0x100000001b3
+		}
+	}
+
+	for path in files {
+		fi, err := os.stat(path, context.temp_allocator)
+		if err != os.ERROR_NONE {
+			continue
+		}
+
+		size := fi.size
+		mtime := time.to_unix_nanoseconds(fi.modification_time)
+		mix(&h, transmute([]u8)path)
+		mix(&h, mem.ptr_to_bytes(&size))
+		mix(&h, mem.ptr_to_bytes(&mtime))
+	}
+
+	return h
+}
+
+// Get the path of the persisted search index
+search_index_path :: proc(cache_dir: string, allocator := context.temp_allocator) -> string {
+	return utils.path_join(cache_dir, SEARCH_INDEX_FILE, allocator = allocator)
+}
+
+// Build an index over docs
+search_index_build :: proc(
+	docs: []Search_Doc,
+	fingerprint: u64,
+	has_official: bool,
+	allocator := context.allocator,
+) -> Search_Index {
+	// Posting lists: doc ids are appended in order, so each list stays sorted
+	lists := make(map[u32][dynamic]u32, allocator = context.temp_allocator)
+	add_grams :: proc(lists: ^map[u32][dynamic]u32, text: string, bit: u32, id: u32) {
+		for i in 0 ..< max(len(text) - 2, 0) {
+			g := trigram_key(text[i:]) | bit
+			if g not_in lists^ {
+				lists^[g] = make([dynamic]u32, context.temp_allocator)
+			}
+			list := &lists^[g]
+			if len(list) == 0 || list[len(list) - 1] != id {
+				append(list, id)
+			}
+		}
+	}
+
+	for doc, i in docs {
+		add_grams(&lists, strings.to_lower(doc.name, context.temp_allocator), 0, u32(i))
+		add_grams(&lists, strings.to_lower(doc.desc, context.temp_allocator), DESC_GRAM_BIT, u32(i))
+	}
+
+	keys := make([dynamic]u32, 0, len(lists), context.temp_allocator)
+	postings_count := 0
+	for g, list in lists {
+		append(&keys, g)
+		postings_count += len(list)
+	}
+	slice.sort(keys[:])
+
+	// String pool (repeated versions and categories are stored once)
+	pool := strings.builder_make(context.temp_allocator)
+	offsets := make(map[string]Search_Str, allocator = context.temp_allocator)
+	intern :: proc(pool: ^strings.Builder, offsets: ^map[string]Search_Str, s: string) -> Search_Str {
+		if ref, ok := offsets^[s]; ok {
+			return ref
+		}
+		ref := Search_Str {
+			off = u32le(strings.builder_len(pool^)),
+			len = u32le(len(s)),
+		}
+		strings.write_string(pool, s)
+		offsets^[s] = ref
+		return ref
+	}
+
+	records := make([]Doc_Record, len(docs), context.temp_allocator)
+	for doc, i in docs {
+		records[i] = Doc_Record {
+			name     = intern(&pool, &offsets, doc.name),
+			desc     = intern(&pool, &offsets, doc.desc),
+			version  = intern(&pool, &offsets, doc.version),
+			category = intern(&pool, &offsets, doc.category),
+			source   = u32le(doc.source),
+		}
+	}
+
+	pool_data := strings.to_string(pool)
+
+	size :=
+		size_of(Search_Header) +
+		len(records) * size_of(Doc_Record) +
+		len(keys) * size_of(Gram_Record) +
+		postings_count * size_of(u32le) +
+		len(pool_data)
+	data := make([]u8, size, allocator)
+
+	h := (^Search_Header)(raw_data(data))
+	h^ = Search_Header {
+		version        = SEARCH_INDEX_VERSION,
+		fingerprint    = u64le(fingerprint),
+		flags          = FLAG_HAS_OFFICIAL if has_official else 0,
+		doc_count      = u32le(len(records)),
+		gram_count     = u32le(len(keys)),
+		postings_count = u32le(postings_count),
+		pool_size      = u32le(len(pool_data)),
+	}
+	copy(h.magic[:], SEARCH_INDEX_MAGIC)
+
+	off := size_of(Search_Header)
+	off += copy(data[off:], slice.to_bytes(records))
+
+	grams := ([^]Gram_Record)(raw_data(data[off:]))[:len(keys)]
+	off += len(keys) * size_of(Gram_Record)
+
+	postings := ([^]u32le)(raw_data(data[off:]))[:postings_count]
+	next := 0
+	for g, i in keys {
+		list := lists[g]
+		grams[i] = Gram_Record {
+			gram  = u32le(g),
+			start = u32le(next),
+			count = u32le(len(list)),
+		}
+		for id in list {
+			postings[next] = u32le(id)
+			next += 1
+		}
+	}
+	off += postings_count * size_of(u32le)
+
+	copy(data[off:], pool_data)
+
+	si, _ := search_index_from_data(data)
+	return si
+}
+
+// Persist an index (written to a temp file and renamed into place)
+search_index_save :: proc(si: ^Search_Index, path: string) -> bool {
+	tmp := strings.concatenate({path, ".tmp"}, context.temp_allocator)
+	if !utils.write_file(tmp, string(si.data)) {
+		return false
+	}
+	if os.rename(tmp, path) != os.ERROR_NONE {
+		os.remove(tmp)
+		return false
+	}
+	return true
+}
+
+// Load a persisted index; fails if it was built from a different corpus
+search_index_load :: proc(
+	path: string,
+	fingerprint: u64,
+	allocator := context.allocator,
+) -> (
+	Search_Index,
+	bool,
+) {
+	content, ok := utils.read_file(path, allocator)
+	if !ok {
+		return {}, false
+	}
+
+	si, valid := search_index_from_data(transmute([]u8)content)
+	if !valid || si.fingerprint != fingerprint {
+		delete(content, allocator)
+		return {}, false
+	}
+	return si, true
+}
+
+// Free an index
+search_index_free :: proc(si: ^Search_Index, allocator := context.allocator) {
+	if si == nil do return
+	delete(si.data, allocator)
+	si^ = {}
+}
+
+// Number of documents in the index
+search_index_count :: proc(si: ^Search_Index) -> int {
+	return len(si.docs)
+}
+
+// Get the fields of a document (views into the index)
+search_index_doc :: proc(si: ^Search_Index, id: int) -> Search_Doc {
+	rec := &si.docs[id]
+	return Search_Doc {
+		name = search_str(si, rec.name),
+		desc = search_str(si, rec.desc),
+		version = search_str(si, rec.version),
+		category = search_str(si, rec.category),
+		source = Doc_Source(rec.source),
+	}
+}
+
+// Validate the header and table bounds of serialized index data
+@(private)
+search_index_from_data :: proc(data: []u8) -> (Search_Index, bool) {
+	if len(data) < size_of(Search_Header) {
+		return {}, false
+	}
+
+	h := (^Search_Header)(raw_data(data))
+	if string(h.magic[:]) != SEARCH_INDEX_MAGIC || h.version != SEARCH_INDEX_VERSION {
+		return {}, false
+	}
+
+	off := size_of(Search_Header)
+	take :: proc(data: []u8, off: ^int, count: int, elem_size: int) -> (rawptr, bool) {
+		if count > (len(data) - off^) / elem_size {
+			return nil, false
+		}
+		p := raw_data(data[off^:])
+		off^ += count * elem_size
+		return p, true
+	}
+
+	docs_ptr, docs_ok := take(data, &off, int(h.doc_count), size_of(Doc_Record))
+	grams_ptr, grams_ok := take(data, &off, int(h.gram_count), size_of(Gram_Record))
+	postings_ptr, postings_ok := take(data, &off, int(h.postings_count), size_of(u32le))
+	pool_ptr, pool_ok := take(data, &off, int(h.pool_size), 1)
+	if !docs_ok || !grams_ok || !postings_ok || !pool_ok {
+		return {}, false
+	}
+
+	return Search_Index {
+			data = data,
+			fingerprint = u64(h.fingerprint),
+			has_official = h.flags & FLAG_HAS_OFFICIAL != 0,
+			docs = ([^]Doc_Record)(docs_ptr)[:h.doc_count],
+			grams = ([^]Gram_Record)(grams_ptr)[:h.gram_count],
+			postings = ([^]u32le)(postings_ptr)[:h.postings_count],
+			pool = string(([^]u8)(pool_ptr)[:h.pool_size]),
+		},
+		true
+}
+
+// Resolve a string reference (empty if out of bounds)
+@(private)
+search_str :: #force_inline proc(si: ^Search_Index, s: Search_Str) -> string {
+	off, n := int(s.off), int(s.len)
+	if off > len(si.pool) || n > len(si.pool) - off {
+		return ""
+	}
+	return si.pool[off:][:n]
+}
+
+// Pack the first three bytes of s into a gram key
+@(private)
+trigram_key :: #force_inline proc(s: string) -> u32 {
+	return u32(s[0]) << 16 | u32(s[1]) << 8 | u32(s[2])
+}
@@ -4,8 +4,27 @@ import "../../utils"
 import config "../config"
 
 import errors "../errors"
+import "base:runtime"
+import "core:crypto/hash"
+import "core:encoding/hex"
+import "core:fmt"
 import "core:os"
 import "core:strings"
+import "core:sys/linux"
+
+// Parsed templates, next to the templates/ cache: parsed/<blob hash> holds
+// the field values of the template with that git blob hash. Entries are also
+// kept in memory for the rest of the run.
+PARSED_CACHE_DIR :: "parsed"
+
+// First line of a parsed template entry (bumped when the parser changes)
+PARSED_CACHE_MAGIC :: "vuru-parsed 1"
+
+// Entries kept in memory before the memo is cleared (the daemon is long-lived)
+MAX_PARSED_MEMO :: 1024
+
+@(private)
+parsed_memo: map[string]string
 
 // Retrieve a cached package template
 cache_get_template :: proc(pkg_name: string, allocator := context.allocator) -> (string, bool) {
@@ -51,3 +70,75 @@ cache_save_template :: proc(pkg_name: string, content: string) -> bool {
 
 	return true
 }
+
+// Git blob hash of a template (the hash GitHub trees list for the file)
+template_blob_hash :: proc(content: string, allocator := context.temp_allocator) -> string {
+	ctx: hash.Context
+	hash.init(&ctx, .Insecure_SHA1)
+	hash.update(&ctx, transmute([]u8)fmt.tprintf("blob %d\x00", len(content)))
+	hash.update(&ctx, transmute([]u8)content)
+
+	digest: [20]u8
+	hash.final(&ctx, digest[:])
+	return string(hex.encode(digest[:], allocator))
+}
+
+// Parsed entry for a blob hash (temp-allocated)
+parsed_cache_get :: proc(blob_hash: string) -> (string, bool) {
+	if entry, ok := parsed_memo[blob_hash]; ok {
+		return entry, true
+	}
+
+	path, ok := parsed_cache_path(blob_hash)
+	if !ok || !os.exists(path) {
+		return "", false
+	}
+	entry, read_ok := utils.read_file(path, context.temp_allocator)
+	if !read_ok {
+		return "", false
+	}
+	parsed_memo_put(blob_hash, entry)
+	return entry, true
+}
+
+// Store a parsed entry (written to a temp file and renamed into place)
+parsed_cache_put :: proc(blob_hash: string, entry: string) {
+	parsed_memo_put(blob_hash, entry)
+
+	path, ok := parsed_cache_path(blob_hash)
+	if !ok || !utils.mkdir_p(path[:strings.last_index_byte(path, '/')]) {
+		return
+	}
+	tmp := fmt.tprintf("%s.tmp.%d", path, linux.getpid())
+	if utils.write_file(tmp, entry) && os.rename(tmp, path) == os.ERROR_NONE {
+		return
+	}
+	os.remove(tmp)
+}
+
+@(private)
+parsed_cache_path :: proc(blob_hash: string) -> (string, bool) {
+	cache_dir, ok := config.get_cache_dir(context.temp_allocator)
+	if !ok {
+		return "", false
+	}
+	return utils.path_join(cache_dir, PARSED_CACHE_DIR, blob_hash, allocator = context.temp_allocator), true
+}
+
+// The memo lives on the heap: it outlives the per-command arena
+@(private)
+parsed_memo_put :: proc(blob_hash: string, entry: string) {
+	heap := runtime.heap_allocator()
+	if parsed_memo == nil || len(parsed_memo) >= MAX_PARSED_MEMO {
+		for k, v in parsed_memo {
+			delete(k, heap)
+			delete(v, heap)
+		}
+		delete(parsed_memo)
+		parsed_memo = make(map[string]string, allocator = heap)
+	}
+	if blob_hash in parsed_memo {
+		return
+	}
+	parsed_memo[strings.clone(blob_hash, heap)] = strings.clone(entry, heap)
+}
@@ -3,6 +3,7 @@ package template
 import utils "../../utils"
 import config "../config"
 import errors "../errors"
+import net "../net"
 
 import "core:fmt"
 import "core:os"
@@ -11,11 +12,13 @@ import "core:sys/linux"
 // Base URL for templates
 TEMPLATE_URL_BASE :: "https://raw.githubusercontent.com/VUP-Linux/vup/main/vup/srcpkgs"
 
-// Fetch the template for a package
+// Fetch the template for a package; read from the synced snapshot when it
+// has it (matching blob_hash, the index's template_hash, if given)
 fetch_template :: proc(
 	category: string,
 	pkg_name: string,
 	allocator := context.allocator,
+	blob_hash := "",
 ) -> (
 	string,
 	bool,
@@ -25,14 +28,17 @@ fetch_template :: proc(
 		return "", false
 	}
 
-	url := fmt.tprintf("%s/%s/%s/template", TEMPLATE_URL_BASE, category, pkg_name)
+	if content, ok := snapshot_template(category, pkg_name, blob_hash, allocator); ok {
+		utils.stats_cache("template snapshot", hit = true)
+		return content, true
+	}
+	utils.stats_cache("template snapshot", hit = false)
 
-	tmpdir := config.get_tmpdir()
-	tmp_path := fmt.tprintf("%s/vuru_tmpl_%s_%d", tmpdir, pkg_name, linux.getpid())
+	url := template_url(category, pkg_name)
+	tmp_path := fmt.tprintf("%s/vuru_tmpl_%s_%d", config.get_tmpdir(), pkg_name, linux.getpid())
 	defer os.remove(tmp_path)
 
-	// curl to fetch
-	if utils.run_command({"curl", "-s", "-f", "-L", "-o", tmp_path, url}) != 0 {
+	if net.download_one(net.Request{url = url, dest = tmp_path}).status != .Ok {
 		errors.log_error("Failed to fetch template from %s", url)
 		return "", false
 	}
@@ -40,3 +46,121 @@ fetch_template :: proc(
 	content, ok := utils.read_file(tmp_path, allocator)
 	return content, ok
 }
+
+// Maximum number of concurrent template downloads
+MAX_PARALLEL_FETCHES :: 8
+
+// Template to fetch in a batch
+Template_Request :: struct {
+	category:  string,
+	pkg_name:  string,
+	blob_hash: string, // Template hash from the index, may be empty
+}
+
+// Concurrent template fetch whose results are taken in request order as
+// soon as each one is in, while the later ones are still downloading
+Template_Stream :: struct {
+	reqs:   []Template_Request,
+	paths:  []string, // Download target (or snapshot file) per request
+	local:  []bool, // Read from the snapshot (paths[i] is not a download)
+	status: []net.Status,
+	batch:  net.Batch,
+	slots:  []int, // Request of each batch transfer
+	next:   int, // Next result to return
+}
+
+// Start fetching every template not in the snapshot
+template_stream_start :: proc(reqs: []Template_Request) -> Template_Stream {
+	s := Template_Stream {
+		reqs   = reqs,
+		paths  = make([]string, len(reqs), context.temp_allocator),
+		local  = make([]bool, len(reqs), context.temp_allocator),
+		status = make([]net.Status, len(reqs), context.temp_allocator),
+	}
+
+	downloads := make([dynamic]net.Request, 0, len(reqs), context.temp_allocator)
+	slots := make([dynamic]int, 0, len(reqs), context.temp_allocator)
+
+	tmpdir := config.get_tmpdir()
+	pid := linux.getpid()
+	for req, i in reqs {
+		if !utils.is_valid_identifier(req.category) || !utils.is_valid_identifier(req.pkg_name) {
+			errors.log_error("Invalid category or package name")
+			s.status[i] = .Failed
+			continue
+		}
+		if path, ok := snapshot_template_path(req.category, req.pkg_name, req.blob_hash); ok {
+			s.paths[i], s.local[i], s.status[i] = path, true, .Ok
+			utils.stats_cache("template snapshot", hit = true)
+			continue
+		}
+		utils.stats_cache("template snapshot", hit = false)
+
+		s.paths[i] = fmt.tprintf("%s/vuru_tmpl_%s_%d", tmpdir, req.pkg_name, pid)
+		append(&downloads, net.Request{url = template_url(req.category, req.pkg_name), dest = s.paths[i]})
+		append(&slots, i)
+	}
+
+	s.slots = slots[:]
+	s.batch = net.batch_start(downloads[:], MAX_PARALLEL_FETCHES)
+	return s
+}
+
+// Wait for the next template in request order. Returns its request index and
+// content (empty if the fetch failed); false once every request was returned.
+template_stream_next :: proc(
+	s: ^Template_Stream,
+	allocator := context.allocator,
+) -> (
+	i: int,
+	content: string,
+	ok: bool,
+) {
+	if s.next >= len(s.reqs) {
+		return 0, "", false
+	}
+	i = s.next
+	s.next += 1
+
+	for s.status[i] == .Pending {
+		j, more := net.batch_next(&s.batch)
+		if !more {
+			break
+		}
+		s.status[s.slots[j]] = s.batch.results[j].status
+	}
+
+	defer if !s.local[i] {
+		os.remove(s.paths[i])
+	}
+	if s.status[i] != .Ok {
+		errors.log_error("Failed to fetch template for %s", s.reqs[i].pkg_name)
+		return i, "", true
+	}
+
+	content, _ = utils.read_file(s.paths[i], allocator)
+	return i, content, true
+}
+
+@(private)
+template_url :: proc(category: string, pkg_name: string) -> string {
+	return fmt.tprintf("%s/%s/%s/template", TEMPLATE_URL_BASE, category, pkg_name)
+}
+
+// Fetch several templates concurrently (at most MAX_PARALLEL_FETCHES at a time)
+// Returns one entry per request; failed fetches are empty strings
+fetch_templates :: proc(reqs: []Template_Request, allocator := context.allocator) -> []string {
+	utils.stats_span("fetch_templates")
+	results := make([]string, len(reqs), allocator)
+
+	stream := template_stream_start(reqs)
+	for {
+		i, content, ok := template_stream_next(&stream, allocator)
+		if !ok {
+			break
+		}
+		results[i] = content
+	}
+
+	return results
+}
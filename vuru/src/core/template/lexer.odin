@@ -0,0 +1,262 @@
+package template
+
+import "core:strings"
+
+// Single-pass lexer for the top-level assignments of a template. Values are
+// views into the source unless they have to be rewritten (escapes, lines
+// joined, variables expanded), in which case they are built in the temp
+// allocator. Assignments inside function bodies (subpackages, do_install...)
+// are skipped.
+
+// Longest value variable expansion may produce
+MAX_EXPANDED_LEN :: 64 * 1024
+
+Lexer :: struct {
+	src:   string,
+	pos:   int,
+	depth: int, // Brace depth, 0 at the top level
+}
+
+Assignment :: struct {
+	name:  string,
+	value: string,
+	quote: u8, // '"', '\'' or 0 for unquoted
+}
+
+lexer_make :: proc(src: string) -> Lexer {
+	return Lexer{src = src}
+}
+
+// Next top-level assignment; false at the end of the source
+lexer_next :: proc(l: ^Lexer) -> (a: Assignment, ok: bool) {
+	for l.pos < len(l.src) {
+		skip_blanks(l)
+		if l.pos >= len(l.src) {
+			break
+		}
+
+		start := l.pos
+		for l.pos < len(l.src) && is_name_char(l.src[l.pos]) {
+			l.pos += 1
+		}
+		name := l.src[start:l.pos]
+
+		if l.depth == 0 && len(name) > 0 && !is_digit(name[0]) && peek(l) == '=' {
+			l.pos += 1
+			a = Assignment {
+				name = name,
+			}
+			a.value, a.quote = lex_value(l)
+			skip_line(l)
+			return a, true
+		}
+
+		// Not an assignment: consume the rest of the (logical) line
+		l.pos = start
+		skip_line(l)
+	}
+	return {}, false
+}
+
+// Expand $name and ${name} from vars (values assigned earlier, already
+// expanded, so one level is enough). Other forms (${x%.*}, $(cmd)) and
+// unknown names - xbps-src globals such as $PYPI_SITE - are kept verbatim.
+expand_vars :: proc(value: string, vars: ^map[string]string) -> string {
+	if strings.index_byte(value, '$') < 0 {
+		return value
+	}
+
+	b := strings.builder_make(context.temp_allocator)
+	i := 0
+	for i < len(value) {
+		c := value[i]
+		if c != '$' || i + 1 >= len(value) || len(b.buf) > MAX_EXPANDED_LEN {
+			strings.write_byte(&b, c)
+			i += 1
+			continue
+		}
+
+		name, ref_len := var_reference(value[i + 1:])
+		expansion, found := vars[name]
+		if len(name) == 0 || !found {
+			strings.write_byte(&b, c)
+			i += 1
+			continue
+		}
+		strings.write_string(&b, expansion)
+		i += 1 + ref_len
+	}
+	return strings.to_string(b)
+}
+
+// Name of the variable referenced after a '$' and the length of the reference
+@(private)
+var_reference :: proc(s: string) -> (name: string, length: int) {
+	if s[0] == '{' {
+		end := 1
+		for end < len(s) && is_name_char(s[end]) {
+			end += 1
+		}
+		if end >= len(s) || s[end] != '}' {
+			return "", 0 // Not a plain ${name}
+		}
+		return s[1:end], end + 1
+	}
+
+	end := 0
+	for end < len(s) && is_name_char(s[end]) {
+		end += 1
+	}
+	if end == 0 || is_digit(s[0]) {
+		return "", 0
+	}
+	return s[:end], end
+}
+
+// Value of an assignment starting at l.pos
+@(private)
+lex_value :: proc(l: ^Lexer) -> (string, u8) {
+	if l.pos >= len(l.src) {
+		return "", 0
+	}
+
+	switch quote := l.src[l.pos]; quote {
+	case '"', '\'':
+		l.pos += 1
+		start := l.pos
+		plain := true // No escapes or line breaks: the value is a view
+		for l.pos < len(l.src) && l.src[l.pos] != quote {
+			c := l.src[l.pos]
+			if c == '\n' || (c == '\\' && quote == '"') {
+				plain = false
+			}
+			l.pos += 1 if c != '\\' || quote == '\'' else 2
+		}
+		end := min(l.pos, len(l.src))
+		l.pos = end + 1
+
+		if plain {
+			return l.src[start:end], quote
+		}
+		return unquote(l.src[start:end], quote), quote
+	case:
+		start := l.pos
+		for l.pos < len(l.src) && !is_word_end(l.src[l.pos]) {
+			l.pos += 1
+		}
+		return l.src[start:l.pos], 0
+	}
+}
+
+// Rewrite a quoted value: escapes resolved, line continuations removed and
+// the lines of a multi-line value trimmed and joined with single spaces
+@(private)
+unquote :: proc(s: string, quote: u8) -> string {
+	b := strings.builder_make(0, len(s), context.temp_allocator)
+	line := strings.builder_make(context.temp_allocator)
+
+	flush :: proc(b: ^strings.Builder, line: ^strings.Builder) {
+		trimmed := strings.trim_space(strings.to_string(line^))
+		if len(trimmed) > 0 {
+			if len(b.buf) > 0 {
+				strings.write_byte(b, ' ')
+			}
+			strings.write_string(b, trimmed)
+		}
+		strings.builder_reset(line)
+	}
+
+	for i := 0; i < len(s); i += 1 {
+		c := s[i]
+		switch {
+		case c == '\\' && quote == '"' && i + 1 < len(s):
+			i += 1
+			switch s[i] {
+			case '\n': // Continuation
+			case '"', '\\', '$', '`':
+				strings.write_byte(&line, s[i])
+			case:
+				strings.write_byte(&line, '\\')
+				strings.write_byte(&line, s[i])
+			}
+		case c == '\n':
+			flush(&b, &line)
+		case:
+			strings.write_byte(&line, c)
+		}
+	}
+	flush(&b, &line)
+	return strings.to_string(b)
+}
+
+// Skip to the start of the next logical line, across quoted strings, and
+// track braces so function bodies are recognised
+@(private)
+skip_line :: proc(l: ^Lexer) {
+	quote: u8 = 0
+	for l.pos < len(l.src) {
+		c := l.src[l.pos]
+		l.pos += 1
+
+		if quote != 0 {
+			if c == '\\' && quote == '"' {
+				l.pos += 1
+			} else if c == quote {
+				quote = 0
+			}
+			continue
+		}
+
+		switch c {
+		case '\n':
+			return
+		case '\\':
+			l.pos += 1 // Escaped character or line continuation
+		case '"', '\'':
+			quote = c
+		case '#':
+			// Comment (only at the start of a word)
+			if l.pos == 1 || is_blank(l.src[l.pos - 2]) || l.src[l.pos - 2] == '\n' {
+				for l.pos < len(l.src) && l.src[l.pos] != '\n' {
+					l.pos += 1
+				}
+			}
+		case '{':
+			l.depth += 1
+		case '}':
+			l.depth = max(l.depth - 1, 0)
+		}
+	}
+}
+
+@(private)
+skip_blanks :: proc(l: ^Lexer) {
+	for l.pos < len(l.src) && is_blank(l.src[l.pos]) {
+		l.pos += 1
+	}
+}
+
+@(private)
+peek :: proc(l: ^Lexer) -> u8 {
+	return l.src[l.pos] if l.pos < len(l.src) else 0
+}
+
+@(private)
+is_blank :: proc(c: u8) -> bool {
+	return c == ' ' || c == '\t'
+}
+
+@(private)
+is_digit :: proc(c: u8) -> bool {
+	return c >= '0' && c <= '9'
+}
+
+@(private)
+is_name_char :: proc(c: u8) -> bool {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || is_digit(c) || c == '_'
+}
+
+@(private)
+is_word_end :: proc(c: u8) -> bool {
+	return is_blank(c) || c == '\n' || c == ';' || c == '#' || c == '\r'
+}
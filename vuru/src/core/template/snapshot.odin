@@ -0,0 +1,180 @@
+package template
+
+import utils "../../utils"
+import config "../config"
+import errors "../errors"
+import net "../net"
+
+import "core:fmt"
+import "core:os"
+import "core:strings"
+import "core:sys/linux"
+
+// Template snapshot: every srcpkgs/<category>/<pkg>/template of the commit an
+// index was generated from, published as one compressed archive. vuru sync
+// unpacks it into templates/.snapshots/<commit> (the leading dot keeps it
+// apart from the per-package cache files), and templates are then read from
+// there; fetch_template only goes to the network for packages it lacks.
+
+SNAPSHOT_DIR :: ".snapshots"
+
+// Name of the file holding the commit of the unpacked snapshot
+SNAPSHOT_CURRENT :: "current"
+
+// Published snapshot archive
+Snapshot_Archive :: struct {
+	commit: string,
+	url:    string,
+	sha256: string,
+	size:   i64,
+}
+
+// Download and unpack a snapshot unless it is already the current one.
+// Older snapshots are removed.
+snapshot_sync :: proc(archive: Snapshot_Archive) -> bool {
+	utils.stats_span("snapshot_sync")
+	if !utils.is_valid_identifier(archive.commit) {
+		errors.log_error("Invalid template snapshot commit: %s", archive.commit)
+		return false
+	}
+
+	root, root_ok := snapshot_root()
+	if !root_ok || !utils.mkdir_p(root) {
+		return false
+	}
+	if current, ok := snapshot_current(); ok && current == archive.commit {
+		return true
+	}
+
+	pid := linux.getpid()
+	tmp_archive := fmt.tprintf("%s/.%s.tar.gz", root, archive.commit) // Resumed if interrupted
+	tmp_dir := fmt.tprintf("%s/.%s.tmp.%d", root, archive.commit, pid)
+	defer os.remove(tmp_archive)
+
+	req := net.Request {
+		url    = archive.url,
+		dest   = tmp_archive,
+		size   = archive.size,
+		sha256 = archive.sha256,
+	}
+	switch net.download_one(req).status {
+	case .Ok:
+	case .Checksum_Mismatch:
+		errors.log_error("Template snapshot checksum mismatch")
+		return false
+	case .Pending, .Not_Modified, .Failed:
+		errors.log_error("Failed to download the template snapshot from %s", archive.url)
+		return false
+	}
+
+	if !utils.mkdir_p(tmp_dir) ||
+	   utils.run_command_silent({"tar", "-xzf", tmp_archive, "-C", tmp_dir}) != 0 {
+		errors.log_error("Failed to unpack the template snapshot")
+		utils.run_command_silent({"rm", "-rf", tmp_dir})
+		return false
+	}
+
+	dest := utils.path_join(root, archive.commit, allocator = context.temp_allocator)
+	utils.run_command_silent({"rm", "-rf", dest})
+	if os.rename(tmp_dir, dest) != os.ERROR_NONE {
+		utils.run_command_silent({"rm", "-rf", tmp_dir})
+		return false
+	}
+
+	pointer := utils.path_join(root, SNAPSHOT_CURRENT, allocator = context.temp_allocator)
+	pointer_tmp := fmt.tprintf("%s.tmp.%d", pointer, pid)
+	if !utils.write_file(pointer_tmp, archive.commit) || os.rename(pointer_tmp, pointer) != os.ERROR_NONE {
+		os.remove(pointer_tmp)
+		return false
+	}
+
+	remove_old_snapshots(root, archive.commit)
+	return true
+}
+
+// Template of a package from the current snapshot. With a blob hash (from the
+// index) the snapshot copy must match it, so a stale snapshot is never used.
+snapshot_template :: proc(
+	category: string,
+	pkg_name: string,
+	blob_hash: string = "",
+	allocator := context.allocator,
+) -> (
+	string,
+	bool,
+) {
+	path, ok := snapshot_template_path(category, pkg_name, blob_hash)
+	if !ok {
+		return "", false
+	}
+	return utils.read_file(path, allocator)
+}
+
+// Commit of the unpacked snapshot
+snapshot_current :: proc() -> (string, bool) {
+	root, ok := snapshot_root()
+	if !ok {
+		return "", false
+	}
+	content, read_ok := utils.read_file(
+		utils.path_join(root, SNAPSHOT_CURRENT, allocator = context.temp_allocator),
+		context.temp_allocator,
+	)
+	if !read_ok {
+		return "", false
+	}
+	commit := strings.trim_space(content)
+	return commit, utils.is_valid_identifier(commit)
+}
+
+// Path of a package's template in the current snapshot, if it has a usable one
+@(private)
+snapshot_template_path :: proc(category: string, pkg_name: string, blob_hash: string) -> (string, bool) {
+	if !utils.is_valid_identifier(category) || !utils.is_valid_identifier(pkg_name) {
+		return "", false
+	}
+
+	root, root_ok := snapshot_root()
+	commit, commit_ok := snapshot_current()
+	if !root_ok || !commit_ok {
+		return "", false
+	}
+
+	path := utils.path_join(root, commit, category, pkg_name, "template", allocator = context.temp_allocator)
+	if len(blob_hash) == 0 {
+		return path, os.exists(path)
+	}
+
+	content, ok := utils.read_file(path, context.temp_allocator)
+	if !ok || template_blob_hash(content) != strings.to_lower(blob_hash, context.temp_allocator) {
+		return "", false
+	}
+	return path, true
+}
+
+@(private)
+snapshot_root :: proc() -> (string, bool) {
+	cache_dir, ok := config.get_cache_dir(context.temp_allocator)
+	if !ok {
+		return "", false
+	}
+	return utils.path_join(cache_dir, "templates", SNAPSHOT_DIR, allocator = context.temp_allocator), true
+}
+
+// Remove unpacked snapshots other than keep (and leftovers of failed syncs)
+@(private)
+remove_old_snapshots :: proc(root: string, keep: string) {
+	d, err := os.open(root)
+	if err != os.ERROR_NONE {
+		return
+	}
+	file_infos, _ := os.read_dir(d, -1, context.temp_allocator)
+	os.close(d)
+
+	for fi in file_infos {
+		if fi.name == keep || fi.name == SNAPSHOT_CURRENT {
+			continue
+		}
+		utils.run_command_silent({"rm", "-rf", utils.path_join(root, fi.name, allocator = context.temp_allocator)})
+	}
+}
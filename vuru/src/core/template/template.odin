@@ -5,6 +5,29 @@ import utils "../../utils"
 import "core:mem"
 import "core:strings"
 
+// Fields read from a template (list fields are split on whitespace)
+TEMPLATE_FIELDS :: [?]string {
+	"pkgname",
+	"version",
+	"revision",
+	"short_desc",
+	"maintainer",
+	"license",
+	"homepage",
+	"build_style",
+	"archs",
+	"depends",
+	"makedepends",
+	"hostmakedepends",
+	"checkdepends",
+	"restricted",
+	"nostrip",
+	"nopie",
+	"create_wrksrc",
+	"distfiles",
+	"checksum",
+}
+
 // Parsed template information from xbps-src template file
 Template :: struct {
 	// Core fields
@@ -39,6 +62,11 @@ Template :: struct {
 	// Raw content for display/diff
 	raw_content:   string,
 
+	// Every string field is a view into buffer (which starts with
+	// raw_content); the list fields are slices of items
+	buffer:        []u8,
+	items:         []string,
+
 	// Allocator used for this template
 	allocator:     mem.Allocator,
 }
@@ -49,40 +77,14 @@ template_free :: proc(t: ^Template) {
 		return
 	}
 
-	delete(t.pkgname, t.allocator)
-	delete(t.version, t.allocator)
-	delete(t.short_desc, t.allocator)
-	delete(t.maintainer, t.allocator)
-	delete(t.license, t.allocator)
-	delete(t.homepage, t.allocator)
-	delete(t.build_style, t.allocator)
-	delete(t.raw_content, t.allocator)
-
-	for s in t.depends {delete(s, t.allocator)}
-	delete(t.depends, t.allocator)
-
-	for s in t.makedepends {delete(s, t.allocator)}
-	delete(t.makedepends, t.allocator)
-
-	for s in t.hostmakedeps {delete(s, t.allocator)}
-	delete(t.hostmakedeps, t.allocator)
-
-	for s in t.checkdepends {delete(s, t.allocator)}
-	delete(t.checkdepends, t.allocator)
-
-	for s in t.archs {delete(s, t.allocator)}
-	delete(t.archs, t.allocator)
-
-	for s in t.distfiles {delete(s, t.allocator)}
-	delete(t.distfiles, t.allocator)
-
-	for s in t.checksum {delete(s, t.allocator)}
-	delete(t.checksum, t.allocator)
+	delete(t.buffer, t.allocator)
+	delete(t.items, t.allocator)
+	t^ = {}
 }
 
 // Parse a template file from disk
 template_parse_file :: proc(path: string, allocator := context.allocator) -> (Template, bool) {
-	// Read with temp allocator - template_parse will clone what it needs
+	// Read with temp allocator - template_parse copies it into the template
 	content, ok := utils.read_file(path, context.temp_allocator)
 	if !ok {
 		return {}, false
@@ -91,45 +93,167 @@ template_parse_file :: proc(path: string, allocator := context.allocator) -> (Te
 	return template_parse(content, allocator)
 }
 
-// Parse template content string
+// Parse template content string. Parsed templates are cached by blob hash,
+// so an unchanged template is only lexed once.
 template_parse :: proc(content: string, allocator := context.allocator) -> (Template, bool) {
+	hash := template_blob_hash(content)
+
+	values: map[string]string
+	cached := false
+	if entry, hit := parsed_cache_get(hash); hit {
+		values, cached = template_decode(entry)
+	}
+	utils.stats_cache("parsed template", cached)
+	if !cached {
+		values = template_lex(content)
+	}
+
+	// Validate required fields
+	if len(values["pkgname"]) == 0 || len(values["version"]) == 0 {
+		return {}, false
+	}
+
+	if !cached {
+		parsed_cache_put(hash, template_encode(&values))
+	}
+	return template_build(content, &values, allocator), true
+}
+
+// Values of the template fields, variables expanded (temp-allocated; the
+// strings may be views into content). The last assignment of a name wins.
+template_lex :: proc(content: string) -> map[string]string {
+	vars := make(map[string]string, allocator = context.temp_allocator)
+
+	l := lexer_make(content)
+	for {
+		a, ok := lexer_next(&l)
+		if !ok {
+			break
+		}
+		vars[a.name] = a.value if a.quote == '\'' else expand_vars(a.value, &vars)
+	}
+
+	return vars
+}
+
+// Serialize the template fields of values (one "name\tvalue" line each)
+@(private)
+template_encode :: proc(values: ^map[string]string) -> string {
+	b := strings.builder_make(context.temp_allocator)
+	strings.write_string(&b, PARSED_CACHE_MAGIC)
+	strings.write_byte(&b, '\n')
+	for field in TEMPLATE_FIELDS {
+		if value, ok := values[field]; ok {
+			strings.write_string(&b, field)
+			strings.write_byte(&b, '\t')
+			strings.write_string(&b, value)
+			strings.write_byte(&b, '\n')
+		}
+	}
+	return strings.to_string(b)
+}
+
+@(private)
+template_decode :: proc(entry: string) -> (map[string]string, bool) {
+	rest := entry
+	header, _ := strings.split_lines_iterator(&rest)
+	if header != PARSED_CACHE_MAGIC {
+		return nil, false
+	}
+
+	values := make(map[string]string, allocator = context.temp_allocator)
+	for line in strings.split_lines_iterator(&rest) {
+		tab := strings.index_byte(line, '\t')
+		if tab <= 0 {
+			return nil, false
+		}
+		values[line[:tab]] = line[tab + 1:]
+	}
+	return values, true
+}
+
+// One allocation for the content and every string field: values that are
+// views into content are pointed at its copy, the others are appended
+@(private)
+template_build :: proc(content: string, values: ^map[string]string, allocator: mem.Allocator) -> Template {
+	size := len(content)
+	item_count := 0
+	for field in TEMPLATE_FIELDS {
+		value := values[field]
+		if _, inside := content_offset(content, value); !inside {
+			size += len(value)
+		}
+		if is_list_field(field) {
+			words := value
+			for _ in strings.fields_iterator(&words) {
+				item_count += 1
+			}
+		}
+	}
+
 	t := Template {
-		allocator   = allocator,
-		raw_content = strings.clone(content, allocator),
+		buffer    = make([]u8, size, allocator),
+		items     = make([]string, item_count, allocator),
+		allocator = allocator,
 	}
+	copy(t.buffer, content)
+	t.raw_content = string(t.buffer[:len(content)])
 
-	// First pass: extract multi-line values and single-line values
-	vars := parse_shell_variables(content, context.temp_allocator)
-	
-	// Process parsed variables
-	for name, value in vars {
-		switch name {
+	end := len(content)
+	next_item := 0
+	for field in TEMPLATE_FIELDS {
+		value, found := values[field]
+		if !found {
+			continue
+		}
+
+		// Place the value in the buffer
+		if offset, inside := content_offset(content, value); inside {
+			value = string(t.buffer[offset:][:len(value)])
+		} else {
+			copy(t.buffer[end:], value)
+			value = string(t.buffer[end:][:len(value)])
+			end += len(value)
+		}
+
+		list: []string
+		if is_list_field(field) {
+			first := next_item
+			words := value
+			for word in strings.fields_iterator(&words) {
+				t.items[next_item] = word
+				next_item += 1
+			}
+			list = t.items[first:next_item]
+		}
+
+		switch field {
 		case "pkgname":
-			t.pkgname = strings.clone(value, allocator)
+			t.pkgname = value
 		case "version":
-			t.version = strings.clone(value, allocator)
+			t.version = value
 		case "revision":
 			t.revision = utils.parse_int(value)
 		case "short_desc":
-			t.short_desc = strings.clone(value, allocator)
+			t.short_desc = value
 		case "maintainer":
-			t.maintainer = strings.clone(value, allocator)
+			t.maintainer = value
 		case "license":
-			t.license = strings.clone(value, allocator)
+			t.license = value
 		case "homepage":
-			t.homepage = strings.clone(value, allocator)
+			t.homepage = value
 		case "build_style":
-			t.build_style = strings.clone(value, allocator)
+			t.build_style = value
 		case "archs":
-			t.archs = utils.split_and_clone(value, allocator)
+			t.archs = list
 		case "depends":
-			t.depends = utils.split_and_clone(value, allocator)
+			t.depends = list
 		case "makedepends":
-			t.makedepends = utils.split_and_clone(value, allocator)
+			t.makedepends = list
 		case "hostmakedepends":
-			t.hostmakedeps = utils.split_and_clone(value, allocator)
+			t.hostmakedeps = list
 		case "checkdepends":
-			t.checkdepends = utils.split_and_clone(value, allocator)
+			t.checkdepends = list
 		case "restricted":
 			t.restricted = value == "yes"
 		case "nostrip":
@@ -138,95 +262,37 @@ template_parse :: proc(content: string, allocator := context.allocator) -> (Temp
 			t.nopie = value == "yes"
 		case "create_wrksrc":
 			t.create_wrksrc = value == "yes"
+		case "distfiles":
+			t.distfiles = list
+		case "checksum":
+			t.checksum = list
 		}
 	}
 
-	// Validate required fields
-	if len(t.pkgname) == 0 || len(t.version) == 0 {
-		template_free(&t)
-		return {}, false
-	}
+	return t
+}
 
-	return t, true
+@(private)
+is_list_field :: proc(field: string) -> bool {
+	switch field {
+	case "archs", "depends", "makedepends", "hostmakedepends", "checkdepends", "distfiles", "checksum":
+		return true
+	}
+	return false
 }
 
-// Parse shell-style variable assignments, handling multi-line quoted values
+// Offset of s in content, if it is a view into it
 @(private)
-parse_shell_variables :: proc(content: string, allocator := context.allocator) -> map[string]string {
-	vars := make(map[string]string, allocator = allocator)
-	
-	lines := strings.split_lines(content, context.temp_allocator)
-	i := 0
-	
-	for i < len(lines) {
-		line := strings.trim_space(lines[i])
-		
-		// Skip comments and empty lines
-		if len(line) == 0 || line[0] == '#' {
-			i += 1
-			continue
-		}
-		
-		// Look for variable assignment
-		eq_idx := strings.index(line, "=")
-		if eq_idx <= 0 {
-			i += 1
-			continue
-		}
-		
-		name := line[:eq_idx]
-		value_start := line[eq_idx + 1:]
-		
-		// Check if this is a multi-line quoted value
-		if len(value_start) > 0 && value_start[0] == '"' {
-			// Check if closing quote is on same line
-			if len(value_start) > 1 && strings.index(value_start[1:], "\"") >= 0 {
-				// Single line quoted value
-				vars[strings.clone(name, allocator)] = strings.clone(utils.strip_quotes(value_start), allocator)
-			} else {
-				// Multi-line value - collect until closing quote
-				builder := strings.builder_make(context.temp_allocator)
-				
-				// Add content after opening quote (skip the quote itself)
-				if len(value_start) > 1 {
-					strings.write_string(&builder, value_start[1:])
-				}
-				
-				i += 1
-				for i < len(lines) {
-					next_line := lines[i]
-					
-					// Check if this line has the closing quote
-					if quote_idx := strings.index(next_line, "\""); quote_idx >= 0 {
-						// Add content before closing quote
-						strings.write_string(&builder, " ")
-						strings.write_string(&builder, strings.trim_space(next_line[:quote_idx]))
-						break
-					} else {
-						// Add entire line (trimmed)
-						trimmed := strings.trim_space(next_line)
-						if len(trimmed) > 0 {
-							strings.write_string(&builder, " ")
-							strings.write_string(&builder, trimmed)
-						}
-					}
-					i += 1
-				}
-				
-				vars[strings.clone(name, allocator)] = strings.clone(strings.trim_space(strings.to_string(builder)), allocator)
-			}
-		} else if len(value_start) > 0 && value_start[0] == '\'' {
-			// Single-quoted value (always single line in shell)
-			vars[strings.clone(name, allocator)] = strings.clone(utils.strip_quotes(value_start), allocator)
-		} else {
-			// Unquoted value
-			vars[strings.clone(name, allocator)] = strings.clone(value_start, allocator)
-		}
-		
-		i += 1
+content_offset :: proc(content: string, s: string) -> (int, bool) {
+	if len(s) == 0 {
+		return 0, true
 	}
-	
-	return vars
+	base := uintptr(raw_data(content))
+	p := uintptr(raw_data(s))
+	if p < base || p + uintptr(len(s)) > base + uintptr(len(content)) {
+		return 0, false
+	}
+	return int(p - base), true
 }
 
 // Get full version string (version_revision)
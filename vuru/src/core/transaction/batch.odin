@@ -0,0 +1,146 @@
+package transaction
+
+import "core:fmt"
+import "core:strings"
+import "core:time"
+
+import builder "../../core/builder"
+import errors "../../core/errors"
+import index "../../core/index"
+import utils "../../utils"
+
+// Install transactions into several rootdirs at once (`vuru --rootdirs`).
+// Rootdirs in the same installed state share a transaction, so a batch holds
+// one per distinct state. The package files of all of them are prefetched
+// once into the shared cachedir, sources are built once, and then one
+// xbps-install per rootdir runs, at most jobs at a time, its output captured
+// and shown only when it fails.
+
+// Rootdirs installed concurrently when no -j is given
+BATCH_DEFAULT_JOBS :: 4
+
+Batch_Group :: struct {
+	rootdirs: []string,
+	tx:       Transaction,
+}
+
+// The items of every group, each package file and build only once
+// (temp-allocated; items are views into the groups' transactions)
+transaction_merge :: proc(groups: []Batch_Group) -> Transaction {
+	merged := transaction_make(context.temp_allocator)
+	seen := make(map[string]bool, allocator = context.temp_allocator)
+	for &g in groups {
+		for item in g.tx.items {
+			key := item.filename if len(item.filename) > 0 else item.name
+			if item.op == .Build_Install {
+				key = fmt.tprintf("build:%s", item.name)
+			}
+			if key in seen {
+				continue
+			}
+			seen[key] = true
+			append(&merged.items, item)
+		}
+	}
+	return merged
+}
+
+// Execute the groups of a batch (install transactions only)
+transaction_execute_batch :: proc(
+	groups: []Batch_Group,
+	cfg: ^builder.Build_Config,
+	idx: ^index.Index,
+	jobs: int,
+) -> bool {
+	utils.stats_span("transaction_execute_batch")
+
+	merged := transaction_merge(groups)
+	builds := make([dynamic]string, context.temp_allocator)
+	for item in merged.items {
+		if item.op == .Build_Install {
+			append(&builds, item.name)
+		}
+	}
+	if transaction_is_empty(&merged) {
+		return true
+	}
+
+	// The host cachedir is the one place every rootdir's packages may already be
+	prefetch, prefetch_ok := prefetch_plan(&merged, "")
+	if prefetch_ok {
+		if bytes, count, _ := prefetch_download_size(&prefetch); count > 0 {
+			errors.log_info("Prefetching %d package(s) (%s)...", count, utils.format_size(bytes))
+		}
+		prefetch_ok = prefetch_start(&prefetch)
+	}
+	// Removed whatever the outcome, once every xbps-install has exited
+	defer if prefetch_ok {
+		prefetch_wait(&prefetch)
+		prefetch_cleanup(&prefetch)
+	}
+
+	build_repo := ""
+	if len(builds) > 0 {
+		if !execute_builds(cfg, idx, builds[:], jobs) {
+			return false
+		}
+		build_repo = utils.path_join(cfg.hostdir, "binpkgs", allocator = context.temp_allocator)
+	}
+
+	if prefetch_ok {
+		prefetch_wait(&prefetch)
+	}
+
+	// Concurrent xbps-install can't share the terminal for prompts: vuru
+	// confirmed the batch already, and sudo asks for a password up front
+	if utils.run_command({"sudo", "-v"}) != 0 {
+		errors.log_error("sudo authentication failed")
+		return false
+	}
+
+	pool := utils.pool_make(jobs if jobs > 0 else BATCH_DEFAULT_JOBS, context.temp_allocator)
+	defer utils.pool_destroy(&pool)
+
+	rootdirs := make([dynamic]string, context.temp_allocator)
+	for &g in groups {
+		for rootdir in g.rootdirs {
+			args, count := install_command(&g.tx, prefetch.dir if prefetch_ok else "", build_repo, rootdir, true)
+			if count == 0 {
+				continue
+			}
+			utils.pool_add(&pool, args, .Capture_All)
+			append(&rootdirs, rootdir)
+		}
+	}
+
+	errors.log_info("Installing into %d rootdir(s)...", len(rootdirs))
+	started := time.tick_now()
+	failed := 0
+	for {
+		i, res, ok := utils.pool_next(&pool)
+		if !ok {
+			break
+		}
+		if res.code == 0 {
+			errors.log_info("%s: done", rootdirs[i])
+			continue
+		}
+		failed += 1
+		errors.log_error("%s: xbps-install exited with %d", rootdirs[i], res.code)
+		lines, _ := strings.split_lines(strings.trim_right(res.output, "\n"), context.temp_allocator)
+		for line in lines[max(len(lines) - builder.FAILED_LOG_LINES, 0):] {
+			fmt.println(line)
+		}
+	}
+
+	if failed > 0 {
+		errors.log_error("Failed to install into %d of %d rootdir(s)", failed, len(rootdirs))
+		return false
+	}
+	errors.log_info(
+		"Installed into %d rootdir(s) in %v",
+		len(rootdirs),
+		time.duration_round(time.tick_since(started), time.Second),
+	)
+	return true
+}
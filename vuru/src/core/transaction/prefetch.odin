@@ -0,0 +1,343 @@
+package transaction
+
+import "core:fmt"
+import "core:os"
+import "core:strings"
+import "core:sys/linux"
+import "core:time"
+
+import builder "../../core/builder"
+import config "../../core/config"
+import errors "../../core/errors"
+import index "../../core/index"
+import net "../../core/net"
+import xbps "../../core/xbps"
+import utils "../../utils"
+
+// Prefetch of the binary packages of a transaction. Every .xbps (and its .sig2,
+// which xbps requires next to a cached package) is placed in a cachedir owned
+// by vuru, which xbps-install is then pointed at with --cachedir. Files come
+// from that directory, the system cachedir or the VUP package cache when
+// present, and are downloaded concurrently otherwise - in a child process, so
+// source builds run in the meantime. Anything that could not be prefetched is
+// simply downloaded by xbps-install itself.
+
+PREFETCH_DIR :: "xbps-cache"
+
+// Last observed download rate (bytes per second), used for estimates
+BANDWIDTH_FILE :: "bandwidth"
+
+SYSTEM_CACHE_DIR :: "var/cache/xbps"
+
+MAX_PARALLEL_PREFETCH :: 6
+
+Prefetch_Source :: enum {
+	Staged, // Already in the prefetch dir
+	System_Cache, // Copied from the system cachedir
+	Vup_Cache, // Linked from the VUP package cache (signature downloaded)
+	Download,
+}
+
+Prefetch_File :: struct {
+	filename: string,
+	url:      string,
+	size:     i64, // 0 if unknown
+	sha256:   string,
+	vup:      bool,
+	source:   Prefetch_Source,
+	object:   string, // Local copy for System_Cache and Vup_Cache
+}
+
+Prefetch :: struct {
+	dir:   string,
+	files: [dynamic]Prefetch_File,
+	pid:   linux.Pid, // Background downloads, 0 if none
+}
+
+// Locate the binary packages of a transaction. Items without a known file
+// are left to xbps-install. Everything is temp-allocated.
+prefetch_plan :: proc(t: ^Transaction, rootdir: string) -> (Prefetch, bool) {
+	cache_dir, ok := config.get_cache_dir(context.temp_allocator)
+	if !ok {
+		return {}, false
+	}
+
+	p := Prefetch {
+		dir   = utils.path_join(cache_dir, PREFETCH_DIR, allocator = context.temp_allocator),
+		files = make([dynamic]Prefetch_File, context.temp_allocator),
+	}
+	if !utils.mkdir_p(p.dir) {
+		return {}, false
+	}
+
+	system_cache := xbps.rootdir_path(rootdir, SYSTEM_CACHE_DIR)
+	vup_cache, vup_cache_ok := builder.binpkg_cache_open()
+
+	for item in t.items {
+		if (item.op != .Install_Official && item.op != .Install_VUP) ||
+		   len(item.filename) == 0 ||
+		   len(item.repo_url) == 0 {
+			continue
+		}
+
+		f := Prefetch_File {
+			filename = item.filename,
+			url      = fmt.tprintf("%s/%s", strings.trim_right(item.repo_url, "/"), item.filename),
+			size     = item.file_size,
+			sha256   = item.file_sha256,
+			vup      = item.op == .Install_VUP,
+			source   = .Download,
+		}
+
+		cached := utils.path_join(system_cache, f.filename, allocator = context.temp_allocator)
+		switch {
+		case is_complete(prefetch_path(&p, f.filename), f.size):
+			f.source = .Staged
+		case is_complete(cached, f.size):
+			f.source = .System_Cache
+			f.object = cached
+		case f.vup && vup_cache_ok:
+			bin := index.Binpkg_Info {
+				filename = f.filename,
+				size     = f.size,
+				sha256   = f.sha256,
+			}
+			if object, hit := builder.binpkg_cache_lookup(&vup_cache, bin); hit {
+				f.source = .Vup_Cache
+				f.object = object
+			}
+		}
+		append(&p.files, f)
+	}
+
+	return p, true
+}
+
+// Bytes and number of packages left to download (unknown: count without a size)
+prefetch_download_size :: proc(p: ^Prefetch) -> (bytes: i64, count: int, unknown: int) {
+	for f in p.files {
+		if f.source != .Download {
+			continue
+		}
+		count += 1
+		if f.size > 0 {
+			bytes += f.size
+		} else {
+			unknown += 1
+		}
+	}
+	return
+}
+
+// Place local copies, then start the downloads in the background.
+// False if they could not be started (xbps-install downloads instead).
+prefetch_start :: proc(p: ^Prefetch) -> bool {
+	downloads := 0
+	for &f in p.files {
+		dest := prefetch_path(p, f.filename)
+
+		#partial switch f.source {
+		case .System_Cache:
+			if utils.run_command_silent({"cp", "--reflink=auto", f.object, dest}) != 0 ||
+			   utils.run_command_silent({"cp", "--reflink=auto", signature_path(f.object), signature_path(dest)}) != 0 {
+				f.source = .Download
+			}
+		case .Vup_Cache:
+			os.remove(dest)
+			if !builder.binpkg_cache_link(f.object, dest) {
+				f.source = .Download
+			}
+		}
+
+		if f.source == .Vup_Cache || f.source == .Download {
+			downloads += 1
+		}
+	}
+	if downloads == 0 {
+		return true
+	}
+
+	pid, err := linux.fork()
+	if err != nil {
+		return false
+	}
+	if pid == 0 {
+		prefetch_download(p)
+		os.exit(0)
+	}
+
+	p.pid = pid
+	return true
+}
+
+// Wait for the background downloads to finish
+prefetch_wait :: proc(p: ^Prefetch) {
+	if p.pid == 0 {
+		return
+	}
+	utils.stats_span("prefetch_wait")
+	for {
+		_, err := linux.waitpid(p.pid, nil, {}, nil)
+		if err != .EINTR {
+			break
+		}
+	}
+	p.pid = 0
+}
+
+// Remove the prefetched files once xbps-install has used them
+prefetch_cleanup :: proc(p: ^Prefetch) {
+	for f in p.files {
+		dest := prefetch_path(p, f.filename)
+		os.remove(dest)
+		os.remove(signature_path(dest))
+	}
+}
+
+// Last measured download rate in bytes per second
+prefetch_rate :: proc() -> (i64, bool) {
+	cache_dir, ok := config.get_cache_dir(context.temp_allocator)
+	if !ok {
+		return 0, false
+	}
+
+	content, read_ok := utils.read_file(
+		utils.path_join(cache_dir, BANDWIDTH_FILE, allocator = context.temp_allocator),
+		context.temp_allocator,
+	)
+	if !read_ok {
+		return 0, false
+	}
+
+	rate := i64(utils.parse_int(strings.trim_space(content)))
+	return rate, rate > 0
+}
+
+// Download and verify the missing files (runs in the prefetch child)
+@(private)
+prefetch_download :: proc(p: ^Prefetch) {
+	reqs := make([dynamic]net.Request, context.temp_allocator)
+	sig_req := make([]int, len(p.files), context.temp_allocator)
+	pkg_req := make([]int, len(p.files), context.temp_allocator)
+
+	for f, i in p.files {
+		sig_req[i], pkg_req[i] = -1, -1
+		if f.source != .Vup_Cache && f.source != .Download {
+			continue
+		}
+
+		dest := prefetch_path(p, f.filename)
+		sig_req[i] = len(reqs)
+		append(&reqs, net.Request{url = signature_path(f.url), dest = signature_path(dest)})
+
+		if f.source == .Download {
+			// Verified on arrival; an interrupted download is resumed next time
+			pkg_req[i] = len(reqs)
+			append(
+				&reqs,
+				net.Request {
+					url = f.url,
+					dest = fmt.tprintf("%s/.%s.dl", p.dir, f.filename),
+					size = f.size,
+					sha256 = f.sha256,
+				},
+			)
+		}
+	}
+
+	start := time.tick_now()
+	results := net.download(reqs[:], MAX_PARALLEL_PREFETCH)
+	elapsed := time.tick_since(start)
+
+	vup_cache, vup_cache_ok := builder.binpkg_cache_open()
+	downloaded: i64 = 0
+
+	for f, i in p.files {
+		if sig_req[i] < 0 {
+			continue
+		}
+		dest := prefetch_path(p, f.filename)
+		placed := results[sig_req[i]].status == .Ok
+
+		if j := pkg_req[i]; j >= 0 {
+			tmp := reqs[j].dest
+			defer os.remove(tmp)
+
+			#partial switch results[j].status {
+			case .Ok:
+				if fi, err := os.stat(tmp, context.temp_allocator); err == os.ERROR_NONE {
+					downloaded += fi.size
+				}
+				placed = placed && place_download(f, tmp, dest, &vup_cache, vup_cache_ok)
+			case .Checksum_Mismatch:
+				errors.log_warning("Checksum mismatch for %s, xbps will download it again", f.filename)
+				placed = false
+			case:
+				placed = false
+			}
+		}
+
+		// xbps only uses a cached package together with its signature
+		if !placed {
+			os.remove(dest)
+			os.remove(signature_path(dest))
+		}
+	}
+
+	if downloaded > 0 && elapsed >= time.Second {
+		rate := i64(f64(downloaded) / time.duration_seconds(elapsed))
+		if cache_dir, ok := config.get_cache_dir(context.temp_allocator); ok {
+			utils.write_file(
+				utils.path_join(cache_dir, BANDWIDTH_FILE, allocator = context.temp_allocator),
+				fmt.tprintf("%d\n", rate),
+			)
+		}
+	}
+}
+
+// Move a verified download to dest (VUP packages go through the package
+// cache so later builds find them there too)
+@(private)
+place_download :: proc(
+	f: Prefetch_File,
+	tmp: string,
+	dest: string,
+	vup_cache: ^builder.Binpkg_Cache,
+	vup_cache_ok: bool,
+) -> bool {
+	if f.vup && vup_cache_ok {
+		bin := index.Binpkg_Info {
+			filename = f.filename,
+			size     = f.size,
+			sha256   = f.sha256,
+		}
+		object, ok := builder.binpkg_cache_adopt(vup_cache, tmp, bin)
+		if !ok {
+			return false
+		}
+		os.remove(dest)
+		return builder.binpkg_cache_link(object, dest)
+	}
+
+	return os.rename(tmp, dest) == os.ERROR_NONE
+}
+
+@(private)
+prefetch_path :: proc(p: ^Prefetch, filename: string) -> string {
+	return utils.path_join(p.dir, filename, allocator = context.temp_allocator)
+}
+
+@(private)
+signature_path :: proc(path: string) -> string {
+	return strings.concatenate({path, ".sig2"}, context.temp_allocator)
+}
+
+// A cached package with its signature (and the published size, if known)
+@(private)
+is_complete :: proc(path: string, size: i64) -> bool {
+	fi, err := os.stat(path, context.temp_allocator)
+	if err != os.ERROR_NONE || (size > 0 && fi.size != size) {
+		return false
+	}
+	return os.exists(signature_path(path))
+}
@@ -2,20 +2,28 @@ package transaction
 
 import "core:fmt"
 import "core:os"
+import "core:slice"
 import "core:strings"
+import "core:time"
 
 import builder "../../core/builder"
+import config "../../core/config"
 import errors "../../core/errors"
+import index "../../core/index"
 import resolve "../../core/resolve"
 import xbps "../../core/xbps"
 import utils "../../utils"
 
 // Create a transaction from resolution result
+// Binary installs carry their package file (from the VUP index or the official
+// repodata) so it can be prefetched.
 transaction_from_resolution :: proc(
 	res: ^resolve.Resolution,
+	sources: ^resolve.Sources,
 	allocator := context.allocator,
 ) -> Transaction {
 	tx := transaction_make(allocator)
+	arch, _ := config.get_arch()
 
 	// Add packages to install (binary)
 	for pkg in res.to_install {
@@ -29,8 +37,26 @@ transaction_from_resolution :: proc(
 			item.op = .Install_VUP
 			item.repo_url = strings.clone(pkg.repo_url, allocator)
 			item.category = strings.clone(pkg.category, allocator)
+
+			if info, ok := index.index_get_package(sources.index, pkg.name); ok {
+				bin := info.binpkgs[arch]
+				if len(bin.filename) == 0 {
+					// Indexes without binpkg metadata: pkgname-version.arch.xbps
+					bin.filename = fmt.tprintf("%s-%s.%s.xbps", pkg.name, pkg.version, arch)
+				}
+				item.filename = strings.clone(bin.filename, allocator)
+				item.file_size = bin.size
+				item.file_sha256 = strings.clone(bin.sha256, allocator)
+			}
 		} else {
 			item.op = .Install_Official
+
+			if rp, ok := xbps.repodata_get(&sources.official, pkg.name); ok && sources.has_official {
+				item.repo_url = strings.clone(rp.repository, allocator)
+				item.filename = strings.clone(xbps.repodata_binpkg_filename(rp), allocator)
+				item.file_size = rp.file_size
+				item.file_sha256 = strings.clone(rp.file_sha256, allocator)
+			}
 		}
 
 		append(&tx.items, item)
@@ -102,82 +128,100 @@ transaction_print :: proc(t: ^Transaction) {
 	fmt.println()
 }
 
-// Execute a transaction
-transaction_execute :: proc(t: ^Transaction, cfg: ^builder.Build_Config, yes: bool) -> bool {
-	if transaction_is_empty(t) {
-		return true
+// Print how much the transaction downloads and, from the last measured
+// rate, how long that should take (dependencies xbps adds are not counted)
+transaction_print_download :: proc(t: ^Transaction, rootdir: string) {
+	p, ok := prefetch_plan(t, rootdir)
+	if !ok || len(p.files) == 0 {
+		return
 	}
 
-	// Group packages by operation type for batch execution
-	VUP_Group :: struct {
-		repo_url: string,
-		pkgs:     [dynamic]string,
+	bytes, count, unknown := prefetch_download_size(&p)
+	fmt.printf("Download: %d package(s), %s", count, utils.format_size(bytes))
+	if unknown > 0 {
+		fmt.printf(" (+%d of unknown size)", unknown)
+	}
+	if cached := len(p.files) - count; cached > 0 {
+		fmt.printf(", %d already cached", cached)
 	}
+	fmt.println()
 
-	official_pkgs := make([dynamic]string, context.temp_allocator)
-	vup_groups := make([dynamic]VUP_Group, context.temp_allocator)
-	remove_pkgs := make([dynamic]string, context.temp_allocator)
-	builds := make([dynamic]^Transaction_Item, context.temp_allocator)
+	if rate, rate_ok := prefetch_rate(); rate_ok && bytes > 0 {
+		eta := time.Duration(f64(bytes) / f64(rate) * f64(time.Second))
+		fmt.printf(
+			"Estimated download time: %v (at %s/s)\n",
+			time.duration_round(eta, time.Second),
+			utils.format_size(rate),
+		)
+	}
+}
 
-	for &item in t.items {
-		switch item.op {
-		case .Install_Official:
-			append(&official_pkgs, item.name)
+// Execute a transaction
+// Package files are prefetched in the background while source builds run;
+// then everything is installed by a single xbps-install with every VUP
+// repository (and the local build repository) added, so xbps solves and
+// unpacks once.
+transaction_execute :: proc(
+	t: ^Transaction,
+	cfg: ^builder.Build_Config,
+	idx: ^index.Index,
+	rootdir: string,
+	yes: bool,
+	jobs: int,
+) -> bool {
+	if transaction_is_empty(t) {
+		return true
+	}
+	utils.stats_span("transaction_execute")
 
-		case .Install_VUP:
-			found := false
-			for &group in vup_groups {
-				if group.repo_url == item.repo_url {
-					append(&group.pkgs, item.name)
-					found = true
-					break
-				}
-			}
-			if !found {
-				append(&vup_groups, VUP_Group{
-					repo_url = item.repo_url,
-					pkgs     = make([dynamic]string, context.temp_allocator),
-				})
-				append(&vup_groups[len(vup_groups) - 1].pkgs, item.name)
-			}
+	remove_pkgs := make([dynamic]string, context.temp_allocator)
+	builds := make([dynamic]string, context.temp_allocator)
 
+	for item in t.items {
+		#partial switch item.op {
 		case .Remove:
 			append(&remove_pkgs, item.name)
-
 		case .Build_Install:
-			append(&builds, &item)
-
-		case .Upgrade:
+			append(&builds, item.name)
 		}
 	}
 
-	// Execute official installs in one batch
-	if len(official_pkgs) > 0 {
-		errors.log_info("Installing %d package(s) from official repos...", len(official_pkgs))
-
-		args: [dynamic; 64]string
-		append(&args, "sudo", "xbps-install", "-S")
-		if yes {
-			append(&args, "-y")
-		}
-		for pkg in official_pkgs {
-			append(&args, pkg)
+	prefetch, prefetch_ok := prefetch_plan(t, rootdir)
+	if prefetch_ok {
+		if bytes, count, _ := prefetch_download_size(&prefetch); count > 0 {
+			errors.log_info("Prefetching %d package(s) (%s)...", count, utils.format_size(bytes))
 		}
+		prefetch_ok = prefetch_start(&prefetch)
+	}
 
-		if utils.run_command(args[:]) != 0 {
-			errors.log_error("Failed to install official packages")
+	// Builds overlap with the downloads
+	build_repo := ""
+	if len(builds) > 0 {
+		if !execute_builds(cfg, idx, builds[:], jobs) {
+			if prefetch_ok {
+				prefetch_wait(&prefetch)
+			}
 			return false
 		}
+		build_repo = utils.path_join(cfg.hostdir, "binpkgs", allocator = context.temp_allocator)
 	}
 
-	// Execute VUP installs grouped by repo
-	for group in vup_groups {
-		errors.log_info("Installing %d package(s) from VUP...", len(group.pkgs))
+	if prefetch_ok {
+		prefetch_wait(&prefetch)
+	}
+
+	// One transaction for everything
+	if args, count := install_command(t, prefetch.dir if prefetch_ok else "", build_repo, rootdir, yes); count > 0 {
+		errors.log_info("Installing %d package(s)...", count)
 
-		if xbps.install_packages_from_repo(group.repo_url, group.pkgs[:], yes, utils.run_command) != 0 {
-			errors.log_error("Failed to install VUP packages")
+		if utils.run_command(args) != 0 {
+			errors.log_error("Failed to install packages")
 			return false
 		}
+
+		if prefetch_ok {
+			prefetch_cleanup(&prefetch)
+		}
 	}
 
 	// Execute removes in one batch
@@ -186,6 +230,9 @@ transaction_execute :: proc(t: ^Transaction, cfg: ^builder.Build_Config, yes: bo
 
 		args: [dynamic; 64]string
 		append(&args, "sudo", "xbps-remove", "-R")
+		if len(rootdir) > 0 {
+			append(&args, "-r", rootdir)
+		}
 		if yes {
 			append(&args, "-y")
 		}
@@ -199,30 +246,78 @@ transaction_execute :: proc(t: ^Transaction, cfg: ^builder.Build_Config, yes: bo
 		}
 	}
 
-	// Execute builds individually
-	for item in builds {
-		if !execute_build_install(item, cfg, yes) {
-			return false
+	return true
+}
+
+// xbps-install of the binary installs of a transaction and of its builds,
+// then in build_repo, with every VUP repository added once; count is the
+// number of packages (0: nothing to install)
+@(private)
+install_command :: proc(
+	t: ^Transaction,
+	cachedir: string,
+	build_repo: string,
+	rootdir: string,
+	yes: bool,
+) -> (
+	args: []string,
+	count: int,
+) {
+	installs := make([dynamic]string, context.temp_allocator)
+	repos := make([dynamic]string, context.temp_allocator)
+
+	for item in t.items {
+		#partial switch item.op {
+		case .Install_Official:
+			append(&installs, item.name)
+		case .Install_VUP:
+			append(&installs, item.name)
+			if !slice.contains(repos[:], item.repo_url) {
+				append(&repos, item.repo_url)
+			}
+		}
+	}
+	if len(build_repo) > 0 {
+		for item in t.items {
+			if item.op == .Build_Install {
+				append(&installs, item.name)
+			}
 		}
+		append(&repos, build_repo)
+	}
+	if len(installs) == 0 {
+		return nil, 0
 	}
 
-	return true
+	cmd := make([dynamic]string, context.temp_allocator)
+	append(&cmd, "sudo", "xbps-install", "-S")
+	if len(cachedir) > 0 {
+		append(&cmd, "--cachedir", cachedir)
+	}
+	for repo in repos {
+		append(&cmd, fmt.tprintf("--repository=%s", repo))
+	}
+	if len(rootdir) > 0 {
+		append(&cmd, "-r", rootdir)
+	}
+	if yes {
+		append(&cmd, "-y")
+	}
+	append(&cmd, ..installs[:])
+	return cmd[:], len(installs)
 }
 
+// Build the packages of a transaction (and VUP dependencies without binaries),
+// at most jobs at a time (0: the builder's default)
 @(private)
-execute_build_install :: proc(item: ^Transaction_Item, cfg: ^builder.Build_Config, yes: bool) -> bool {
-	errors.log_info("Building %s...", item.name)
-	
-	if !builder.build_package(cfg, item.name, item.category) {
-		errors.log_error("Failed to build %s", item.name)
+execute_builds :: proc(cfg: ^builder.Build_Config, idx: ^index.Index, names: []string, jobs: int) -> bool {
+	srcpkgs := utils.path_join(cfg.vup_dir, "srcpkgs", allocator = context.temp_allocator)
+	plan, err := builder.build_plan_make(idx, names, srcpkgs, true, false, context.temp_allocator)
+	if err.kind != nil {
+		errors.print_error(err)
 		return false
 	}
-	
-	if !builder.install_local_package(cfg, item.name, yes) {
-		errors.log_error("Failed to install built package %s", item.name)
-		return false
-	}
-	return true
+	return builder.build_plan_run(cfg, &plan, idx, jobs)
 }
 
 // Confirm transaction with user
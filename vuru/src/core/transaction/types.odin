@@ -17,9 +17,12 @@ Transaction_Item :: struct {
 	name:        string,
 	old_version: string, // For upgrades
 	new_version: string,
-	repo_url:    string, // For VUP binary installs
+	repo_url:    string, // Repository of binary installs
 	category:    string, // For VUP packages
 	reason:      string, // "explicit" or "dependency"
+	filename:    string, // Binary package file in repo_url, "" if unknown
+	file_size:   i64, // 0 if unknown
+	file_sha256: string,
 }
 
 // Complete transaction plan
@@ -38,6 +41,8 @@ transaction_item_free :: proc(item: ^Transaction_Item, allocator: mem.Allocator)
 	if len(item.repo_url) > 0 do delete(item.repo_url, allocator)
 	if len(item.category) > 0 do delete(item.category, allocator)
 	if len(item.reason) > 0 do delete(item.reason, allocator)
+	if len(item.filename) > 0 do delete(item.filename, allocator)
+	if len(item.file_sha256) > 0 do delete(item.file_sha256, allocator)
 }
 
 // Free transaction and all its allocations
@@ -0,0 +1,82 @@
+package xbps
+
+import "core:strings"
+
+// Minimal libarchive bindings for reading members out of xbps repodata
+// archives (tar compressed with zstd, gzip, ...). libarchive is already a
+// dependency of xbps itself, so it is present wherever vuru runs.
+foreign import libarchive "system:archive"
+
+Archive :: struct {}
+Archive_Entry :: struct {}
+
+@(private)
+ARCHIVE_OK :: 0
+@(private)
+ARCHIVE_BLOCK_SIZE :: 64 * 1024
+
+foreign libarchive {
+	archive_read_new :: proc() -> ^Archive ---
+	archive_read_support_filter_all :: proc(a: ^Archive) -> i32 ---
+	archive_read_support_format_tar :: proc(a: ^Archive) -> i32 ---
+	archive_read_open_filename :: proc(a: ^Archive, filename: cstring, block_size: uint) -> i32 ---
+	archive_read_next_header :: proc(a: ^Archive, entry: ^^Archive_Entry) -> i32 ---
+	archive_read_data :: proc(a: ^Archive, buf: rawptr, size: uint) -> int ---
+	archive_read_free :: proc(a: ^Archive) -> i32 ---
+	archive_entry_pathname :: proc(entry: ^Archive_Entry) -> cstring ---
+	archive_entry_size :: proc(entry: ^Archive_Entry) -> i64 ---
+}
+
+// Read a single member (e.g. "index.plist") from a compressed tar archive
+archive_read_member :: proc(
+	path: string,
+	member: string,
+	allocator := context.allocator,
+) -> (
+	string,
+	bool,
+) {
+	a := archive_read_new()
+	if a == nil {
+		return "", false
+	}
+	defer archive_read_free(a)
+
+	archive_read_support_filter_all(a)
+	archive_read_support_format_tar(a)
+
+	cpath := strings.clone_to_cstring(path, context.temp_allocator)
+	if archive_read_open_filename(a, cpath, ARCHIVE_BLOCK_SIZE) != ARCHIVE_OK {
+		return "", false
+	}
+
+	entry: ^Archive_Entry
+	for archive_read_next_header(a, &entry) == ARCHIVE_OK {
+		if string(archive_entry_pathname(entry)) != member {
+			continue
+		}
+
+		size := archive_entry_size(entry)
+		if size <= 0 {
+			return "", false
+		}
+
+		buf := make([]u8, int(size), allocator)
+		total := 0
+		for total < len(buf) {
+			n := archive_read_data(a, &buf[total], uint(len(buf) - total))
+			if n <= 0 {
+				break
+			}
+			total += n
+		}
+
+		if total != len(buf) {
+			delete(buf, allocator)
+			return "", false
+		}
+		return string(buf), true
+	}
+
+	return "", false
+}
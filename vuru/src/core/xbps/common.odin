@@ -5,7 +5,6 @@ import "core:strings"
 // Common utilities for XBPS operations
 
 import "core:mem"
-import "../../utils"
 
 // Type alias for command runner functions
 Command_Runner :: proc(args: []string) -> int
@@ -38,48 +37,38 @@ build_args_with_yes :: proc(
 	return result
 }
 
-// Parse "pkgname-version" format into (name, version) using xbps-uhelper
+// Parse "pkgname-version" format into (name, version)
+// Same rules as libxbps xbps_pkg_name()/xbps_pkg_version(): the version is the
+// part after the last '-', and must contain a digit before its '_revision'.
 // This correctly handles package names with dashes (e.g., visual-studio-code-insiders-1.102.0.20250116_1)
+// Falls back to simple splitting for strings without a revision.
+// Returned strings are views into pkgver.
 parse_pkgver :: proc(pkgver: string) -> (name: string, version: string, ok: bool) {
-	if len(pkgver) == 0 {
+	dash := strings.last_index_byte(pkgver, '-')
+	if dash <= 0 {
 		return "", "", false
 	}
 
-	// Use xbps-uhelper getpkgname to correctly parse the package name
-	name_output, name_ok := utils.run_command_output(
-		{"xbps-uhelper", "getpkgname", pkgver},
-		context.temp_allocator,
-	)
-	if !name_ok {
-		// Fall back to simple parsing if xbps-uhelper fails
-		return parse_pkgver_simple(pkgver)
-	}
-
-	parsed_name := strings.trim_space(name_output)
-	if len(parsed_name) == 0 {
+	suffix := pkgver[dash:]
+	if strings.index_byte(suffix, '_') < 0 {
 		return parse_pkgver_simple(pkgver)
 	}
 
-	// Use xbps-uhelper getpkgversion to correctly parse the version
-	ver_output, ver_ok := utils.run_command_output(
-		{"xbps-uhelper", "getpkgversion", pkgver},
-		context.temp_allocator,
-	)
-	if !ver_ok {
-		return parse_pkgver_simple(pkgver)
+	for i in 0 ..< len(suffix) {
+		c := suffix[i]
+		if c == '_' {
+			break
+		}
+		if c >= '0' && c <= '9' {
+			return pkgver[:dash], suffix[1:], true
+		}
 	}
 
-	parsed_version := strings.trim_space(ver_output)
-	if len(parsed_version) == 0 {
-		return parse_pkgver_simple(pkgver)
-	}
-
-	return parsed_name, parsed_version, true
+	return parse_pkgver_simple(pkgver)
 }
 
 // Parse "pkgname-version" format into (name, version) using simple string splitting
-// NOTE: This is a fallback and does NOT work correctly for packages with dashes in their names!
-// Prefer parse_pkgver which uses xbps-uhelper for correct parsing.
+// NOTE: This does not validate the version part; prefer parse_pkgver.
 parse_pkgver_simple :: proc(pkgver: string) -> (name: string, version: string, ok: bool) {
 	if len(pkgver) == 0 {
 		return "", "", false
@@ -92,3 +81,13 @@ parse_pkgver_simple :: proc(pkgver: string) -> (name: string, version: string, o
 
 	return pkgver[:idx], pkgver[idx + 1:], true
 }
+
+// Get the package name from a dependency pattern ("foo>=1.0", "foo<2", "foo")
+// Same rules as libxbps xbps_pkgpattern_name() for relational patterns.
+// Returned string is a view into pattern.
+pkgpattern_name :: proc(pattern: string) -> string {
+	if i := strings.index_any(pattern, "<>="); i > 0 {
+		return pattern[:i]
+	}
+	return pattern
+}
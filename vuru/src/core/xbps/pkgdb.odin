@@ -0,0 +1,281 @@
+package xbps
+
+import "core:mem"
+import "core:os"
+import "core:strings"
+
+import "../../utils"
+
+// Installed-package snapshot, read once per invocation.
+// Parses <rootdir>/var/db/xbps/pkgdb-*.plist directly; falls back to a single
+// `xbps-query -l` (plus `-m` for manual packages) when the file can't be read.
+
+PKGDB_DIR :: "var/db/xbps"
+
+// Installed package entry
+Installed_Package :: struct {
+	pkgver:      string,
+	version:     string, // View into pkgver
+	state:       string, // "installed", "unpacked", ...
+	automatic:   bool, // Installed as a dependency
+	run_depends: []string, // Dependency patterns (empty in fallback mode)
+}
+
+// Snapshot of the installed package database
+Pkgdb :: struct {
+	packages:  map[string]Installed_Package,
+	rootdir:   string,
+	allocator: mem.Allocator,
+}
+
+// Free all resources in a Pkgdb
+pkgdb_free :: proc(db: ^Pkgdb) {
+	if db == nil do return
+
+	for name, pkg in db.packages {
+		delete(name, db.allocator)
+		delete(pkg.pkgver, db.allocator)
+		if len(pkg.state) > 0 do delete(pkg.state, db.allocator)
+		for d in pkg.run_depends {delete(d, db.allocator)}
+		delete(pkg.run_depends, db.allocator)
+	}
+	delete(db.packages)
+	if len(db.rootdir) > 0 do delete(db.rootdir, db.allocator)
+}
+
+// Load the installed package snapshot for rootdir ("" for the host system)
+pkgdb_load :: proc(rootdir: string = "", allocator := context.allocator) -> (Pkgdb, bool) {
+	db := Pkgdb {
+		packages  = make(map[string]Installed_Package, allocator = allocator),
+		rootdir   = strings.clone(rootdir, allocator) if len(rootdir) > 0 else "",
+		allocator = allocator,
+	}
+
+	if path, found := find_pkgdb_plist(rootdir); found {
+		if content, ok := utils.read_file(path, context.temp_allocator); ok {
+			if pkgdb_parse_plist(&db, content) {
+				return db, true
+			}
+			// Partial parse - start over with the fallback
+			pkgdb_free(&db)
+			db = Pkgdb {
+				packages  = make(map[string]Installed_Package, allocator = allocator),
+				rootdir   = strings.clone(rootdir, allocator) if len(rootdir) > 0 else "",
+				allocator = allocator,
+			}
+		}
+	}
+
+	if pkgdb_load_from_query(&db) {
+		return db, true
+	}
+
+	return db, false
+}
+
+// Get an installed package (returns a view, not a copy)
+pkgdb_get :: proc(db: ^Pkgdb, name: string) -> (Installed_Package, bool) {
+	pkg, ok := db.packages[name]
+	return pkg, ok
+}
+
+// Check if a package is installed
+pkgdb_is_installed :: proc(db: ^Pkgdb, name: string) -> bool {
+	return name in db.packages
+}
+
+// Get the installed version of a package (view into the snapshot)
+pkgdb_installed_version :: proc(db: ^Pkgdb, name: string) -> (string, bool) {
+	pkg, ok := db.packages[name]
+	if !ok {
+		return "", false
+	}
+	return pkg.version, true
+}
+
+// Resolve a path relative to rootdir ("/" when no rootdir is set)
+rootdir_path :: proc(rootdir: string, rel: string, allocator := context.temp_allocator) -> string {
+	if len(rootdir) == 0 {
+		return strings.concatenate({"/", rel}, allocator)
+	}
+	return utils.path_join(strings.trim_right(rootdir, "/"), rel, allocator = allocator)
+}
+
+// Locate pkgdb-<format>.plist under rootdir; picks the newest format if several exist
+@(private)
+find_pkgdb_plist :: proc(rootdir: string) -> (string, bool) {
+	dir := rootdir_path(rootdir, PKGDB_DIR)
+
+	d, err := os.open(dir)
+	if err != os.ERROR_NONE {
+		return "", false
+	}
+	defer os.close(d)
+
+	file_infos, _ := os.read_dir(d, -1, context.temp_allocator)
+
+	best := ""
+	for fi in file_infos {
+		if fi.type == .Directory {
+			continue
+		}
+		if strings.has_prefix(fi.name, "pkgdb-") && strings.has_suffix(fi.name, ".plist") {
+			if fi.name > best {
+				best = fi.name
+			}
+		}
+	}
+
+	if len(best) == 0 {
+		return "", false
+	}
+	return utils.path_join(dir, best, allocator = context.temp_allocator), true
+}
+
+// Parse pkgdb plist content into db
+@(private)
+pkgdb_parse_plist :: proc(db: ^Pkgdb, content: string) -> bool {
+	r := plist_reader_make(content)
+
+	if tok, _ := plist_next(&r); tok != .Dict_Begin {
+		return false
+	}
+
+	for {
+		tok, text := plist_next(&r)
+		#partial switch tok {
+		case .Dict_End, .EOF:
+			return true
+		case .Key:
+		case:
+			return false
+		}
+
+		name := plist_unescape(text, context.temp_allocator)
+
+		value_tok, _ := plist_next(&r)
+		if value_tok != .Dict_Begin || strings.has_prefix(name, "_XBPS_") {
+			// Internal metadata (alternatives, etc.)
+			if !plist_skip(&r, value_tok) {
+				return false
+			}
+			continue
+		}
+
+		pkg, ok := pkgdb_parse_entry(&r, db.allocator)
+		if !ok {
+			return false
+		}
+		if len(pkg.pkgver) == 0 {
+			continue
+		}
+		db.packages[strings.clone(name, db.allocator)] = pkg
+	}
+}
+
+// Parse one package dictionary (after its Dict_Begin)
+@(private)
+pkgdb_parse_entry :: proc(
+	r: ^Plist_Reader,
+	allocator: mem.Allocator,
+) -> (
+	pkg: Installed_Package,
+	ok: bool,
+) {
+	for {
+		tok, key := plist_next(r)
+		#partial switch tok {
+		case .Dict_End:
+			return pkg, true
+		case .Key:
+		case:
+			return pkg, false
+		}
+
+		value_tok, value := plist_next(r)
+		switch key {
+		case "pkgver":
+			if value_tok == .String {
+				pkg.pkgver = strings.clone(plist_unescape(value, context.temp_allocator), allocator)
+				_, pkg.version, _ = parse_pkgver(pkg.pkgver)
+			}
+		case "state":
+			if value_tok == .String {
+				pkg.state = strings.clone(value, allocator)
+			}
+		case "automatic-install":
+			pkg.automatic = value_tok == .True
+		case "run_depends":
+			if value_tok == .Array_Begin {
+				pkg.run_depends = plist_read_string_array(r, allocator) or_return
+				continue
+			}
+		}
+
+		if !plist_skip(r, value_tok) {
+			return pkg, false
+		}
+	}
+}
+
+// Fallback: build the snapshot from `xbps-query -l` and `xbps-query -m`
+@(private)
+pkgdb_load_from_query :: proc(db: ^Pkgdb) -> bool {
+	list_cmd: [dynamic; 4]string
+	append(&list_cmd, "xbps-query", "-l")
+	manual_cmd: [dynamic; 4]string
+	append(&manual_cmd, "xbps-query", "-m")
+	if len(db.rootdir) > 0 {
+		append(&list_cmd, "-r", db.rootdir)
+		append(&manual_cmd, "-r", db.rootdir)
+	}
+
+	// Both queries read the whole pkgdb; run them side by side
+	pool := utils.pool_make(2, context.temp_allocator)
+	utils.pool_add(&pool, list_cmd[:])
+	utils.pool_add(&pool, manual_cmd[:])
+	results := utils.pool_wait(&pool)
+	utils.pool_destroy(&pool)
+
+	if results[0].code != 0 {
+		return false
+	}
+
+	output_iter := results[0].output
+	for line in strings.split_lines_iterator(&output_iter) {
+		// Format: "ii pkgver  short_desc"
+		parts := strings.fields(line, context.temp_allocator)
+		if len(parts) < 2 {
+			continue
+		}
+
+		name, _, parse_ok := parse_pkgver(parts[1])
+		if !parse_ok {
+			continue
+		}
+
+		pkg := Installed_Package {
+			pkgver    = strings.clone(parts[1], db.allocator),
+			state     = strings.clone("installed" if parts[0] == "ii" else "unpacked", db.allocator),
+			automatic = true,
+		}
+		_, pkg.version, _ = parse_pkgver(pkg.pkgver)
+		db.packages[strings.clone(name, db.allocator)] = pkg
+	}
+
+	// Manually installed packages (one pkgver per line)
+	if results[1].code == 0 {
+		manual_iter := results[1].output
+		for line in strings.split_lines_iterator(&manual_iter) {
+			name, _, parse_ok := parse_pkgver(strings.trim_space(line))
+			if !parse_ok {
+				continue
+			}
+			if pkg, exists := &db.packages[name]; exists {
+				pkg.automatic = false
+			}
+		}
+	}
+
+	return true
+}
@@ -0,0 +1,197 @@
+package xbps
+
+import "core:strings"
+
+// Minimal pull parser for the XML property lists written by libxbps
+// (pkgdb-*.plist, repodata index.plist). Only the subset xbps emits is
+// supported: dict, array, key, string, integer, true/false, data, date, real.
+
+Plist_Token :: enum {
+	EOF,
+	Error,
+	Dict_Begin,
+	Dict_End,
+	Array_Begin,
+	Array_End,
+	Key,
+	String,
+	Integer,
+	True,
+	False,
+	Other, // data, date, real - text is returned raw
+}
+
+Plist_Reader :: struct {
+	data: string,
+	pos:  int,
+}
+
+plist_reader_make :: proc(data: string) -> Plist_Reader {
+	return Plist_Reader{data = data}
+}
+
+// Read the next token. For scalar tokens, text holds the raw (still escaped)
+// element content as a view into the input.
+plist_next :: proc(r: ^Plist_Reader) -> (tok: Plist_Token, text: string) {
+	for {
+		lt := strings.index_byte(r.data[r.pos:], '<')
+		if lt < 0 {
+			r.pos = len(r.data)
+			return .EOF, ""
+		}
+		r.pos += lt
+
+		rest := r.data[r.pos:]
+		gt := strings.index_byte(rest, '>')
+		if gt < 0 {
+			return .Error, ""
+		}
+
+		tag := rest[1:gt]
+		r.pos += gt + 1
+
+		// Prolog, doctype, comments and the <plist> wrapper
+		if len(tag) == 0 || tag[0] == '?' || tag[0] == '!' {
+			continue
+		}
+		if strings.has_prefix(tag, "plist") || tag == "/plist" {
+			continue
+		}
+
+		self_closing := tag[len(tag) - 1] == '/'
+		name := strings.trim_right(tag, "/ ")
+
+		switch name {
+		case "dict":
+			return .Dict_Begin if !self_closing else .Dict_End, ""
+		case "/dict":
+			return .Dict_End, ""
+		case "array":
+			return .Array_Begin if !self_closing else .Array_End, ""
+		case "/array":
+			return .Array_End, ""
+		case "true":
+			return .True, ""
+		case "false":
+			return .False, ""
+		}
+
+		kind := Plist_Token.Other
+		switch name {
+		case "key":
+			kind = .Key
+		case "string":
+			kind = .String
+		case "integer":
+			kind = .Integer
+		}
+
+		if self_closing {
+			return kind, ""
+		}
+
+		// Scalar content runs until the closing tag
+		end := strings.index(r.data[r.pos:], "</")
+		if end < 0 {
+			return .Error, ""
+		}
+		text = r.data[r.pos:r.pos + end]
+		r.pos += end
+
+		close_end := strings.index_byte(r.data[r.pos:], '>')
+		if close_end < 0 {
+			return .Error, ""
+		}
+		r.pos += close_end + 1
+
+		return kind, text
+	}
+}
+
+// Skip the value that started with tok (recursing into dicts and arrays)
+plist_skip :: proc(r: ^Plist_Reader, tok: Plist_Token) -> bool {
+	if tok != .Dict_Begin && tok != .Array_Begin {
+		return tok != .Error && tok != .EOF
+	}
+
+	depth := 1
+	for depth > 0 {
+		t, _ := plist_next(r)
+		#partial switch t {
+		case .Dict_Begin, .Array_Begin:
+			depth += 1
+		case .Dict_End, .Array_End:
+			depth -= 1
+		case .EOF, .Error:
+			return false
+		}
+	}
+	return true
+}
+
+// Decode XML entities in element text. Returns a view when nothing needs decoding.
+plist_unescape :: proc(text: string, allocator := context.allocator) -> string {
+	if strings.index_byte(text, '&') < 0 {
+		return text
+	}
+
+	b := strings.builder_make(0, len(text), allocator)
+	i := 0
+	for i < len(text) {
+		c := text[i]
+		if c != '&' {
+			strings.write_byte(&b, c)
+			i += 1
+			continue
+		}
+
+		semi := strings.index_byte(text[i:], ';')
+		if semi < 0 {
+			strings.write_string(&b, text[i:])
+			break
+		}
+
+		entity := text[i + 1:i + semi]
+		switch entity {
+		case "lt":
+			strings.write_byte(&b, '<')
+		case "gt":
+			strings.write_byte(&b, '>')
+		case "amp":
+			strings.write_byte(&b, '&')
+		case "quot":
+			strings.write_byte(&b, '"')
+		case "apos":
+			strings.write_byte(&b, '\'')
+		case:
+			strings.write_string(&b, text[i:i + semi + 1])
+		}
+		i += semi + 1
+	}
+
+	return strings.to_string(b)
+}
+
+// Read an array of strings after its Array_Begin token, cloning into allocator
+plist_read_string_array :: proc(
+	r: ^Plist_Reader,
+	allocator := context.allocator,
+) -> (
+	[]string,
+	bool,
+) {
+	result := make([dynamic]string, allocator)
+	for {
+		tok, text := plist_next(r)
+		#partial switch tok {
+		case .Array_End:
+			return result[:], true
+		case .String:
+			append(&result, strings.clone(plist_unescape(text, context.temp_allocator), allocator))
+		case:
+			if !plist_skip(r, tok) {
+				return result[:], false
+			}
+		}
+	}
+}
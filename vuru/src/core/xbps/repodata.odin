@@ -0,0 +1,328 @@
+package xbps
+
+import "core:mem"
+import "core:os"
+import "core:slice"
+import "core:strings"
+
+import "../../utils"
+
+// Official repository tables read from the repodata archives xbps keeps in
+// its cache (<rootdir>/var/db/xbps/<escaped-url>/<arch>-repodata).
+// Loaded once per run; lookups never spawn xbps-query.
+
+// Package entry from a repository index
+Repo_Package :: struct {
+	pkgver:         string,
+	version:        string, // View into pkgver
+	short_desc:     string,
+	run_depends:    []string,
+	shlib_provides: []string,
+	repository:     string, // Repository URL this entry came from
+	architecture:   string, // Binary package is <pkgver>.<architecture>.xbps
+	file_size:      i64, // filename-size, 0 if absent
+	file_sha256:    string, // filename-sha256
+}
+
+// Merged tables of all configured repositories (first repository wins)
+Repodata :: struct {
+	packages:     map[string]Repo_Package,
+	repositories: [dynamic]string,
+	buffers:      [dynamic]string, // Decompressed index.plist data (entries are views)
+	owned:        [dynamic]string, // Unescaped strings allocated separately
+	allocator:    mem.Allocator,
+}
+
+// Free all resources in a Repodata
+repodata_free :: proc(rd: ^Repodata) {
+	if rd == nil do return
+
+	for _, pkg in rd.packages {
+		delete(pkg.run_depends, rd.allocator)
+		delete(pkg.shlib_provides, rd.allocator)
+	}
+	delete(rd.packages)
+
+	for s in rd.repositories {delete(s, rd.allocator)}
+	delete(rd.repositories)
+
+	for s in rd.buffers {delete(s, rd.allocator)}
+	delete(rd.buffers)
+
+	for s in rd.owned {delete(s, rd.allocator)}
+	delete(rd.owned)
+}
+
+// Load repodata for every configured repository that has a local cache.
+// Returns false if no repository index could be read (e.g. never synced).
+// Official indexes are large; pass an allocator that can grow.
+repodata_load :: proc(
+	rootdir: string,
+	arch: string,
+	allocator := context.allocator,
+) -> (
+	Repodata,
+	bool,
+) {
+	rd := Repodata {
+		packages     = make(map[string]Repo_Package, allocator = allocator),
+		repositories = make([dynamic]string, allocator),
+		buffers      = make([dynamic]string, allocator),
+		owned        = make([dynamic]string, allocator),
+		allocator    = allocator,
+	}
+
+	loaded := 0
+	for repo in read_repository_config(rootdir) {
+		path := repodata_path(rootdir, repo, arch)
+		if !os.exists(path) {
+			continue
+		}
+
+		content, ok := archive_read_member(path, "index.plist", allocator)
+		if !ok {
+			continue
+		}
+		append(&rd.buffers, content)
+
+		repo_url := strings.clone(repo, allocator)
+		append(&rd.repositories, repo_url)
+
+		if repodata_parse_index(&rd, content, repo_url) {
+			loaded += 1
+		}
+	}
+
+	return rd, loaded > 0
+}
+
+// Get a package from the official repositories (returns a view)
+repodata_get :: proc(rd: ^Repodata, name: string) -> (Repo_Package, bool) {
+	if rd == nil {
+		return {}, false
+	}
+	pkg, ok := rd.packages[name]
+	return pkg, ok
+}
+
+// Paths of the cached repodata archives of all configured repositories
+repodata_files :: proc(rootdir: string, arch: string, allocator := context.temp_allocator) -> []string {
+	repos := read_repository_config(rootdir)
+	files := make([]string, len(repos), allocator)
+	for repo, i in repos {
+		files[i] = repodata_path(rootdir, repo, arch, allocator)
+	}
+	return files
+}
+
+// File name of a package's binary in its repository ("" if unknown)
+repodata_binpkg_filename :: proc(pkg: Repo_Package, allocator := context.temp_allocator) -> string {
+	if len(pkg.pkgver) == 0 || len(pkg.architecture) == 0 {
+		return ""
+	}
+	return strings.concatenate({pkg.pkgver, ".", pkg.architecture, ".xbps"}, allocator)
+}
+
+// Get the local path of the cached repodata archive for a repository
+repodata_path :: proc(
+	rootdir: string,
+	repo: string,
+	arch: string,
+	allocator := context.temp_allocator,
+) -> string {
+	filename := strings.concatenate({arch, "-repodata"}, context.temp_allocator)
+
+	// Local repositories keep repodata next to the packages
+	if !strings.contains(repo, "://") {
+		return utils.path_join(repo, filename, allocator = allocator)
+	}
+
+	// Remote repositories: '.', '/' and ':' become '_' (xbps_get_remote_repo_string)
+	escaped := strings.clone(strings.trim_right(repo, "/"), context.temp_allocator)
+	buf := transmute([]u8)escaped
+	for &c in buf {
+		if c == '.' || c == '/' || c == ':' {
+			c = '_'
+		}
+	}
+
+	return utils.path_join(rootdir_path(rootdir, PKGDB_DIR), escaped, filename, allocator = allocator)
+}
+
+// Configuration directories, lowest priority first
+XBPS_CONF_DIRS :: []string{"usr/share/xbps.d", "etc/xbps.d"}
+
+// Read the configured repository URLs from xbps.d, in xbps priority order.
+// Files in etc/xbps.d override files with the same name in usr/share/xbps.d.
+read_repository_config :: proc(rootdir: string) -> []string {
+	conf_files := make(map[string]string, allocator = context.temp_allocator)
+
+	for dir in XBPS_CONF_DIRS {
+		full_dir := rootdir_path(rootdir, dir)
+
+		d, err := os.open(full_dir)
+		if err != os.ERROR_NONE {
+			continue
+		}
+		file_infos, _ := os.read_dir(d, -1, context.temp_allocator)
+		os.close(d)
+
+		for fi in file_infos {
+			if fi.type != .Directory && strings.has_suffix(fi.name, ".conf") {
+				conf_files[fi.name] = utils.path_join(full_dir, fi.name, allocator = context.temp_allocator)
+			}
+		}
+	}
+
+	names := make([dynamic]string, 0, len(conf_files), context.temp_allocator)
+	for name in conf_files {
+		append(&names, name)
+	}
+	slice.sort(names[:])
+
+	repos := make([dynamic]string, context.temp_allocator)
+	for name in names {
+		content, ok := utils.read_file(conf_files[name], context.temp_allocator)
+		if !ok {
+			continue
+		}
+
+		for line in strings.split_lines_iterator(&content) {
+			trimmed := strings.trim_space(line)
+			if !strings.has_prefix(trimmed, "repository=") {
+				continue
+			}
+			url := strings.trim_space(trimmed[len("repository="):])
+			if hash := strings.index_byte(url, '#'); hash >= 0 {
+				url = strings.trim_space(url[:hash])
+			}
+			if len(url) > 0 && !slice.contains(repos[:], url) {
+				append(&repos, url)
+			}
+		}
+	}
+
+	return repos[:]
+}
+
+// Parse one repository index.plist into rd; existing entries take priority
+@(private)
+repodata_parse_index :: proc(rd: ^Repodata, content: string, repo_url: string) -> bool {
+	r := plist_reader_make(content)
+
+	if tok, _ := plist_next(&r); tok != .Dict_Begin {
+		return false
+	}
+
+	for {
+		tok, name := plist_next(&r)
+		#partial switch tok {
+		case .Dict_End, .EOF:
+			return true
+		case .Key:
+		case:
+			return false
+		}
+
+		value_tok, _ := plist_next(&r)
+		if value_tok != .Dict_Begin || name in rd.packages {
+			if !plist_skip(&r, value_tok) {
+				return false
+			}
+			continue
+		}
+
+		pkg, ok := repodata_parse_entry(rd, &r)
+		if !ok {
+			return false
+		}
+		if len(pkg.pkgver) == 0 {
+			continue
+		}
+		pkg.repository = repo_url
+		rd.packages[name] = pkg
+	}
+}
+
+// Parse one package dictionary (after its Dict_Begin)
+@(private)
+repodata_parse_entry :: proc(rd: ^Repodata, r: ^Plist_Reader) -> (pkg: Repo_Package, ok: bool) {
+	for {
+		tok, key := plist_next(r)
+		#partial switch tok {
+		case .Dict_End:
+			return pkg, true
+		case .Key:
+		case:
+			return pkg, false
+		}
+
+		value_tok, value := plist_next(r)
+		switch key {
+		case "pkgver":
+			if value_tok == .String {
+				pkg.pkgver = repodata_text(rd, value)
+				_, pkg.version, _ = parse_pkgver(pkg.pkgver)
+			}
+		case "short_desc":
+			if value_tok == .String {
+				pkg.short_desc = repodata_text(rd, value)
+			}
+		case "architecture":
+			if value_tok == .String {
+				pkg.architecture = repodata_text(rd, value)
+			}
+		case "filename-sha256":
+			if value_tok == .String {
+				pkg.file_sha256 = repodata_text(rd, value)
+			}
+		case "filename-size":
+			if value_tok == .Integer {
+				pkg.file_size = i64(utils.parse_int(value))
+			}
+		case "run_depends", "shlib-provides":
+			if value_tok == .Array_Begin {
+				list := repodata_read_array(rd, r) or_return
+				if key == "run_depends" {
+					pkg.run_depends = list
+				} else {
+					pkg.shlib_provides = list
+				}
+				continue
+			}
+		}
+
+		if !plist_skip(r, value_tok) {
+			return pkg, false
+		}
+	}
+}
+
+// Decode element text, keeping a view into the buffer when possible
+@(private)
+repodata_text :: proc(rd: ^Repodata, text: string) -> string {
+	decoded := plist_unescape(text, rd.allocator)
+	if raw_data(decoded) != raw_data(text) {
+		append(&rd.owned, decoded)
+	}
+	return decoded
+}
+
+// Read an array of strings as views (after its Array_Begin)
+@(private)
+repodata_read_array :: proc(rd: ^Repodata, r: ^Plist_Reader) -> ([]string, bool) {
+	result := make([dynamic]string, rd.allocator)
+	for {
+		tok, text := plist_next(r)
+		#partial switch tok {
+		case .Array_End:
+			return result[:], true
+		case .String:
+			append(&result, repodata_text(rd, text))
+		case:
+			if !plist_skip(r, tok) {
+				return result[:], false
+			}
+		}
+	}
+}
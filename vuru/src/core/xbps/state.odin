@@ -0,0 +1,52 @@
+package xbps
+
+import "core:os"
+import "core:slice"
+
+// Fingerprint of what a resolution against rootdir depends on: the installed
+// pkgvers, the configured repositories and the content of their cached
+// repodata. Rootdirs with the same fingerprint resolve to the same
+// transaction. Paths are not mixed in, so identical images match.
+state_fingerprint :: proc(rootdir: string, arch: string) -> u64 {
+	// FNV-1a, each field followed by a separator byte
+	h: u64 = 0xcbf29ce484222325
+	mix :: proc(h: ^u64, data: []u8) {
+		for b in data {
+			h^ = (h^ ~ u64(b)) * 0x100000001b3
+		}
+		h^ = (h^ ~ 0) * 0x100000001b3
+	}
+
+	db, _ := pkgdb_load(rootdir, context.temp_allocator)
+	pkgvers := make([]string, len(db.packages), context.temp_allocator)
+	i := 0
+	for _, pkg in db.packages {
+		pkgvers[i] = pkg.pkgver
+		i += 1
+	}
+	slice.sort(pkgvers)
+	for pkgver in pkgvers {
+		mix(&h, transmute([]u8)pkgver)
+	}
+	pkgdb_free(&db)
+
+	buf: [64 * 1024]u8
+	for repo in read_repository_config(rootdir) {
+		mix(&h, transmute([]u8)repo)
+
+		f, err := os.open(repodata_path(rootdir, repo, arch))
+		if err != os.ERROR_NONE {
+			continue
+		}
+		for {
+			n, _ := os.read(f, buf[:])
+			if n <= 0 {
+				break
+			}
+			mix(&h, buf[:n])
+		}
+		os.close(f)
+	}
+
+	return h
+}
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""
+Check the other ports of the libxbps version logic against the corpus that
+version_test.odin runs: xbps_cmpver()/xbps_pkg_version() in
+vup/scripts/manage_release.py and the DEPS_AWK functions (cmpver,
+pkgver_version, dep_name) in vup/common/scripts/scan-elf-deps.
+"""
+
+import os
+import re
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+VUP = os.path.join(HERE, "..", "..", "..", "..", "..", "vup")
+
+sys.path.insert(0, os.path.join(VUP, "scripts"))
+import manage_release  # noqa: E402
+
+# Prints one "cmpver" line per cmpver.tsv row, then one "name<TAB>version"
+# line per pkgver.tsv row ("-" when rejected)
+AWK_DRIVER = r"""
+BEGIN { FS = "\t" }
+/^#/ { next }
+FILENAME ~ /cmpver\.tsv$/ { print cmpver($1, $2); next }
+{
+	n = dep_name($1); v = pkgver_version($1)
+	print (n == "" ? "-" : n) "\t" (v == "" ? "-" : v)
+}
+"""
+
+
+def load(name):
+    rows = []
+    with open(os.path.join(HERE, name)) as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if line and not line.startswith("#"):
+                rows.append(line.split("\t"))
+    return rows
+
+
+def deps_awk():
+    """The DEPS_AWK function library, as embedded in scan-elf-deps."""
+    with open(os.path.join(VUP, "common", "scripts", "scan-elf-deps")) as f:
+        match = re.search(r"^DEPS_AWK='\n(.*?)^'$", f.read(), re.M | re.S)
+    if not match:
+        sys.exit("scan-elf-deps: DEPS_AWK not found")
+    return match.group(1)
+
+
+def main():
+    cmpver = load("cmpver.tsv")
+    pkgver = load("pkgver.tsv")
+    failures = []
+
+    for a, b, want in cmpver:
+        got = manage_release.xbps_cmpver(a, b)
+        if got != int(want):
+            failures.append(f"python: xbps_cmpver({a!r}, {b!r}) = {got}, want {want}")
+    for p, _, version in pkgver:
+        got = manage_release.xbps_pkg_version(p) or "-"
+        if got != version:
+            failures.append(f"python: xbps_pkg_version({p!r}) = {got!r}, want {version!r}")
+
+    out = subprocess.run(
+        ["awk", deps_awk() + AWK_DRIVER, os.path.join(HERE, "cmpver.tsv"), os.path.join(HERE, "pkgver.tsv")],
+        check=True,
+        capture_output=True,
+        text=True,
+    ).stdout.splitlines()
+    for (a, b, want), got in zip(cmpver, out):
+        if got != want:
+            failures.append(f"awk: cmpver({a!r}, {b!r}) = {got}, want {want}")
+    for (p, name, version), got in zip(pkgver, out[len(cmpver) :]):
+        if got != f"{name}\t{version}":
+            failures.append(f"awk: dep_name/pkgver_version({p!r}) = {got!r}, want {name!r}, {version!r}")
+    if len(out) != len(cmpver) + len(pkgver):
+        failures.append(f"awk: {len(out)} results for {len(cmpver) + len(pkgver)} cases")
+
+    for failure in failures:
+        print(failure)
+    print(f"{len(cmpver)} cmpver and {len(pkgver)} pkgver cases, {len(failures)} failure(s)")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,30 @@
+#!/bin/sh
+#
+# Re-record the expected columns of cmpver.tsv and pkgver.tsv from
+# xbps-uhelper, keeping the inputs (first columns) and comments as they are.
+# Run after adding cases, on a host with xbps installed.
+
+set -e
+cd "$(dirname "$0")"
+command -v xbps-uhelper >/dev/null || { echo "xbps-uhelper not found" >&2; exit 1; }
+
+tab=$(printf '\t')
+
+grep '^#' cmpver.tsv > cmpver.tsv.new
+grep -v '^#' cmpver.tsv | while IFS="$tab" read -r a b _; do
+	# cmpver exits with the comparison result; -1 comes back as 255
+	rc=0
+	xbps-uhelper cmpver "$a" "$b" || rc=$?
+	[ "$rc" = 255 ] && rc=-1
+	printf '%s\t%s\t%s\n' "$a" "$b" "$rc"
+done >> cmpver.tsv.new
+
+grep '^#' pkgver.tsv > pkgver.tsv.new
+grep -v '^#' pkgver.tsv | while IFS="$tab" read -r p _; do
+	name=$(xbps-uhelper getpkgname "$p" 2>/dev/null) || name=-
+	version=$(xbps-uhelper getpkgversion "$p" 2>/dev/null) || version=-
+	printf '%s\t%s\t%s\n' "$p" "$name" "$version"
+done >> pkgver.tsv.new
+
+mv cmpver.tsv.new cmpver.tsv
+mv pkgver.tsv.new pkgver.tsv
@@ -1,5 +1,7 @@
 package xbps
 
+import "core:strings"
+
 // Package upgrade using xbps-install
 
 // Upgrade a specific package from a repository
@@ -39,3 +41,29 @@ upgrade_all_official :: proc(yes: bool, run_cmd: Command_Runner) -> int {
 
 	return run_cmd(args[:])
 }
+
+// Upgrade every installed package in one transaction, with extra repositories
+// (VUP) added on top of the configured ones
+upgrade_all_with_repos :: proc(
+	repos: []string,
+	yes: bool,
+	dry_run: bool,
+	verbose: bool,
+	rootdir: string,
+	run_cmd: Command_Runner,
+) -> int {
+	args := build_args_with_yes(yes, "sudo", "xbps-install", "-Su", allocator = context.temp_allocator)
+	for repo in repos {
+		append(&args, strings.concatenate({"--repository=", repo}, context.temp_allocator))
+	}
+	if dry_run {
+		append(&args, "-n")
+	}
+	if verbose {
+		append(&args, "-v")
+	}
+	if len(rootdir) > 0 {
+		append(&args, "-r", rootdir)
+	}
+	return run_cmd(args[:])
+}
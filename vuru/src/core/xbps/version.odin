@@ -1,35 +1,172 @@
 package xbps
 
-// Version comparison using xbps-uhelper
+// Native version comparison, compatible with libxbps xbps_cmpver()
+// (lib/external/dewey.c). No xbps-uhelper process is spawned.
 
-// Compare two versions using xbps-uhelper cmpver
+// Component values used by dewey for non-numeric version parts.
+// Do not modify these values: ordering depends on them.
+@(private)
+DEWEY_ALPHA :: -3
+@(private)
+DEWEY_BETA :: -2
+@(private)
+DEWEY_RC :: -1
+@(private)
+DEWEY_DOT :: 0
+
+@(private)
+Dewey_Modifier :: struct {
+	s:     string,
+	value: i32,
+}
+
+// Recognised modifiers, checked in this order (case-insensitive)
+@(private)
+DEWEY_MODIFIERS :: [?]Dewey_Modifier {
+	{"alpha", DEWEY_ALPHA},
+	{"beta", DEWEY_BETA},
+	{"pre", DEWEY_RC},
+	{"rc", DEWEY_RC},
+	{"pl", DEWEY_DOT},
+	{".", DEWEY_DOT},
+}
+
+// Lazy component scanner over a version string.
+// Yields the same component sequence as dewey's mkversion() without allocating.
+@(private)
+Dewey_Iter :: struct {
+	s:           string,
+	pos:         int,
+	pending:     i32, // Second component of an alpha character (letter index)
+	has_pending: bool,
+	revision:    i32, // Value after the last '_'
+}
+
+@(private)
+is_ascii_digit :: #force_inline proc(c: u8) -> bool {
+	return c >= '0' && c <= '9'
+}
+
+@(private)
+ascii_lower :: #force_inline proc(c: u8) -> u8 {
+	return c + ('a' - 'A') if c >= 'A' && c <= 'Z' else c
+}
+
+@(private)
+has_prefix_fold :: proc(s: string, prefix: string) -> bool {
+	if len(s) < len(prefix) {
+		return false
+	}
+	for i in 0 ..< len(prefix) {
+		if ascii_lower(s[i]) != prefix[i] {
+			return false
+		}
+	}
+	return true
+}
+
+// Return the next version component, or ok=false at end of string
+@(private)
+dewey_next :: proc(it: ^Dewey_Iter) -> (value: i32, ok: bool) {
+	if it.has_pending {
+		it.has_pending = false
+		return it.pending, true
+	}
+
+	scan: for it.pos < len(it.s) {
+		rest := it.s[it.pos:]
+		c := rest[0]
+
+		// Numeric component (wraps like the C int accumulator)
+		if is_ascii_digit(c) {
+			n: i32 = 0
+			for it.pos < len(it.s) && is_ascii_digit(it.s[it.pos]) {
+				n = n * 10 + i32(it.s[it.pos] - '0')
+				it.pos += 1
+			}
+			return n, true
+		}
+
+		for m in DEWEY_MODIFIERS {
+			if has_prefix_fold(rest, m.s) {
+				it.pos += len(m.s)
+				return m.value, true
+			}
+		}
+
+		// Revision suffix: "_N" sets the revision, produces no component
+		if c == '_' {
+			it.pos += 1
+			n: i32 = 0
+			for it.pos < len(it.s) && is_ascii_digit(it.s[it.pos]) {
+				n = n * 10 + i32(it.s[it.pos] - '0')
+				it.pos += 1
+			}
+			it.revision = n
+			continue scan
+		}
+
+		// Single letter: encoded as Dot followed by its alphabet position
+		lower := ascii_lower(c)
+		if lower >= 'a' && lower <= 'z' {
+			it.pos += 1
+			it.pending = i32(lower - 'a') + 1
+			it.has_pending = true
+			return DEWEY_DOT, true
+		}
+
+		// Anything else is skipped
+		it.pos += 1
+	}
+
+	return 0, false
+}
+
+// Compare two versions natively (same semantics as xbps_cmpver)
+// Returns: -1 if v1 < v2, 0 if equal, 1 if v1 > v2
+cmpver :: proc(v1: string, v2: string) -> int {
+	a := Dewey_Iter {
+		s = v1,
+	}
+	b := Dewey_Iter {
+		s = v2,
+	}
+
+	for {
+		x, x_ok := dewey_next(&a)
+		y, y_ok := dewey_next(&b)
+		if !x_ok && !y_ok {
+			break
+		}
+
+		// Missing components compare as 0
+		if cmp := x - y; cmp != 0 {
+			return -1 if cmp < 0 else 1
+		}
+	}
+
+	if cmp := a.revision - b.revision; cmp != 0 {
+		return -1 if cmp < 0 else 1
+	}
+	return 0
+}
+
+// Compare two versions
 // Returns true if v1 > v2
-version_greater_than :: proc(
-	v1: string,
-	v2: string,
-	run_cmd: proc([]string) -> int,
-) -> bool {
+version_greater_than :: proc(v1: string, v2: string) -> bool {
 	if len(v1) == 0 || len(v2) == 0 {
 		return false
 	}
 
-	// xbps-uhelper cmpver returns:
-	//   0 if v1 == v2
-	//   1 if v1 > v2
-	//  -1 if v1 < v2
-	return run_cmd({"xbps-uhelper", "cmpver", v1, v2}) == 1
+	return cmpver(v1, v2) == 1
 }
 
 // Compare two versions
 // Returns: -1 if v1 < v2, 0 if equal, 1 if v1 > v2
-version_compare :: proc(
-	v1: string,
-	v2: string,
-	run_cmd: proc([]string) -> int,
-) -> int {
+version_compare :: proc(v1: string, v2: string) -> int {
 	if len(v1) == 0 || len(v2) == 0 {
 		return 0
 	}
 
-	return run_cmd({"xbps-uhelper", "cmpver", v1, v2})
+	return cmpver(v1, v2)
 }
@@ -0,0 +1,72 @@
+package xbps
+
+import "core:strconv"
+import "core:strings"
+import "core:testing"
+
+// Differential tests against libxbps. The corpus is shared with the Python
+// and awk ports (testdata/check_ports.py) and re-recorded from xbps-uhelper
+// by testdata/record.sh.
+
+@(private)
+CMPVER_CORPUS :: #load("testdata/cmpver.tsv", string)
+@(private)
+PKGVER_CORPUS :: #load("testdata/pkgver.tsv", string)
+
+// Tab-separated fields of each corpus line, comments skipped (temp-allocated)
+@(private)
+corpus_rows :: proc(data: string) -> [][]string {
+	rows := make([dynamic][]string, context.temp_allocator)
+	data := data
+	for line in strings.split_lines_iterator(&data) {
+		if len(line) == 0 || line[0] == '#' {
+			continue
+		}
+		append(&rows, strings.split(line, "\t", context.temp_allocator))
+	}
+	return rows[:]
+}
+
+@(test)
+test_cmpver_corpus :: proc(t: ^testing.T) {
+	for row in corpus_rows(CMPVER_CORPUS) {
+		want, _ := strconv.parse_int(row[2])
+		got := cmpver(row[0], row[1])
+		testing.expectf(t, got == want, "cmpver(%q, %q) = %d, want %d", row[0], row[1], got, want)
+	}
+}
+
+@(test)
+test_parse_pkgver_corpus :: proc(t: ^testing.T) {
+	for row in corpus_rows(PKGVER_CORPUS) {
+		pkgver, name, version := row[0], row[1], row[2]
+		got_name, got_version, ok := parse_pkgver(pkgver)
+
+		// Rejected by libxbps: parse_pkgver falls back to plain splitting
+		if name == "-" {
+			simple_name, simple_version, simple_ok := parse_pkgver_simple(pkgver)
+			testing.expectf(
+				t,
+				ok == simple_ok && got_name == simple_name && got_version == simple_version,
+				"parse_pkgver(%q) = %q, %q, %v, want the parse_pkgver_simple result",
+				pkgver,
+				got_name,
+				got_version,
+				ok,
+			)
+			continue
+		}
+
+		testing.expectf(
+			t,
+			ok && got_name == name && got_version == version,
+			"parse_pkgver(%q) = %q, %q, %v, want %q, %q",
+			pkgver,
+			got_name,
+			got_version,
+			ok,
+			name,
+			version,
+		)
+	}
+}
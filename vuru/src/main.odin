@@ -1,18 +1,20 @@
 package main
 
 import "core:fmt"
-import "core:mem"
+import "core:mem/virtual"
 import "core:os"
+import "core:strconv"
 import "core:strings"
 
 import commands "commands"
 import errors "core/errors"
+import utils "utils"
 
 VERSION :: "0.6.0"
 INDEX_URL :: "https://vup-linux.github.io/vup/index.json"
 
-// Arena size for command execution (4MB should be plenty)
-ARENA_SIZE :: 4 * 1024 * 1024
+// Address space reserved for a command's arena; pages are committed as used
+ARENA_RESERVE :: 16 * 1024 * 1024 * 1024
 
 main :: proc() {
 	exit_code := run()
@@ -20,7 +22,14 @@ main :: proc() {
 }
 
 run :: proc() -> int {
-	if len(os.args) < 2 {
+	// Installed as vurud (a symlink to vuru): run the daemon
+	prog := os.args[0]
+	if slash := strings.last_index_byte(prog, '/'); slash >= 0 {
+		prog = prog[slash + 1:]
+	}
+	is_daemon := prog == "vurud"
+
+	if len(os.args) < 2 && !is_daemon {
 		print_help()
 		return 1
 	}
@@ -33,7 +42,7 @@ run :: proc() -> int {
 	}
 	defer commands.config_free(&config)
 
-	command_name := ""
+	command_name := "daemon" if is_daemon else ""
 	command_args: [dynamic]string
 	defer delete(command_args)
 
@@ -76,6 +85,8 @@ run :: proc() -> int {
 				config.description_search = true
 			} else if arg == "-v" || arg == "--verbose" {
 				config.verbose = true
+			} else if arg == "--stats" {
+				config.stats = true
 			} else if arg == "-S" || arg == "--sync" {
 				config.sync = true
 			} else if arg == "-u" || arg == "--update" {
@@ -94,11 +105,34 @@ run :: proc() -> int {
 				config.show_deps = true
 			} else if arg == "--ownedby" {
 				config.ownedby = true
+			} else if arg == "--outdated" {
+				config.outdated = true
 			} else if arg == "-r" || arg == "--rootdir" {
 				if i + 1 < len(args) {
 					config.rootdir = strings.clone(args[i + 1])
 					skip_next = true
 				}
+			} else if arg == "--rootdirs" {
+				if i + 1 < len(args) {
+					config.rootdirs = strings.clone(args[i + 1])
+					skip_next = true
+				}
+			} else if arg == "--category" {
+				if i + 1 < len(args) {
+					config.category = strings.clone(args[i + 1])
+					skip_next = true
+				}
+			} else if arg == "-j" || arg == "--jobs" {
+				jobs, jobs_ok := 0, false
+				if i + 1 < len(args) {
+					jobs, jobs_ok = strconv.parse_int(args[i + 1])
+				}
+				if !jobs_ok || jobs < 1 {
+					errors.log_error("Option %s requires a positive number of jobs", arg)
+					return 1
+				}
+				config.jobs = jobs
+				skip_next = true
 			} else if strings.has_prefix(arg, "-") && len(arg) > 1 && arg[1] != '-' {
 				// Short flags combined (e.g., -Sy, -Ryn)
 				for c in arg[1:] {
@@ -147,6 +181,25 @@ run :: proc() -> int {
 		}
 	}
 
+	if len(config.rootdirs) > 0 {
+		if command_name != "install" && command_name != "i" {
+			errors.print_flag_error("--rootdirs", "install", "vuru --rootdirs a,b install <pkg>")
+			return 1
+		}
+		if len(config.rootdir) > 0 || config.update_system {
+			errors.log_error("--rootdirs can't be combined with -r/--rootdir or -u/--update")
+			return 1
+		}
+	}
+
+	// Phase timings: summary with --stats, Chrome trace to $VURU_TRACE
+	utils.stats_enable(config.stats, os.get_env("VURU_TRACE", context.temp_allocator))
+
+	// Children run concurrently across the run, $VURU_MAX_CHILDREN to override
+	if n, ok := strconv.parse_int(os.get_env("VURU_MAX_CHILDREN", context.temp_allocator)); ok {
+		utils.set_max_children(n)
+	}
+
 	// Dispatch with arena allocator for automatic cleanup
 	switch command_name {
 	case "query", "q", "info", "show":
@@ -167,6 +220,9 @@ run :: proc() -> int {
 		return run_with_arena(commands.sync_run, command_args[:], &config)
 	case "fetch":
 		return run_with_arena(commands.fetch_run, command_args[:], &config)
+	case "daemon":
+		// Long-running: the daemon manages its own memory
+		return commands.daemon_run(command_args[:], &config)
 	case "src":
 		// Pass raw args after 'src' command (bypass vuru's flag parsing)
 		if src_cmd_index >= 0 && src_cmd_index + 1 < len(args) {
@@ -230,16 +286,28 @@ run_with_arena :: proc(
 	args: []string,
 	config: ^commands.Config,
 ) -> int {
-	// Allocate arena backing memory
-	arena_backing := make([]u8, ARENA_SIZE)
-	defer delete(arena_backing)
-
-	arena: mem.Arena
-	mem.arena_init(&arena, arena_backing)
+	arena: virtual.Arena
+	if err := virtual.arena_init_static(&arena, ARENA_RESERVE); err != nil {
+		errors.log_error("Could not reserve memory for the command")
+		return 1
+	}
+	defer virtual.arena_destroy(&arena)
 
 	// Run command with arena as context.allocator
-	context.allocator = mem.arena_allocator(&arena)
-	return command(args, config)
+	context.allocator = virtual.arena_allocator(&arena)
+	code := command(args, config)
+
+	// Nothing is freed before the end, so what was used is the high-water mark
+	if config.verbose {
+		errors.log_info(
+			"Memory: %s allocated (%s committed)",
+			utils.format_size(i64(arena.total_used)),
+			utils.format_size(i64(arena.curr_block.committed)),
+		)
+	}
+	utils.stats_memory(i64(arena.total_used))
+	utils.stats_report()
+	return code
 }
 
 print_help :: proc() {
@@ -257,6 +325,7 @@ print_help :: proc() {
 	fmt.println("  fetch    <url...>      Download files from URLs")
 	fmt.println("  clone                  Clone/update VUP repository")
 	fmt.println("  src      <cmd> [args]  Run xbps-src with VUP deps")
+	fmt.println("  daemon                 Keep the index resident for fast queries (vurud)")
 	fmt.println("  help                   Show this help")
 	fmt.println()
 	fmt.println("Query modes:")
@@ -265,6 +334,7 @@ print_help :: proc() {
 	fmt.println("  -f, --files      Show package files")
 	fmt.println("  -x, --deps       Show dependencies")
 	fmt.println("  --ownedby        Find package owning a file")
+	fmt.println("  --outdated       List VUP packages with updates")
 	fmt.println()
 	fmt.println("Install/Remove flags:")
 	fmt.println("  -S, --sync       Sync repos before operation")
@@ -279,8 +349,12 @@ print_help :: proc() {
 	fmt.println("  -b, --build      Force build from source")
 	fmt.println("  -d, --desc       Include descriptions in search")
 	fmt.println("  -v, --verbose    Verbose output")
+	fmt.println("  --stats          Print phase timings, subprocesses, downloads and cache hits")
 	fmt.println("  -r, --rootdir    Alternate root directory")
+	fmt.println("  --rootdirs <r>   Install into several rootdirs (comma-separated, or @file)")
 	fmt.println("  --vup-only       VUP packages only")
+	fmt.println("  --category <c>   Search only these VUP categories (comma-separated)")
+	fmt.println("  -j, --jobs <n>   Packages built concurrently (build, src, install), rootdirs (--rootdirs)")
 	fmt.println("  -V, --version    Show version")
 	fmt.println("  -h, --help       Show help")
 	fmt.println()
@@ -5,6 +5,7 @@ import errors "../core/errors"
 import "core:fmt"
 import "core:math/rand"
 import "core:os"
+import "core:slice"
 import "core:strings"
 import "core:sys/linux"
 
@@ -41,41 +42,280 @@ diff_write_temp_file :: proc(content: string, allocator := context.allocator) ->
 	return path, true
 }
 
-// Generate a colored unified diff between old and new content
-diff_generate :: proc(
+// Lines of context around each hunk
+DIFF_CONTEXT :: 3
+
+Diff_Op :: enum u8 {
+	Equal,
+	Delete,
+	Insert,
+}
+
+// One line of an edit script, with its position in both inputs
+Diff_Edit :: struct {
+	op:       Diff_Op,
+	old_line: int, // Index into the old lines (where an insert goes for .Insert)
+	new_line: int, // Index into the new lines (where a delete was for .Delete)
+}
+
+// Append a colored unified diff (DIFF_CONTEXT lines of context) to b;
+// nothing is written when the contents are equal
+diff_write_unified :: proc(
+	b: ^strings.Builder,
 	old_content: string,
 	new_content: string,
-	allocator := context.allocator,
-) -> (
-	string,
-	bool,
+	old_label: string,
+	new_label: string,
 ) {
-	new_path, new_ok := diff_write_temp_file(new_content, context.temp_allocator)
-	if !new_ok {
-		return "", false
+	old_lines, old_eol := diff_split_lines(old_content)
+	new_lines, new_eol := diff_split_lines(new_content)
+	edits := diff_lines(old_lines, new_lines)
+
+	header_written := false
+	i := 0
+	for i < len(edits) {
+		// Next change, with its context
+		for i < len(edits) && edits[i].op == .Equal {
+			i += 1
+		}
+		if i == len(edits) {
+			break
+		}
+		start := max(i - DIFF_CONTEXT, 0)
+
+		// Extend through changes separated by at most 2 * DIFF_CONTEXT equal lines
+		last := i
+		for j := i; j < len(edits) && j - last <= 2 * DIFF_CONTEXT; j += 1 {
+			if edits[j].op != .Equal {
+				last = j
+			}
+		}
+		end := min(last + DIFF_CONTEXT + 1, len(edits))
+		hunk := edits[start:end]
+		i = end
+
+		if !header_written {
+			fmt.sbprintf(b, "%s--- %s\n+++ %s%s\n", errors.COLOR_BOLD, old_label, new_label, errors.COLOR_RESET)
+			header_written = true
+		}
+
+		old_count, new_count := 0, 0
+		for e in hunk {
+			if e.op != .Insert do old_count += 1
+			if e.op != .Delete do new_count += 1
+		}
+		fmt.sbprintf(
+			b,
+			"%s@@ -%s +%s @@%s\n",
+			errors.COLOR_CYAN,
+			hunk_range(hunk[0].old_line, old_count),
+			hunk_range(hunk[0].new_line, new_count),
+			errors.COLOR_RESET,
+		)
+
+		for e in hunk {
+			switch e.op {
+			case .Equal:
+				fmt.sbprintf(b, " %s\n", new_lines[e.new_line])
+			case .Delete:
+				fmt.sbprintf(b, "%s-%s%s\n", errors.COLOR_RED, old_lines[e.old_line], errors.COLOR_RESET)
+			case .Insert:
+				fmt.sbprintf(b, "%s+%s%s\n", errors.COLOR_GREEN, new_lines[e.new_line], errors.COLOR_RESET)
+			}
+
+			last_old := e.op != .Insert && e.old_line == len(old_lines) - 1 && !old_eol
+			last_new := e.op != .Delete && e.new_line == len(new_lines) - 1 && !new_eol
+			if last_old || last_new {
+				strings.write_string(b, "\\ No newline at end of file\n")
+			}
+		}
+	}
+}
+
+// Line edit script turning a into b (Myers' O(ND) algorithm). The common
+// prefix and suffix are matched first, so similar inputs stay cheap.
+diff_lines :: proc(a: []string, b: []string, allocator := context.temp_allocator) -> []Diff_Edit {
+	edits := make([dynamic]Diff_Edit, 0, max(len(a), len(b)), allocator)
+
+	prefix := 0
+	for prefix < len(a) && prefix < len(b) && a[prefix] == b[prefix] {
+		prefix += 1
+	}
+	suffix := 0
+	for suffix < len(a) - prefix && suffix < len(b) - prefix && a[len(a) - 1 - suffix] == b[len(b) - 1 - suffix] {
+		suffix += 1
+	}
+
+	for i in 0 ..< prefix {
+		append(&edits, Diff_Edit{op = .Equal, old_line = i, new_line = i})
+	}
+	myers_middle(&edits, a[prefix:len(a) - suffix], b[prefix:len(b) - suffix], prefix, prefix)
+	for i in 0 ..< suffix {
+		append(
+			&edits,
+			Diff_Edit{op = .Equal, old_line = len(a) - suffix + i, new_line = len(b) - suffix + i},
+		)
 	}
-	defer os.remove(new_path)
 
-	if len(old_content) > 0 {
-		old_path, old_ok := diff_write_temp_file(old_content, context.temp_allocator)
-		if !old_ok {
-			return "", false
+	return edits[:]
+}
+
+// Greedy forward search keeping each round's V array, then a backtrack
+// through them (edits come out reversed and are flipped in place)
+@(private)
+myers_middle :: proc(edits: ^[dynamic]Diff_Edit, a: []string, b: []string, a_off: int, b_off: int) {
+	n, m := len(a), len(b)
+	if n == 0 && m == 0 {
+		return
+	}
+
+	max_d := n + m
+	offset := max_d + 1
+	v := make([]int, 2 * max_d + 3, context.temp_allocator)
+	trace := make([dynamic][]int, context.temp_allocator)
+
+	search: for d in 0 ..= max_d {
+		append(&trace, slice.clone(v, context.temp_allocator))
+		for k := -d; k <= d; k += 2 {
+			x: int
+			if k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1]) {
+				x = v[offset + k + 1] // Down: insert
+			} else {
+				x = v[offset + k - 1] + 1 // Right: delete
+			}
+			y := x - k
+			for x < n && y < m && a[x] == b[y] {
+				x += 1
+				y += 1
+			}
+			v[offset + k] = x
+			if x >= n && y >= m {
+				break search
+			}
 		}
-		defer os.remove(old_path)
+	}
 
-		// diff returns 1 if different, which is fine. run_command_output just captures output.
-		// Note: diff -u --color=always old new
-		output, _ := run_command_output({"diff", "-u", "--color=always", old_path, new_path})
-		return output, true
-	} else {
-		// No old content, return new content
-		return strings.clone(new_content, allocator), true
+	first := len(edits)
+	x, y := n, m
+	for d := len(trace) - 1; d > 0; d -= 1 {
+		prev := trace[d]
+		k := x - y
+
+		prev_k := k - 1
+		if k == -d || (k != d && prev[offset + k - 1] < prev[offset + k + 1]) {
+			prev_k = k + 1
+		}
+		prev_x := prev[offset + prev_k]
+		prev_y := prev_x - prev_k
+
+		for x > prev_x && y > prev_y {
+			x -= 1
+			y -= 1
+			append(edits, Diff_Edit{op = .Equal, old_line = a_off + x, new_line = b_off + y})
+		}
+		if x == prev_x {
+			y -= 1
+			append(edits, Diff_Edit{op = .Insert, old_line = a_off + x, new_line = b_off + y})
+		} else {
+			x -= 1
+			append(edits, Diff_Edit{op = .Delete, old_line = a_off + x, new_line = b_off + y})
+		}
+	}
+	for x > 0 && y > 0 {
+		x -= 1
+		y -= 1
+		append(edits, Diff_Edit{op = .Equal, old_line = a_off + x, new_line = b_off + y})
 	}
+
+	slice.reverse(edits[first:])
 }
 
-// Show content in less pager
-diff_show_pager :: proc(path: string) {
-	run_command({"less", "-R", path})
+// Split into lines; false if the last line has no newline
+@(private)
+diff_split_lines :: proc(s: string) -> ([]string, bool) {
+	if len(s) == 0 {
+		return nil, true
+	}
+	lines := strings.split(s, "\n", context.temp_allocator)
+	if lines[len(lines) - 1] == "" {
+		return lines[:len(lines) - 1], true
+	}
+	return lines, false
+}
+
+// "start,count" of a hunk side (1-based; an empty side names the line before)
+@(private)
+hunk_range :: proc(first: int, count: int) -> string {
+	if count == 0 {
+		return fmt.tprintf("%d,0", first)
+	}
+	if count == 1 {
+		return fmt.tprintf("%d", first + 1)
+	}
+	return fmt.tprintf("%d,%d", first + 1, count)
+}
+
+// Pager reading from a pipe, so output can be written while it is produced
+Pager :: struct {
+	fd:          linux.Fd,
+	pid:         linux.Pid, // 0: writing to stdout
+	closed:      bool, // The user quit the pager
+	old_sigpipe: rawptr,
+}
+
+// Start less (or print directly if it can't be started). Writes to a pager
+// that was quit fail with EPIPE instead of killing vuru.
+pager_open :: proc() -> Pager {
+	p := Pager {
+		fd = linux.STDOUT_FILENO,
+	}
+
+	fds: [2]linux.Fd
+	if linux.pipe2(&fds, {.CLOEXEC}) != nil {
+		return p
+	}
+
+	child, ok := spawn_process({"less", "-R"}, stdin = fds[0])
+	if !ok {
+		child, ok = spawn_process({"cat"}, stdin = fds[0]) // No less installed
+	}
+	linux.close(fds[0])
+	if !ok {
+		linux.close(fds[1])
+		return p
+	}
+
+	p.fd = fds[1]
+	p.pid = child.pid
+	p.old_sigpipe = signal(SIGPIPE, SIG_IGN)
+	return p
+}
+
+// Write to the pager; ignored once it was quit
+pager_write :: proc(p: ^Pager, s: string) {
+	data := transmute([]u8)s
+	for len(data) > 0 && !p.closed {
+		n, err := linux.write(p.fd, data)
+		if err == .EINTR {
+			continue
+		}
+		if err != nil || n <= 0 {
+			p.closed = true
+			break
+		}
+		data = data[n:]
+	}
+}
+
+// Close the pipe and wait until the user quits the pager
+pager_close :: proc(p: ^Pager) {
+	if p.pid == 0 {
+		return
+	}
+	linux.close(p.fd)
+	wait_process(p.pid)
+	signal(SIGPIPE, p.old_sigpipe)
+	p.pid = 0
 }
 
 // Review changes between current and previous template
@@ -92,29 +332,20 @@ review_changes :: proc(pkg_name: string, current: string, previous: string) -> b
 	if len(previous) > 0 && current == previous {
 		errors.log_info("Template for %s unchanged since last install.", pkg_name)
 	} else {
+		fmt.println()
+		b := strings.builder_make(context.temp_allocator)
 		if len(previous) > 0 {
-			// Generate colored diff and show in pager
-			diff_output, diff_ok := diff_generate(previous, current, context.temp_allocator)
-			if diff_ok && len(diff_output) > 0 {
-				review_path, path_ok := diff_write_temp_file(diff_output, context.temp_allocator)
-				if path_ok {
-					defer os.remove(review_path)
-
-					fmt.println()
-					fmt.printf("Template for %s has changed:\n", pkg_name)
-					diff_show_pager(review_path)
-				}
-			}
+			fmt.printf("Template for %s has changed:\n", pkg_name)
+			diff_write_unified(&b, previous, current, "installed", "new")
 		} else {
 			// New package - show full template in pager
-			fmt.println()
 			fmt.printf("New package %s. Review template:\n", pkg_name)
-			review_path, path_ok := diff_write_temp_file(current, context.temp_allocator)
-			if path_ok {
-				defer os.remove(review_path)
-				diff_show_pager(review_path)
-			}
+			strings.write_string(&b, current)
 		}
+
+		pager := pager_open()
+		pager_write(&pager, strings.to_string(b))
+		pager_close(&pager)
 	}
 
 	fmt.print("Proceed with installation? [Y/n] ")
@@ -0,0 +1,77 @@
+package utils
+
+import "core:mem"
+import "core:strings"
+
+// String interner: every distinct string is stored once and named by a 32-bit
+// handle. Used for the names, categories and URLs repeated all over the
+// index and a resolution, so those hold one copy instead of one per use.
+
+// Handle of an interned string; 0 is the empty string
+Str_Id :: distinct u32
+
+Interner :: struct {
+	ids:       map[string]Str_Id, // Keys are the stored copies
+	strs:      [dynamic]string, // By handle
+	bytes:     int, // Total length of the stored strings
+	allocator: mem.Allocator,
+}
+
+interner_make :: proc(allocator := context.allocator) -> Interner {
+	it := Interner {
+		ids       = make(map[string]Str_Id, allocator = allocator),
+		strs      = make([dynamic]string, allocator),
+		allocator = allocator,
+	}
+	append(&it.strs, "")
+	return it
+}
+
+interner_destroy :: proc(it: ^Interner) {
+	for s in it.strs[1:] {
+		delete(s, it.allocator)
+	}
+	delete(it.ids)
+	delete(it.strs)
+}
+
+// Handle of s, storing a copy the first time it is seen
+intern :: proc(it: ^Interner, s: string) -> Str_Id {
+	if len(s) == 0 {
+		return 0
+	}
+	if id, ok := it.ids[s]; ok {
+		return id
+	}
+
+	stored := strings.clone(s, it.allocator)
+	id := Str_Id(len(it.strs))
+	append(&it.strs, stored)
+	it.ids[stored] = id
+	it.bytes += len(stored)
+	return id
+}
+
+// Stored copy of s (interned if new), valid as long as the interner
+intern_string :: proc(it: ^Interner, s: string) -> string {
+	return it.strs[intern(it, s)]
+}
+
+// Handle of s if it was interned, without storing it
+intern_lookup :: proc(it: ^Interner, s: string) -> (Str_Id, bool) {
+	if len(s) == 0 {
+		return 0, true
+	}
+	id, ok := it.ids[s]
+	return id, ok
+}
+
+// String of a handle
+interned :: proc(it: ^Interner, id: Str_Id) -> string {
+	return it.strs[id]
+}
+
+// Number of distinct strings stored
+interner_count :: proc(it: ^Interner) -> int {
+	return len(it.strs) - 1
+}
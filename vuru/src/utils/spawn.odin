@@ -0,0 +1,344 @@
+package utils
+
+import "core:mem"
+import "core:sys/linux"
+
+// Process spawning. Children are started with posix_spawnp (glibc clones with
+// CLONE_VM|CLONE_VFORK, so vuru's address space is never copied) and argv is
+// built in the parent. Captured output is read 64 KiB at a time straight into
+// the destination buffer.
+//
+// A Command_Pool runs commands concurrently, at most max_jobs at a time (and
+// at most max_children children of all pools), and hands them back as they
+// finish; their pipes, or pidfds when output isn't captured, are watched with
+// epoll.
+
+// glibc posix_spawn_file_actions_t (80 bytes on 64-bit targets), opaque
+Spawn_File_Actions :: struct {
+	_: [16]u64,
+}
+
+// Bytes requested per read of a child's output
+READ_CHUNK :: 64 * 1024
+
+@(private)
+O_WRONLY :: 1
+
+Output_Mode :: enum {
+	Inherit,
+	Capture, // stdout on a pipe, stderr inherited
+	Capture_All, // stdout and stderr on the pipe
+	Discard, // stdout and stderr to /dev/null
+}
+
+Process :: struct {
+	pid: linux.Pid,
+	out: linux.Fd, // Read end of the output pipe, -1 unless captured
+}
+
+// Start a command. stdin is inherited unless a descriptor is given.
+// Fails (without a child to wait for) if the command can't be executed.
+spawn_process :: proc(args: []string, mode := Output_Mode.Inherit, stdin := linux.Fd(-1)) -> (Process, bool) {
+	if len(args) == 0 {
+		return {}, false
+	}
+	argv := make_argv(args, context.temp_allocator)
+	captured := mode == .Capture || mode == .Capture_All
+
+	// CLOEXEC on both ends: a sibling started meanwhile must not keep the
+	// write end open, or the reader would never see end of file
+	fds: [2]linux.Fd
+	if captured && linux.pipe2(&fds, {.CLOEXEC}) != nil {
+		return {}, false
+	}
+
+	actions: Spawn_File_Actions
+	posix_spawn_file_actions_init(&actions)
+	defer posix_spawn_file_actions_destroy(&actions)
+
+	if stdin >= 0 {
+		posix_spawn_file_actions_adddup2(&actions, i32(stdin), i32(linux.STDIN_FILENO))
+	}
+	switch mode {
+	case .Inherit:
+	case .Capture, .Capture_All:
+		// The copy made by dup2 does not inherit CLOEXEC
+		posix_spawn_file_actions_adddup2(&actions, i32(fds[1]), i32(linux.STDOUT_FILENO))
+		if mode == .Capture_All {
+			posix_spawn_file_actions_adddup2(&actions, i32(fds[1]), i32(linux.STDERR_FILENO))
+		}
+	case .Discard:
+		posix_spawn_file_actions_addopen(&actions, i32(linux.STDOUT_FILENO), "/dev/null", O_WRONLY, 0)
+		posix_spawn_file_actions_adddup2(&actions, i32(linux.STDOUT_FILENO), i32(linux.STDERR_FILENO))
+	}
+
+	p := Process {
+		out = -1,
+	}
+	ok := posix_spawnp(&p.pid, argv[0], &actions, nil, argv, environ) == 0
+	if ok {
+		stats_process_started(p.pid, args[0])
+	}
+
+	if captured {
+		linux.close(fds[1])
+		if ok {
+			p.out = fds[0]
+		} else {
+			linux.close(fds[0])
+		}
+	}
+	return p, ok
+}
+
+// Wait for a child; returns its exit code (-1 if killed or already reaped)
+wait_process :: proc(pid: linux.Pid) -> int {
+	status: u32
+	for {
+		_, err := linux.waitpid(pid, &status, {}, nil)
+		if err == .EINTR {
+			continue
+		}
+		if err != nil {
+			return -1
+		}
+		stats_process_exited(pid)
+		return decode_wait_status(status)
+	}
+}
+
+// Read one chunk from fd onto the end of buf; false at end of file or on error
+read_chunk :: proc(fd: linux.Fd, buf: ^[dynamic]u8) -> bool {
+	start := len(buf)
+	if cap(buf) - start < READ_CHUNK {
+		reserve(buf, max(2 * cap(buf), start + READ_CHUNK))
+	}
+	non_zero_resize(buf, cap(buf))
+
+	for {
+		n, err := linux.read(fd, buf^[start:])
+		if err == .EINTR {
+			continue
+		}
+		if err != nil || n <= 0 {
+			non_zero_resize(buf, start)
+			return false
+		}
+		non_zero_resize(buf, start + n)
+		return true
+	}
+}
+
+// Result of a command run to completion
+Command_Result :: struct {
+	output: string,
+	code:   int, // Exit code; -1 if killed, 127 if it could not be started
+}
+
+// Concurrent commands. Add them, then collect them with pool_next
+// (completion order) or pool_wait (all, in order).
+Command_Pool :: struct {
+	max_jobs:  int,
+	epfd:      linux.Fd,
+	jobs:      [dynamic]Pool_Job,
+	next:      int, // First job not started yet
+	running:   int,
+	ready:     [dynamic]int, // Finished but not yet returned by pool_next
+	allocator: mem.Allocator,
+}
+
+Pool_Job :: struct {
+	args:    []string, // Must outlive the pool
+	mode:    Output_Mode,
+	process: Process,
+	pidfd:   linux.Fd, // Watched instead of a pipe when output isn't captured
+	live:    bool, // Started and not reaped yet
+	output:  [dynamic]u8,
+	code:    int,
+}
+
+// Children of all pools running at once, and the cap on them for the whole
+// run (set_max_children). A pool with nothing running may always start one,
+// so pools used in turn never wait on each other.
+DEFAULT_MAX_CHILDREN :: 32
+
+@(private)
+pool_children := 0
+@(private)
+max_children := DEFAULT_MAX_CHILDREN
+
+// Cap the children started by pools across the run (< 1: the default)
+set_max_children :: proc(n: int) {
+	max_children = n if n > 0 else DEFAULT_MAX_CHILDREN
+}
+
+// Outputs are allocated with allocator and stay valid after pool_destroy
+pool_make :: proc(max_jobs: int, allocator := context.allocator) -> Command_Pool {
+	epfd, err := linux.epoll_create1({.FDCLOEXEC})
+	return Command_Pool {
+		max_jobs = max(max_jobs, 1),
+		epfd = epfd if err == nil else -1,
+		jobs = make([dynamic]Pool_Job, allocator),
+		ready = make([dynamic]int, allocator),
+		allocator = allocator,
+	}
+}
+
+// Queue a command; it starts once a slot is free. Output is captured unless
+// mode is .Inherit or .Discard. Commands may be added while others run.
+// Returns its index.
+pool_add :: proc(p: ^Command_Pool, args: []string, mode := Output_Mode.Capture) -> int {
+	append(&p.jobs, Pool_Job{args = args, mode = mode})
+	return len(p.jobs) - 1
+}
+
+// Wait for the next finished command; false once all were returned
+pool_next :: proc(p: ^Command_Pool) -> (int, Command_Result, bool) {
+	for len(p.ready) == 0 {
+		pool_fill(p)
+		if len(p.ready) > 0 {
+			break
+		}
+		if p.running == 0 {
+			return 0, {}, false
+		}
+
+		events: [16]linux.EPoll_Event
+		n, err := linux.epoll_wait(p.epfd, &events[0], len(events), -1)
+		if err == .EINTR {
+			continue
+		}
+		if err != nil {
+			// Can't poll: finish the running commands one by one
+			for &job, i in p.jobs[:p.next] {
+				if job.live {
+					pool_drain(p, i)
+				}
+			}
+			break
+		}
+
+		for ev in events[:n] {
+			i := int(ev.data.u64)
+			job := &p.jobs[i]
+			// A readable pidfd means the child exited
+			if job.process.out < 0 || !read_chunk(job.process.out, &job.output) {
+				pool_reap(p, i)
+			}
+		}
+	}
+
+	i := pop_front(&p.ready)
+	job := &p.jobs[i]
+	return i, Command_Result{output = string(job.output[:]), code = job.code}, true
+}
+
+// Run every queued command; results in the order they were added
+pool_wait :: proc(p: ^Command_Pool) -> []Command_Result {
+	results := make([]Command_Result, len(p.jobs), p.allocator)
+	for {
+		i, res, ok := pool_next(p)
+		if !ok {
+			break
+		}
+		results[i] = res
+	}
+	return results
+}
+
+// Wait for commands still running and release the pool
+pool_destroy :: proc(p: ^Command_Pool) {
+	for &job, i in p.jobs[:p.next] {
+		if job.live {
+			pool_drain(p, i)
+		}
+	}
+	if p.epfd >= 0 {
+		linux.close(p.epfd)
+	}
+	delete(p.jobs)
+	delete(p.ready)
+}
+
+// Start queued commands while slots are free, here and across the run
+@(private)
+pool_fill :: proc(p: ^Command_Pool) {
+	for p.running < p.max_jobs && p.next < len(p.jobs) {
+		if p.running > 0 && pool_children >= max_children {
+			break
+		}
+		i := p.next
+		p.next += 1
+		job := &p.jobs[i]
+		job.output = make([dynamic]u8, p.allocator)
+		job.process.out = -1
+		job.pidfd = -1
+
+		process, ok := spawn_process(job.args, job.mode)
+		if !ok {
+			job.code = 127
+			append(&p.ready, i)
+			continue
+		}
+		job.process = process
+		job.live = true
+		p.running += 1
+		pool_children += 1
+
+		watch := process.out
+		if watch < 0 {
+			if pidfd, err := linux.pidfd_open(process.pid, {}); err == nil {
+				job.pidfd = linux.Fd(pidfd)
+				watch = job.pidfd
+			}
+		}
+		ev := linux.EPoll_Event {
+			events = {.IN},
+			data = {u64 = u64(i)},
+		}
+		if p.epfd < 0 || watch < 0 || linux.epoll_ctl(p.epfd, .ADD, watch, &ev) != nil {
+			pool_drain(p, i)
+		}
+	}
+}
+
+// Read a command's output to the end (if captured), then reap it
+@(private)
+pool_drain :: proc(p: ^Command_Pool, i: int) {
+	job := &p.jobs[i]
+	for job.process.out >= 0 && read_chunk(job.process.out, &job.output) {
+	}
+	pool_reap(p, i)
+}
+
+@(private)
+pool_reap :: proc(p: ^Command_Pool, i: int) {
+	job := &p.jobs[i]
+	pool_unwatch(p, &job.process.out)
+	pool_unwatch(p, &job.pidfd)
+	job.code = wait_process(job.process.pid)
+	job.live = false
+	p.running -= 1
+	pool_children -= 1
+	append(&p.ready, i)
+}
+
+@(private)
+pool_unwatch :: proc(p: ^Command_Pool, fd: ^linux.Fd) {
+	if fd^ < 0 {
+		return
+	}
+	if p.epfd >= 0 {
+		linux.epoll_ctl(p.epfd, .DEL, fd^, nil)
+	}
+	linux.close(fd^)
+	fd^ = -1
+}
+
+@(private)
+decode_wait_status :: proc(status: u32) -> int {
+	if (status & 0x7f) == 0 {
+		return int((status & 0xff00) >> 8)
+	}
+	return -1 // Terminated by signal
+}
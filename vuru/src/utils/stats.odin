@@ -0,0 +1,280 @@
+package utils
+
+import "base:runtime"
+import "core:fmt"
+import "core:strings"
+import "core:sys/linux"
+import "core:time"
+
+// Instrumentation for diagnosing slow runs: wall time of the main phases,
+// subprocesses and their wall time by program, downloaded bytes by kind, cache
+// hits and misses and the arena high-water mark. `--stats` prints a summary
+// when the command ends; VURU_TRACE=<file> also writes the timeline as Chrome
+// trace JSON (chrome://tracing, ui.perfetto.dev). Disabled, recording is a
+// single branch. Forked helpers (background prefetch, index refresh) are not
+// covered.
+
+// Events kept for the trace; later ones are only counted in the summary
+MAX_TRACE_EVENTS :: 100_000
+
+Stats_Total :: struct {
+	name:   string,
+	count:  int, // Calls, processes, files or cache hits
+	time:   time.Duration,
+	bytes:  i64,
+	misses: int,
+}
+
+// Phase being timed, ended by stats_span_end
+Span :: struct {
+	name:  string,
+	start: time.Tick,
+}
+
+@(private)
+Trace_Event :: struct {
+	name:  string,
+	cat:   string, // "phase" or "process"
+	tid:   int,
+	start: time.Tick,
+	dur:   time.Duration,
+}
+
+@(private)
+Running_Process :: struct {
+	name:  string,
+	start: time.Tick,
+}
+
+@(private)
+Stats :: struct {
+	enabled:    bool,
+	summary:    bool,
+	trace_path: string,
+	origin:     time.Tick,
+	phases:     [dynamic]Stats_Total,
+	processes:  [dynamic]Stats_Total,
+	downloads:  [dynamic]Stats_Total,
+	caches:     [dynamic]Stats_Total,
+	running:    map[linux.Pid]Running_Process,
+	events:     [dynamic]Trace_Event,
+	memory:     i64,
+}
+
+// Outlives the per-command arena, so everything lives in the heap
+@(private)
+stats_state: Stats
+
+// Start recording. summary: print the summary in stats_report; trace_path:
+// also write a Chrome trace there ("" for none).
+stats_enable :: proc(summary: bool, trace_path: string) {
+	if !summary && len(trace_path) == 0 {
+		return
+	}
+	a := runtime.heap_allocator()
+	stats_state = Stats {
+		enabled    = true,
+		summary    = summary,
+		trace_path = strings.clone(trace_path, a),
+		origin     = time.tick_now(),
+		phases     = make([dynamic]Stats_Total, a),
+		processes  = make([dynamic]Stats_Total, a),
+		downloads  = make([dynamic]Stats_Total, a),
+		caches     = make([dynamic]Stats_Total, a),
+		running    = make(map[linux.Pid]Running_Process, allocator = a),
+		events     = make([dynamic]Trace_Event, a),
+	}
+}
+
+// Time the rest of the calling scope as a phase: utils.stats_span("resolve_deps").
+// name must outlive the command (a literal).
+@(deferred_out = stats_span_end)
+stats_span :: proc(name: string) -> Span {
+	if !stats_state.enabled {
+		return {}
+	}
+	return Span{name = name, start = time.tick_now()}
+}
+
+stats_span_end :: proc(span: Span) {
+	if !stats_state.enabled || len(span.name) == 0 {
+		return
+	}
+	dur := time.tick_since(span.start)
+	t := stats_total(&stats_state.phases, span.name)
+	t.count += 1
+	t.time += dur
+	stats_event(span.name, "phase", int(linux.getpid()), span.start, dur)
+}
+
+// Bytes downloaded for a kind of file ("index", "package"...)
+stats_download :: proc(kind: string, bytes: i64) {
+	if !stats_state.enabled {
+		return
+	}
+	t := stats_total(&stats_state.downloads, kind)
+	t.count += 1
+	t.bytes += bytes
+}
+
+// Cache lookup outcome
+stats_cache :: proc(name: string, hit: bool) {
+	if !stats_state.enabled {
+		return
+	}
+	t := stats_total(&stats_state.caches, name)
+	if hit {
+		t.count += 1
+	} else {
+		t.misses += 1
+	}
+}
+
+// Arena bytes in use at the end of the command
+stats_memory :: proc(bytes: i64) {
+	stats_state.memory = max(stats_state.memory, bytes)
+}
+
+// Print the summary and write the trace, as requested
+stats_report :: proc() {
+	if !stats_state.enabled {
+		return
+	}
+	if stats_state.summary {
+		stats_print_summary()
+	}
+	if len(stats_state.trace_path) > 0 && !stats_write_trace(stats_state.trace_path) {
+		fmt.eprintf("Could not write trace to %s\n", stats_state.trace_path)
+	}
+}
+
+// Called by spawn_process
+@(private)
+stats_process_started :: proc(pid: linux.Pid, argv0: string) {
+	if !stats_state.enabled {
+		return
+	}
+	name := argv0[strings.last_index_byte(argv0, '/') + 1:]
+	stats_state.running[pid] = Running_Process {
+		name  = strings.clone(name, runtime.heap_allocator()),
+		start = time.tick_now(),
+	}
+}
+
+// Called once a child was reaped
+@(private)
+stats_process_exited :: proc(pid: linux.Pid) {
+	if !stats_state.enabled {
+		return
+	}
+	p, ok := stats_state.running[pid]
+	if !ok {
+		return
+	}
+	delete_key(&stats_state.running, pid)
+
+	dur := time.tick_since(p.start)
+	t := stats_total(&stats_state.processes, p.name)
+	t.count += 1
+	t.time += dur
+	stats_event(p.name, "process", int(pid), p.start, dur)
+}
+
+@(private)
+stats_total :: proc(totals: ^[dynamic]Stats_Total, name: string) -> ^Stats_Total {
+	for &t in totals {
+		if t.name == name {
+			return &t
+		}
+	}
+	append(totals, Stats_Total{name = name})
+	return &totals[len(totals) - 1]
+}
+
+@(private)
+stats_event :: proc(name: string, cat: string, tid: int, start: time.Tick, dur: time.Duration) {
+	if len(stats_state.events) >= MAX_TRACE_EVENTS || len(stats_state.trace_path) == 0 {
+		return
+	}
+	append(&stats_state.events, Trace_Event{name = name, cat = cat, tid = tid, start = start, dur = dur})
+}
+
+@(private)
+stats_print_summary :: proc() {
+	seconds :: proc(d: time.Duration) -> string {
+		return fmt.tprintf("%.3fs", time.duration_seconds(d))
+	}
+
+	s := &stats_state
+	fmt.eprintln()
+	fmt.eprintf("%-32s %8s %10s\n", "Phase", "Calls", "Time")
+	for t in s.phases {
+		fmt.eprintf("%-32s %8d %10s\n", t.name, t.count, seconds(t.time))
+	}
+	fmt.eprintf("%-32s %8s %10s\n", "Total", "", seconds(time.tick_since(s.origin)))
+
+	if len(s.processes) > 0 {
+		fmt.eprintln()
+		fmt.eprintf("%-32s %8s %10s\n", "Subprocess", "Count", "Time")
+		for t in s.processes {
+			fmt.eprintf("%-32s %8d %10s\n", t.name, t.count, seconds(t.time))
+		}
+	}
+	if len(s.downloads) > 0 {
+		fmt.eprintln()
+		fmt.eprintf("%-32s %8s %10s\n", "Download", "Files", "Bytes")
+		for t in s.downloads {
+			fmt.eprintf("%-32s %8d %10s\n", t.name, t.count, format_size(t.bytes))
+		}
+	}
+	if len(s.caches) > 0 {
+		fmt.eprintln()
+		fmt.eprintf("%-32s %8s %10s\n", "Cache", "Hits", "Misses")
+		for t in s.caches {
+			fmt.eprintf("%-32s %8d %10d\n", t.name, t.count, t.misses)
+		}
+	}
+	if s.memory > 0 {
+		fmt.eprintln()
+		fmt.eprintf("%-32s %19s\n", "Arena high-water", format_size(s.memory))
+	}
+}
+
+@(private)
+stats_write_trace :: proc(path: string) -> bool {
+	s := &stats_state
+	pid := int(linux.getpid())
+	b := strings.builder_make(context.temp_allocator)
+
+	strings.write_string(&b, "{\"traceEvents\":[\n")
+	fmt.sbprintf(
+		&b,
+		"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"vuru\"}}",
+		pid,
+		pid,
+	)
+	for ev in s.events {
+		fmt.sbprintf(
+			&b,
+			",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%d,\"dur\":%d,\"pid\":%d,\"tid\":%d}",
+			json_escape(ev.name),
+			ev.cat,
+			i64(time.duration_microseconds(time.tick_diff(s.origin, ev.start))),
+			i64(time.duration_microseconds(ev.dur)),
+			pid,
+			ev.tid,
+		)
+	}
+	strings.write_string(&b, "\n]}\n")
+	return write_file(path, strings.to_string(b))
+}
+
+@(private)
+json_escape :: proc(s: string) -> string {
+	if strings.index_any(s, "\"\\") < 0 {
+		return s
+	}
+	escaped, _ := strings.replace_all(s, "\\", "\\\\", context.temp_allocator)
+	escaped, _ = strings.replace_all(escaped, "\"", "\\\"", context.temp_allocator)
+	return escaped
+}
@@ -1,17 +1,31 @@
 package utils
 
+import "core:fmt"
 import "core:mem"
 import "core:os"
 import "core:strings"
 import "core:sys/linux"
 
-// Define execvp since it's missing from core:c/libc sometimes or not exported commonly
+// libc functions missing from core:c/libc or not exported commonly
 foreign import libc "system:c"
 
 foreign libc {
-	execvp :: proc(file: cstring, argv: [^]cstring) -> i32 ---
+	signal :: proc(sig: i32, handler: rawptr) -> rawptr ---
+
+	// Process spawning (spawn.odin)
+	posix_spawnp :: proc(pid: ^linux.Pid, file: cstring, file_actions: ^Spawn_File_Actions, attrp: rawptr, argv: [^]cstring, envp: [^]cstring) -> i32 ---
+	posix_spawn_file_actions_init :: proc(file_actions: ^Spawn_File_Actions) -> i32 ---
+	posix_spawn_file_actions_destroy :: proc(file_actions: ^Spawn_File_Actions) -> i32 ---
+	posix_spawn_file_actions_adddup2 :: proc(file_actions: ^Spawn_File_Actions, fd: i32, new_fd: i32) -> i32 ---
+	posix_spawn_file_actions_addopen :: proc(file_actions: ^Spawn_File_Actions, fd: i32, path: cstring, oflag: i32, mode: u32) -> i32 ---
+	environ: [^]cstring
 }
 
+SIGPIPE :: 13
+
+// Handler value for signal() ignoring the signal
+SIG_IGN :: rawptr(uintptr(1))
+
 
 // Read entire file contents
 read_file :: proc(path: string, allocator := context.allocator) -> (string, bool) {
@@ -40,135 +54,57 @@ make_argv :: proc(args: []string, allocator := context.allocator) -> [^]cstring
 
 // Run a command and return its output
 run_command_output :: proc(args: []string, allocator := context.allocator) -> (string, bool) {
-	if len(args) == 0 {return "", false}
-
-	fds: [2]linux.Fd
-	// pipe2 with empty flags ({}) is equivalent to pipe
-	if linux.pipe2(&fds, {}) != nil {
-		return "", false
-	}
-	defer linux.close(fds[0])
-
-	pid, err := linux.fork()
-	if err != nil {
-		linux.close(fds[1])
+	p, ok := spawn_process(args, .Capture)
+	if !ok {
 		return "", false
 	}
 
-	if pid == 0 {
-		// Child process
-		linux.close(fds[0]) // Close read end
-		linux.dup2(fds[1], linux.STDOUT_FILENO)
-		linux.close(fds[1])
-
-		argv := make_argv(args, context.temp_allocator)
-		path := strings.clone_to_cstring(args[0], context.temp_allocator)
-
-		// If execvp returns, it failed
-		execvp(path, argv)
-		os.exit(1)
-	}
-
-	// Parent process
-	linux.close(fds[1]) // Close write end
-
-	builder := strings.builder_make(allocator)
-	buf: [1024]u8
-
-	for {
-		n, read_err := linux.read(fds[0], buf[:])
-		if n <= 0 || read_err != nil {break}
-		strings.write_bytes(&builder, buf[:n])
+	buf := make([dynamic]u8, allocator)
+	for read_chunk(p.out, &buf) {
 	}
+	linux.close(p.out)
 
-	status: u32
-	linux.waitpid(pid, &status, {}, nil)
-
-	// Check exit status
-	success := (status & 0x7f) == 0 && ((status & 0xff00) >> 8) == 0
-
-	return strings.to_string(builder), success
+	return string(buf[:]), wait_process(p.pid) == 0
 }
 
-// Run a command silently (capture output, return exit code)
+// Run a command silently (output discarded, return exit code)
 run_command_silent :: proc(args: []string) -> int {
-	if len(args) == 0 {return 127}
-
-	fds: [2]linux.Fd
-	if linux.pipe2(&fds, {}) != nil {
-		return -1
-	}
-	defer linux.close(fds[0])
-
-	pid, err := linux.fork()
-	if err != nil {
-		linux.close(fds[1])
-		return -1
-	}
-
-	if pid == 0 {
-		// Child - redirect both stdout and stderr to pipe
-		linux.close(fds[0])
-		linux.dup2(fds[1], linux.STDOUT_FILENO)
-		linux.dup2(fds[1], linux.STDERR_FILENO)
-		linux.close(fds[1])
-
-		argv := make_argv(args, context.temp_allocator)
-		path := strings.clone_to_cstring(args[0], context.temp_allocator)
-
-		execvp(path, argv)
-		os.exit(127)
-	}
-
-	// Parent - drain the pipe to avoid blocking
-	linux.close(fds[1])
-	buf: [1024]u8
-	for {
-		n, _ := linux.read(fds[0], buf[:])
-		if n <= 0 {break}
+	p, ok := spawn_process(args, .Discard)
+	if !ok {
+		return 127
 	}
-
-	status: u32
-	linux.waitpid(pid, &status, {}, nil)
-
-	if (status & 0x7f) == 0 {
-		return int((status & 0xff00) >> 8)
-	}
-
-	return -1
+	return wait_process(p.pid)
 }
 
 // Run a command and return exit code
 run_command :: proc(args: []string) -> int {
-	if len(args) == 0 {return 127}
-
-	pid, err := linux.fork()
-	if err != nil {
-		return -1
+	p, ok := spawn_process(args)
+	if !ok {
+		return 127
 	}
+	return wait_process(p.pid)
+}
 
-	if pid == 0 {
-		// Child
-		argv := make_argv(args, context.temp_allocator)
-		path := strings.clone_to_cstring(args[0], context.temp_allocator)
-
-		execvp(path, argv)
-		os.exit(127)
+// Run several commands concurrently, at most max_jobs at a time
+// Output is inherited; returns the exit code of each command in order
+run_commands_parallel :: proc(
+	cmds: [][]string,
+	max_jobs: int,
+	allocator := context.allocator,
+) -> []int {
+	pool := pool_make(max_jobs, context.temp_allocator)
+	defer pool_destroy(&pool)
+	for cmd in cmds {
+		pool_add(&pool, cmd, .Inherit)
 	}
 
-	// Parent
-	status: u32
-	linux.waitpid(pid, &status, {}, nil)
-
-	// Decode status
-	if (status & 0x7f) == 0 {
-		return int((status & 0xff00) >> 8)
+	codes := make([]int, len(cmds), allocator)
+	for res, i in pool_wait(&pool) {
+		codes[i] = res.code
 	}
-
-	return -1 // Terminated by signal
+	return codes
 }
 
-
 // Validate identifier (package name, category)
 is_valid_identifier :: proc(s: string) -> bool {
 	if len(s) == 0 || s[0] == '.' {
@@ -196,6 +132,30 @@ is_valid_identifier :: proc(s: string) -> bool {
 	return true
 }
 
+// ASCII case-insensitive substring search; needle must already be lowercase
+contains_fold :: proc(s: string, needle: string) -> bool {
+	if len(needle) == 0 {
+		return true
+	}
+	if len(needle) > len(s) {
+		return false
+	}
+
+	outer: for i in 0 ..= len(s) - len(needle) {
+		for j in 0 ..< len(needle) {
+			c := s[i + j]
+			if c >= 'A' && c <= 'Z' {
+				c += 'a' - 'A'
+			}
+			if c != needle[j] {
+				continue outer
+			}
+		}
+		return true
+	}
+	return false
+}
+
 // Create directory and all parents
 mkdir_p :: proc(path: string) -> bool {
 	if os.exists(path) {
@@ -266,3 +226,20 @@ int_to_string :: proc(n: int, allocator := context.allocator) -> string {
 
 	return strings.clone(string(buf[i:]), allocator)
 }
+
+// Format a byte count for display ("12.3 MiB")
+format_size :: proc(bytes: i64, allocator := context.temp_allocator) -> string {
+	units := [?]string{"B", "KiB", "MiB", "GiB", "TiB"}
+
+	value := f64(bytes)
+	unit := 0
+	for value >= 1024 && unit < len(units) - 1 {
+		value /= 1024
+		unit += 1
+	}
+
+	if unit == 0 {
+		return fmt.aprintf("%d B", bytes, allocator = allocator)
+	}
+	return fmt.aprintf("%.1f %s", value, units[unit], allocator = allocator)
+}